@@ -330,6 +330,8 @@ gpg_error_t agent_public_key_from_file (ctrl_t ctrl,
 int agent_is_dsa_key (gcry_sexp_t s_key);
 int agent_is_eddsa_key (gcry_sexp_t s_key);
 int agent_key_available (const unsigned char *grip);
+gpg_error_t agent_update_key_set (void);
+gpg_error_t agent_list_keygrips (unsigned char **r_grips, size_t *r_ngrips);
 gpg_error_t agent_key_info_from_file (ctrl_t ctrl, const unsigned char *grip,
                                       int *r_keytype,
                                       unsigned char **r_shadow_info);
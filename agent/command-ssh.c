@@ -191,12 +191,55 @@ struct ssh_key_type_spec
 };
 
 
+/* An entry of the sshcontrol file.  */
+struct control_item_s
+{
+  int lnr;             /* The line number of the entry.  */
+  int disabled;        /* The item is disabled.  */
+  int ttl;             /* The TTL of the item.   */
+  int confirm;         /* The confirm flag is set.  */
+  char hexgrip[40+1];  /* The hexgrip of the item (uppercase).  */
+
+  /* The public key as sent by REQUEST_IDENTITIES and the modification
+     time and size of the key file at the time it was read.  */
+  void *pubblob;
+  size_t pubbloblen;
+  time_t key_mtime;
+  off_t key_size;
+  time_t pubblob_time; /* The time PUBBLOB was created.  */
+};
+
+
+/* The parsed sshcontrol file.  The object is reference counted
+   because it may be replaced while a control file object still uses
+   the old version.  */
+struct control_data_s
+{
+  unsigned int refcount;
+  time_t mtime;        /* The modification time of the file ...  */
+  off_t size;          /* ... and its size at the time it was read.  */
+  time_t load_time;    /* The time the file was read.  */
+  gpg_error_t err;     /* The error which stopped reading or 0.  */
+  size_t nitems;       /* The number of items in ITEMS.  */
+  struct control_item_s *items;  /* The items in file order.  */
+  size_t nindex;       /* The number of items in INDEX.  */
+  struct control_item_s **index; /* The first item for each keygrip
+                                    sorted by keygrip.  */
+};
+typedef struct control_data_s *control_data_t;
+
+/* The current content of the sshcontrol file or NULL.  */
+static control_data_t control_data;
+
+
 /* Definition of an object to access the sshcontrol file.  */
 struct ssh_control_file_s
 {
   char *fname;  /* Name of the file.  */
-  FILE *fp;     /* This is never NULL. */
+  FILE *fp;     /* Used while reading the file or in append mode.  */
   int lnr;      /* The current line number.  */
+  control_data_t data;  /* The parsed file; NULL while reading it.  */
+  size_t pos;           /* The index of the next item in DATA.  */
   struct {
     int valid;           /* True if the data of this structure is valid.  */
     int disabled;        /* The item is disabled.  */
@@ -827,96 +870,94 @@ file_to_buffer (const char *filename, unsigned char **buffer, size_t *buffer_n)
 
 
 
-/* Open the ssh control file and create it if not available.  With
-   APPEND passed as true the file will be opened in append mode,
-   otherwise in read only mode.  On success 0 is returned and a new
-   control file object stored at R_CF.  On error an error code is
-   returned and NULL is stored at R_CF.  */
+/* Open the ssh control file FNAME and create it if not available.
+   With APPEND passed as true the file will be opened in append mode,
+   otherwise in read only mode.  On success 0 is returned and the file
+   pointer stored at R_FP.  */
 static gpg_error_t
-open_control_file (ssh_control_file_t *r_cf, int append)
+open_control_fp (const char *fname, int append, FILE **r_fp)
 {
   gpg_error_t err;
-  ssh_control_file_t cf;
+  FILE *fp;
 
-  cf = xtrycalloc (1, sizeof *cf);
-  if (!cf)
-    {
-      err = gpg_error_from_syserror ();
-      goto leave;
-    }
-
-  /* Note: As soon as we start to use non blocking functions here
-     (i.e. where Pth might switch threads) we need to employ a
-     mutex.  */
-  cf->fname = make_filename_try (opt.homedir, SSH_CONTROL_FILE_NAME, NULL);
-  if (!cf->fname)
-    {
-      err = gpg_error_from_syserror ();
-      goto leave;
-    }
   /* FIXME: With "a+" we are not able to check whether this will
      be created and thus the blurb needs to be written first.  */
-  cf->fp = fopen (cf->fname, append? "a+":"r");
-  if (!cf->fp && errno == ENOENT)
+  fp = fopen (fname, append? "a+":"r");
+  if (!fp && errno == ENOENT)
     {
-      estream_t stream = es_fopen (cf->fname, "wx,mode=-rw-r");
+      estream_t stream = es_fopen (fname, "wx,mode=-rw-r");
       if (!stream)
         {
           err = gpg_error_from_syserror ();
-          log_error (_("can't create '%s': %s\n"),
-                     cf->fname, gpg_strerror (err));
-          goto leave;
+          log_error (_("can't create '%s': %s\n"), fname, gpg_strerror (err));
+          return err;
         }
       es_fputs (sshcontrolblurb, stream);
       es_fclose (stream);
-      cf->fp = fopen (cf->fname, append? "a+":"r");
+      fp = fopen (fname, append? "a+":"r");
     }
 
-  if (!cf->fp)
+  if (!fp)
     {
       err = gpg_error_from_syserror ();
-      log_error (_("can't open '%s': %s\n"),
-                 cf->fname, gpg_strerror (err));
-      goto leave;
+      log_error (_("can't open '%s': %s\n"), fname, gpg_strerror (err));
+      return err;
     }
 
-  err = 0;
+  *r_fp = fp;
+  return 0;
+}
 
- leave:
-  if (err && cf)
-    {
-      if (cf->fp)
-        fclose (cf->fp);
-      xfree (cf->fname);
-      xfree (cf);
-    }
-  else
-    *r_cf = cf;
 
-  return err;
+/* Release the reference to the control data DATA.  */
+static void
+release_control_data (control_data_t data)
+{
+  size_t n;
+
+  if (!data || --data->refcount)
+    return;
+  for (n=0; n < data->nitems; n++)
+    xfree (data->items[n].pubblob);
+  xfree (data->items);
+  xfree (data->index);
+  xfree (data);
 }
 
 
+/* Drop the cached control data so that the file is read again on the
+   next access.  */
 static void
-rewind_control_file (ssh_control_file_t cf)
+invalidate_control_data (void)
 {
-  fseek (cf->fp, 0, SEEK_SET);
-  cf->lnr = 0;
-  clearerr (cf->fp);
+  release_control_data (control_data);
+  control_data = NULL;
 }
 
 
-static void
-close_control_file (ssh_control_file_t cf)
+/* qsort helper to sort the index of the control data by keygrip and
+   then by line number.  */
+static int
+compare_control_items (const void *a, const void *b)
 {
-  if (!cf)
-    return;
-  fclose (cf->fp);
-  xfree (cf->fname);
-  xfree (cf);
+  const struct control_item_s *ia = *(const struct control_item_s **)a;
+  const struct control_item_s *ib = *(const struct control_item_s **)b;
+  int cmp;
+
+  cmp = strcmp (ia->hexgrip, ib->hexgrip);
+  if (!cmp)
+    cmp = ia->lnr < ib->lnr? -1 : ia->lnr > ib->lnr;
+  return cmp;
 }
 
 
+/* bsearch helper to find the keygrip KEY in the index.  */
+static int
+compare_control_grip (const void *key, const void *item)
+{
+  return strcmp (key, (*(const struct control_item_s **)item)->hexgrip);
+}
+
 
 /* Read the next line from the control file and store the data in CF.
    Returns 0 on success, GPG_ERR_EOF on EOF, or other error codes. */
@@ -1017,17 +1058,241 @@ read_control_file_item (ssh_control_file_t cf)
 }
 
 
+/* Read and parse the control file FNAME whose stat information is
+   given by ST and store a new object at R_DATA.  */
+static gpg_error_t
+load_control_data (const char *fname, struct stat *st,
+                   control_data_t *r_data)
+{
+  gpg_error_t err;
+  struct ssh_control_file_s cf;
+  control_data_t data;
+  size_t size = 0;
+  size_t i, j;
+
+  *r_data = NULL;
+  memset (&cf, 0, sizeof cf);
+  cf.fname = (char*)fname;
+
+  data = xtrycalloc (1, sizeof *data);
+  if (!data)
+    return gpg_error_from_syserror ();
+  data->refcount = 1;
+  data->mtime = st->st_mtime;
+  data->size = st->st_size;
+  data->load_time = time (NULL);
+
+  err = open_control_fp (fname, 0, &cf.fp);
+  if (err)
+    goto leave;
+
+  while (!(err = read_control_file_item (&cf)))
+    {
+      struct control_item_s *item;
+
+      if (!cf.item.valid)
+        continue; /* Should not happen.  */
+      if (data->nitems == size)
+        {
+          struct control_item_s *tmp;
+
+          size += 32;
+          tmp = xtryrealloc (data->items, size * sizeof *tmp);
+          if (!tmp)
+            {
+              err = gpg_error_from_syserror ();
+              goto leave;
+            }
+          data->items = tmp;
+        }
+      item = data->items + data->nitems++;
+      memset (item, 0, sizeof *item);
+      item->lnr = cf.lnr;
+      item->disabled = cf.item.disabled;
+      item->ttl = cf.item.ttl;
+      item->confirm = cf.item.confirm;
+      strcpy (item->hexgrip, cf.item.hexgrip);
+    }
+  /* The old code stopped at the first bad line; we do the same but
+     remember the error to return it where the old code did.  */
+  data->err = gpg_err_code (err) == GPG_ERR_EOF? 0 : err;
+
+  /* Build the index.  Only the first entry for a keygrip is used.  */
+  data->index = xtrycalloc (data->nitems + 1, sizeof *data->index);
+  if (!data->index)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  for (i=0; i < data->nitems; i++)
+    data->index[i] = data->items + i;
+  qsort (data->index, data->nitems, sizeof *data->index,
+         compare_control_items);
+  for (i=j=0; i < data->nitems; i++)
+    if (!j || strcmp (data->index[j-1]->hexgrip, data->index[i]->hexgrip))
+      data->index[j++] = data->index[i];
+  data->nindex = j;
+  err = 0;
+
+ leave:
+  if (cf.fp)
+    fclose (cf.fp);
+  if (err)
+    release_control_data (data);
+  else
+    *r_data = data;
+  return err;
+}
+
+
+/* Return a reference to the parsed control file FNAME at R_DATA.
+   The file is only read if it has been changed since the last
+   call.  */
+static gpg_error_t
+get_control_data (const char *fname, control_data_t *r_data)
+{
+  gpg_error_t err;
+  struct stat st;
+  control_data_t data;
+
+  *r_data = NULL;
+
+  if (stat (fname, &st))
+    {
+      /* Let open_control_fp create the file.  */
+      memset (&st, 0, sizeof st);
+      invalidate_control_data ();
+    }
+  else if (control_data
+           && control_data->mtime == st.st_mtime
+           && control_data->size == st.st_size
+           && control_data->mtime < control_data->load_time)
+    {
+      /* Note that a change in the same second as the last read can't
+         be detected; thus we read the file again until that second is
+         over.  */
+      control_data->refcount++;
+      *r_data = control_data;
+      return 0;
+    }
+
+  err = load_control_data (fname, &st, &data);
+  if (err)
+    return err;
+  if (!st.st_mtime && !stat (fname, &st))
+    {
+      /* The file has just been created.  */
+      data->mtime = st.st_mtime;
+      data->size = st.st_size;
+    }
+
+  invalidate_control_data ();
+  control_data = data;
+  control_data->refcount++;
+  *r_data = data;
+  return 0;
+}
+
+
+/* Open the ssh control file and create it if not available.  With
+   APPEND passed as true the file will be opened in append mode,
+   otherwise only the cached content is used.  On success 0 is
+   returned and a new control file object stored at R_CF.  On error an
+   error code is returned and NULL is stored at R_CF.  */
+static gpg_error_t
+open_control_file (ssh_control_file_t *r_cf, int append)
+{
+  gpg_error_t err;
+  ssh_control_file_t cf;
+
+  *r_cf = NULL;
+  cf = xtrycalloc (1, sizeof *cf);
+  if (!cf)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  /* Note: As soon as we start to use non blocking functions here
+     (i.e. where Pth might switch threads) we need to employ a
+     mutex.  */
+  cf->fname = make_filename_try (opt.homedir, SSH_CONTROL_FILE_NAME, NULL);
+  if (!cf->fname)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+
+  err = get_control_data (cf->fname, &cf->data);
+  if (err)
+    goto leave;
+
+  if (append)
+    err = open_control_fp (cf->fname, 1, &cf->fp);
+
+ leave:
+  if (err && cf)
+    {
+      if (cf->fp)
+        fclose (cf->fp);
+      release_control_data (cf->data);
+      xfree (cf->fname);
+      xfree (cf);
+    }
+  else
+    *r_cf = cf;
+
+  return err;
+}
+
+
+static void
+close_control_file (ssh_control_file_t cf)
+{
+  if (!cf)
+    return;
+  if (cf->fp)
+    fclose (cf->fp);
+  release_control_data (cf->data);
+  xfree (cf->fname);
+  xfree (cf);
+}
+
 
-/* Search the control file CF from the beginning until a matching
-   HEXGRIP is found; return success in this case and store true at
-   DISABLED if the found key has been disabled.  If R_TTL is not NULL
-   a specified TTL for that key is stored there.  If R_CONFIRM is not
-   NULL it is set to 1 if the key has the confirm flag set. */
+/* Store the next item of the parsed control file in CF.  Returns 0 on
+   success, GPG_ERR_EOF on EOF, or the error which stopped the reading
+   of the file.  */
+static gpg_error_t
+next_control_item (ssh_control_file_t cf)
+{
+  struct control_item_s *item;
+
+  cf->item.valid = 0;
+  if (cf->pos >= cf->data->nitems)
+    return cf->data->err? cf->data->err : gpg_error (GPG_ERR_EOF);
+
+  item = cf->data->items + cf->pos++;
+  cf->lnr = item->lnr;
+  cf->item.disabled = item->disabled;
+  cf->item.ttl = item->ttl;
+  cf->item.confirm = item->confirm;
+  strcpy (cf->item.hexgrip, item->hexgrip);
+  cf->item.valid = 1;
+  return 0;
+}
+
+
+
+/* Search the control file CF for the first entry matching HEXGRIP;
+   return success in this case and store true at DISABLED if the found
+   key has been disabled.  If R_TTL is not NULL a specified TTL for
+   that key is stored there.  If R_CONFIRM is not NULL it is set to 1
+   if the key has the confirm flag set. */
 static gpg_error_t
 search_control_file (ssh_control_file_t cf, const char *hexgrip,
                      int *r_disabled, int *r_ttl, int *r_confirm)
 {
-  gpg_error_t err;
+  struct control_item_s **found;
 
   assert (strlen (hexgrip) == 40 );
 
@@ -1038,24 +1303,18 @@ search_control_file (ssh_control_file_t cf, const char *hexgrip,
   if (r_confirm)
     *r_confirm = 0;
 
-  rewind_control_file (cf);
-  while (!(err=read_control_file_item (cf)))
-    {
-      if (!cf->item.valid)
-        continue; /* Should not happen.  */
-      if (!strcmp (hexgrip, cf->item.hexgrip))
-        break;
-    }
-  if (!err)
-    {
-      if (r_disabled)
-        *r_disabled = cf->item.disabled;
-      if (r_ttl)
-        *r_ttl = cf->item.ttl;
-      if (r_confirm)
-        *r_confirm = cf->item.confirm;
-    }
-  return err;
+  found = bsearch (hexgrip, cf->data->index, cf->data->nindex,
+                   sizeof *cf->data->index, compare_control_grip);
+  if (!found)
+    return cf->data->err? cf->data->err : gpg_error (GPG_ERR_EOF);
+
+  if (r_disabled)
+    *r_disabled = (*found)->disabled;
+  if (r_ttl)
+    *r_ttl = (*found)->ttl;
+  if (r_confirm)
+    *r_confirm = (*found)->confirm;
+  return 0;
 }
 
 
@@ -1097,7 +1356,7 @@ add_control_entry (ctrl_t ctrl, ssh_key_type_spec_t *spec,
                1900+tp->tm_year, tp->tm_mon+1, tp->tm_mday,
                tp->tm_hour, tp->tm_min, tp->tm_sec,
                fmtfpr, hexgrip, ttl, confirm? " confirm":"");
-
+      invalidate_control_data ();
     }
   close_control_file (cf);
   return 0;
@@ -1188,7 +1447,7 @@ ssh_read_control_file (ssh_control_file_t cf,
   gpg_error_t err;
 
   do
-    err = read_control_file_item (cf);
+    err = next_control_item (cf);
   while (!err && !cf->item.valid);
   if (!err)
     {
@@ -2590,6 +2849,7 @@ ssh_handler_request_identities (ctrl_t ctrl,
   ssh_control_file_t cf = NULL;
   char *cardsn;
   gpg_error_t ret_err;
+  size_t idx;
 
   (void)request;
 
@@ -2647,59 +2907,111 @@ ssh_handler_request_identities (ctrl_t ctrl,
     xfree (dname);
   }
 
-  /* Then look at all the registered and non-disabled keys. */
+  /* Then look at all the registered and non-disabled keys.  The
+     public key blobs are cached with the items of the parsed control
+     file as long as the key file does not change.  */
   err = open_control_file (&cf, 0);
   if (err)
     goto out;
 
-  while (!read_control_file_item (cf))
+  for (idx=0; idx < cf->data->nitems; idx++)
     {
-      if (!cf->item.valid)
-        continue; /* Should not happen.  */
-      if (cf->item.disabled)
+      struct control_item_s *item = cf->data->items + idx;
+      struct stat st;
+
+      if (item->disabled)
         continue;
-      assert (strlen (cf->item.hexgrip) == 40);
+      assert (strlen (item->hexgrip) == 40);
 
-      stpcpy (stpcpy (fnameptr, cf->item.hexgrip), ".key");
+      stpcpy (stpcpy (fnameptr, item->hexgrip), ".key");
 
-      /* Read file content.  */
-      {
-        unsigned char *buffer;
-        size_t buffer_n;
+      if (stat (key_fname, &st))
+        {
+          err = gpg_error_from_syserror ();
+          log_error ("%s:%d: key '%s' skipped: %s\n",
+                     cf->fname, item->lnr, item->hexgrip,
+                     gpg_strerror (err));
+          continue;
+        }
+
+      if (!item->pubblob
+          || item->key_mtime != st.st_mtime
+          || item->key_size != st.st_size
+          || item->key_mtime >= item->pubblob_time)
+        {
+          estream_t blobstream;
+          void *blob;
+          size_t bloblen;
 
-        err = file_to_buffer (key_fname, &buffer, &buffer_n);
-        if (err)
+          /* Note that file_to_buffer may yield; thus another
+             connection may still use the old blob until we replace
+             it below.  */
+
+          /* Read file content.  */
           {
-            log_error ("%s:%d: key '%s' skipped: %s\n",
-                       cf->fname, cf->lnr, cf->item.hexgrip,
-                       gpg_strerror (err));
-            continue;
+            unsigned char *buffer;
+            size_t buffer_n;
+
+            err = file_to_buffer (key_fname, &buffer, &buffer_n);
+            if (err)
+              {
+                log_error ("%s:%d: key '%s' skipped: %s\n",
+                           cf->fname, item->lnr, item->hexgrip,
+                           gpg_strerror (err));
+                continue;
+              }
+
+            err = gcry_sexp_sscan (&key_secret, NULL,
+                                   (char*)buffer, buffer_n);
+            xfree (buffer);
+            if (err)
+              goto out;
           }
 
-        err = gcry_sexp_sscan (&key_secret, NULL, (char*)buffer, buffer_n);
-        xfree (buffer);
-        if (err)
-          goto out;
-      }
+          {
+            char *key_type = NULL;
 
-      {
-        char *key_type = NULL;
+            err = sexp_extract_identifier (key_secret, &key_type);
+            if (err)
+              goto out;
 
-        err = sexp_extract_identifier (key_secret, &key_type);
-        if (err)
-          goto out;
+            err = ssh_key_type_lookup (NULL, key_type, &spec);
+            xfree (key_type);
+            if (err)
+              goto out;
+          }
 
-        err = ssh_key_type_lookup (NULL, key_type, &spec);
-        xfree (key_type);
-        if (err)
-          goto out;
-      }
+          blobstream = es_fopenmem (0, "w+b");
+          if (!blobstream)
+            {
+              err = gpg_error_from_syserror ();
+              goto out;
+            }
+          err = ssh_send_key_public (blobstream, key_secret, NULL);
+          if (!err)
+            {
+              if (es_fclose_snatch (blobstream, &blob, &bloblen))
+                err = gpg_error_from_syserror ();
+              else
+                blobstream = NULL;
+            }
+          es_fclose (blobstream);
+          if (err)
+            goto out;
+          gcry_sexp_release (key_secret);
+          key_secret = NULL;
+
+          xfree (item->pubblob);
+          item->pubblob = blob;
+          item->pubbloblen = bloblen;
+          item->key_mtime = st.st_mtime;
+          item->key_size = st.st_size;
+          item->pubblob_time = time (NULL);
+        }
 
-      err = ssh_send_key_public (key_blobs, key_secret, NULL);
+      err = stream_write_data (key_blobs, item->pubblob, item->pubbloblen);
       if (err)
         goto out;
-      gcry_sexp_release (key_secret);
-      key_secret = NULL;
 
       key_counter++;
     }
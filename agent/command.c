@@ -493,7 +493,9 @@ static const char hlp_geteventcounter[] =
   "The currently defined counters are:\n"
   "\n"
   "ANY  - Incremented with any change of any of the other counters.\n"
-  "KEY  - Incremented for added or removed private keys.\n"
+  "KEY  - Incremented for added or removed private keys.  This\n"
+  "       includes changes of the private key directory done by other\n"
+  "       processes.\n"
   "CARD - Incremented for changes of the card readers stati.";
 static gpg_error_t
 cmd_geteventcounter (assuan_context_t ctx, char *line)
@@ -502,6 +504,10 @@ cmd_geteventcounter (assuan_context_t ctx, char *line)
 
   (void)line;
 
+  /* Rescan the key directory if it has been modified so that the
+     KEY counter accounts for changes done behind our back.  */
+  agent_update_key_set ();
+
   return agent_print_status (ctrl, "EVENTCOUNTER", "%u %u %u",
                              eventcounter.any,
                              eventcounter.key,
@@ -631,15 +637,38 @@ cmd_marktrusted (assuan_context_t ctx, char *line)
 
 static const char hlp_havekey[] =
   "HAVEKEY <hexstrings_with_keygrips>\n"
+  "HAVEKEY --list[=<limit>]\n"
   "\n"
   "Return success if at least one of the secret keys with the given\n"
-  "keygrips is available.";
+  "keygrips is available.  With --list return the keygrips of all\n"
+  "available secret keys as binary data, 20 bytes for each key.  If\n"
+  "there are more than <limit> keys, nothing is returned and the\n"
+  "command fails with GPG_ERR_TRUNCATED.";
 static gpg_error_t
 cmd_havekey (assuan_context_t ctx, char *line)
 {
   gpg_error_t err;
   unsigned char buf[20];
 
+  if (has_option_name (line, "--list"))
+    {
+      unsigned char *grips;
+      size_t ngrips;
+      const char *s;
+      unsigned long limit = 0;
+
+      if ((s = option_value (line, "--list")))
+        limit = strtoul (s, NULL, 10);
+
+      err = agent_list_keygrips (&grips, &ngrips);
+      if (!err && limit && ngrips > limit)
+        err = gpg_error (GPG_ERR_TRUNCATED);
+      if (!err && ngrips)
+        err = assuan_send_data (ctx, grips, 20 * ngrips);
+      xfree (grips);
+      return leave_cmd (ctx, err);
+    }
+
   do
     {
       err = parse_keygrip (ctx, line, buf);
@@ -2935,6 +2964,11 @@ command_has_option (const char *cmd, const char *cmdopt)
       if (!strcmp (cmdopt, "repeat"))
           return 1;
     }
+  else if (!strcmp (cmd, "HAVEKEY"))
+    {
+      if (!strcmp (cmdopt, "list"))
+          return 1;
+    }
 
   return 0;
 }
@@ -29,6 +29,7 @@
 #include <assert.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <assert.h>
 #include <npth.h> /* (we use pth_sleep) */
 
@@ -51,6 +52,31 @@ struct try_unprotect_arg_s
 };
 
 
+/* The keygrips of all keys in the private key directory.  This set
+   is used to answer HAVEKEY requests without a file system access per
+   keygrip.  It is rebuilt if the modification time of the directory
+   changed or we changed a key file ourself.  A rebuild which finds a
+   different set of keys bumps the key event counter so that clients
+   caching the set learn about keys added or removed by other
+   processes.  */
+static struct
+{
+  int valid;            /* The set may be used.  */
+  time_t dir_mtime;     /* The mtime of the directory at the last scan. */
+  time_t scan_time;     /* The time of the last scan.  */
+  unsigned char *grips; /* Sorted array with NGRIPS keygrips.  */
+  size_t ngrips;
+} key_set;
+
+
+/* Mark the set of available keys as outdated.  */
+static void
+invalidate_key_set (void)
+{
+  key_set.valid = 0;
+}
+
+
 /* Write an S-expression formatted key to our key storage.  With FORCE
    passed as true an existing key with the given GRIP will get
    overwritten.  */
@@ -104,6 +130,7 @@ agent_write_private_key (const unsigned char *grip,
       return tmperr;
     }
   bump_key_eventcounter ();
+  invalidate_key_set ();
   xfree (fname);
   return 0;
 }
@@ -607,6 +634,9 @@ remove_key_file (const unsigned char *grip)
   fname = make_filename (opt.homedir, GNUPG_PRIVATE_KEYS_DIR, hexgrip, NULL);
   if (gnupg_remove (fname))
     err = gpg_error_from_syserror ();
+  else
+    bump_key_eventcounter ();
+  invalidate_key_set ();
   xfree (fname);
   return err;
 }
@@ -1129,6 +1159,126 @@ agent_public_key_from_file (ctrl_t ctrl,
 
 
 
+/* qsort and bsearch helper for the keygrips in KEY_SET.  */
+static int
+compare_grips (const void *a, const void *b)
+{
+  return memcmp (a, b, 20);
+}
+
+
+/* Make sure that KEY_SET reflects the content of the private key
+   directory.  Returns 0 on success.  */
+gpg_error_t
+agent_update_key_set (void)
+{
+  gpg_error_t err;
+  char *dirname;
+  struct stat st;
+  DIR *dir;
+  struct dirent *dir_entry;
+  unsigned char *grips = NULL;
+  size_t ngrips = 0;
+  size_t size = 0;
+  char hexgrip[41];
+  time_t now;
+
+  dirname = make_filename_try (opt.homedir, GNUPG_PRIVATE_KEYS_DIR, NULL);
+  if (!dirname)
+    return gpg_error_from_syserror ();
+  if (stat (dirname, &st))
+    {
+      err = gpg_error_from_syserror ();
+      xfree (dirname);
+      key_set.valid = 0;
+      return err;
+    }
+
+  /* A change done in the same second as the last scan can't be
+     detected by the mtime; thus we rescan until that second is
+     over.  */
+  if (key_set.valid && st.st_mtime == key_set.dir_mtime
+      && st.st_mtime < key_set.scan_time)
+    {
+      xfree (dirname);
+      return 0;
+    }
+
+  now = time (NULL);
+  dir = opendir (dirname);
+  xfree (dirname);
+  if (!dir)
+    {
+      key_set.valid = 0;
+      return gpg_error_from_syserror ();
+    }
+  while ((dir_entry = readdir (dir)))
+    {
+      if (strlen (dir_entry->d_name) != 44
+          || strcmp (dir_entry->d_name + 40, ".key"))
+        continue;
+      if (ngrips == size)
+        {
+          unsigned char *tmp;
+
+          size += size? size : 256;
+          tmp = xtryrealloc (grips, size * 20);
+          if (!tmp)
+            {
+              err = gpg_error_from_syserror ();
+              closedir (dir);
+              xfree (grips);
+              key_set.valid = 0;
+              return err;
+            }
+          grips = tmp;
+        }
+      memcpy (hexgrip, dir_entry->d_name, 40);
+      hexgrip[40] = 0;
+      if (hex2bin (hexgrip, grips + 20 * ngrips, 20) >= 0)
+        ngrips++;
+    }
+  closedir (dir);
+
+  qsort (grips, ngrips, 20, compare_grips);
+  if (key_set.grips
+      && (ngrips != key_set.ngrips
+          || memcmp (grips, key_set.grips, ngrips * 20)))
+    bump_key_eventcounter ();
+  xfree (key_set.grips);
+  key_set.grips = grips;
+  key_set.ngrips = ngrips;
+  key_set.dir_mtime = st.st_mtime;
+  key_set.scan_time = now;
+  key_set.valid = 1;
+  return 0;
+}
+
+
+/* Store a copy of the keygrips of all available secret keys as an
+   array of 20 byte items at R_GRIPS and their number at R_NGRIPS.
+   The caller must release the array using xfree.  */
+gpg_error_t
+agent_list_keygrips (unsigned char **r_grips, size_t *r_ngrips)
+{
+  gpg_error_t err;
+
+  *r_grips = NULL;
+  *r_ngrips = 0;
+
+  err = agent_update_key_set ();
+  if (err)
+    return err;
+
+  *r_grips = xtrymalloc (key_set.ngrips? key_set.ngrips * 20 : 1);
+  if (!*r_grips)
+    return gpg_error_from_syserror ();
+  memcpy (*r_grips, key_set.grips, key_set.ngrips * 20);
+  *r_ngrips = key_set.ngrips;
+  return 0;
+}
+
+
 /* Check whether the the secret key identified by GRIP is available.
    Returns 0 is the key is available.  */
 int
@@ -1138,6 +1288,11 @@ agent_key_available (const unsigned char *grip)
   char *fname;
   char hexgrip[40+4+1];
 
+  if (!agent_update_key_set ())
+    return bsearch (grip, key_set.grips, key_set.ngrips, 20,
+                    compare_grips)? 0 : -1;
+
+  /* Fallback to a direct check.  */
   bin2hex (grip, 20, hexgrip);
   strcpy (hexgrip+40, ".key");
 
@@ -50,10 +50,28 @@ struct trustitem_s
 };
 typedef struct trustitem_s trustitem_t;
 
-/* Malloced table and its allocated size with all trust items. */
-static trustitem_t *trusttable;
-static size_t trusttablesize;
-/* A mutex used to protect the table. */
+/* The table with all trust items and a hash index on the
+   fingerprints.  The table is reference counted so that lookups may
+   continue to use a table while it is replaced by a reload.  */
+struct trusttable_s
+{
+  unsigned int refcount; /* Protected by TRUSTTABLE_LOCK.  */
+  trustitem_t *items;    /* The items in the order of the file.  */
+  size_t nitems;         /* The number of items.  */
+  unsigned int hashmask; /* The number of buckets minus one.  */
+  int *buckets;          /* The index of the first item for each
+                            hash value or -1.  */
+  int *next;             /* The index of the next item with the same
+                            hash value or -1.  */
+};
+typedef struct trusttable_s *trusttable_t;
+
+/* The current trust table or NULL if it needs to be read.  */
+static trusttable_t trusttable;
+/* Incremented each time the table is cleared.  */
+static unsigned int trusttable_generation;
+/* A mutex used to protect the table pointer and the reference
+   counts.  It is only held for a short time.  */
 static npth_mutex_t trusttable_lock;
 
 
@@ -117,14 +135,114 @@ unlock_trusttable (void)
 }
 
 
+/* Release the reference to TABLE.  If ALREADY_LOCKED is true the
+   trusttable is assumed to be locked.  */
+static void
+release_trusttable (trusttable_t table, int already_locked)
+{
+  int last;
+
+  if (!table)
+    return;
+
+  if (!already_locked)
+    lock_trusttable ();
+  last = !--table->refcount;
+  if (!already_locked)
+    unlock_trusttable ();
+
+  if (last)
+    {
+      xfree (table->items);
+      xfree (table->buckets);
+      xfree (table->next);
+      xfree (table);
+    }
+}
+
+
 /* Clear the trusttable.  The caller needs to make sure that the
    trusttable is locked.  */
 static inline void
 clear_trusttable (void)
 {
-  xfree (trusttable);
+  release_trusttable (trusttable, 1);
   trusttable = NULL;
-  trusttablesize = 0;
+  trusttable_generation++;
+}
+
+
+/* Return the hash value of the fingerprint FPR.  Fingerprints are
+   SHA-1 hashes and thus we can simply use the first bytes.  */
+static inline unsigned int
+hash_fpr (const unsigned char *fpr)
+{
+  return (((u32)fpr[0] << 24) | ((u32)fpr[1] << 16)
+          | ((u32)fpr[2] << 8) | (u32)fpr[3]);
+}
+
+
+/* Create a new trust table object from the NITEMS items at ITEMS.
+   On success the table takes ownership of ITEMS.  */
+static gpg_error_t
+new_trusttable (trustitem_t *items, size_t nitems, trusttable_t *r_table)
+{
+  trusttable_t table;
+  unsigned int nbuckets;
+  unsigned int h;
+  int idx;
+
+  *r_table = NULL;
+
+  table = xtrycalloc (1, sizeof *table);
+  if (!table)
+    return gpg_error_from_syserror ();
+
+  for (nbuckets = 16; nbuckets < nitems; nbuckets <<= 1)
+    ;
+  table->buckets = xtrymalloc (nbuckets * sizeof *table->buckets);
+  table->next = xtrymalloc ((nitems? nitems:1) * sizeof *table->next);
+  if (!table->buckets || !table->next)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+      xfree (table->buckets);
+      xfree (table->next);
+      xfree (table);
+      return err;
+    }
+  table->refcount = 1;
+  table->items = items;
+  table->nitems = nitems;
+  table->hashmask = nbuckets - 1;
+  for (h=0; h < nbuckets; h++)
+    table->buckets[h] = -1;
+
+  /* Insert in reverse order so that the first of duplicate entries
+     is found first, as with a linear search.  */
+  for (idx = nitems - 1; idx >= 0; idx--)
+    {
+      h = hash_fpr (items[idx].fpr) & table->hashmask;
+      table->next[idx] = table->buckets[h];
+      table->buckets[h] = idx;
+    }
+
+  *r_table = table;
+  return 0;
+}
+
+
+/* Return the item with the binary fingerprint FPR from TABLE or
+   NULL.  */
+static trustitem_t *
+lookup_trustitem (trusttable_t table, const unsigned char *fpr)
+{
+  int idx;
+
+  for (idx = table->buckets[hash_fpr (fpr) & table->hashmask];
+       idx != -1; idx = table->next[idx])
+    if (!memcmp (table->items[idx].fpr, fpr, 20))
+      return table->items + idx;
+  return NULL;
 }
 
 
@@ -326,10 +444,9 @@ read_one_trustfile (const char *fname, int allow_include,
 }
 
 
-/* Read the trust files and update the global table on success.  The
-   trusttable is assumed to be locked. */
+/* Read the trust files and store a new table at R_TABLE.  */
 static gpg_error_t
-read_trustfiles (void)
+read_trustfiles (trusttable_t *r_table)
 {
   gpg_error_t err;
   trustitem_t *table, *ti;
@@ -364,17 +481,16 @@ read_trustfiles (void)
 
   if (err)
     {
-      xfree (table);
-      if (gpg_err_code (err) == GPG_ERR_ENOENT)
+      if (gpg_err_code (err) != GPG_ERR_ENOENT)
         {
-          /* Take a missing trustlist as an empty one.  */
-          clear_trusttable ();
-          err = 0;
+          xfree (table);
+          return err;
         }
-      return err;
+      /* Take a missing trustlist as an empty one.  */
+      tableidx = 0;
+      err = 0;
     }
 
-  /* Fixme: we should drop duplicates and sort the table. */
   ti = xtryrealloc (table, (tableidx?tableidx:1) * sizeof *table);
   if (!ti)
     {
@@ -383,10 +499,57 @@ read_trustfiles (void)
       return err;
     }
 
-  /* Replace the trusttable.  */
-  xfree (trusttable);
-  trusttable = ti;
-  trusttablesize = tableidx;
+  err = new_trusttable (ti, tableidx, r_table);
+  if (err)
+    xfree (ti);
+  return err;
+}
+
+
+/* Store a reference to the current trust table at R_TABLE.  The
+   table is read if needed; this is done without holding the lock so
+   that other lookups don't need to wait.  If ALREADY_LOCKED is true
+   the trusttable is assumed to be locked.  The caller must release
+   the table using release_trusttable.  */
+static gpg_error_t
+get_trusttable (trusttable_t *r_table, int already_locked)
+{
+  gpg_error_t err;
+  trusttable_t table;
+  unsigned int generation;
+
+  if (!already_locked)
+    lock_trusttable ();
+  table = trusttable;
+  if (table)
+    table->refcount++;
+  generation = trusttable_generation;
+  if (!already_locked)
+    unlock_trusttable ();
+
+  if (!table)
+    {
+      err = read_trustfiles (&table);
+      if (err)
+        {
+          *r_table = NULL;
+          return err;
+        }
+
+      /* Install the new table unless another thread did this already
+         or the table has been cleared in the meantime.  */
+      if (!already_locked)
+        lock_trusttable ();
+      if (!trusttable && generation == trusttable_generation)
+        {
+          trusttable = table;
+          table->refcount++;
+        }
+      if (!already_locked)
+        unlock_trusttable ();
+    }
+
+  *r_table = table;
   return 0;
 }
 
@@ -398,10 +561,9 @@ static gpg_error_t
 istrusted_internal (ctrl_t ctrl, const char *fpr, int *r_disabled,
                     int already_locked)
 {
-  gpg_error_t err;
-  int locked = already_locked;
+  gpg_error_t err = 0;
+  trusttable_t table = NULL;
   trustitem_t *ti;
-  size_t len;
   unsigned char fprbin[20];
 
   if (r_disabled)
@@ -413,57 +575,37 @@ istrusted_internal (ctrl_t ctrl, const char *fpr, int *r_disabled,
       goto leave;
     }
 
-  if (!already_locked)
+  err = get_trusttable (&table, already_locked);
+  if (err)
     {
-      lock_trusttable ();
-      locked = 1;
+      log_error (_("error reading list of trusted root certificates\n"));
+      goto leave;
     }
 
-  if (!trusttable)
+  ti = lookup_trustitem (table, fprbin);
+  if (!ti)
     {
-      err = read_trustfiles ();
-      if (err)
-        {
-          log_error (_("error reading list of trusted root certificates\n"));
-          goto leave;
-        }
+      err = gpg_error (GPG_ERR_NOT_TRUSTED);
+      goto leave;
     }
 
-  if (trusttable)
-    {
-      for (ti=trusttable, len = trusttablesize; len; ti++, len--)
-        if (!memcmp (ti->fpr, fprbin, 20))
-          {
-            if (ti->flags.disabled && r_disabled)
-              *r_disabled = 1;
-
-            /* Print status messages only if we have not been called
-               in a locked state.  */
-            if (already_locked)
-              ;
-            else if (ti->flags.relax)
-              {
-                unlock_trusttable ();
-                locked = 0;
-                err = agent_write_status (ctrl, "TRUSTLISTFLAG", "relax", NULL);
-              }
-            else if (ti->flags.cm)
-              {
-                unlock_trusttable ();
-                locked = 0;
-                err = agent_write_status (ctrl, "TRUSTLISTFLAG", "cm", NULL);
-              }
-
-            if (!err)
-              err = ti->flags.disabled? gpg_error (GPG_ERR_NOT_TRUSTED) : 0;
-            goto leave;
-          }
-    }
-  err = gpg_error (GPG_ERR_NOT_TRUSTED);
+  if (ti->flags.disabled && r_disabled)
+    *r_disabled = 1;
+
+  /* Print status messages only if we have not been called in a
+     locked state.  */
+  if (already_locked)
+    ;
+  else if (ti->flags.relax)
+    err = agent_write_status (ctrl, "TRUSTLISTFLAG", "relax", NULL);
+  else if (ti->flags.cm)
+    err = agent_write_status (ctrl, "TRUSTLISTFLAG", "cm", NULL);
+
+  if (!err)
+    err = ti->flags.disabled? gpg_error (GPG_ERR_NOT_TRUSTED) : 0;
 
  leave:
-  if (locked && !already_locked)
-    unlock_trusttable ();
+  release_trusttable (table, already_locked);
   return err;
 }
 
@@ -481,40 +623,33 @@ agent_istrusted (ctrl_t ctrl, const char *fpr, int *r_disabled)
 gpg_error_t
 agent_listtrusted (void *assuan_context)
 {
+  trusttable_t table;
   trustitem_t *ti;
   char key[51];
   gpg_error_t err;
   size_t len;
 
-  lock_trusttable ();
-  if (!trusttable)
+  err = get_trusttable (&table, 0);
+  if (err)
     {
-      err = read_trustfiles ();
-      if (err)
-        {
-          unlock_trusttable ();
-          log_error (_("error reading list of trusted root certificates\n"));
-          return err;
-        }
+      log_error (_("error reading list of trusted root certificates\n"));
+      return err;
     }
 
-  if (trusttable)
+  for (ti=table->items, len = table->nitems; len; ti++, len--)
     {
-      for (ti=trusttable, len = trusttablesize; len; ti++, len--)
-        {
-          if (ti->flags.disabled)
-            continue;
-          bin2hex (ti->fpr, 20, key);
-          key[40] = ' ';
-          key[41] = ((ti->flags.for_smime && ti->flags.for_pgp)? '*'
-                     : ti->flags.for_smime? 'S': ti->flags.for_pgp? 'P':' ');
-          key[42] = '\n';
-          assuan_send_data (assuan_context, key, 43);
-          assuan_send_data (assuan_context, NULL, 0); /* flush */
-        }
+      if (ti->flags.disabled)
+        continue;
+      bin2hex (ti->fpr, 20, key);
+      key[40] = ' ';
+      key[41] = ((ti->flags.for_smime && ti->flags.for_pgp)? '*'
+                 : ti->flags.for_smime? 'S': ti->flags.for_pgp? 'P':' ');
+      key[42] = '\n';
+      assuan_send_data (assuan_context, key, 43);
+      assuan_send_data (assuan_context, NULL, 0); /* flush */
     }
 
-  unlock_trusttable ();
+  release_trusttable (table, 0);
   return 0;
 }
 
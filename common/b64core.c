@@ -0,0 +1,437 @@
+/* b64core.c - Block based Base64 encoding and decoding.
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This module provides the bulk conversion used by the various Base64
+   (aka Radix-64) encoders and decoders: b64enc.c, b64dec.c,
+   g10/armor.c and sm/base64.c.  Those modules keep doing the line
+   handling, padding, checksums and partial groups themselves and only
+   pass runs of complete groups to the functions here.  On x86-64 the
+   SSSE3 or AVX2 instructions are used if the CPU supports them; the
+   algorithms are those described by Wojciech Muła and Daniel Lemire
+   in "Faster Base64 Encoding and Decoding using AVX2 Instructions"
+   (2018).  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define USE_X86_SIMD 1
+# include <immintrin.h>
+#endif
+
+
+/* The base-64 character list */
+static const char bintoasc[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "abcdefghijklmnopqrstuvwxyz"
+                                 "0123456789+/";
+
+/* The reverse mapping; 0xff marks characters not in the alphabet.  */
+static const unsigned char asctobin[256] =
+  {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b,
+    0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+    0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
+    0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+    0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+  };
+
+
+#ifdef USE_X86_SIMD
+/* Bit 0 is set if SSSE3 may be used, bit 1 if AVX2 may be used.  A
+   value of -1 means that the CPU has not yet been checked.  */
+static int cpu_features = -1;
+
+static int
+get_cpu_features (void)
+{
+  int features;
+
+  if (cpu_features == -1)
+    {
+      __builtin_cpu_init ();
+      features = 0;
+      if (__builtin_cpu_supports ("ssse3"))
+        features |= 1;
+      if (__builtin_cpu_supports ("avx2"))
+        features |= 2;
+      cpu_features = features;
+    }
+  return cpu_features;
+}
+
+
+/* Convert the 16 bytes at IN, of which the first 12 are used, into 16
+   Base64 characters.  */
+static inline __attribute__ ((target ("ssse3"))) __m128i
+encode_ssse3 (__m128i in)
+{
+  __m128i t0, t1, t2, t3, idx, res;
+
+  /* Split the 3 bytes of each group into 4 six bit indices.  */
+  in = _mm_shuffle_epi8 (in, _mm_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7,
+                                           4, 5, 3, 4, 1, 2, 0, 1));
+  t0 = _mm_and_si128 (in, _mm_set1_epi32 (0x0fc0fc00));
+  t1 = _mm_mulhi_epu16 (t0, _mm_set1_epi32 (0x04000040));
+  t2 = _mm_and_si128 (in, _mm_set1_epi32 (0x003f03f0));
+  t3 = _mm_mullo_epi16 (t2, _mm_set1_epi32 (0x01000010));
+  idx = _mm_or_si128 (t1, t3);
+
+  /* Map the indices to the alphabet by adding an offset depending on
+     the range of the index.  */
+  res = _mm_subs_epu8 (idx, _mm_set1_epi8 (51));
+  res = _mm_or_si128 (res, _mm_and_si128 (_mm_cmpgt_epi8 (_mm_set1_epi8 (26),
+                                                          idx),
+                                          _mm_set1_epi8 (13)));
+  res = _mm_shuffle_epi8 (_mm_setr_epi8 ('a' - 26, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '+' - 62,
+                                         '/' - 63, 'A', 0, 0), res);
+  return _mm_add_epi8 (res, idx);
+}
+
+
+/* Encode groups from SRC to DST as long as 16 bytes may be read from
+   SRC.  Returns the number of groups done.  */
+static __attribute__ ((target ("ssse3"))) size_t
+encode_blocks_ssse3 (char *dst, const unsigned char *src, size_t ngroups)
+{
+  size_t n;
+
+  for (n = 0; n + 6 <= ngroups; n += 4, src += 12, dst += 16)
+    _mm_storeu_si128 ((__m128i *)dst,
+                      encode_ssse3 (_mm_loadu_si128 ((const __m128i *)src)));
+  return n;
+}
+
+
+/* Same as encode_ssse3 but for 32 characters; the two lanes of IN
+   each hold 12 used bytes.  */
+static inline __attribute__ ((target ("avx2"))) __m256i
+encode_avx2 (__m256i in)
+{
+  __m256i t0, t1, t2, t3, idx, res;
+
+  in = _mm256_shuffle_epi8 (in, _mm256_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7,
+                                                 4, 5, 3, 4, 1, 2, 0, 1,
+                                                 10, 11, 9, 10, 7, 8, 6, 7,
+                                                 4, 5, 3, 4, 1, 2, 0, 1));
+  t0 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x0fc0fc00));
+  t1 = _mm256_mulhi_epu16 (t0, _mm256_set1_epi32 (0x04000040));
+  t2 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x003f03f0));
+  t3 = _mm256_mullo_epi16 (t2, _mm256_set1_epi32 (0x01000010));
+  idx = _mm256_or_si256 (t1, t3);
+
+  res = _mm256_subs_epu8 (idx, _mm256_set1_epi8 (51));
+  res = _mm256_or_si256 (res,
+                         _mm256_and_si256 (_mm256_cmpgt_epi8
+                                           (_mm256_set1_epi8 (26), idx),
+                                           _mm256_set1_epi8 (13)));
+  res = _mm256_shuffle_epi8 (_mm256_setr_epi8 ('a' - 26, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0,
+                                               'a' - 26, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '0' - 52,
+                                               '0' - 52, '0' - 52, '+' - 62,
+                                               '/' - 63, 'A', 0, 0), res);
+  return _mm256_add_epi8 (res, idx);
+}
+
+
+static __attribute__ ((target ("avx2"))) size_t
+encode_blocks_avx2 (char *dst, const unsigned char *src, size_t ngroups)
+{
+  size_t n;
+  __m256i in;
+
+  /* The second load reads 16 bytes starting at SRC+12.  */
+  for (n = 0; n + 10 <= ngroups; n += 8, src += 24, dst += 32)
+    {
+      in = _mm256_inserti128_si256
+        (_mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *)src)),
+         _mm_loadu_si128 ((const __m128i *)(src + 12)), 1);
+      _mm256_storeu_si256 ((__m256i *)dst, encode_avx2 (in));
+    }
+  return n;
+}
+
+
+/* Decode the 16 characters in IN to 12 bytes stored at the start of
+   R_OUT.  Returns false if IN has a character not in the alphabet.  */
+static inline __attribute__ ((target ("ssse3"))) int
+decode_ssse3 (__m128i in, __m128i *r_out)
+{
+  const __m128i lut_lo = _mm_setr_epi8 (0x15, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1a,
+                                        0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8 (0x10, 0x10, 0x01, 0x02,
+                                        0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10,
+                                        0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8 (0, 16, 19, 4, -65, -65, -71, -71,
+                                          0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8 (0x2f);
+  __m128i hi_nibbles, lo, hi, roll, t;
+
+  /* Classify each character by its two nibbles; a character is valid
+     if the bit sets selected by both nibbles are disjoint.  */
+  hi_nibbles = _mm_and_si128 (_mm_srli_epi32 (in, 4), mask_2f);
+  lo = _mm_shuffle_epi8 (lut_lo, _mm_and_si128 (in, mask_2f));
+  hi = _mm_shuffle_epi8 (lut_hi, hi_nibbles);
+  t = _mm_cmpeq_epi8 (_mm_and_si128 (lo, hi), _mm_setzero_si128 ());
+  if (_mm_movemask_epi8 (t) != 0xffff)
+    return 0;
+
+  /* Translate to the 6 bit values and pack them.  */
+  roll = _mm_shuffle_epi8 (lut_roll,
+                           _mm_add_epi8 (_mm_cmpeq_epi8 (in, mask_2f),
+                                         hi_nibbles));
+  in = _mm_add_epi8 (in, roll);
+  in = _mm_maddubs_epi16 (in, _mm_set1_epi32 (0x01400140));
+  in = _mm_madd_epi16 (in, _mm_set1_epi32 (0x00011000));
+  *r_out = _mm_shuffle_epi8 (in, _mm_setr_epi8 (2, 1, 0, 6, 5, 4,
+                                                10, 9, 8, 14, 13, 12,
+                                                -1, -1, -1, -1));
+  return 1;
+}
+
+
+/* Decode characters from SRC to DST.  Each store writes 4 bytes past
+   the 12 decoded, thus we stop early enough to stay within the
+   SRCLEN/4*3 bytes available at DST.  Returns the number of
+   characters done.  */
+static __attribute__ ((target ("ssse3"))) size_t
+decode_run_ssse3 (unsigned char *dst, const char *src, size_t srclen)
+{
+  size_t n;
+  __m128i out;
+
+  for (n = 0; n + 24 <= srclen; n += 16, src += 16, dst += 12)
+    {
+      if (!decode_ssse3 (_mm_loadu_si128 ((const __m128i *)src), &out))
+        break;
+      _mm_storeu_si128 ((__m128i *)dst, out);
+    }
+  return n;
+}
+
+
+static inline __attribute__ ((target ("avx2"))) int
+decode_avx2 (__m256i in, __m256i *r_out)
+{
+  const __m256i lut_lo = _mm256_setr_epi8 (0x15, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1a,
+                                           0x1b, 0x1b, 0x1b, 0x1a,
+                                           0x15, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1a,
+                                           0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i lut_hi = _mm256_setr_epi8 (0x10, 0x10, 0x01, 0x02,
+                                           0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x01, 0x02,
+                                           0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8 (0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8 (0x2f);
+  __m256i hi_nibbles, lo, hi, roll, t;
+
+  hi_nibbles = _mm256_and_si256 (_mm256_srli_epi32 (in, 4), mask_2f);
+  lo = _mm256_shuffle_epi8 (lut_lo, _mm256_and_si256 (in, mask_2f));
+  hi = _mm256_shuffle_epi8 (lut_hi, hi_nibbles);
+  if (!_mm256_testz_si256 (lo, hi))
+    return 0;
+
+  roll = _mm256_shuffle_epi8 (lut_roll,
+                              _mm256_add_epi8 (_mm256_cmpeq_epi8 (in,
+                                                                  mask_2f),
+                                               hi_nibbles));
+  in = _mm256_add_epi8 (in, roll);
+  in = _mm256_maddubs_epi16 (in, _mm256_set1_epi32 (0x01400140));
+  in = _mm256_madd_epi16 (in, _mm256_set1_epi32 (0x00011000));
+  t = _mm256_shuffle_epi8 (in, _mm256_setr_epi8 (2, 1, 0, 6, 5, 4,
+                                                 10, 9, 8, 14, 13, 12,
+                                                 -1, -1, -1, -1,
+                                                 2, 1, 0, 6, 5, 4,
+                                                 10, 9, 8, 14, 13, 12,
+                                                 -1, -1, -1, -1));
+  /* Move the 12 bytes of the high lane next to those of the low lane.  */
+  *r_out = _mm256_permutevar8x32_epi32 (t, _mm256_setr_epi32 (0, 1, 2, 4,
+                                                              5, 6, 3, 7));
+  return 1;
+}
+
+
+static __attribute__ ((target ("avx2"))) size_t
+decode_run_avx2 (unsigned char *dst, const char *src, size_t srclen)
+{
+  size_t n;
+  __m256i out;
+
+  for (n = 0; n + 44 <= srclen; n += 32, src += 32, dst += 24)
+    {
+      if (!decode_avx2 (_mm256_loadu_si256 ((const __m256i *)src), &out))
+        break;
+      _mm256_storeu_si256 ((__m256i *)dst, out);
+    }
+  return n;
+}
+#endif /*USE_X86_SIMD*/
+
+
+/* Encode NGROUPS groups of 3 bytes from SRC into 4*NGROUPS Base64
+   characters stored at DST.  No padding and no line breaks are
+   written and DST is not terminated.  */
+void
+b64_encode_groups (char *dst, const void *src, size_t ngroups)
+{
+  const unsigned char *s = src;
+  size_t n;
+
+#ifdef USE_X86_SIMD
+  int features = get_cpu_features ();
+
+  if ((features & 2))
+    {
+      n = encode_blocks_avx2 (dst, s, ngroups);
+      s += 3 * n;
+      dst += 4 * n;
+      ngroups -= n;
+    }
+  if ((features & 1))
+    {
+      n = encode_blocks_ssse3 (dst, s, ngroups);
+      s += 3 * n;
+      dst += 4 * n;
+      ngroups -= n;
+    }
+#endif /*USE_X86_SIMD*/
+
+  for (n = 0; n < ngroups; n++, s += 3)
+    {
+      *dst++ = bintoasc[(*s >> 2) & 077];
+      *dst++ = bintoasc[(((*s<<4)&060)|((s[1] >> 4)&017))&077];
+      *dst++ = bintoasc[(((s[1]<<2)&074)|((s[2]>>6)&03))&077];
+      *dst++ = bintoasc[s[2]&077];
+    }
+}
+
+
+/* Decode the longest prefix of the SRCLEN characters at SRC which
+   consists of complete groups of 4 characters from the Base64
+   alphabet.  The decoded bytes are stored at DST which must have room
+   for SRCLEN/4*3 bytes; DST may be the same as SRC.  The number of
+   characters used is stored at R_USED and the number of bytes stored
+   is returned.  Padding, white space and any other characters stop
+   the decoding; they are left for the caller.  */
+size_t
+b64_decode_groups (void *dst, const char *src, size_t srclen, size_t *r_used)
+{
+  unsigned char *d = dst;
+  const unsigned char *s = (const unsigned char *)src;
+  unsigned int c0, c1, c2, c3;
+  size_t n, used = 0;
+
+#ifdef USE_X86_SIMD
+  int features = get_cpu_features ();
+
+  if ((features & 2))
+    {
+      n = decode_run_avx2 (d, (const char *)s, srclen);
+      s += n;
+      d += n / 4 * 3;
+      used += n;
+    }
+  if ((features & 1))
+    {
+      n = decode_run_ssse3 (d, (const char *)s, srclen - used);
+      s += n;
+      d += n / 4 * 3;
+      used += n;
+    }
+#endif /*USE_X86_SIMD*/
+
+  for (; used + 4 <= srclen; used += 4, s += 4)
+    {
+      c0 = asctobin[s[0]];
+      c1 = asctobin[s[1]];
+      c2 = asctobin[s[2]];
+      c3 = asctobin[s[3]];
+      if ((c0 | c1 | c2 | c3) == 0xff)
+        break;
+      *d++ = (c0 << 2) | (c1 >> 4);
+      *d++ = (c1 << 4) | (c2 >> 2);
+      *d++ = (c2 << 6) | c3;
+    }
+
+  *r_used = used;
+  return d - (unsigned char *)dst;
+}
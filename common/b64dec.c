@@ -147,6 +147,20 @@ b64dec_proc (struct b64state *state, void *buffer, size_t length,
             ds = s_b64_0;
           break;
         case s_b64_0:
+          if (length > 3)
+            {
+              /* Decode a run of complete groups in one go.  */
+              size_t used;
+
+              d += b64_decode_groups (d, s, length, &used);
+              if (used)
+                {
+                  s += used - 1;
+                  length -= used - 1;
+                  break;
+                }
+            }
+          /* Fall through.  */
         case s_b64_1:
         case s_b64_2:
         case s_b64_3:
@@ -0,0 +1,230 @@
+/* crc24.c - The OpenPGP CRC-24 checksum.
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The CRC-24 as used by the OpenPGP armor (RFC-4880, 6.1) is computed
+   here with the slicing-by-8 algorithm, which processes 8 bytes per
+   step using 8 lookup tables.  On x86-64 CPUs with the PCLMULQDQ
+   instruction long buffers are first folded with carry-less
+   multiplications as described by Intel in "Fast CRC Computation for
+   Generic Polynomials Using PCLMULQDQ Instruction" (2009).
+
+   Internally the CRC is kept in the high 24 bits of a 32 bit register;
+   this is the same as a 32 bit CRC with the polynomial multiplied by
+   x^8 and allows to use the common 32 bit algorithms.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define USE_PCLMUL 1
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
+
+/* The polynomial 0x864CFB shifted into the high 24 bits.  */
+#define CRCPOLY 0x864CFB00
+
+/* The lookup tables; crc_table[0] is the classic byte wise table.  */
+static u32 crc_table[8][256];
+static int initialized;
+
+#ifdef USE_PCLMUL
+/* True if the CPU supports PCLMULQDQ and SSSE3.  */
+static int use_pclmul;
+
+/* The folding constants x^128, x^192, x^512 and x^576 modulo the
+   polynomial.  */
+static u32 fold_128, fold_192, fold_512, fold_576;
+#endif /*USE_PCLMUL*/
+
+
+#ifdef USE_PCLMUL
+/* Return x^N modulo the polynomial.  */
+static u32
+xpow_mod (unsigned int n)
+{
+  u32 r = 1;
+
+  while (n--)
+    r = (r & 0x80000000)? ((r << 1) ^ CRCPOLY) : (r << 1);
+  return r;
+}
+#endif /*USE_PCLMUL*/
+
+
+/* Build the tables.  This may happen concurrently in several threads;
+   they all store the same values.  */
+static void
+initialize (void)
+{
+  int i, k;
+  u32 t;
+
+  for (i=0; i < 256; i++)
+    {
+      t = (u32)i << 24;
+      for (k=0; k < 8; k++)
+        t = (t & 0x80000000)? ((t << 1) ^ CRCPOLY) : (t << 1);
+      crc_table[0][i] = t;
+    }
+  for (i=0; i < 256; i++)
+    for (k=1; k < 8; k++)
+      crc_table[k][i] = ((crc_table[k-1][i] << 8)
+                         ^ crc_table[0][crc_table[k-1][i] >> 24]);
+
+#ifdef USE_PCLMUL
+  {
+    unsigned int eax, ebx, ecx, edx;
+
+    fold_128 = xpow_mod (128);
+    fold_192 = xpow_mod (192);
+    fold_512 = xpow_mod (512);
+    fold_576 = xpow_mod (576);
+    if (__get_cpuid (1, &eax, &ebx, &ecx, &edx)
+        && (ecx & bit_PCLMUL) && (ecx & bit_SSSE3))
+      use_pclmul = 1;
+  }
+#endif /*USE_PCLMUL*/
+
+  initialized = 1;
+}
+
+
+/* Update the 32 bit register C with LEN bytes from P.  */
+static u32
+update_slice8 (u32 c, const unsigned char *p, size_t len)
+{
+  u32 a, b;
+
+  for (; len >= 8; len -= 8, p += 8)
+    {
+      a = c ^ (((u32)p[0] << 24) | ((u32)p[1] << 16)
+               | ((u32)p[2] << 8) | p[3]);
+      b = ((u32)p[4] << 24) | ((u32)p[5] << 16) | ((u32)p[6] << 8) | p[7];
+      c = (crc_table[7][a >> 24] ^ crc_table[6][(a >> 16) & 0xff]
+           ^ crc_table[5][(a >> 8) & 0xff] ^ crc_table[4][a & 0xff]
+           ^ crc_table[3][b >> 24] ^ crc_table[2][(b >> 16) & 0xff]
+           ^ crc_table[1][(b >> 8) & 0xff] ^ crc_table[0][b & 0xff]);
+    }
+  for (; len; len--, p++)
+    c = (c << 8) ^ crc_table[0][(c >> 24) ^ *p];
+  return c;
+}
+
+
+#ifdef USE_PCLMUL
+/* Return X * x^128 + D reduced to 128 bits using the constants K for
+   x^192 (high) and x^128 (low) or the corresponding larger ones.  */
+static inline __attribute__ ((target ("pclmul,ssse3"))) __m128i
+fold (__m128i x, __m128i k, __m128i d)
+{
+  return _mm_xor_si128 (_mm_xor_si128 (_mm_clmulepi64_si128 (x, k, 0x00),
+                                       _mm_clmulepi64_si128 (x, k, 0x11)),
+                        d);
+}
+
+
+/* Update the 32 bit register C with the bytes at P by folding 64 byte
+   blocks.  LEN must be at least 64; the number of bytes processed, a
+   multiple of 16, is stored at R_USED.  */
+static __attribute__ ((target ("pclmul,ssse3"))) u32
+update_pclmul (u32 c, const unsigned char *p, size_t len, size_t *r_used)
+{
+  const __m128i bswap = _mm_setr_epi8 (15, 14, 13, 12, 11, 10, 9, 8,
+                                       7, 6, 5, 4, 3, 2, 1, 0);
+  const __m128i k128 = _mm_set_epi64x (fold_192, fold_128);
+  const __m128i k512 = _mm_set_epi64x (fold_576, fold_512);
+  __m128i a0, a1, a2, a3;
+  unsigned char tmp[16];
+  size_t used;
+
+#define LOAD(off) \
+  _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(p + (off))), bswap)
+
+  /* The bytes are loaded in big-endian order so that the first bit
+     of the message is the coefficient with the highest degree.  */
+  a0 = _mm_xor_si128 (LOAD (0), _mm_set_epi32 (c, 0, 0, 0));
+  a1 = LOAD (16);
+  a2 = LOAD (32);
+  a3 = LOAD (48);
+  for (used = 64; used + 64 <= len; used += 64)
+    {
+      a0 = fold (a0, k512, LOAD (used));
+      a1 = fold (a1, k512, LOAD (used + 16));
+      a2 = fold (a2, k512, LOAD (used + 32));
+      a3 = fold (a3, k512, LOAD (used + 48));
+    }
+  a1 = fold (a0, k128, a1);
+  a2 = fold (a1, k128, a2);
+  a3 = fold (a2, k128, a3);
+  for (; used + 16 <= len; used += 16)
+    a3 = fold (a3, k128, LOAD (used));
+
+#undef LOAD
+
+  /* A3 is now congruent to the processed data; its CRC is thus the
+     CRC of the data.  */
+  _mm_storeu_si128 ((__m128i *)tmp, _mm_shuffle_epi8 (a3, bswap));
+  *r_used = used;
+  return update_slice8 (0, tmp, sizeof tmp);
+}
+#endif /*USE_PCLMUL*/
+
+
+/* Update the OpenPGP CRC-24 value CRC with LENGTH bytes from BUFFER
+   and return the new value.  The initial value for the armor is
+   0xB704CE.  */
+u32
+crc24_update (u32 crc, const void *buffer, size_t length)
+{
+  const unsigned char *p = buffer;
+  u32 c = crc << 8;
+
+  if (!initialized)
+    initialize ();
+
+#ifdef USE_PCLMUL
+  if (use_pclmul && length >= 128)
+    {
+      size_t used;
+
+      c = update_pclmul (c, p, length, &used);
+      p += used;
+      length -= used;
+    }
+#endif /*USE_PCLMUL*/
+
+  c = update_slice8 (c, p, length);
+  return (c >> 8);
+}
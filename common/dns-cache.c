@@ -0,0 +1,456 @@
+/* dns-cache.c - A cache for DNS answers
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This module caches the raw answers of resolver queries so that
+   repeated SRV, CERT and PKA lookups for the same names do not go out
+   to the network again.  Positive answers are kept for the smallest
+   TTL of their answer records; "no such name" and "no data" answers
+   are kept for the TTL given by the SOA record of the authority
+   section (RFC-2308).
+
+   The cache is not protected by a lock and is thus disabled by
+   default.  Only programs which do not run resolver queries
+   concurrently, like the dirmngr with its big nPth lock, may enable
+   it.  Without the cache dns_cache_query is a plain res_query.  Such
+   a program may register functions to release its lock while the
+   resolver waits for the network; the cache itself is only accessed
+   with the lock held.  */
+
+#include <config.h>
+#include <sys/types.h>
+#if !defined(USE_ADNS) \
+    && (defined(USE_DNS_SRV) || defined(USE_DNS_CERT) || defined(USE_DNS_PKA))
+# define USE_DNS_CACHE 1
+# include <netinet/in.h>
+# include <arpa/nameser.h>
+# include <resolv.h>
+# include <netdb.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util.h"
+#include "dns-cache.h"
+
+/* The number of answers we keep.  */
+#define DNS_CACHE_SIZE 128
+
+/* Answers are not kept longer than this number of seconds, regardless
+   of their TTL.  */
+#define DNS_CACHE_MAX_TTL 3600
+
+/* The time in seconds a negative answer is kept if the server did not
+   send an SOA record along with it.  */
+#define DNS_CACHE_NEG_TTL 60
+
+/* Answers larger than this are not cached.  */
+#define DNS_CACHE_MAX_ANSWER 16384
+
+
+#ifdef USE_DNS_CACHE
+/* An item of the cache.  An unused slot has NAME set to NULL.  */
+struct dns_cache_item_s
+{
+  char *name;              /* The queried name.  */
+  int class;               /* The queried class.  */
+  int type;                /* The queried type.  */
+  time_t expires;          /* The time the item becomes invalid.  */
+  unsigned long used;      /* Value of USE_COUNTER at the last use.  */
+  int herrno;              /* The h_errno of a negative answer or 0.  */
+  unsigned char *answer;   /* The answer of a positive item.  */
+  int anslen;              /* Its length.  */
+};
+
+static struct dns_cache_item_s cache[DNS_CACHE_SIZE];
+
+/* Counter used to find the least recently used item.  */
+static unsigned long use_counter;
+#endif /*USE_DNS_CACHE*/
+
+/* True if the cache is enabled.  */
+static int cache_enabled;
+
+/* The statistics.  */
+static struct dns_cache_stats_s stats;
+
+/* Functions called before and after a blocking resolver call.  */
+static void (*pre_query_hook) (void);
+static void (*post_query_hook) (void);
+
+
+
+#ifdef USE_DNS_CACHE
+static void
+release_item (struct dns_cache_item_s *item)
+{
+  xfree (item->name);
+  xfree (item->answer);
+  memset (item, 0, sizeof *item);
+}
+
+
+/* Return the 16 bit value at P.  */
+static unsigned int
+get16 (const unsigned char *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+
+/* Return the TTL as used by RFC-2181 from the 32 bit value at P.  */
+static unsigned long
+get_ttl (const unsigned char *p)
+{
+  u32 ttl = ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+
+  return (ttl & 0x80000000)? 0 : ttl;
+}
+
+
+/* Return the number of seconds the answer of length LEN may be
+   cached.  If NEGATIVE is set the answer is a negative one.  Returns
+   0 if the answer shall not be cached.  This function is only
+   exported for the regression test.  */
+unsigned long
+_dns_cache_answer_ttl (const unsigned char *answer, int len, int negative)
+{
+  const unsigned char *pt, *end;
+  unsigned int qdcount, ancount, nscount, idx, type, rdlen;
+  unsigned long ttl, result;
+  int n;
+
+  end = answer + len;
+  qdcount = get16 (answer + 4);
+  ancount = get16 (answer + 6);
+  nscount = get16 (answer + 8);
+  pt = answer + HFIXEDSZ;
+
+  for (idx=0; idx < qdcount; idx++)
+    {
+      n = dn_skipname (pt, end);
+      if (n < 0 || end - pt < n + QFIXEDSZ)
+        return 0;
+      pt += n + QFIXEDSZ;
+    }
+
+  result = negative? DNS_CACHE_NEG_TTL : DNS_CACHE_MAX_TTL;
+  for (idx=0; idx < ancount + nscount; idx++)
+    {
+      n = dn_skipname (pt, end);
+      if (n < 0 || end - pt < n + RRFIXEDSZ)
+        return 0;
+      pt += n;
+      type = get16 (pt);
+      ttl = get_ttl (pt + 4);
+      rdlen = get16 (pt + 8);
+      pt += RRFIXEDSZ;
+      if (end - pt < rdlen)
+        return 0;
+
+      if (!negative)
+        {
+          if (idx < ancount && ttl < result)
+            result = ttl;
+        }
+      else if (idx >= ancount && type == T_SOA && rdlen >= 20)
+        {
+          /* The negative TTL is the minimum of the TTL of the SOA
+             record and its MINIMUM field, which are the last 4
+             octets of its data.  */
+          result = get_ttl (pt + rdlen - 4);
+          if (ttl < result)
+            result = ttl;
+          break;
+        }
+      pt += rdlen;
+    }
+
+  return result > DNS_CACHE_MAX_TTL? DNS_CACHE_MAX_TTL : result;
+}
+
+
+/* Return the cache item for NAME, CLASS and TYPE or NULL.  Expired
+   items are released on the way.  */
+static struct dns_cache_item_s *
+find_item (const char *name, int class, int type, time_t now)
+{
+  struct dns_cache_item_s *item, *found = NULL;
+  int idx;
+
+  for (idx=0; idx < DIM (cache); idx++)
+    {
+      item = cache + idx;
+      if (!item->name)
+        continue;
+      if (item->expires <= now)
+        {
+          release_item (item);
+          stats.expired++;
+        }
+      else if (!found && item->class == class && item->type == type
+               && !ascii_strcasecmp (item->name, name))
+        found = item;
+    }
+  return found;
+}
+
+
+/* Store an answer for NAME, CLASS and TYPE in the cache, replacing
+   the least recently used item if the cache is full.  HERRNO is 0
+   for a positive answer.  Errors are ignored; the answer is then
+   just not cached.  */
+static void
+put_item (const char *name, int class, int type, int herrno,
+          const unsigned char *answer, int anslen, unsigned long ttl,
+          time_t now)
+{
+  struct dns_cache_item_s *item = NULL;
+  int idx;
+
+  /* Another thread may have stored an answer for the same query
+     while we were waiting for ours; replace that one.  */
+  for (idx=0; idx < DIM (cache); idx++)
+    if (cache[idx].name && cache[idx].class == class
+        && cache[idx].type == type
+        && !ascii_strcasecmp (cache[idx].name, name))
+      {
+        item = cache + idx;
+        break;
+      }
+  if (!item)
+    {
+      for (idx=0; idx < DIM (cache); idx++)
+        {
+          if (!cache[idx].name)
+            {
+              item = cache + idx;
+              break;
+            }
+          if (!item || cache[idx].used < item->used)
+            item = cache + idx;
+        }
+    }
+  release_item (item);
+
+  item->name = xtrystrdup (name);
+  if (!item->name)
+    return;
+  if (!herrno)
+    {
+      item->answer = xtrymalloc (anslen);
+      if (!item->answer)
+        {
+          release_item (item);
+          return;
+        }
+      memcpy (item->answer, answer, anslen);
+      item->anslen = anslen;
+    }
+  item->class = class;
+  item->type = type;
+  item->herrno = herrno;
+  item->expires = now + ttl;
+  item->used = ++use_counter;
+}
+
+
+/* Send the query to the resolver and cache its answer.  The return
+   value and h_errno are those of res_query.  */
+static int
+query_and_store (const char *name, int class, int type,
+                 unsigned char *answer, int anslen, time_t now)
+{
+  unsigned char query[PACKETSZ];
+  unsigned long ttl;
+  int qlen, len, rcode, herrno;
+
+  if (!(_res.options & RES_INIT) && res_init ())
+    {
+      h_errno = NETDB_INTERNAL;
+      return -1;
+    }
+
+  qlen = res_mkquery (QUERY, name, class, type, NULL, 0, NULL,
+                      query, sizeof query);
+  if (qlen < 0)
+    {
+      h_errno = NO_RECOVERY;
+      return -1;
+    }
+
+  if (pre_query_hook)
+    pre_query_hook ();
+  len = res_send (query, qlen, answer, anslen);
+  if (post_query_hook)
+    post_query_hook ();
+  if (len < 0)
+    {
+      h_errno = TRY_AGAIN;
+      return -1;
+    }
+  if (len < HFIXEDSZ)
+    {
+      h_errno = NO_RECOVERY;
+      return -1;
+    }
+
+  rcode = answer[3] & 0x0f;
+  if (rcode == NXDOMAIN || (rcode == NOERROR && !get16 (answer + 6)))
+    {
+      herrno = rcode == NXDOMAIN? HOST_NOT_FOUND : NO_DATA;
+      if (len <= anslen)
+        {
+          ttl = _dns_cache_answer_ttl (answer, len, 1);
+          if (ttl)
+            put_item (name, class, type, herrno, NULL, 0, ttl, now);
+        }
+      h_errno = herrno;
+      return -1;
+    }
+  if (rcode != NOERROR)
+    {
+      h_errno = rcode == SERVFAIL? TRY_AGAIN : NO_RECOVERY;
+      return -1;
+    }
+
+  /* Truncated answers are passed on but not cached.  */
+  if (len <= anslen && len <= DNS_CACHE_MAX_ANSWER
+      && !(answer[2] & 0x02))
+    {
+      ttl = _dns_cache_answer_ttl (answer, len, 0);
+      if (ttl)
+        put_item (name, class, type, 0, answer, len, ttl, now);
+    }
+  return len;
+}
+#endif /*USE_DNS_CACHE*/
+
+
+/* Enable the cache if ENABLE is true or disable and flush it.  */
+void
+dns_cache_enable (int enable)
+{
+  if (!enable)
+    dns_cache_flush ();
+  cache_enabled = !!enable;
+}
+
+
+/* Register the functions PRE_QUERY and POST_QUERY which are called
+   before and after the resolver may block.  Either may be NULL.  */
+void
+dns_cache_set_query_hooks (void (*pre_query) (void),
+                           void (*post_query) (void))
+{
+  pre_query_hook = pre_query;
+  post_query_hook = post_query;
+}
+
+
+/* Remove all items from the cache.  */
+void
+dns_cache_flush (void)
+{
+#ifdef USE_DNS_CACHE
+  int idx;
+
+  for (idx=0; idx < DIM (cache); idx++)
+    release_item (cache + idx);
+#endif /*USE_DNS_CACHE*/
+}
+
+
+/* Store the current statistics at STATS.  */
+void
+dns_cache_get_stats (struct dns_cache_stats_s *r_stats)
+{
+#ifdef USE_DNS_CACHE
+  time_t now = time (NULL);
+  int idx;
+#endif /*USE_DNS_CACHE*/
+
+  *r_stats = stats;
+  r_stats->size = 0;
+  r_stats->entries = 0;
+#ifdef USE_DNS_CACHE
+  if (cache_enabled)
+    r_stats->size = DNS_CACHE_SIZE;
+  for (idx=0; idx < DIM (cache); idx++)
+    if (cache[idx].name && cache[idx].expires > now)
+      r_stats->entries++;
+#endif /*USE_DNS_CACHE*/
+}
+
+
+#ifdef USE_DNS_CACHE
+/* A replacement for res_query which takes the answer from the cache
+   if possible.  The arguments, the return value and h_errno are the
+   same as for res_query.  */
+int
+dns_cache_query (const char *name, int class, int type,
+                 unsigned char *answer, int anslen)
+{
+  struct dns_cache_item_s *item;
+  time_t now;
+
+  if (!cache_enabled)
+    {
+      int len;
+
+      if (pre_query_hook)
+        pre_query_hook ();
+      len = res_query (name, class, type, answer, anslen);
+      if (post_query_hook)
+        post_query_hook ();
+      return len;
+    }
+
+  now = time (NULL);
+  item = find_item (name, class, type, now);
+  if (!item)
+    {
+      stats.misses++;
+      return query_and_store (name, class, type, answer, anslen, now);
+    }
+
+  item->used = ++use_counter;
+  if (item->herrno)
+    {
+      stats.neghits++;
+      h_errno = item->herrno;
+      return -1;
+    }
+  stats.hits++;
+  memcpy (answer, item->answer,
+          item->anslen < anslen? item->anslen : anslen);
+  return item->anslen;
+}
+#endif /*USE_DNS_CACHE*/
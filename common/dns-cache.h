@@ -0,0 +1,56 @@
+/* dns-cache.h - A cache for DNS answers
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GNUPG_COMMON_DNS_CACHE_H
+#define GNUPG_COMMON_DNS_CACHE_H
+
+/* Statistics of the DNS cache.  */
+struct dns_cache_stats_s
+{
+  unsigned int size;        /* Number of slots in the cache.  */
+  unsigned int entries;     /* Number of valid entries.  */
+  unsigned long hits;       /* Positive answers taken from the cache.  */
+  unsigned long neghits;    /* Negative answers taken from the cache.  */
+  unsigned long misses;     /* Queries sent to the resolver.  */
+  unsigned long expired;    /* Entries dropped due to their TTL.  */
+};
+
+void dns_cache_enable (int enable);
+void dns_cache_set_query_hooks (void (*pre_query) (void),
+                                void (*post_query) (void));
+void dns_cache_flush (void);
+void dns_cache_get_stats (struct dns_cache_stats_s *stats);
+int dns_cache_query (const char *name, int class, int type,
+                     unsigned char *answer, int anslen);
+
+/* Internal; only exported for the regression test.  */
+unsigned long _dns_cache_answer_ttl (const unsigned char *answer, int len,
+                                     int negative);
+
+#endif /*GNUPG_COMMON_DNS_CACHE_H*/
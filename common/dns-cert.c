@@ -48,6 +48,7 @@
 
 #include "util.h"
 #include "dns-cert.h"
+#include "dns-cache.h"
 
 /* Not every installation has gotten around to supporting CERTs
    yet... */
@@ -215,7 +216,7 @@ get_dns_cert (const char *name, estream_t *r_key,
 
   err = gpg_err_make (default_errsource, GPG_ERR_NOT_FOUND);
 
-  r = res_query (name, C_IN, T_CERT, answer, 65536);
+  r = dns_cache_query (name, C_IN, T_CERT, answer, 65536);
   /* Not too big, not too small, no errors and at least 1 answer. */
   if (r >= sizeof (HEADER) && r <= 65536
       && (((HEADER *) answer)->rcode) == NOERROR
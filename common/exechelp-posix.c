@@ -64,6 +64,37 @@
 # include <sys/stat.h>
 #endif
 
+#include <dirent.h>
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+#ifdef HAVE_SPAWN_H
+# include <spawn.h>
+#endif
+
+/* Use close_range(2) if available.  On Linux we use the system call
+   directly because only recent versions of the libc provide a
+   wrapper.  */
+#if defined(__linux__) && defined(SYS_close_range)
+# define USE_CLOSE_RANGE 1
+# define my_close_range(a,b) \
+   syscall (SYS_close_range, (unsigned int)(a), (unsigned int)(b), 0)
+#elif defined(HAVE_CLOSE_RANGE)
+# define USE_CLOSE_RANGE 1
+# define my_close_range(a,b) close_range ((a), (b), 0)
+#endif
+
+/* We can use posix_spawn only if we are able to close all unused file
+   descriptors in the child.  */
+#if defined(HAVE_SPAWN_H) && defined(HAVE_POSIX_SPAWN) \
+    && defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP)
+# define USE_POSIX_SPAWN 1
+extern char **environ;
+#endif
+
+/* The directory listing the open file descriptors of the process.  */
+#define FD_DIRECTORY "/proc/self/fd"
+
 #include "util.h"
 #include "i18n.h"
 #include "sysutils.h"
@@ -118,6 +149,57 @@ get_max_fds (void)
 }
 
 
+/* Helper for close_all_fds to avoid a close call for each possible
+   file descriptor.  Either close_range is used for the ranges between
+   the EXCEPT entries or only the descriptors listed in FD_DIRECTORY
+   are closed.  Returns 0 on success or -1 if neither works.  */
+static int
+close_fds_fast (int first, int *except)
+{
+  DIR *dir;
+  struct dirent *de;
+  int fd, dfd, i;
+  char *endp;
+
+#ifdef USE_CLOSE_RANGE
+  fd = first;
+  if (except)
+    for (i=0; except[i] != -1; i++)
+      {
+        if (except[i] < fd)
+          continue;
+        if (except[i] > fd && my_close_range (fd, except[i] - 1))
+          goto no_close_range;
+        fd = except[i] + 1;
+      }
+  if (!my_close_range (fd, ~0U))
+    return 0;
+ no_close_range:
+#endif /*USE_CLOSE_RANGE*/
+
+  dir = opendir (FD_DIRECTORY);
+  if (!dir)
+    return -1;
+  dfd = dirfd (dir);
+  while ((de = readdir (dir)))
+    {
+      fd = strtol (de->d_name, &endp, 10);
+      if (*endp || endp == de->d_name || fd < first || fd == dfd)
+        continue;
+      if (except)
+        {
+          for (i=0; except[i] != -1 && except[i] != fd; i++)
+            ;
+          if (except[i] != -1)
+            continue;
+        }
+      close (fd);
+    }
+  closedir (dir);
+  return 0;
+}
+
+
 /* Close all file descriptors starting with descriptor FIRST.  If
    EXCEPT is not NULL, it is expected to be a list of file descriptors
    which shall not be closed.  This list shall be sorted in ascending
@@ -125,9 +207,16 @@ get_max_fds (void)
 void
 close_all_fds (int first, int *except)
 {
-  int max_fd = get_max_fds ();
+  int max_fd;
   int fd, i, except_start;
 
+  if (!close_fds_fast (first, except))
+    {
+      gpg_err_set_errno (0);
+      return;
+    }
+
+  max_fd = get_max_fds ();
   if (except)
     {
       except_start = 0;
@@ -158,6 +247,44 @@ close_all_fds (int first, int *except)
 }
 
 
+#ifdef HAVE_STAT
+/* Helper for get_all_open_fds to store FD at index IDX of *ARRAY
+   which has a size of *NARRAY.  Room for the terminating -1 is kept.
+   On error *ARRAY is released and -1 returned.  */
+static int
+append_fd (int **array, size_t *narray, int idx, int fd)
+{
+  if (idx+1 >= *narray)
+    {
+      int *tmp;
+
+      *narray += (*narray < 256)? 32:256;
+      tmp = realloc (*array, *narray * sizeof **array);
+      if (!tmp)
+        {
+          free (*array);
+          *array = NULL;
+          return -1;
+        }
+      *array = tmp;
+    }
+  (*array)[idx] = fd;
+  return 0;
+}
+
+
+/* qsort helper for get_all_open_fds.  */
+static int
+compare_fds (const void *a, const void *b)
+{
+  int fda = *(const int *)a;
+  int fdb = *(const int *)b;
+
+  return fda < fdb? -1 : fda > fdb;
+}
+#endif /*HAVE_STAT*/
+
+
 /* Returns an array with all currently open file descriptors.  The end
    of the array is marked by -1.  The caller needs to release this
    array using the *standard free* and not with xfree.  This allow the
@@ -176,31 +303,46 @@ get_all_open_fds (void)
     array[0] = -1;
 #else /*HAVE_STAT*/
   struct stat statbuf;
+  DIR *dir;
+  struct dirent *de;
+  char *endp;
 
-  max_fd = get_max_fds ();
   narray = 32;  /* If you change this change also t-exechelp.c.  */
   array = calloc (narray, sizeof *array);
   if (!array)
     return NULL;
 
+  /* Checking all possible descriptors may take long if the limit is
+     high; thus we first try to read the list of open descriptors.  */
+  dir = opendir (FD_DIRECTORY);
+  if (dir)
+    {
+      int dfd = dirfd (dir);
+
+      for (idx=0; (de = readdir (dir)); )
+        {
+          fd = strtol (de->d_name, &endp, 10);
+          if (*endp || endp == de->d_name || fd == dfd)
+            continue;
+          if (append_fd (&array, &narray, idx++, fd))
+            {
+              closedir (dir);
+              return NULL;
+            }
+        }
+      closedir (dir);
+      qsort (array, idx, sizeof *array, compare_fds);
+      array[idx] = -1;
+      return array;
+    }
+
   /* Note:  The list we return is ordered.  */
+  max_fd = get_max_fds ();
   for (idx=0, fd=0; fd < max_fd; fd++)
     if (!(fstat (fd, &statbuf) == -1 && errno == EBADF))
       {
-        if (idx+1 >= narray)
-          {
-            int *tmp;
-
-            narray += (narray < 256)? 32:256;
-            tmp = realloc (array, narray * sizeof *array);
-            if (!tmp)
-              {
-                free (array);
-                return NULL;
-              }
-            array = tmp;
-          }
-        array[idx++] = fd;
+        if (append_fd (&array, &narray, idx++, fd))
+          return NULL;
       }
   array[idx] = -1;
 #endif /*HAVE_STAT*/
@@ -268,6 +410,76 @@ do_exec (const char *pgmname, const char *argv[],
 }
 
 
+#ifdef USE_POSIX_SPAWN
+/* Start PGMNAME with the same setup of the file descriptors as done
+   by do_exec but using posix_spawn.  This avoids the copying of the
+   page tables done by fork, which is expensive for large processes,
+   and the new process does not see a copy of our memory.  On success
+   the process id is stored at R_PID.  Errors in executing PGMNAME
+   are also returned.  */
+static gpg_error_t
+do_spawn (const char *pgmname, const char *argv[],
+          int fd_in, int fd_out, int fd_err, pid_t *r_pid)
+{
+  posix_spawn_file_actions_t actions;
+  const char **arg_list;
+  const char *p;
+  int fds[3];
+  int i, j, rc;
+
+  fds[0] = fd_in;
+  fds[1] = fd_out;
+  fds[2] = fd_err;
+
+  /* Create the command line argument array.  */
+  i = 0;
+  if (argv)
+    while (argv[i])
+      i++;
+  arg_list = xtrycalloc (i+2, sizeof *arg_list);
+  if (!arg_list)
+    return gpg_error_from_syserror ();
+  p = strrchr (pgmname, '/');
+  arg_list[0] = p? p+1 : pgmname;
+  if (argv)
+    for (i=0,j=1; argv[i]; i++, j++)
+      arg_list[j] = argv[i];
+
+  rc = posix_spawn_file_actions_init (&actions);
+  if (rc)
+    {
+      xfree (arg_list);
+      return gpg_error_from_errno (rc);
+    }
+
+  /* Connect the standard files; unused ones to /dev/null.  All other
+     files are closed.  */
+  for (i=0; !rc && i <= 2; i++)
+    if (fds[i] != -1 && fds[i] != i)
+      rc = posix_spawn_file_actions_adddup2 (&actions, fds[i], i);
+  for (i=0; !rc && i <= 2; i++)
+    if (fds[i] == -1)
+      rc = posix_spawn_file_actions_addopen (&actions, i, "/dev/null",
+                                             i? O_WRONLY : O_RDONLY, 0);
+  if (!rc)
+    rc = posix_spawn_file_actions_addclosefrom_np (&actions, 3);
+
+  if (!rc)
+    rc = posix_spawn (r_pid, pgmname, &actions, NULL,
+                      (char **)arg_list, environ);
+
+  posix_spawn_file_actions_destroy (&actions);
+  xfree (arg_list);
+  if (rc)
+    {
+      *r_pid = (pid_t)(-1);
+      return gpg_error_from_errno (rc);
+    }
+  return 0;
+}
+#endif /*USE_POSIX_SPAWN*/
+
+
 static gpg_error_t
 do_create_pipe (int filedes[2])
 {
@@ -389,10 +601,18 @@ gnupg_spawn_process (const char *pgmname, const char *argv[],
     }
 
 
-  *pid = fork ();
-  if (*pid == (pid_t)(-1))
+#ifdef USE_POSIX_SPAWN
+  if (!preexec)
+    err = do_spawn (pgmname, argv, infd, outpipe[1], errpipe[1], pid);
+  else
+#endif /*USE_POSIX_SPAWN*/
     {
-      err = gpg_err_make (errsource, gpg_err_code_from_syserror ());
+      *pid = fork ();
+      err = *pid == (pid_t)(-1)? gpg_error_from_syserror () : 0;
+    }
+  if (err)
+    {
+      err = gpg_err_make (errsource, gpg_err_code (err));
       log_error (_("error forking process: %s\n"), gpg_strerror (err));
 
       if (outfp)
@@ -451,6 +671,12 @@ gnupg_spawn_process_fd (const char *pgmname, const char *argv[],
 {
   gpg_error_t err;
 
+#ifdef USE_POSIX_SPAWN
+  err = do_spawn (pgmname, argv, infd, outfd, errfd, pid);
+  if (err)
+    log_error (_("error forking process: %s\n"), gpg_strerror (err));
+  return err;
+#else /*!USE_POSIX_SPAWN*/
   *pid = fork ();
   if (*pid == (pid_t)(-1))
     {
@@ -468,6 +694,7 @@ gnupg_spawn_process_fd (const char *pgmname, const char *argv[],
     }
 
   return 0;
+#endif /*!USE_POSIX_SPAWN*/
 }
 
 
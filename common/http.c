@@ -182,7 +182,8 @@ static gpg_error_t parse_response (http_t hd);
 
 static int connect_server (const char *server, unsigned short port,
                            unsigned int flags, const char *srvtag,
-                           int *r_host_not_found);
+                           int *r_host_not_found,
+                           struct http_timing_s *timing);
 static gpg_error_t write_server (int sock, const char *data, size_t length);
 
 static ssize_t cookie_read (void *cookie, void *buffer, size_t size);
@@ -276,6 +277,7 @@ struct http_context_s
   size_t buffer_size;
   unsigned int flags;
   header_t headers;      /* Received headers. */
+  struct http_timing_s timing;  /* Time spent in the phases of the request. */
 };
 
 
@@ -412,6 +414,22 @@ my_npth_write (gnutls_transport_ptr_t ptr, const void *buffer, size_t size)
 #endif /*USE_NPTH && HTTP_USE_GNUTLS*/
 
 
+/* Return a time stamp in milliseconds.  This is only used to compute
+   the durations returned by http_get_timing.  */
+static unsigned long
+get_msec (void)
+{
+#ifdef HAVE_W32_SYSTEM
+  return GetTickCount ();
+#else
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (unsigned long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+
 
 
 /* This notification function is called by estream whenever stream is
@@ -754,7 +772,8 @@ http_raw_connect (http_t *r_hd, const char *server, unsigned short port,
   hd->flags = flags;
 
   /* Connect.  */
-  sock = connect_server (server, port, hd->flags, srvtag, &hnf);
+  sock = connect_server (server, port, hd->flags, srvtag, &hnf,
+                         &hd->timing);
   if (sock == -1)
     {
       err = gpg_err_make (default_errsource,
@@ -849,9 +868,11 @@ http_wait_response (http_t hd)
 {
   gpg_error_t err;
   cookie_t cookie;
+  unsigned long starttime;
 
   /* Make sure that we are in the data. */
   http_start_data (hd);
+  starttime = get_msec ();
 
   /* Close the write stream.  Note that the reference counted socket
      object keeps the actual system socket open.  */
@@ -892,6 +913,7 @@ http_wait_response (http_t hd)
     }
 
   err = parse_response (hd);
+  hd->timing.firstbyte += get_msec () - starttime;
 
   if (!err)
     err = es_onclose (hd->fp_read, 1, fp_onclose_notification, hd);
@@ -994,6 +1016,18 @@ http_get_tls_info (http_t hd, const char *what)
 }
 
 
+/* Store the time in milliseconds spent in the phases of the request
+   at R_TIMING.  Phases not yet done or not applicable are zero.  */
+void
+http_get_timing (http_t hd, struct http_timing_s *r_timing)
+{
+  if (hd)
+    *r_timing = hd->timing;
+  else
+    memset (r_timing, 0, sizeof *r_timing);
+}
+
+
 
 static gpg_error_t
 parse_uri (parsed_uri_t *ret_uri, const char *uri,
@@ -1409,6 +1443,7 @@ send_request (http_t hd, const char *httphost, const char *auth,
   char *authstr = NULL;
   int sock;
   int hnf;
+  unsigned long starttime;
 
   if (hd->uri->use_tls && !hd->session)
     {
@@ -1496,7 +1531,7 @@ send_request (http_t hd, const char *httphost, const char *auth,
 
       sock = connect_server (*uri->host ? uri->host : "localhost",
                              uri->port ? uri->port : 80,
-                             hd->flags, srvtag, &hnf);
+                             hd->flags, srvtag, &hnf, &hd->timing);
       save_errno = errno;
       http_release_parsed_uri (uri);
       if (sock == -1)
@@ -1504,7 +1539,8 @@ send_request (http_t hd, const char *httphost, const char *auth,
     }
   else
     {
-      sock = connect_server (server, port, hd->flags, srvtag, &hnf);
+      sock = connect_server (server, port, hd->flags, srvtag, &hnf,
+                             &hd->timing);
     }
 
   if (sock == -1)
@@ -1523,6 +1559,7 @@ send_request (http_t hd, const char *httphost, const char *auth,
 
 
 
+  starttime = get_msec ();
 #if HTTP_USE_NTBTLS
   if (hd->uri->use_tls)
     {
@@ -1593,6 +1630,7 @@ send_request (http_t hd, const char *httphost, const char *auth,
         }
     }
 #endif /*HTTP_USE_GNUTLS*/
+  hd->timing.tls += get_msec () - starttime;
 
   if (auth || hd->uri->auth)
     {
@@ -2107,11 +2145,15 @@ start_server ()
 #endif
 
 /* Actually connect to a server.  Returns the file descriptor or -1 on
-   error.  ERRNO is set on error. */
+   error.  ERRNO is set on error.  If TIMING is not NULL the time spent
+   in name lookups and in connecting is added to it.  */
 static int
 connect_server (const char *server, unsigned short port,
-                unsigned int flags, const char *srvtag, int *r_host_not_found)
+                unsigned int flags, const char *srvtag, int *r_host_not_found,
+                struct http_timing_s *timing)
 {
+  struct http_timing_s dummy;
+  unsigned long starttime;
   int sock = -1;
   int srvcount = 0;
   int hostfound = 0;
@@ -2123,6 +2165,8 @@ connect_server (const char *server, unsigned short port,
 #endif
 
   *r_host_not_found = 0;
+  if (!timing)
+    timing = &dummy;
 #ifdef HAVE_W32_SYSTEM
 
 #ifndef HTTP_NO_WSASTARTUP
@@ -2148,8 +2192,12 @@ connect_server (const char *server, unsigned short port,
       addr.sin_port = htons(port);
       memcpy (&addr.sin_addr,&inaddr,sizeof(inaddr));
 
+      starttime = get_msec ();
       if (!my_connect (sock,(struct sockaddr *)&addr,sizeof(addr)) )
-	return sock;
+        {
+          timing->connect += get_msec () - starttime;
+          return sock;
+        }
       sock_close(sock);
       return -1;
     }
@@ -2166,7 +2214,9 @@ connect_server (const char *server, unsigned short port,
 
 	  stpcpy (stpcpy (stpcpy (stpcpy (srvname,"_"), srvtag),
                            "._tcp."), server);
+          starttime = get_msec ();
 	  srvcount = getsrv (srvname, &serverlist);
+          timing->dns += get_msec () - starttime;
 	}
     }
 #else
@@ -2197,8 +2247,13 @@ connect_server (const char *server, unsigned short port,
       snprintf (portstr, sizeof portstr, "%hu", port);
       memset (&hints, 0, sizeof (hints));
       hints.ai_socktype = SOCK_STREAM;
+      starttime = get_msec ();
       if (getaddrinfo (serverlist[srv].target, portstr, &hints, &res))
-        continue; /* Not found - try next one. */
+        {
+          timing->dns += get_msec () - starttime;
+          continue; /* Not found - try next one. */
+        }
+      timing->dns += get_msec () - starttime;
       hostfound = 1;
 
       for (ai = res; ai && !connected; ai = ai->ai_next)
@@ -2221,10 +2276,12 @@ connect_server (const char *server, unsigned short port,
               return -1;
             }
 
+          starttime = get_msec ();
           if (my_connect (sock, ai->ai_addr, ai->ai_addrlen))
             last_errno = errno;
           else
             connected = 1;
+          timing->connect += get_msec () - starttime;
         }
       freeaddrinfo (res);
     }
@@ -2239,7 +2296,9 @@ connect_server (const char *server, unsigned short port,
       /* Note: This code is not thread-safe.  */
 
       memset (&addr, 0, sizeof (addr));
+      starttime = get_msec ();
       host = gethostbyname (serverlist[srv].target);
+      timing->dns += get_msec () - starttime;
       if (!host)
         continue;
       hostfound = 1;
@@ -2275,13 +2334,14 @@ connect_server (const char *server, unsigned short port,
       for (i = 0; host->h_addr_list[i] && !connected; i++)
         {
           memcpy (&addr.sin_addr, host->h_addr_list[i], host->h_length);
+          starttime = get_msec ();
           if (my_connect (sock, (struct sockaddr *) &addr, sizeof (addr)))
             last_errno = errno;
           else
-            {
-              connected = 1;
-              break;
-            }
+            connected = 1;
+          timing->connect += get_msec () - starttime;
+          if (connected)
+            break;
         }
     }
 #endif /* !HAVE_GETADDRINFO */
@@ -89,6 +89,15 @@ typedef struct http_session_s *http_session_t;
 struct http_context_s;
 typedef struct http_context_s *http_t;
 
+/* The time in milliseconds spent in the phases of a request.  */
+struct http_timing_s
+{
+  unsigned long dns;        /* Resolving the server name.  */
+  unsigned long connect;    /* Connecting the socket.  */
+  unsigned long tls;        /* TLS handshake and verification.  */
+  unsigned long firstbyte;  /* Waiting for and reading the response header. */
+};
+
 void http_register_tls_callback (gpg_error_t (*cb)(http_t,http_session_t,int));
 void http_register_tls_ca (const char *fname);
 
@@ -141,6 +150,7 @@ estream_t http_get_read_ptr (http_t hd);
 estream_t http_get_write_ptr (http_t hd);
 unsigned int http_get_status_code (http_t hd);
 const char *http_get_tls_info (http_t hd, const char *what);
+void http_get_timing (http_t hd, struct http_timing_s *r_timing);
 const char *http_get_header (http_t hd, const char *name);
 const char **http_get_header_names (http_t hd);
 gpg_error_t http_verify_server_credentials (http_session_t sess);
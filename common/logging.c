@@ -38,6 +38,9 @@
 #include <stddef.h>
 #include <errno.h>
 #include <time.h>
+#ifdef HAVE_GETTIMEOFDAY
+# include <sys/time.h>
+#endif
 #include <sys/types.h>
 #include <sys/stat.h>
 #ifdef HAVE_W32_SYSTEM
@@ -891,29 +894,33 @@ is found in sexputils.c
 */
 
 
+/* Print STRING prefixed with the microseconds elapsed since the first
+   call.  If STRING is NULL only the reference time is set; this may be
+   used to start the clock early in main.  */
 void
 log_clock (const char *string)
 {
-#if 0
+#if defined(HAVE_GETTIMEOFDAY) && !defined(HAVE_W32_SYSTEM)
   static unsigned long long initial;
-  struct timespec tv;
+  struct timeval tv;
   unsigned long long now;
 
-  if (clock_gettime (CLOCK_REALTIME, &tv))
+  if (gettimeofday (&tv, NULL))
     {
-      log_debug ("error getting the realtime clock value\n");
+      log_debug ("error getting the clock value\n");
       return;
     }
-  now = tv.tv_sec * 1000000000ull;
-  now += tv.tv_nsec;
+  now = tv.tv_sec * 1000000ull;
+  now += tv.tv_usec;
 
   if (!initial)
     initial = now;
 
-  log_debug ("[%6llu] %s", (now - initial)/1000, string);
+  if (string)
+    log_debug ("[%6llu] %s\n", now - initial, string);
 #else
-  /* You need to link with -ltr to enable the above code.  */
-  log_debug ("[not enabled in the source] %s", string);
+  if (string)
+    log_debug ("[not enabled in the source] %s\n", string);
 #endif
 }
 
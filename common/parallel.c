@@ -0,0 +1,547 @@
+/* parallel.c - Run jobs and filters on worker threads
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This module is used by otherwise single threaded programs like gpg
+   and gpgsm to spread CPU bound work over several cores.  Thus unlike
+   other modules we do not disable nPth if WITHOUT_NPTH is defined but
+   merely take care of initializing it on first use.  Such programs
+   do not know about nPth and thus their threads run without holding
+   the nPth lock; this module takes the lock only for calling nPth
+   functions.  Programs using nPth run their threads while holding
+   the lock as usual.  */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_W32_SYSTEM
+# include <windows.h>
+#else
+# include <unistd.h>
+#endif
+#ifdef HAVE_NPTH
+# include <npth.h>
+#endif
+
+#include "util.h"
+#include "parallel.h"
+
+/* Do not use more threads than this even if more CPUs are online.  */
+#define MAX_THREADS 64
+
+/* The size of the ring buffer of a pipe filter.  */
+#define PIPE_BUFSIZE (256*1024)
+
+
+#ifdef HAVE_NPTH
+/* The state shared by the threads working on one gnupg_parallel_run
+   call.  */
+struct parallel_ctx_s
+{
+  gnupg_parallel_job_t func;
+  void *opaque;
+  unsigned int njobs;
+  unsigned int nextjob;  /* Index of the next job to be taken.  */
+};
+
+/* The context of a pipe filter.  */
+struct pipe_filter_ctx_s
+{
+  npth_mutex_t lock;
+  npth_cond_t cond;   /* Signaled on any change of the state below.  */
+  npth_t thread;
+  int started;        /* 1 = thread running, -1 = no thread,
+                         2 = stopped.  */
+  int use;            /* 1 = input stream, 2 = output stream.  */
+  iobuf_t chain;      /* The stream served by the thread.  */
+  byte *buffer;       /* The ring buffer.  */
+  size_t start;       /* Offset of the first byte in BUFFER.  */
+  size_t len;         /* Number of bytes in BUFFER.  */
+  int eof;            /* No more data will be put into BUFFER.  */
+  int stop;           /* The thread shall terminate.  */
+  int error;          /* The error code seen by the thread.  */
+};
+typedef struct pipe_filter_ctx_s *pipe_filter_ctx_t;
+
+# ifdef WITHOUT_NPTH
+/* Flag indicating that we called npth_init.  */
+static int npth_initialized;
+#  define LOCK_NPTH()   npth_protect ()
+#  define UNLOCK_NPTH() npth_unprotect ()
+# else
+#  define LOCK_NPTH()   do { } while (0)
+#  define UNLOCK_NPTH() do { } while (0)
+# endif
+#endif /*HAVE_NPTH*/
+
+
+#if defined(HAVE_NPTH) && defined(WITHOUT_NPTH)
+/* Initialize nPth on first use.  */
+static void
+init_npth (void)
+{
+  if (!npth_initialized)
+    {
+      npth_init ();
+      npth_initialized = 1;
+      UNLOCK_NPTH ();
+    }
+}
+#else
+# define init_npth() do { } while (0)
+#endif
+
+
+/* Return the number of threads to use for a requested number of
+   NTHREADS.  A value of 0 or less selects the number of online
+   CPUs.  */
+int
+gnupg_parallel_threads (int nthreads)
+{
+  if (nthreads > 0)
+    return nthreads > MAX_THREADS? MAX_THREADS : nthreads;
+
+#ifdef HAVE_W32_SYSTEM
+  {
+    SYSTEM_INFO si;
+
+    GetSystemInfo (&si);
+    nthreads = (int)si.dwNumberOfProcessors;
+  }
+#elif defined(_SC_NPROCESSORS_ONLN)
+  nthreads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+#else
+  nthreads = 1;
+#endif
+  if (nthreads < 1)
+    nthreads = 1;
+  else if (nthreads > MAX_THREADS)
+    nthreads = MAX_THREADS;
+  return nthreads;
+}
+
+
+#ifdef HAVE_NPTH
+/* The thread function.  Take jobs from CTX until all are done.  The
+   job counter is only accessed while holding the nPth lock; the job
+   itself runs with the lock released so that the jobs are actually
+   processed in parallel.  */
+static void *
+worker_thread (void *arg)
+{
+  struct parallel_ctx_s *ctx = arg;
+  unsigned int idx;
+
+  while ((idx = ctx->nextjob) < ctx->njobs)
+    {
+      ctx->nextjob++;
+      npth_unprotect ();
+      ctx->func (ctx->opaque, idx);
+      npth_protect ();
+    }
+  return NULL;
+}
+#endif /*HAVE_NPTH*/
+
+
+/* Call FUNC for each index in the range 0 to NJOBS-1 and return after
+   all jobs have been completed.  Up to NTHREADS threads are used; see
+   gnupg_parallel_threads for the meaning of that value.  The calling
+   thread takes part in the processing.  The order in which the jobs
+   are run is not defined and thus FUNC may only access data which
+   belongs to its own job.  FUNC may use Libgcrypt and the logging
+   functions but no other nPth functions; other I/O is only allowed on
+   objects not used by any other job.  If threads can't be created
+   the jobs are run in the calling thread.  */
+void
+gnupg_parallel_run (int nthreads, unsigned int njobs,
+                    gnupg_parallel_job_t func, void *opaque)
+{
+#ifdef HAVE_NPTH
+  struct parallel_ctx_s ctx;
+  npth_attr_t tattr;
+  npth_t *tids;
+  int i, ntids, err;
+#endif
+  unsigned int idx;
+
+  nthreads = gnupg_parallel_threads (nthreads);
+  if ((unsigned int)nthreads > njobs)
+    nthreads = njobs;
+
+#ifdef HAVE_NPTH
+  if (nthreads > 1)
+    {
+      init_npth ();
+
+      tids = xtrycalloc (nthreads - 1, sizeof *tids);
+      if (!tids)
+        {
+          log_error ("error allocating thread array: %s\n",
+                     gpg_strerror (gpg_error_from_syserror ()));
+          goto serial;
+        }
+
+      ctx.func = func;
+      ctx.opaque = opaque;
+      ctx.njobs = njobs;
+      ctx.nextjob = 0;
+
+      LOCK_NPTH ();
+      npth_attr_init (&tattr);
+      npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+      for (ntids = 0; ntids < nthreads - 1; ntids++)
+        {
+          err = npth_create (&tids[ntids], &tattr, worker_thread, &ctx);
+          if (err)
+            {
+              log_error ("error spawning worker thread: %s\n",
+                         strerror (err));
+              break;
+            }
+        }
+      npth_attr_destroy (&tattr);
+
+      worker_thread (&ctx);
+      for (i = 0; i < ntids; i++)
+        npth_join (tids[i], NULL);
+      UNLOCK_NPTH ();
+      xfree (tids);
+      return;
+    }
+
+ serial:
+#endif /*HAVE_NPTH*/
+  for (idx = 0; idx < njobs; idx++)
+    func (opaque, idx);
+}
+
+
+#ifdef HAVE_NPTH
+/* The thread of a pipe filter on an output stream.  It takes the
+   data from the ring buffer and writes it to the chained stream.  */
+static void *
+pipe_writer_thread (void *arg)
+{
+  pipe_filter_ctx_t ctx = arg;
+  byte *p;
+  size_t n;
+  int rc;
+
+  npth_mutex_lock (&ctx->lock);
+  for (;;)
+    {
+      while (!ctx->len && !ctx->eof && !ctx->stop)
+        npth_cond_wait (&ctx->cond, &ctx->lock);
+      if (!ctx->len || ctx->stop)
+        break;
+
+      p = ctx->buffer + ctx->start;
+      n = PIPE_BUFSIZE - ctx->start;
+      if (n > ctx->len)
+        n = ctx->len;
+      npth_mutex_unlock (&ctx->lock);
+      UNLOCK_NPTH ();
+      rc = iobuf_write (ctx->chain, p, n);
+      LOCK_NPTH ();
+      npth_mutex_lock (&ctx->lock);
+      if (rc)
+        {
+          ctx->error = rc;
+          ctx->stop = 1;
+        }
+      else
+        {
+          ctx->start = (ctx->start + n) % PIPE_BUFSIZE;
+          ctx->len -= n;
+        }
+      npth_cond_broadcast (&ctx->cond);
+    }
+  npth_mutex_unlock (&ctx->lock);
+  return NULL;
+}
+
+
+/* The thread of a pipe filter on an input stream.  It reads the data
+   from the chained stream into the ring buffer.  */
+static void *
+pipe_reader_thread (void *arg)
+{
+  pipe_filter_ctx_t ctx = arg;
+  byte *p;
+  size_t n;
+  int nread, err;
+
+  npth_mutex_lock (&ctx->lock);
+  for (;;)
+    {
+      while (ctx->len == PIPE_BUFSIZE && !ctx->stop)
+        npth_cond_wait (&ctx->cond, &ctx->lock);
+      if (ctx->stop)
+        break;
+
+      /* The free space is not accessed by the consumer; thus we can
+         fill it without holding the lock.  */
+      n = (ctx->start + ctx->len) % PIPE_BUFSIZE;
+      p = ctx->buffer + n;
+      n = (n < ctx->start? ctx->start : PIPE_BUFSIZE) - n;
+      npth_mutex_unlock (&ctx->lock);
+      UNLOCK_NPTH ();
+      nread = iobuf_read (ctx->chain, p, n);
+      err = nread == -1? iobuf_error (ctx->chain) : 0;
+      LOCK_NPTH ();
+      npth_mutex_lock (&ctx->lock);
+      if (nread == -1)
+        {
+          ctx->error = err;
+          ctx->eof = 1;
+          npth_cond_broadcast (&ctx->cond);
+          break;
+        }
+      ctx->len += nread;
+      npth_cond_broadcast (&ctx->cond);
+    }
+  npth_mutex_unlock (&ctx->lock);
+  return NULL;
+}
+
+
+/* Start the thread of the pipe filter CTX for the stream CHAIN.
+   FUNC is the thread function.  If the thread can't be created the
+   filter passes the data through.  */
+static void
+pipe_start (pipe_filter_ctx_t ctx, iobuf_t chain, void *(*func)(void*))
+{
+  npth_attr_t tattr;
+  int err;
+
+  ctx->chain = chain;
+  ctx->started = -1;
+  ctx->buffer = xtrymalloc (PIPE_BUFSIZE);
+  if (!ctx->buffer)
+    {
+      log_error ("error allocating pipe buffer: %s\n",
+                 gpg_strerror (gpg_error_from_syserror ()));
+      return;
+    }
+
+  init_npth ();
+  LOCK_NPTH ();
+  npth_mutex_init (&ctx->lock, NULL);
+  npth_cond_init (&ctx->cond, NULL);
+  npth_attr_init (&tattr);
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+  err = npth_create (&ctx->thread, &tattr, func, ctx);
+  npth_attr_destroy (&tattr);
+  if (err)
+    {
+      npth_cond_destroy (&ctx->cond);
+      npth_mutex_destroy (&ctx->lock);
+    }
+  else
+    ctx->started = 1;
+  UNLOCK_NPTH ();
+  if (err)
+    log_error ("error spawning pipe thread: %s\n", strerror (err));
+}
+
+
+/* Terminate the thread of the pipe filter CTX.  If CANCEL is set
+   buffered output is discarded.  Returns the error seen by the
+   thread.  The filter is then in the stopped state and won't touch
+   the chained stream again.  */
+static int
+pipe_stop (pipe_filter_ctx_t ctx, int cancel)
+{
+  if (ctx->started != 1)
+    {
+      ctx->started = 2;
+      return 0;
+    }
+
+  LOCK_NPTH ();
+  npth_mutex_lock (&ctx->lock);
+  ctx->eof = 1;
+  if (cancel)
+    ctx->stop = 1;
+  npth_cond_broadcast (&ctx->cond);
+  npth_mutex_unlock (&ctx->lock);
+  npth_join (ctx->thread, NULL);
+  npth_cond_destroy (&ctx->cond);
+  npth_mutex_destroy (&ctx->lock);
+  UNLOCK_NPTH ();
+  ctx->started = 2;
+  return ctx->error;
+}
+#endif /*HAVE_NPTH*/
+
+
+/* An iobuf filter which runs the filters below it in a separate
+   thread.  The two threads are decoupled by a ring buffer so that
+   the filters above and below this one are processed in parallel.
+   Use gnupg_parallel_push_pipe to push it.  */
+int
+gnupg_parallel_pipe_filter (void *opaque, int control,
+                            iobuf_t chain, byte *buf, size_t *ret_len)
+{
+#ifdef HAVE_NPTH
+  pipe_filter_ctx_t ctx = opaque;
+  size_t size = *ret_len;
+  size_t n, len;
+  int rc = 0;
+
+  if (control == IOBUFCTRL_FLUSH)
+    {
+      if (!ctx->started)
+        {
+          ctx->use = 2;
+          pipe_start (ctx, chain, pipe_writer_thread);
+        }
+      if (ctx->started == 2)
+        return 0;  /* Stopped; discard the data.  */
+      if (ctx->started != 1)
+        return iobuf_write (chain, buf, size);
+
+      LOCK_NPTH ();
+      npth_mutex_lock (&ctx->lock);
+      while (size)
+        {
+          while (ctx->len == PIPE_BUFSIZE && !ctx->stop)
+            npth_cond_wait (&ctx->cond, &ctx->lock);
+          if (ctx->stop)
+            {
+              rc = ctx->error;
+              break;
+            }
+          n = (ctx->start + ctx->len) % PIPE_BUFSIZE;
+          len = (n < ctx->start? ctx->start : PIPE_BUFSIZE) - n;
+          if (len > size)
+            len = size;
+          memcpy (ctx->buffer + n, buf, len);
+          buf += len;
+          size -= len;
+          ctx->len += len;
+          npth_cond_broadcast (&ctx->cond);
+        }
+      npth_mutex_unlock (&ctx->lock);
+      UNLOCK_NPTH ();
+    }
+  else if (control == IOBUFCTRL_UNDERFLOW)
+    {
+      if (!ctx->started)
+        {
+          ctx->use = 1;
+          pipe_start (ctx, chain, pipe_reader_thread);
+        }
+      if (ctx->started == 2)
+        {
+          *ret_len = 0;
+          return -1;  /* Stopped; act as eof.  */
+        }
+      if (ctx->started != 1)
+        {
+          rc = iobuf_read (chain, buf, size);
+          if (rc == -1)
+            {
+              *ret_len = 0;
+              return iobuf_error (chain)? iobuf_error (chain) : -1;
+            }
+          *ret_len = rc;
+          return 0;
+        }
+
+      LOCK_NPTH ();
+      npth_mutex_lock (&ctx->lock);
+      while (!ctx->len && !ctx->eof)
+        npth_cond_wait (&ctx->cond, &ctx->lock);
+      len = PIPE_BUFSIZE - ctx->start;
+      if (len > ctx->len)
+        len = ctx->len;
+      if (len > size)
+        len = size;
+      memcpy (buf, ctx->buffer + ctx->start, len);
+      ctx->start = (ctx->start + len) % PIPE_BUFSIZE;
+      ctx->len -= len;
+      if (!len)
+        rc = ctx->error? ctx->error : -1; /* eof */
+      npth_cond_broadcast (&ctx->cond);
+      npth_mutex_unlock (&ctx->lock);
+      UNLOCK_NPTH ();
+      *ret_len = len;
+    }
+  else if (control == IOBUFCTRL_CANCEL)
+    {
+      /* The filters below us are going to be canceled too; thus
+         stop the thread now.  The stopped state makes sure that a
+         later flush does not start a new thread.  */
+      pipe_stop (ctx, 1);
+    }
+  else if (control == IOBUFCTRL_FREE)
+    {
+      /* Output is written out but there is no need to wait for
+         input which won't be consumed anymore.  */
+      rc = pipe_stop (ctx, ctx->use == 1);
+      xfree (ctx->buffer);
+      xfree (ctx);
+    }
+  else if (control == IOBUFCTRL_DESC)
+    *(char**)buf = "pipe_filter";
+  return rc;
+#else /*!HAVE_NPTH*/
+  (void)opaque;
+  (void)control;
+  (void)chain;
+  (void)buf;
+  (void)ret_len;
+  return GPG_ERR_NOT_SUPPORTED;
+#endif /*!HAVE_NPTH*/
+}
+
+
+/* Push a pipe filter onto the stream A.  All filters already pushed
+   onto A will then be run in a separate thread.  Without thread
+   support this function does nothing.  */
+void
+gnupg_parallel_push_pipe (iobuf_t a)
+{
+#ifdef HAVE_NPTH
+  pipe_filter_ctx_t ctx;
+
+  ctx = xtrycalloc (1, sizeof *ctx);
+  if (!ctx)
+    {
+      log_error ("error allocating pipe filter: %s\n",
+                 gpg_strerror (gpg_error_from_syserror ()));
+      return;
+    }
+  iobuf_push_filter (a, gnupg_parallel_pipe_filter, ctx);
+#else
+  (void)a;
+#endif
+}
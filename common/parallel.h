@@ -0,0 +1,47 @@
+/* parallel.h - Run jobs and filters on worker threads
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GNUPG_COMMON_PARALLEL_H
+#define GNUPG_COMMON_PARALLEL_H
+
+#include "iobuf.h"
+
+/* The prototype of a job function.  OPAQUE is the value passed to
+   gnupg_parallel_run and IDX the index of the job to run.  */
+typedef void (*gnupg_parallel_job_t) (void *opaque, unsigned int idx);
+
+int gnupg_parallel_threads (int nthreads);
+void gnupg_parallel_run (int nthreads, unsigned int njobs,
+                         gnupg_parallel_job_t func, void *opaque);
+
+int gnupg_parallel_pipe_filter (void *opaque, int control,
+                                iobuf_t chain, byte *buf, size_t *ret_len);
+void gnupg_parallel_push_pipe (iobuf_t a);
+
+#endif /*GNUPG_COMMON_PARALLEL_H*/
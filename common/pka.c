@@ -52,6 +52,7 @@
 
 #include "util.h"
 #include "pka.h"
+#include "dns-cache.h"
 
 #ifdef USE_DNS_PKA
 /* Parse the TXT resource record. Format is:
@@ -202,7 +203,7 @@ get_pka_info (const char *address, unsigned char *fpr)
   memcpy (name, address, domain - address);
   strcpy (stpcpy (name + (domain-address), "._pka."), domain+1);
 
-  anslen = res_query (name, C_IN, T_TXT, answer, PACKETSZ);
+  anslen = dns_cache_query (name, C_IN, T_TXT, answer, PACKETSZ);
   xfree (name);
   if (anslen < sizeof(HEADER))
     return NULL; /* DNS resolver returned a too short answer. */
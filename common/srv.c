@@ -49,6 +49,7 @@
 
 #include "util.h"
 #include "srv.h"
+#include "dns-cache.h"
 
 /* Not every installation has gotten around to supporting SRVs
    yet... */
@@ -145,7 +146,7 @@ getsrv (const char *name,struct srventry **list)
     int r;
     u16 dlen;
 
-    r = res_query (name, C_IN, T_SRV, answer, sizeof answer);
+    r = dns_cache_query (name, C_IN, T_SRV, answer, sizeof answer);
     if (r < sizeof (HEADER) || r > sizeof answer)
       return -1;
     if (header->rcode != NOERROR || !(count=ntohs (header->ancount)))
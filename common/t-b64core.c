@@ -0,0 +1,190 @@
+/* t-b64core.c - Module test for b64core.c
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#define pass()  do { ; } while(0)
+#define fail(a)  do { fprintf (stderr, "%s:%d: test %d failed\n",\
+                               __FILE__,__LINE__, (a));          \
+                     errcount++;                                 \
+                   } while(0)
+
+#define MAXGROUPS 100
+
+static int errcount;
+
+static const char bintoasc[] = ("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                "abcdefghijklmnopqrstuvwxyz"
+                                "0123456789+/");
+
+
+/* A straightforward encoder to compare against.  */
+static void
+encode_ref (char *dst, const unsigned char *s, size_t ngroups)
+{
+  for (; ngroups; ngroups--, s += 3)
+    {
+      *dst++ = bintoasc[s[0] >> 2];
+      *dst++ = bintoasc[((s[0] << 4) & 0x30) | (s[1] >> 4)];
+      *dst++ = bintoasc[((s[1] << 2) & 0x3c) | (s[2] >> 6)];
+      *dst++ = bintoasc[s[2] & 0x3f];
+    }
+}
+
+
+static void
+test_vectors (void)
+{
+  static struct {
+    const char *data;
+    const char *expected;
+  } tests[] = {
+    { "", "" },
+    { "foo", "Zm9v" },
+    { "foobar", "Zm9vYmFy" },
+    { "\xfb\xff\xbf", "+/+/" },
+    { "\x00\x10\x83\x10\x51\x87\x20\x92\x8b\x30\xd3\x8f"
+      "\x41\x14\x93\x51\x55\x97\x61\x96\x9b\x71\xd7\x9f"
+      "\x82\x18\xa3\x92\x59\xa7\xa2\x9a\xab\xb2\xdb\xaf"
+      "\xc3\x1c\xb3\xd3\x5d\xb7\xe3\x9e\xbb\xf3\xdf\xbf",
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" }
+  };
+  char buffer[100];
+  int tidx;
+  size_t ngroups, n, used;
+
+  for (tidx = 0; tidx < DIM (tests); tidx++)
+    {
+      ngroups = strlen (tests[tidx].expected) / 4;
+      b64_encode_groups (buffer, tests[tidx].data, ngroups);
+      if (memcmp (buffer, tests[tidx].expected, 4 * ngroups))
+        fail (tidx);
+
+      n = b64_decode_groups (buffer, tests[tidx].expected, 4 * ngroups,
+                             &used);
+      if (n != 3 * ngroups || used != 4 * ngroups
+          || memcmp (buffer, tests[tidx].data, n))
+        fail (tidx);
+      else
+        pass ();
+    }
+}
+
+
+/* Check all lengths and alignments against the reference encoder and
+   decode the result back, in place and into a separate buffer.  */
+static void
+test_roundtrip (void)
+{
+  unsigned char data[3 * MAXGROUPS + 16];
+  char text[4 * MAXGROUPS + 32];
+  char expected[4 * MAXGROUPS];
+  unsigned char result[3 * MAXGROUPS + 32];
+  size_t i, ngroups, off, n, used;
+
+  for (i = 0; i < sizeof data; i++)
+    data[i] = (i * 97) ^ (i >> 3);
+
+  for (ngroups = 0; ngroups <= MAXGROUPS; ngroups++)
+    for (off = 0; off < 16; off++)
+      {
+        encode_ref (expected, data + off, ngroups);
+        b64_encode_groups (text + off, data + off, ngroups);
+        if (memcmp (text + off, expected, 4 * ngroups))
+          {
+            fail (1);
+            continue;
+          }
+
+        n = b64_decode_groups (result + off, text + off, 4 * ngroups, &used);
+        if (n != 3 * ngroups || used != 4 * ngroups
+            || memcmp (result + off, data + off, n))
+          fail (2);
+
+        n = b64_decode_groups (text + off, text + off, 4 * ngroups, &used);
+        if (n != 3 * ngroups || used != 4 * ngroups
+            || memcmp (text + off, data + off, n))
+          fail (3);
+      }
+}
+
+
+/* Put a character not in the alphabet at each position and check
+   that decoding stops at the group containing it.  */
+static void
+test_invalid (void)
+{
+  static const char badchars[] = "=\n\r \t-_.\x80\xff";
+  unsigned char data[3 * MAXGROUPS];
+  char text[4 * MAXGROUPS];
+  unsigned char result[3 * MAXGROUPS];
+  size_t i, pos, n, used;
+  const char *bad;
+
+  for (i = 0; i < sizeof data; i++)
+    data[i] = i * 131;
+  encode_ref (text, data, MAXGROUPS);
+
+  for (bad = badchars; *bad; bad++)
+    for (pos = 0; pos < sizeof text; pos++)
+      {
+        char save = text[pos];
+
+        text[pos] = *bad;
+        n = b64_decode_groups (result, text, sizeof text, &used);
+        if (used != pos / 4 * 4 || n != pos / 4 * 3
+            || memcmp (result, data, n))
+          fail (4);
+        text[pos] = save;
+      }
+
+  /* A trailing partial group is not used.  */
+  n = b64_decode_groups (result, text, 4 * MAXGROUPS - 1, &used);
+  if (used != 4 * (MAXGROUPS - 1) || n != 3 * (MAXGROUPS - 1))
+    fail (5);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  test_vectors ();
+  test_roundtrip ();
+  test_invalid ();
+
+  return !!errcount;
+}
@@ -0,0 +1,120 @@
+/* t-crc24.c - Module test for crc24.c
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#define pass()  do { ; } while(0)
+#define fail(a)  do { fprintf (stderr, "%s:%d: test %d failed\n",\
+                               __FILE__,__LINE__, (a));          \
+                     errcount++;                                 \
+                   } while(0)
+
+#define CRCINIT 0xB704CE
+#define CRCPOLY 0x864CFB
+
+static int errcount;
+
+
+/* A bit wise implementation as given in RFC-4880.  */
+static u32
+crc24_ref (u32 crc, const unsigned char *p, size_t len)
+{
+  int i;
+
+  while (len--)
+    {
+      crc ^= (u32)*p++ << 16;
+      for (i = 0; i < 8; i++)
+        {
+          crc <<= 1;
+          if (crc & 0x1000000)
+            crc ^= CRCPOLY;
+        }
+    }
+  return crc & 0xffffff;
+}
+
+
+static void
+test_vectors (void)
+{
+  if (crc24_update (CRCINIT, "", 0) != CRCINIT)
+    fail (1);
+  /* The check value from the CRC catalogue.  */
+  if (crc24_update (CRCINIT, "123456789", 9) != 0x21CF02)
+    fail (2);
+}
+
+
+/* Compare all lengths up to a few folding blocks, with various
+   alignments and split points, against the reference.  */
+static void
+test_random (void)
+{
+  unsigned char data[1100];
+  size_t i, len, off;
+  u32 crc, expected;
+
+  for (i = 0; i < sizeof data; i++)
+    data[i] = (i * 151) ^ (i >> 5);
+
+  for (len = 0; len <= 1024; len++)
+    for (off = 0; off < 16; off += 5)
+      {
+        expected = crc24_ref (CRCINIT, data + off, len);
+        crc = crc24_update (CRCINIT, data + off, len);
+        if (crc != expected)
+          fail (3);
+        crc = crc24_update (CRCINIT, data + off, len / 3);
+        crc = crc24_update (crc, data + off + len / 3, len - len / 3);
+        if (crc != expected)
+          fail (4);
+        else
+          pass ();
+      }
+}
+
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  test_vectors ();
+  test_random ();
+
+  return !!errcount;
+}
@@ -0,0 +1,258 @@
+/* t-dns-cache.c - Module test for dns-cache.c
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "dns-cache.h"
+
+#define pass()  do { ; } while(0)
+#define fail(a)  do { fprintf (stderr, "%s:%d: test %d failed\n",\
+                               __FILE__,__LINE__, (a));          \
+                     errcount++;                                 \
+                   } while(0)
+
+#if !defined(USE_ADNS) \
+    && (defined(USE_DNS_SRV) || defined(USE_DNS_CERT) || defined(USE_DNS_PKA))
+
+/* The RR types used by the tests.  */
+#define TYPE_SOA  6
+#define TYPE_CERT 37
+
+static int errcount;
+
+/* Buffer to build a DNS message.  */
+static unsigned char msg[512];
+static int msglen;
+
+
+static void
+put8 (unsigned int value)
+{
+  msg[msglen++] = value;
+}
+
+
+static void
+put16 (unsigned int value)
+{
+  put8 (value >> 8);
+  put8 (value);
+}
+
+
+static void
+put32 (unsigned long value)
+{
+  put16 (value >> 16);
+  put16 (value);
+}
+
+
+/* Start a message with a question for CERT records of "a.example"
+   which has ANCOUNT answer and NSCOUNT authority records.  */
+static void
+start_msg (int rcode, unsigned int ancount, unsigned int nscount)
+{
+  msglen = 0;
+  put16 (0x1234);          /* Id.  */
+  put16 (0x8180 | rcode);  /* Response, RD, RA.  */
+  put16 (1);               /* QDCOUNT.  */
+  put16 (ancount);
+  put16 (nscount);
+  put16 (0);               /* ARCOUNT.  */
+  put8 (1); put8 ('a');
+  put8 (7); memcpy (msg + msglen, "example", 7); msglen += 7;
+  put8 (0);
+  put16 (TYPE_CERT);
+  put16 (1);               /* Class IN.  */
+}
+
+
+/* Append a record of TYPE with TTL and RDLEN octets of data.  The
+   owner is a pointer to the name of the question.  */
+static void
+put_rr (unsigned int type, unsigned long ttl, unsigned int rdlen)
+{
+  put16 (0xc00c);
+  put16 (type);
+  put16 (1);
+  put32 (ttl);
+  put16 (rdlen);
+  memset (msg + msglen, 0, rdlen);
+  msglen += rdlen;
+}
+
+
+/* Append an SOA record with TTL and the MINIMUM field set to
+   MINIMUM.  */
+static void
+put_soa (unsigned long ttl, unsigned long minimum)
+{
+  put16 (0xc00c);
+  put16 (TYPE_SOA);
+  put16 (1);
+  put32 (ttl);
+  put16 (2 + 20);
+  put8 (0);                /* MNAME (the root).  */
+  put8 (0);                /* RNAME (the root).  */
+  put32 (1);               /* SERIAL.  */
+  put32 (7200);            /* REFRESH.  */
+  put32 (900);             /* RETRY.  */
+  put32 (86400);           /* EXPIRE.  */
+  put32 (minimum);
+}
+
+
+static void
+test_positive (void)
+{
+  /* The smallest TTL of the answers is used.  */
+  start_msg (0, 2, 0);
+  put_rr (TYPE_CERT, 300, 10);
+  put_rr (TYPE_CERT, 120, 4);
+  if (_dns_cache_answer_ttl (msg, msglen, 0) != 120)
+    fail (1);
+
+  /* Authority records do not count for a positive answer.  */
+  start_msg (0, 1, 1);
+  put_rr (TYPE_CERT, 300, 10);
+  put_soa (10, 10);
+  if (_dns_cache_answer_ttl (msg, msglen, 0) != 300)
+    fail (2);
+
+  /* The TTL is capped at one hour.  */
+  start_msg (0, 1, 0);
+  put_rr (TYPE_CERT, 86400, 10);
+  if (_dns_cache_answer_ttl (msg, msglen, 0) != 3600)
+    fail (3);
+
+  /* A TTL with the high bit set is taken as zero (RFC-2181).  */
+  start_msg (0, 2, 0);
+  put_rr (TYPE_CERT, 300, 10);
+  put_rr (TYPE_CERT, 0x80000000, 10);
+  if (_dns_cache_answer_ttl (msg, msglen, 0) != 0)
+    fail (4);
+}
+
+
+static void
+test_negative (void)
+{
+  /* The negative TTL is the MINIMUM field of the SOA ...  */
+  start_msg (3, 0, 1);
+  put_soa (900, 30);
+  if (_dns_cache_answer_ttl (msg, msglen, 1) != 30)
+    fail (1);
+
+  /* ... or the TTL of the SOA itself if that is smaller.  */
+  start_msg (0, 0, 1);
+  put_soa (20, 300);
+  if (_dns_cache_answer_ttl (msg, msglen, 1) != 20)
+    fail (2);
+
+  /* Both are capped.  */
+  start_msg (3, 0, 1);
+  put_soa (86400, 86400);
+  if (_dns_cache_answer_ttl (msg, msglen, 1) != 3600)
+    fail (3);
+
+  /* Without an SOA a default is used.  */
+  start_msg (3, 0, 0);
+  if (_dns_cache_answer_ttl (msg, msglen, 1) != 60)
+    fail (4);
+
+  /* An SOA which is too short is ignored.  */
+  start_msg (3, 0, 1);
+  put_rr (TYPE_SOA, 10, 8);
+  if (_dns_cache_answer_ttl (msg, msglen, 1) != 60)
+    fail (5);
+}
+
+
+static void
+test_malformed (void)
+{
+  /* Records cut short are not cached.  */
+  start_msg (0, 1, 0);
+  put_rr (TYPE_CERT, 300, 10);
+  if (_dns_cache_answer_ttl (msg, msglen - 1, 0) != 0)
+    fail (1);
+  if (_dns_cache_answer_ttl (msg, msglen - 14, 0) != 0)
+    fail (2);
+
+  start_msg (3, 0, 1);
+  put_soa (900, 30);
+  if (_dns_cache_answer_ttl (msg, msglen - 1, 1) != 0)
+    fail (3);
+
+  /* More records announced than present.  */
+  start_msg (0, 2, 0);
+  put_rr (TYPE_CERT, 300, 10);
+  if (_dns_cache_answer_ttl (msg, msglen, 0) != 0)
+    fail (4);
+
+  /* A truncated question.  */
+  start_msg (0, 0, 0);
+  if (_dns_cache_answer_ttl (msg, 15, 0) != 0)
+    fail (5);
+  else
+    pass ();
+}
+
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  test_positive ();
+  test_negative ();
+  test_malformed ();
+
+  return !!errcount;
+}
+
+#else /* The cache is not used in this configuration.  */
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  return 77; /* Skip.  */
+}
+
+#endif
@@ -0,0 +1,237 @@
+/* t-parallel.c - Module test for parallel.c
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either
+ *
+ *   - the GNU Lesser General Public License as published by the Free
+ *     Software Foundation; either version 3 of the License, or (at
+ *     your option) any later version.
+ *
+ * or
+ *
+ *   - the GNU General Public License as published by the Free
+ *     Software Foundation; either version 2 of the License, or (at
+ *     your option) any later version.
+ *
+ * or both in parallel, as here.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "iobuf.h"
+#include "parallel.h"
+
+#define pass()  do { ; } while(0)
+#define fail(a)  do { fprintf (stderr, "%s:%d: test %d failed\n",\
+                               __FILE__,__LINE__, (a));          \
+                     errcount++;                                 \
+                   } while(0)
+
+#define NJOBS 1000
+#define PIPE_DATALEN (3*256*1024 + 17)
+
+static int errcount;
+
+
+struct job_s
+{
+  int ncalls;
+  unsigned char digest[20];
+};
+
+
+static void
+run_job (void *opaque, unsigned int idx)
+{
+  struct job_s *jobs = opaque;
+  char buffer[32];
+
+  snprintf (buffer, sizeof buffer, "job %u", idx);
+  gcry_md_hash_buffer (GCRY_MD_SHA1, jobs[idx].digest,
+                       buffer, strlen (buffer));
+  jobs[idx].ncalls++;
+}
+
+
+static void
+test_parallel_run (int nthreads)
+{
+  struct job_s *jobs;
+  unsigned char digest[20];
+  char buffer[32];
+  unsigned int idx;
+
+  jobs = xcalloc (NJOBS, sizeof *jobs);
+  gnupg_parallel_run (nthreads, NJOBS, run_job, jobs);
+  for (idx = 0; idx < NJOBS; idx++)
+    {
+      snprintf (buffer, sizeof buffer, "job %u", idx);
+      gcry_md_hash_buffer (GCRY_MD_SHA1, digest, buffer, strlen (buffer));
+      if (jobs[idx].ncalls != 1)
+        fail (nthreads);
+      else if (memcmp (jobs[idx].digest, digest, 20))
+        fail (nthreads);
+      else
+        pass ();
+    }
+  xfree (jobs);
+
+  /* No jobs at all must also work.  */
+  gnupg_parallel_run (nthreads, 0, run_job, NULL);
+}
+
+
+/* Return the test data byte at offset OFF.  */
+static int
+pipe_data (size_t off)
+{
+  return (off * 7 + (off >> 11)) & 0xff;
+}
+
+
+static void
+test_pipe_write (void)
+{
+  iobuf_t out;
+  byte buffer[1000];
+  const byte *p;
+  size_t i, n, off;
+
+  out = iobuf_temp ();
+  gnupg_parallel_push_pipe (out);
+  for (off = 0; off < PIPE_DATALEN; off += n)
+    {
+      n = 1 + off % sizeof buffer;
+      if (n > PIPE_DATALEN - off)
+        n = PIPE_DATALEN - off;
+      for (i = 0; i < n; i++)
+        buffer[i] = pipe_data (off + i);
+      if (iobuf_write (out, buffer, n))
+        fail (1);
+    }
+  iobuf_flush_temp (out);
+
+  p = iobuf_get_temp_buffer (out);
+  if (iobuf_get_temp_length (out) != PIPE_DATALEN)
+    fail (1);
+  else
+    {
+      for (off = 0; off < PIPE_DATALEN; off++)
+        if (p[off] != pipe_data (off))
+          break;
+      if (off != PIPE_DATALEN)
+        fail (1);
+    }
+  iobuf_close (out);
+}
+
+
+/* After a cancel the pipe filter must not start a new thread nor
+   write anything more to the chained stream.  */
+static void
+test_pipe_cancel (void)
+{
+  iobuf_t out;
+  byte buffer[1000];
+  size_t dummy, off;
+
+  memset (buffer, 'x', sizeof buffer);
+  out = iobuf_temp ();
+  gnupg_parallel_push_pipe (out);
+  for (off = 0; off < PIPE_DATALEN; off += sizeof buffer)
+    if (iobuf_write (out, buffer, sizeof buffer))
+      fail (3);
+  out->filter (out->filter_ov, IOBUFCTRL_CANCEL, out->chain, NULL, &dummy);
+  for (off = 0; off < PIPE_DATALEN; off += sizeof buffer)
+    iobuf_write (out, buffer, sizeof buffer);
+  iobuf_flush_temp (out);
+
+  if (iobuf_get_temp_length (out) > off)
+    fail (3);
+  iobuf_close (out);
+}
+
+
+static void
+test_pipe_read (void)
+{
+  const char fname[] = "t-parallel.tmp";
+  FILE *fp;
+  iobuf_t inp;
+  byte buffer[1000];
+  size_t off;
+  int i, n;
+
+  fp = fopen (fname, "wb");
+  if (!fp)
+    {
+      fail (2);
+      return;
+    }
+  for (off = 0; off < PIPE_DATALEN; off++)
+    putc (pipe_data (off), fp);
+  fclose (fp);
+
+  inp = iobuf_open (fname);
+  if (!inp)
+    {
+      fail (2);
+      remove (fname);
+      return;
+    }
+  gnupg_parallel_push_pipe (inp);
+  off = 0;
+  while ((n = iobuf_read (inp, buffer, 1 + off % sizeof buffer)) != -1)
+    {
+      for (i = 0; i < n; i++)
+        if (buffer[i] != pipe_data (off + i))
+          break;
+      if (i != n)
+        {
+          fail (2);
+          break;
+        }
+      off += n;
+    }
+  if (off != PIPE_DATALEN)
+    fail (2);
+  iobuf_close (inp);
+  remove (fname);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  if (gnupg_parallel_threads (0) < 1)
+    fail (0);
+  if (gnupg_parallel_threads (3) != 3)
+    fail (0);
+
+  test_parallel_run (1);
+  test_parallel_run (4);
+  test_parallel_run (0);
+  test_pipe_write ();
+  test_pipe_read ();
+  test_pipe_cancel ();
+
+  return !!errcount;
+}
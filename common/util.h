@@ -159,6 +159,14 @@ gpg_error_t b64dec_proc (struct b64state *state, void *buffer, size_t length,
                          size_t *r_nbytes);
 gpg_error_t b64dec_finish (struct b64state *state);
 
+/*-- b64core.c --*/
+void b64_encode_groups (char *dst, const void *src, size_t ngroups);
+size_t b64_decode_groups (void *dst, const char *src, size_t srclen,
+                          size_t *r_used);
+
+/*-- crc24.c --*/
+u32 crc24_update (u32 crc, const void *buffer, size_t length);
+
 
 /*-- zb32.c --*/
 char *zb32_encode (const void *data, unsigned int databits);
@@ -0,0 +1,369 @@
+/* akl.c - Concurrent auto-key-locate lookups
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This module runs the remote lookups of gpg's --auto-key-locate
+   mechanisms for a mailbox concurrently.  Each lookup runs in its own
+   thread and the results are handed to the caller in the order of
+   the mechanisms up to the first successful one.  The lookups which
+   are still running at that point are not waited for; their threads
+   finish in the background and the result is then discarded.  The
+   DNS answers they receive are nevertheless kept by the DNS cache.
+
+   The threads do not use the CTRL object of the connection because
+   the connection may already be gone when they finish.  The keyserver
+   lookup uses a private CTRL object with a copy of the keyservers.  */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <npth.h>
+
+#include "dirmngr.h"
+#include "ks-action.h"
+#include "../common/dns-cert.h"
+#include "../common/pka.h"
+#include "akl.h"
+
+
+/* One lookup of a race.  */
+struct akl_part_s
+{
+  struct akl_race_s *race; /* The shared state.  */
+  akl_mech_t mech;
+  int done;                /* The lookup has been finished.  */
+  gpg_error_t err;         /* Its result.  */
+  estream_t key;           /* The key data or NULL.  */
+  unsigned char *fpr;      /* The fingerprint or NULL.  */
+  size_t fprlen;
+  char *url;               /* The URL of the key or NULL.  */
+};
+
+/* The state of the lookups for one mailbox.  It is shared between
+   the caller and the threads and released by the last one.  */
+struct akl_race_s
+{
+  npth_mutex_t lock;
+  npth_cond_t cond;
+  int refcount;
+  char *name;              /* The mailbox.  */
+  ctrl_t ks_ctrl;          /* The private CTRL for the keyserver.  */
+  int nparts;
+  struct akl_part_s part[AKL_MECH_N];
+};
+
+
+/* Release the private CTRL object KS_CTRL.  */
+static void
+release_ks_ctrl (ctrl_t ks_ctrl)
+{
+  if (!ks_ctrl)
+    return;
+  release_ctrl_keyservers (ks_ctrl);
+  xfree (ks_ctrl);
+}
+
+
+/* Return a new CTRL object which has a copy of the keyservers
+   configured in CTRL or NULL on error.  */
+static ctrl_t
+copy_ks_ctrl (ctrl_t ctrl)
+{
+  ctrl_t ks_ctrl;
+  uri_item_t u, item, *tail;
+
+  ks_ctrl = xtrycalloc (1, sizeof *ks_ctrl);
+  if (!ks_ctrl)
+    return NULL;
+  dirmngr_init_default_ctrl (ks_ctrl);
+  tail = &ks_ctrl->keyservers;
+  for (u = ctrl->keyservers; u; u = u->next)
+    {
+      item = xtrycalloc (1, sizeof *item + strlen (u->uri));
+      if (!item)
+        {
+          release_ks_ctrl (ks_ctrl);
+          return NULL;
+        }
+      strcpy (item->uri, u->uri);
+      if (http_parse_uri (&item->parsed_uri, item->uri, 1))
+        {
+          xfree (item);
+          release_ks_ctrl (ks_ctrl);
+          return NULL;
+        }
+      *tail = item;
+      tail = &item->next;
+    }
+  return ks_ctrl;
+}
+
+
+/* Drop a reference to RACE and release it if this was the last
+   one.  */
+static void
+release_race (struct akl_race_s *race)
+{
+  int last, i;
+
+  npth_mutex_lock (&race->lock);
+  last = !--race->refcount;
+  npth_mutex_unlock (&race->lock);
+  if (!last)
+    return;
+
+  for (i=0; i < race->nparts; i++)
+    {
+      es_fclose (race->part[i].key);
+      xfree (race->part[i].fpr);
+      xfree (race->part[i].url);
+    }
+  release_ks_ctrl (race->ks_ctrl);
+  xfree (race->name);
+  npth_cond_destroy (&race->cond);
+  npth_mutex_destroy (&race->lock);
+  xfree (race);
+}
+
+
+/* Run the CERT lookup for PART.  A lookup is only successful if it
+   yields a key or a fingerprint.  */
+static gpg_error_t
+lookup_cert (struct akl_part_s *part)
+{
+  gpg_error_t err;
+  char *look, *domain;
+
+  look = xtrystrdup (part->race->name);
+  if (!look)
+    return gpg_error_from_syserror ();
+  domain = strrchr (look, '@');
+  if (domain)
+    *domain = '.';
+  err = get_dns_cert (look, &part->key, &part->fpr, &part->fprlen,
+                      &part->url);
+  xfree (look);
+  if (!err && !part->key && !part->fpr)
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+  return err;
+}
+
+
+/* Run the PKA lookup for PART.  A lookup is only successful if the
+   record has an URL because gpg can't get the key otherwise.  */
+static gpg_error_t
+lookup_pka (struct akl_part_s *part)
+{
+  part->fpr = xtrymalloc (20);
+  if (!part->fpr)
+    return gpg_error_from_syserror ();
+  part->fprlen = 20;
+  part->url = get_pka_info (part->race->name, part->fpr);
+  if (!part->url || !*part->url)
+    return gpg_error (GPG_ERR_NOT_FOUND);
+  return 0;
+}
+
+
+/* Run the keyserver lookup for PART.  */
+static gpg_error_t
+lookup_keyserver (struct akl_part_s *part)
+{
+  gpg_error_t err;
+  strlist_t pattern;
+
+  part->key = es_fopenmem (0, "rwb");
+  if (!part->key)
+    return gpg_error_from_syserror ();
+
+  /* The '=' prefix asks for an exact match of the user id.  */
+  pattern = xtrymalloc (sizeof *pattern + 1 + strlen (part->race->name));
+  if (!pattern)
+    return gpg_error_from_syserror ();
+  pattern->next = NULL;
+  pattern->flags = 0;
+  strcpy (stpcpy (pattern->d, "="), part->race->name);
+
+  err = ks_action_get (part->race->ks_ctrl, pattern, part->key);
+  free_strlist (pattern);
+  if (!err && !es_ftell (part->key))
+    err = gpg_error (GPG_ERR_NO_DATA);
+  return err;
+}
+
+
+/* Thread to run one lookup of a race.  */
+static void *
+akl_thread (void *arg)
+{
+  struct akl_part_s *part = arg;
+  struct akl_race_s *race = part->race;
+  gpg_error_t err;
+
+  switch (part->mech)
+    {
+    case AKL_MECH_CERT:      err = lookup_cert (part); break;
+    case AKL_MECH_PKA:       err = lookup_pka (part); break;
+    case AKL_MECH_KEYSERVER: err = lookup_keyserver (part); break;
+    default: err = gpg_error (GPG_ERR_BUG); break;
+    }
+
+  npth_mutex_lock (&race->lock);
+  part->err = err;
+  part->done = 1;
+  npth_cond_broadcast (&race->cond);
+  npth_mutex_unlock (&race->lock);
+
+  release_race (race);
+  return NULL;
+}
+
+
+/* Start a thread to run the lookup of PART.  */
+static gpg_error_t
+start_akl_thread (struct akl_part_s *part)
+{
+  npth_attr_t tattr;
+  npth_t thread;
+  int rc;
+
+  npth_attr_init (&tattr);
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_DETACHED);
+  npth_mutex_lock (&part->race->lock);
+  part->race->refcount++;
+  npth_mutex_unlock (&part->race->lock);
+  rc = npth_create (&thread, &tattr, akl_thread, part);
+  npth_attr_destroy (&tattr);
+  if (rc)
+    {
+      log_error ("error spawning lookup thread: %s\n", strerror (rc));
+      npth_mutex_lock (&part->race->lock);
+      part->race->refcount--;
+      npth_mutex_unlock (&part->race->lock);
+      return gpg_error_from_errno (rc);
+    }
+  return 0;
+}
+
+
+/* Look up the key for the mailbox NAME using the NMECHS mechanisms
+   MECHS concurrently.  RESULT_CB is called with the result of each
+   mechanism in the order of MECHS until one succeeded.  Returns an
+   error only if the lookups could not be run or if RESULT_CB or the
+   progress status returned an error.  */
+gpg_error_t
+akl_lookup (ctrl_t ctrl, const akl_mech_t *mechs, int nmechs,
+            const char *name, akl_result_cb_t result_cb, void *opaque)
+{
+  gpg_error_t err = 0;
+  struct akl_race_s *race;
+  struct akl_part_s *part, result;
+  struct timespec abstime;
+  int i;
+
+  if (nmechs < 1 || nmechs > AKL_MECH_N)
+    return gpg_error (GPG_ERR_INV_ARG);
+
+  race = xtrycalloc (1, sizeof *race);
+  if (!race)
+    return gpg_error_from_syserror ();
+  npth_mutex_init (&race->lock, NULL);
+  npth_cond_init (&race->cond, NULL);
+  race->refcount = 1;
+  race->nparts = nmechs;
+  race->name = xtrystrdup (name);
+  if (!race->name)
+    {
+      err = gpg_error_from_syserror ();
+      release_race (race);
+      return err;
+    }
+
+  for (i=0; i < nmechs; i++)
+    {
+      race->part[i].race = race;
+      race->part[i].mech = mechs[i];
+    }
+  for (i=0; i < nmechs; i++)
+    {
+      gpg_error_t starterr;
+
+      /* Note that the thread may already be done when
+         start_akl_thread returns.  */
+      part = race->part + i;
+      if (part->mech == AKL_MECH_KEYSERVER && !ctrl->keyservers)
+        starterr = gpg_error (GPG_ERR_NO_KEYSERVER);
+      else if (part->mech == AKL_MECH_KEYSERVER
+               && !(race->ks_ctrl = copy_ks_ctrl (ctrl)))
+        starterr = gpg_error_from_syserror ();
+      else
+        starterr = start_akl_thread (part);
+      if (starterr)
+        {
+          npth_mutex_lock (&race->lock);
+          part->err = starterr;
+          part->done = 1;
+          npth_mutex_unlock (&race->lock);
+        }
+    }
+
+  /* Hand out the results in the order of the mechanisms.  */
+  npth_mutex_lock (&race->lock);
+  for (i=0; i < nmechs; )
+    {
+      part = race->part + i;
+      if (!part->done)
+        {
+          /* Wake up at least once a second for dirmngr_tick.  */
+          npth_clock_gettime (&abstime);
+          abstime.tv_sec++;
+          npth_cond_timedwait (&race->cond, &race->lock, &abstime);
+          npth_mutex_unlock (&race->lock);
+          err = dirmngr_tick (ctrl);
+          npth_mutex_lock (&race->lock);
+          if (err)
+            break;
+          continue;
+        }
+
+      /* Take the result so that we can call the callback without
+         holding the lock.  */
+      result = *part;
+      part->key = NULL;
+      part->fpr = NULL;
+      part->url = NULL;
+      npth_mutex_unlock (&race->lock);
+
+      err = result_cb (opaque, result.mech, result.err, result.key,
+                       result.fpr, result.fprlen, result.url);
+      es_fclose (result.key);
+      xfree (result.fpr);
+      xfree (result.url);
+
+      npth_mutex_lock (&race->lock);
+      if (err || !result.err)
+        break;
+      i++;
+    }
+  npth_mutex_unlock (&race->lock);
+
+  release_race (race);
+  return err;
+}
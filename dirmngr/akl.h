@@ -0,0 +1,44 @@
+/* akl.h - Concurrent auto-key-locate lookups
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIRMNGR_AKL_H
+#define DIRMNGR_AKL_H 1
+
+/* The mechanisms supported by akl_lookup.  */
+typedef enum
+  {
+    AKL_MECH_CERT = 0,    /* A DNS CERT record.  */
+    AKL_MECH_PKA,         /* A DNS PKA record.  */
+    AKL_MECH_KEYSERVER,   /* The configured keyservers.  */
+    AKL_MECH_N
+  }
+akl_mech_t;
+
+/* The function called by akl_lookup with the result of a mechanism.
+   KEY, FPR and URL may be NULL and are only valid during the call.  */
+typedef gpg_error_t (*akl_result_cb_t) (void *opaque, akl_mech_t mech,
+                                        gpg_error_t err, estream_t key,
+                                        const unsigned char *fpr,
+                                        size_t fprlen, const char *url);
+
+gpg_error_t akl_lookup (ctrl_t ctrl, const akl_mech_t *mechs, int nmechs,
+                        const char *name,
+                        akl_result_cb_t result_cb, void *opaque);
+
+#endif /*DIRMNGR_AKL_H*/
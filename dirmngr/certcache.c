@@ -31,6 +31,7 @@
 #include "misc.h"
 #include "crlfetch.h"
 #include "certcache.h"
+#include "stats.h"
 
 
 #define MAX_EXTRA_CACHED_CERTS 1000
@@ -553,10 +554,12 @@ get_cert_byfpr (const unsigned char *fpr)
       {
         ksba_cert_ref (ci->cert);
         release_cache_lock ();
+        stats_count_cache (STATS_CACHE_CERT, 1);
         return ci->cert;
       }
 
   release_cache_lock ();
+  stats_count_cache (STATS_CACHE_CERT, 0);
   return NULL;
 }
 
@@ -619,11 +622,13 @@ get_cert_bysn (const char *issuer_dn, ksba_sexp_t serialno)
           {
             ksba_cert_ref (ci->cert);
             release_cache_lock ();
+            stats_count_cache (STATS_CACHE_CERT, 1);
             return ci->cert;
           }
     }
 
   release_cache_lock ();
+  stats_count_cache (STATS_CACHE_CERT, 0);
   return NULL;
 }
 
@@ -663,6 +668,7 @@ get_cert_bysubject (const char *subject_dn, unsigned int seq)
   /* Simple and very inefficient implementation and API.  fixme! */
   cert_item_t ci;
   int i;
+  int first = !seq;  /* Only the first lookup is counted.  */
 
   if (!subject_dn)
     return NULL;
@@ -677,11 +683,15 @@ get_cert_bysubject (const char *subject_dn, unsigned int seq)
             {
               ksba_cert_ref (ci->cert);
               release_cache_lock ();
+              if (first)
+                stats_count_cache (STATS_CACHE_CERT, 1);
               return ci->cert;
             }
     }
 
   release_cache_lock ();
+  if (first)
+    stats_count_cache (STATS_CACHE_CERT, 0);
   return NULL;
 }
 
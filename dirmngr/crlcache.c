@@ -113,6 +113,7 @@
 #include "crlfetch.h"
 #include "misc.h"
 #include "cdb.h"
+#include "stats.h"
 
 /* Change this whenever the format changes */
 #define DBDIR_D (opt.system_daemon? "crls.d" : "dirmngr-cache.d")
@@ -1434,6 +1435,7 @@ crl_cache_isvalid (ctrl_t ctrl, const char *issuer_hash, const char *serialno,
   n = unhexify (snbuf, serialno);
 
   result = cache_isvalid (ctrl, issuer_hash, snbuf, n, force_refresh);
+  stats_count_cache (STATS_CACHE_CRL, result != CRL_CACHE_DONTKNOW);
 
   if (snbuf != snbuf_buffer)
     xfree (snbuf);
@@ -1500,6 +1502,7 @@ crl_cache_cert_isvalid (ctrl_t ctrl, ksba_cert_t cert,
 
   /* Check the cache.  */
   result = cache_isvalid (ctrl, issuerhash_hex, sn, snlen, force_refresh);
+  stats_count_cache (STATS_CACHE_CRL, result != CRL_CACHE_DONTKNOW);
   switch (result)
     {
     case CRL_CACHE_VALID:
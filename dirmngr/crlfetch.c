@@ -28,6 +28,7 @@
 #include "dirmngr.h"
 #include "misc.h"
 #include "http.h"
+#include "stats.h"
 
 #if USE_LDAP
 # include "ldap-wrapper.h"
@@ -42,6 +43,8 @@ struct reader_cb_context_s
   int checked:1;            /* PEM/binary detection ahs been done.    */
   int is_pem:1;             /* The file stream is PEM encoded.        */
   struct b64state b64state; /* The state used for Base64 decoding.    */
+  unsigned long starttime;  /* Time the reader was created.           */
+  unsigned long readtime;   /* Milliseconds spent reading the stream. */
 };
 
 
@@ -102,8 +105,11 @@ my_es_read (void *opaque, char *buffer, size_t nbytes, size_t *nread)
 {
   struct reader_cb_context_s *cb_ctx = opaque;
   int result;
+  unsigned long starttime;
 
+  starttime = stats_get_msec ();
   result = es_read (cb_ctx->fp, buffer, nbytes, nread);
+  cb_ctx->readtime += stats_get_msec () - starttime;
   if (result)
     return result;
   /* Fixme we should check whether the semantics of es_read are okay
@@ -196,10 +202,16 @@ crl_fetch (ctrl_t ctrl, const char *url, ksba_reader_t *reader)
           err = gpg_error (GPG_ERR_NOT_SUPPORTED);
         }
       else
-        err = http_open_document (&hd, url, NULL,
-                                  (opt.honor_http_proxy? HTTP_FLAG_TRY_PROXY:0)
-                                  |(DBG_LOOKUP? HTTP_FLAG_LOG_RESP:0),
-                                  opt.http_proxy, NULL, NULL, NULL);
+        {
+          err = http_open_document (&hd, url, NULL,
+                                    (opt.honor_http_proxy?
+                                     HTTP_FLAG_TRY_PROXY:0)
+                                    |(DBG_LOOKUP? HTTP_FLAG_LOG_RESP:0),
+                                    opt.http_proxy, NULL, NULL, NULL);
+          /* On error the handle has already been closed.  */
+          stats_add_http (STATS_CRL, err? NULL : hd,
+                          err || http_get_status_code (hd) >= 400);
+        }
 
       switch ( err? 99999 : http_get_status_code (hd) )
         {
@@ -216,6 +228,7 @@ crl_fetch (ctrl_t ctrl, const char *url, ksba_reader_t *reader)
             if (!err)
               {
                 cb_ctx->fp = fp;
+                cb_ctx->starttime = stats_get_msec ();
                 err = ksba_reader_set_cb (*reader, &my_es_read, cb_ctx);
               }
             if (err)
@@ -511,6 +524,7 @@ void
 crl_close_reader (ksba_reader_t reader)
 {
   struct reader_cb_context_s *cb_ctx;
+  unsigned long total;
 
   if (!reader)
     return;
@@ -519,7 +533,12 @@ crl_close_reader (ksba_reader_t reader)
   cb_ctx = get_file_reader (reader);
   if (cb_ctx)
     {
-      /* This is an HTTP context. */
+      /* This is an HTTP context.  The time not spent in reading is
+         used for parsing and storing the CRL.  */
+      total = stats_get_msec () - cb_ctx->starttime;
+      stats_add (STATS_CRL, STATS_BODY, cb_ctx->readtime);
+      stats_add (STATS_CRL, STATS_PROCESS,
+                 total > cb_ctx->readtime? total - cb_ctx->readtime : 0);
       if (cb_ctx->fp)
         es_fclose (cb_ctx->fp);
       /* Release the base64 decoder state.  */
@@ -68,6 +68,8 @@
 # include "ldap-wrapper.h"
 #endif
 #include "../common/init.h"
+#include "../common/dns-cache.h"
+#include "stats.h"
 #include "gc-opt-flags.h"
 
 /* The plain Windows version uses the windows service system.  For
@@ -130,6 +132,8 @@ enum cmd_and_opt_values {
   oOCSPCurrentPeriod,
   oMaxReplies,
   oHkpCaCert,
+  oHedgeHkpRequests,
+  oLogStats,
   oFakedSystemTime,
   oForce,
   oAllowOCSP,
@@ -211,6 +215,10 @@ static ARGPARSE_OPTS opts[] = {
 
   ARGPARSE_s_s (oHkpCaCert, "hkp-cacert",
                 N_("|FILE|use the CA certificates in FILE for HKP over TLS")),
+  ARGPARSE_s_n (oHedgeHkpRequests, "hedge-hkp-requests",
+                N_("ask a second keyserver of a pool if the first is slow")),
+  ARGPARSE_s_n (oLogStats, "log-stats",
+                N_("log request and cache statistics periodically")),
 
 
   ARGPARSE_s_s (oSocketName, "socket-name", "@"),  /* Only for debugging.  */
@@ -486,6 +494,8 @@ parse_rereadable_options (ARGPARSE_ARGS *pargs, int reread)
       opt.ocsp_max_period = 90 * 86400;       /* 90 days.  */
       opt.ocsp_current_period = 3 * 60 * 60;  /* 3 hours. */
       opt.max_replies = DEFAULT_MAX_REPLIES;
+      opt.hedge_hkp_requests = 0;
+      opt.log_stats = 0;
       while (opt.ocsp_signer)
         {
           fingerprint_list_t tmp = opt.ocsp_signer->next;
@@ -550,6 +560,9 @@ parse_rereadable_options (ARGPARSE_ARGS *pargs, int reread)
       http_register_tls_ca (pargs->r.ret_str);
       break;
 
+    case oHedgeHkpRequests: opt.hedge_hkp_requests = 1; break;
+    case oLogStats: opt.log_stats = 1; break;
+
     case oIgnoreCertExtension:
       add_to_strlist (&opt.ignored_cert_extensions, pargs->r.ret_str);
       break;
@@ -1017,6 +1030,8 @@ main (int argc, char **argv)
 
       cert_cache_init ();
       crl_cache_init ();
+      dns_cache_enable (1);
+      dns_cache_set_query_hooks (npth_unprotect, npth_protect);
       start_command_handler (ASSUAN_INVALID_FD);
       shutdown_reaper ();
     }
@@ -1195,6 +1210,8 @@ main (int argc, char **argv)
 
       cert_cache_init ();
       crl_cache_init ();
+      dns_cache_enable (1);
+      dns_cache_set_query_hooks (npth_unprotect, npth_protect);
 #ifdef USE_W32_SERVICE
       if (opt.system_service)
 	{
@@ -1697,6 +1714,7 @@ dirmngr_sighup_action (void)
   crl_cache_deinit ();
   cert_cache_init ();
   crl_cache_init ();
+  dns_cache_flush ();
 }
 
 
@@ -1714,6 +1732,7 @@ handle_signal (int signo)
 
     case SIGUSR1:
       cert_cache_print_stats ();
+      stats_log ();
       break;
 
     case SIGUSR2:
@@ -1770,6 +1789,8 @@ housekeeping_thread (void *arg)
     log_info ("starting housekeeping\n");
 
   ks_hkp_housekeeping (curtime);
+  if (opt.log_stats)
+    stats_log ();
 
   if (opt.verbose)
     log_info ("ready with housekeeping\n");
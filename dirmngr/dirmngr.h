@@ -118,6 +118,10 @@ struct
   int max_replies;
   unsigned int ldaptimeout;
 
+  int hedge_hkp_requests; /* Send a keyserver request also to a second
+                             host if the first one is slow.  */
+  int log_stats;          /* Log the statistics at each housekeeping.  */
+
   ldap_server_t ldapservers;
   int add_new_ldapservers;
 
@@ -191,6 +195,7 @@ void ks_hkp_housekeeping (time_t curtime);
 
 /*-- server.c --*/
 ldap_server_t get_ldapservers_from_ctrl (ctrl_t ctrl);
+void release_ctrl_keyservers (ctrl_t ctrl);
 ksba_cert_t get_cert_local (ctrl_t ctrl, const char *issuer);
 ksba_cert_t get_issuing_cert_local (ctrl_t ctrl, const char *issuer);
 ksba_cert_t get_cert_local_ski (ctrl_t ctrl,
@@ -107,6 +107,9 @@ static void npth_protect (void) { }
 
 #define DEFAULT_LDAP_TIMEOUT 100 /* Arbitrary long timeout. */
 
+/* The number of bound connections kept open in server mode.  */
+#define MAX_CACHED_CONNS 8
+
 
 /* Constants for the options.  */
 enum
@@ -182,10 +185,31 @@ struct my_opt_s
 typedef struct my_opt_s *my_opt_t;
 
 
+/* In server mode we keep the connections open after a query and
+   reuse them for the next query to the same server with the same
+   credentials.  This saves the connect and the bind, which is the
+   major part of the time for a typical certificate lookup.  */
+struct cached_conn_s
+{
+  LDAP *ld;          /* The bound connection or NULL for an unused slot.  */
+  char *host;
+  int port;
+  char *user;
+  char *pass;
+  unsigned long lastuse;  /* Value of CONN_USE_COUNTER at the last use.  */
+};
+static struct cached_conn_s conn_cache[MAX_CACHED_CONNS];
+static unsigned long conn_use_counter;
+
+/* True if we are running in server mode and shall keep connections.  */
+static int keep_connections;
+
+
 /* Prototypes.  */
 #ifndef HAVE_W32_SYSTEM
 static void catch_alarm (int dummy);
 #endif
+static int run_query (int argc, char **argv, estream_t outstream);
 static int process_url (my_opt_t myopt, const char *url);
 
 
@@ -222,6 +246,169 @@ my_strusage (int level)
 #endif /*!USE_LDAPWRAPPER*/
 
 
+#ifdef USE_LDAPWRAPPER
+/* A write handler used by es_fopencookie in server mode.  Each chunk
+   of the response is sent as a frame made up of a 'D', the length of
+   the chunk as 4 byte big endian value, and the chunk itself.  */
+static ssize_t
+frame_cookie_write (void *cookie, const void *buffer, size_t size)
+{
+  unsigned char tmp[5];
+
+  (void)cookie;
+
+  if (!buffer || !size)
+    return 0;  /* Flush request.  */
+
+  tmp[0] = 'D';
+  tmp[1] = (size >> 24);
+  tmp[2] = (size >> 16);
+  tmp[3] = (size >> 8);
+  tmp[4] = (size);
+  if (es_fwrite (tmp, 5, 1, es_stdout) != 1
+      || es_fwrite (buffer, size, 1, es_stdout) != 1)
+    return -1;
+  return size;
+}
+
+static es_cookie_io_functions_t frame_cookie_functions =
+  {
+    NULL,
+    frame_cookie_write,
+    NULL,
+    NULL
+  };
+
+
+/* Run a query in server mode.  ARGS has the arguments of the query.
+   The response is written as 'D' frames and terminated by an 'S'
+   frame with the exit status of the query.  Returns true if writing
+   to stdout failed.  */
+static int
+serve_query (strlist_t args)
+{
+  strlist_t sl;
+  char **argv;
+  int argc, rc;
+  estream_t fp;
+  unsigned char tmp[5];
+
+  for (argc=1, sl=args; sl; sl = sl->next)
+    argc++;
+  argv = xtrycalloc (argc + 1, sizeof *argv);
+  if (!argv)
+    {
+      log_error ("error allocating memory: %s\n", strerror (errno));
+      return -1;
+    }
+  argv[0] = (char*)"dirmngr_ldap";
+  for (argc=1, sl=args; sl; sl = sl->next)
+    argv[argc++] = sl->d;
+  argv[argc] = NULL;
+
+  fp = es_fopencookie (NULL, "w", frame_cookie_functions);
+  if (!fp)
+    {
+      log_error ("error creating response stream: %s\n", strerror (errno));
+      xfree (argv);
+      return -1;
+    }
+
+  /* The error count is used to detect bad options; thus we need to
+     start from scratch for each query.  */
+  log_get_errorcount (1);
+  rc = run_query (argc, argv, fp);
+#ifndef HAVE_W32_SYSTEM
+  alarm (0);
+#endif
+  xfree (argv);
+  if (es_fclose (fp))
+    {
+      log_error (_("error writing to stdout: %s\n"), strerror (errno));
+      return -1;
+    }
+
+  tmp[0] = 'S';
+  tmp[1] = 0;
+  tmp[2] = 0;
+  tmp[3] = 0;
+  tmp[4] = rc;
+  if (es_fwrite (tmp, 5, 1, es_stdout) != 1 || es_fflush (es_stdout))
+    {
+      log_error (_("error writing to stdout: %s\n"), strerror (errno));
+      return -1;
+    }
+  return 0;
+}
+
+
+/* Server mode main loop.  Each query is read from stdin as a list of
+   arguments, one per line and percent escaped, terminated by an empty
+   line.  We return on EOF.  */
+static int
+run_server (void)
+{
+  char *line = NULL;
+  size_t linesize = 0;
+  size_t maxlen;
+  ssize_t n;
+  strlist_t args = NULL;
+  int rc = 0;
+
+  keep_connections = 1;
+  es_set_binary (es_stdin);
+
+  for (;;)
+    {
+      maxlen = 4096;
+      n = es_read_line (es_stdin, &line, &linesize, &maxlen);
+      if (n < 0)
+        {
+          log_error ("error reading query: %s\n", strerror (errno));
+          rc = 2;
+          break;
+        }
+      if (!n)
+        break;  /* EOF.  */
+      if (!maxlen)
+        {
+          log_error ("error reading query: %s\n", "line too long");
+          rc = 2;
+          break;
+        }
+      if (line[n-1] != '\n')
+        {
+          log_error ("error reading query: %s\n", "incomplete line");
+          rc = 2;
+          break;
+        }
+      line[--n] = 0;
+      if (n && line[n-1] == '\r')
+        line[--n] = 0;
+
+      if (n)
+        {
+          percent_unescape_inplace (line, 0);
+          append_to_strlist (&args, line);
+          continue;
+        }
+
+      if (serve_query (args))
+        {
+          rc = 2;
+          break;
+        }
+      free_strlist (args);
+      args = NULL;
+    }
+
+  free_strlist (args);
+  es_free (line);
+  return rc;
+}
+#endif /*USE_LDAPWRAPPER*/
+
+
 int
 #ifdef USE_LDAPWRAPPER
 main (int argc, char **argv)
@@ -229,19 +416,6 @@ main (int argc, char **argv)
 ldap_wrapper_main (char **argv, estream_t outstream)
 #endif
 {
-#ifndef USE_LDAPWRAPPER
-  int argc;
-#endif
-  ARGPARSE_ARGS pargs;
-  int any_err = 0;
-  char *p;
-  int only_search_timeout = 0;
-  struct my_opt_s my_opt_buffer;
-  my_opt_t myopt = &my_opt_buffer;
-  char *malloced_buffer1 = NULL;
-
-  memset (&my_opt_buffer, 0, sizeof my_opt_buffer);
-
 #ifdef USE_LDAPWRAPPER
   set_strusage (my_strusage);
   log_set_prefix ("dirmngr_ldap", JNLIB_LOG_WITH_PREFIX);
@@ -252,12 +426,38 @@ ldap_wrapper_main (char **argv, estream_t outstream)
   init_common_subsystems (&argc, &argv);
 
   es_set_binary (es_stdout);
-  myopt->outstream = es_stdout;
+
+  /* The dirmngr starts us with "--server" as the only argument to run
+     queries read from stdin.  */
+  if (argc == 2 && !strcmp (argv[1], "--server"))
+    return run_server ();
+
+  return run_query (argc, argv, es_stdout);
 #else /*!USE_LDAPWRAPPER*/
-  myopt->outstream = outstream;
+  int argc;
+
   for (argc=0; argv[argc]; argc++)
     ;
+  return run_query (argc, argv, outstream);
 #endif /*!USE_LDAPWRAPPER*/
+}
+
+
+/* Parse the options in ARGV and run the query for the URLs given as
+   remaining arguments.  The result is written to OUTSTREAM.  */
+static int
+run_query (int argc, char **argv, estream_t outstream)
+{
+  ARGPARSE_ARGS pargs;
+  int any_err = 0;
+  char *p;
+  int only_search_timeout = 0;
+  struct my_opt_s my_opt_buffer;
+  my_opt_t myopt = &my_opt_buffer;
+  char *malloced_buffer1 = NULL;
+
+  memset (&my_opt_buffer, 0, sizeof my_opt_buffer);
+  myopt->outstream = outstream;
 
   /* LDAP defaults */
   myopt->timeout.tv_sec = DEFAULT_LDAP_TIMEOUT;
@@ -563,6 +763,97 @@ print_ldap_entries (my_opt_t myopt, LDAP *ld, LDAPMessage *msg, char *want_attr)
 
 
 
+/* Return true if the strings A and B, which may be NULL, are equal.  */
+static int
+same_string_p (const char *a, const char *b)
+{
+  return !strcmp (a? a:"", b? b:"");
+}
+
+
+/* Take a bound connection to HOST:PORT for USER and PASS from the
+   cache.  Returns NULL if there is none.  */
+static LDAP *
+get_cached_conn (const char *host, int port, const char *user,
+                 const char *pass)
+{
+  struct cached_conn_s *c;
+  LDAP *ld;
+  int i;
+
+  for (i=0; i < MAX_CACHED_CONNS; i++)
+    {
+      c = conn_cache + i;
+      if (c->ld && c->port == port && !ascii_strcasecmp (c->host, host)
+          && same_string_p (c->user, user) && same_string_p (c->pass, pass))
+        {
+          ld = c->ld;
+          c->ld = NULL;
+          xfree (c->host);
+          xfree (c->user);
+          xfree (c->pass);
+          c->host = c->user = c->pass = NULL;
+          return ld;
+        }
+    }
+  return NULL;
+}
+
+
+/* Put the bound connection LD back into the cache or close it if we
+   are not in server mode.  The least recently used connection is
+   closed if the cache is full.  */
+static void
+put_cached_conn (LDAP *ld, const char *host, int port, const char *user,
+                 const char *pass)
+{
+  struct cached_conn_s *c = NULL;
+  int i;
+
+  if (!keep_connections)
+    {
+      ldap_unbind (ld);
+      return;
+    }
+
+  for (i=0; i < MAX_CACHED_CONNS; i++)
+    if (!conn_cache[i].ld)
+      {
+        c = conn_cache + i;
+        break;
+      }
+    else if (!c || conn_cache[i].lastuse < c->lastuse)
+      c = conn_cache + i;
+
+  if (c->ld)
+    {
+      ldap_unbind (c->ld);
+      c->ld = NULL;
+      xfree (c->host);
+      xfree (c->user);
+      xfree (c->pass);
+      c->host = c->user = c->pass = NULL;
+    }
+
+  c->host = xtrystrdup (host);
+  c->user = user? xtrystrdup (user) : NULL;
+  c->pass = pass? xtrystrdup (pass) : NULL;
+  if (!c->host || (user && !c->user) || (pass && !c->pass))
+    {
+      xfree (c->host);
+      xfree (c->user);
+      xfree (c->pass);
+      c->host = c->user = c->pass = NULL;
+      ldap_unbind (ld);
+      return;
+    }
+  c->ld = ld;
+  c->port = port;
+  c->lastuse = ++conn_use_counter;
+}
+
+
+
 /* Helper for the URL based LDAP query. */
 static int
 fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
@@ -573,6 +864,7 @@ fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
   char *host, *dn, *filter, *attrs[2], *attr;
   int port;
   int ret;
+  int reused;
 
   host     = myopt->host?   myopt->host   : ludp->lud_host;
   port     = myopt->port?   myopt->port   : ludp->lud_port;
@@ -626,29 +918,39 @@ fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
     log_info (_("WARNING: using first attribute only\n"));
 
 
-  set_timeout (myopt);
-  npth_unprotect ();
-  ld = my_ldap_init (host, port);
-  npth_protect ();
+  ld = get_cached_conn (host, port, myopt->user, myopt->pass);
+  reused = !!ld;
+  if (reused && myopt->verbose > 1)
+    log_info ("reusing connection to '%s:%d'\n", host, port);
+
+ again:
   if (!ld)
     {
-      log_error (_("LDAP init to '%s:%d' failed: %s\n"),
-                 host, port, strerror (errno));
-      return -1;
-    }
-  npth_unprotect ();
-  /* Fixme:  Can we use MYOPT->user or is it shared with other theeads?.  */
-  ret = my_ldap_simple_bind_s (ld, myopt->user, myopt->pass);
-  npth_protect ();
-  if (ret)
-    {
-      log_error (_("binding to '%s:%d' failed: %s\n"),
-                 host, port, strerror (errno));
-      ldap_unbind (ld);
-      return -1;
+      set_timeout (myopt);
+      npth_unprotect ();
+      ld = my_ldap_init (host, port);
+      npth_protect ();
+      if (!ld)
+        {
+          log_error (_("LDAP init to '%s:%d' failed: %s\n"),
+                     host, port, strerror (errno));
+          return -1;
+        }
+      npth_unprotect ();
+      /* Fixme:  Can we use MYOPT->user or is it shared with other theeads?.  */
+      ret = my_ldap_simple_bind_s (ld, myopt->user, myopt->pass);
+      npth_protect ();
+      if (ret)
+        {
+          log_error (_("binding to '%s:%d' failed: %s\n"),
+                     host, port, strerror (errno));
+          ldap_unbind (ld);
+          return -1;
+        }
     }
 
   set_timeout (myopt);
+  msg = NULL;
   npth_unprotect ();
   rc = my_ldap_search_st (ld, dn, ludp->lud_scope, filter,
                           myopt->multi && !myopt->attr && ludp->lud_attrs?
@@ -656,11 +958,27 @@ fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
                           0,
                           &myopt->timeout, &msg);
   npth_protect ();
+  if (reused && (rc == LDAP_SERVER_DOWN || rc == LDAP_UNAVAILABLE))
+    {
+      /* The server closed the cached connection in the meantime; try
+         again with a fresh one.  */
+      if (myopt->verbose)
+        log_info ("connection to '%s:%d' lost - reconnecting\n", host, port);
+      if (msg)
+        ldap_msgfree (msg);
+      ldap_unbind (ld);
+      ld = NULL;
+      reused = 0;
+      goto again;
+    }
   if (rc == LDAP_SIZELIMIT_EXCEEDED && myopt->multi)
     {
       if (es_fwrite ("E\0\0\0\x09truncated", 14, 1, myopt->outstream) != 1)
         {
           log_error (_("error writing to stdout: %s\n"), strerror (errno));
+          if (msg)
+            ldap_msgfree (msg);
+          ldap_unbind (ld);
           return -1;
         }
     }
@@ -674,8 +992,9 @@ fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
 #endif
       if (rc != LDAP_NO_SUCH_OBJECT)
         {
-          /* FIXME: Need deinit (ld)?  */
-          /* Hmmm: Do we need to released MSG in case of an error? */
+          if (msg)
+            ldap_msgfree (msg);
+          ldap_unbind (ld);
           return -1;
         }
     }
@@ -683,7 +1002,7 @@ fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
   rc = print_ldap_entries (myopt, ld, msg, myopt->multi? NULL:attr);
 
   ldap_msgfree (msg);
-  ldap_unbind (ld);
+  put_cached_conn (ld, host, port, myopt->user, myopt->pass);
   return rc;
 }
 
@@ -29,6 +29,7 @@
 #include "misc.h"
 #include "ks-engine.h"
 #include "ks-action.h"
+#include "stats.h"
 
 
 /* Copy all data from IN to OUT.  */
@@ -50,6 +51,21 @@ copy_stream (estream_t in, estream_t out)
 }
 
 
+/* Same as copy_stream but account the time for the keyserver
+   statistics.  */
+static gpg_error_t
+copy_hkp_stream (estream_t in, estream_t out)
+{
+  gpg_error_t err;
+  unsigned long starttime;
+
+  starttime = stats_get_msec ();
+  err = copy_stream (in, out);
+  stats_add (STATS_HKP, STATS_BODY, stats_get_msec () - starttime);
+  return err;
+}
+
+
 /* Called by the engine's help functions to print the actual help.  */
 gpg_error_t
 ks_print_help (ctrl_t ctrl, const char *text)
@@ -167,7 +183,7 @@ ks_action_search (ctrl_t ctrl, strlist_t patterns, estream_t outfp)
           err = ks_hkp_search (ctrl, uri->parsed_uri, patterns->d, &infp);
           if (!err)
             {
-              err = copy_stream (infp, outfp);
+              err = copy_hkp_stream (infp, outfp);
               es_fclose (infp);
               break;
             }
@@ -222,7 +238,7 @@ ks_action_get (ctrl_t ctrl, strlist_t patterns, estream_t outfp)
                 }
               else
                 {
-                  err = copy_stream (infp, outfp);
+                  err = copy_hkp_stream (infp, outfp);
                   /* Reading from the keyserver should never fail, thus
                      return this error.  */
                   if (!err)
@@ -34,11 +34,13 @@
 # include <sys/socket.h>
 # include <netdb.h>
 #endif /*!HAVE_W32_SYSTEM*/
+#include <npth.h>
 
 #include "dirmngr.h"
 #include "misc.h"
 #include "userids.h"
 #include "ks-engine.h"
+#include "stats.h"
 
 /* Substitutes for missing Mingw macro.  The EAI_SYSTEM mechanism
    seems not to be available (probably because there is only one set
@@ -56,6 +58,32 @@
 /* Number of seconds after a host is marked as resurrected.  */
 #define RESURRECT_INTERVAL  (3600*3)  /* 3 hours */
 
+/* Number of seconds after which a slow host is tried again.  */
+#define PROBE_INTERVAL  (60*30)  /* 30 minutes */
+
+/* The weight of a new sample for the smoothed response time and
+   error rate of a host is 1/EWMA_DIVISOR.  */
+#define EWMA_DIVISOR 8
+
+/* A host is considered slow if its score is larger than SLOW_FACTOR
+   times the best score of its pool plus SLOW_SLACK milliseconds.  */
+#define SLOW_FACTOR 2
+#define SLOW_SLACK  100
+
+/* The response times of all hosts are kept in a histogram with
+   RTT_BUCKETS buckets; bucket I counts the times up to
+   RTT_BUCKET_BASE << I milliseconds and the last bucket also all
+   larger times.  The counts are halved when their sum reaches
+   RTT_HISTOGRAM_MAX so that old samples fade out.  */
+#define RTT_BUCKETS       12
+#define RTT_BUCKET_BASE   16
+#define RTT_HISTOGRAM_MAX 1000
+
+/* The delay in milliseconds for a hedged request as long as we have
+   not enough samples and the lower bound for this delay.  */
+#define HEDGE_DEFAULT_DELAY 1000
+#define HEDGE_MIN_DELAY       50
+
 /* To match the behaviour of our old gpgkeys helper code we escape
    more characters than actually needed. */
 #define EXTRA_ESCAPE_CHARS "@!\"#$%&'()*+,-./:;<=>?[\\]^_{|}~"
@@ -80,8 +108,13 @@ struct hostinfo_s
   unsigned int v4:1; /* Host supports AF_INET.  */
   unsigned int v6:1; /* Host supports AF_INET6.  */
   unsigned int dead:1; /* Host is currently unresponsive.  */
+  unsigned int probe:1; /* Host is slow but shall be tried again.  */
   time_t died_at;    /* The time the host was marked dead.  If this is
                         0 the host has been manually marked dead.  */
+  unsigned int rtt;  /* Smoothed response time in milliseconds or 0
+                        if not yet known.  */
+  unsigned int errrate; /* Smoothed error rate in 1/1000.  */
+  time_t lastsample; /* Time of the last response time sample.  */
   char *cname;       /* Canonical name of the host.  Only set if this
                         is a pool.  */
   char *v4addr;      /* A string with the v4 IP address of the host.
@@ -99,6 +132,10 @@ struct hostinfo_s
 static hostinfo_t *hosttable;
 static int hosttable_size;
 
+/* The histogram of the response times and the sum of its counts.  */
+static unsigned int rtt_histogram[RTT_BUCKETS];
+static unsigned int rtt_histogram_total;
+
 /* The number of host slots we initally allocate for HOSTTABLE.  */
 #define INITIAL_HOSTTABLE_SIZE 10
 
@@ -124,7 +161,11 @@ create_new_hostinfo (const char *name)
   hi->v4 = 0;
   hi->v6 = 0;
   hi->dead = 0;
+  hi->probe = 0;
   hi->died_at = 0;
+  hi->rtt = 0;
+  hi->errrate = 0;
+  hi->lastsample = 0;
   hi->cname = NULL;
   hi->v4addr = NULL;
   hi->v6addr = NULL;
@@ -198,20 +239,64 @@ host_in_pool_p (int *pool, int tblidx)
 }
 
 
+/* Return the score of the host HI, which is its smoothed response
+   time weighted by its error rate; an error rate of 25% doubles the
+   score.  Lower is better and 0 is returned for a host without any
+   measurements.  */
+static unsigned int
+host_score (hostinfo_t hi)
+{
+  return hi->rtt + (unsigned int)((unsigned long)hi->rtt * hi->errrate / 250);
+}
+
+
+/* Return the best score of the alive and measured hosts in TABLE,
+   which has indices into the global hosttable, or 0 if none is
+   known.  */
+static unsigned int
+best_score (int *table)
+{
+  unsigned int best = 0;
+  unsigned int score;
+  int pidx, idx;
+
+  for (idx=0; (pidx = table[idx]) != -1; idx++)
+    if (hosttable[pidx] && !hosttable[pidx]->dead
+        && (score = host_score (hosttable[pidx]))
+        && (!best || score < best))
+      best = score;
+  return best;
+}
+
+
+/* Return true if the host HI is slow compared to the best score BEST
+   of its pool.  */
+static int
+host_slow_p (hostinfo_t hi, unsigned int best)
+{
+  return best && host_score (hi) > SLOW_FACTOR * best + SLOW_SLACK;
+}
+
+
 /* Select a random host.  Consult TABLE which indices into the global
    hosttable.  Returns index into TABLE or -1 if no host could be
-   selected.  */
+   selected.  Slow hosts are only selected if no other host is
+   available or if they are due for a probe.  The host with the index
+   AVOID is never selected; use -1 to allow all hosts.  */
 static int
-select_random_host (int *table)
+select_random_host (int *table, int avoid)
 {
   int *tbl;
   size_t tblsize;
   int pidx, idx;
+  unsigned int best;
 
   /* We create a new table so that we randomly select only from
-     currently alive hosts.  */
+     currently alive and fast hosts.  Hosts without measurements are
+     used as well so that we learn about them.  */
+  best = best_score (table);
   for (idx=0, tblsize=0; (pidx = table[idx]) != -1; idx++)
-    if (hosttable[pidx] && !hosttable[pidx]->dead)
+    if (hosttable[pidx] && !hosttable[pidx]->dead && pidx != avoid)
       tblsize++;
   if (!tblsize)
     return -1; /* No hosts.  */
@@ -220,8 +305,16 @@ select_random_host (int *table)
   if (!tbl)
     return -1;
   for (idx=0, tblsize=0; (pidx = table[idx]) != -1; idx++)
-    if (hosttable[pidx] && !hosttable[pidx]->dead)
+    if (hosttable[pidx] && !hosttable[pidx]->dead && pidx != avoid
+        && (hosttable[pidx]->probe || !host_slow_p (hosttable[pidx], best)))
       tbl[tblsize++] = pidx;
+  if (!tblsize)
+    {
+      /* Only slow hosts - use them all.  */
+      for (idx=0; (pidx = table[idx]) != -1; idx++)
+        if (hosttable[pidx] && !hosttable[pidx]->dead && pidx != avoid)
+          tbl[tblsize++] = pidx;
+    }
 
   if (tblsize == 1)  /* Save a get_uint_nonce.  */
     pidx = tbl[0];
@@ -229,10 +322,27 @@ select_random_host (int *table)
     pidx = tbl[get_uint_nonce () % tblsize];
 
   xfree (tbl);
+  hosttable[pidx]->probe = 0;
   return pidx;
 }
 
 
+/* Return the index into the global hosttable of a host in TABLE
+   which is due for a probe or -1 if there is none.  The host with
+   the index AVOID is never returned.  */
+static int
+select_probe_host (int *table, int avoid)
+{
+  int idx, pidx;
+
+  for (idx=0; (pidx = table[idx]) != -1; idx++)
+    if (hosttable[pidx] && !hosttable[pidx]->dead
+        && hosttable[pidx]->probe && pidx != avoid)
+      return pidx;
+  return -1;
+}
+
+
 /* Simplified version of getnameinfo which also returns a numeric
    hostname inside of brackets.  The caller should provide a buffer
    for HOST which is 2 bytes larger than the largest hostname.  If
@@ -316,13 +426,17 @@ is_ip_address (const char *name)
    to choose one of the hosts.  For example we skip those hosts which
    failed for some time and we stick to one host for a time
    independent of DNS retry times.  If FORCE_RESELECT is true a new
-   host is always selected.  If R_HTTPFLAGS is not NULL if will
-   receive flags which are to be passed to http_open.  If R_HOST is
+   host is always selected.  If FORCE_RESELECT is 2 a pool host other
+   than the currently selected one is returned without changing the
+   selection; this is used for hedged requests.  FOR_REQUEST tells
+   that a request will be sent to the returned host; only then a
+   slow host due for a probe may be returned.  If R_HTTPFLAGS is not
+   NULL if will receive flags which are to be passed to http_open.  If R_HOST is
    not NULL a malloced name of the pool is stored or NULL if it is not
    a pool. */
 static char *
 map_host (ctrl_t ctrl, const char *name, int force_reselect,
-          unsigned int *r_httpflags, char **r_host)
+          int for_request, unsigned int *r_httpflags, char **r_host)
 {
   hostinfo_t hi;
   int idx;
@@ -510,20 +624,39 @@ map_host (ctrl_t ctrl, const char *name, int force_reselect,
     }
 
   hi = hosttable[idx];
-  if (hi->pool)
+  if (hi->pool && force_reselect == 2)
+    {
+      idx = select_random_host (hi->pool, hi->poolidx);
+      if (idx == -1)
+        {
+          gpg_err_set_errno (ENOENT);
+          return NULL;
+        }
+      hi = hosttable[idx];
+    }
+  else if (force_reselect == 2)
+    {
+      /* Not a pool - there is no other host.  */
+      gpg_err_set_errno (ENOENT);
+      return NULL;
+    }
+  else if (hi->pool)
     {
-      /* If the currently selected host is now marked dead, force a
-         re-selection .  */
+      /* If the currently selected host is now marked dead or turned
+         out to be slow, force a re-selection .  */
       if (force_reselect)
         hi->poolidx = -1;
       else if (hi->poolidx >= 0 && hi->poolidx < hosttable_size
-               && hosttable[hi->poolidx] && hosttable[hi->poolidx]->dead)
+               && hosttable[hi->poolidx]
+               && (hosttable[hi->poolidx]->dead
+                   || host_slow_p (hosttable[hi->poolidx],
+                                   best_score (hi->pool))))
         hi->poolidx = -1;
 
       /* Select a host if needed.  */
       if (hi->poolidx == -1)
         {
-          hi->poolidx = select_random_host (hi->pool);
+          hi->poolidx = select_random_host (hi->pool, -1);
           if (hi->poolidx == -1)
             {
               log_error ("no alive host found in pool '%s'\n", name);
@@ -532,7 +665,20 @@ map_host (ctrl_t ctrl, const char *name, int force_reselect,
         }
 
       assert (hi->poolidx >= 0 && hi->poolidx < hosttable_size);
-      hi = hosttable[hi->poolidx];
+
+      /* A slow host due for a probe gets this one request so that
+         its response time is measured again.  The selected host is
+         not changed.  */
+      idx = for_request? select_probe_host (hi->pool, hi->poolidx) : -1;
+      if (idx != -1)
+        {
+          hosttable[idx]->probe = 0;
+          if (opt.verbose)
+            log_info ("using host '%s' for a probe\n", hosttable[idx]->name);
+          hi = hosttable[idx];
+        }
+      else
+        hi = hosttable[hi->poolidx];
       assert (hi);
     }
 
@@ -562,16 +708,16 @@ map_host (ctrl_t ctrl, const char *name, int force_reselect,
 }
 
 
-/* Mark the host NAME as dead.  NAME may be given as an URL.  Returns
-   true if a host was really marked as dead or was already marked dead
-   (e.g. by a concurrent session).  */
+/* Find the host NAME in our table.  NAME may be given as an URL.
+   Return the index into the hosttable or -1 if not found or NAME is
+   "localhost".  */
 static int
-mark_host_dead (const char *name)
+find_hostinfo_by_url (const char *name)
 {
   const char *host;
   char *host_buffer = NULL;
   parsed_uri_t parsed_uri = NULL;
-  int done = 0;
+  int idx = -1;
 
   if (name && *name && !http_parse_uri (&parsed_uri, name, 1))
     {
@@ -589,27 +735,92 @@ mark_host_dead (const char *name)
     host = name;
 
   if (host && *host && strcmp (host, "localhost"))
-    {
-      hostinfo_t hi;
-      int idx;
+    idx = find_hostinfo (host);
 
-      idx = find_hostinfo (host);
-      if (idx != -1)
+  http_release_parsed_uri (parsed_uri);
+  xfree (host_buffer);
+  return idx;
+}
+
+
+/* Mark the host NAME as dead.  NAME may be given as an URL.  Returns
+   true if a host was really marked as dead or was already marked dead
+   (e.g. by a concurrent session).  */
+static int
+mark_host_dead (const char *name)
+{
+  hostinfo_t hi;
+  int idx;
+
+  idx = find_hostinfo_by_url (name);
+  if (idx == -1)
+    return 0;
+
+  hi = hosttable[idx];
+  log_info ("marking host '%s' as dead%s\n",
+            hi->name, hi->dead? " (again)":"");
+  hi->dead = 1;
+  hi->died_at = gnupg_get_time ();
+  if (!hi->died_at)
+    hi->died_at = 1;
+  return 1;
+}
+
+
+/* Update the smoothed response time and error rate of the host used
+   for the request URL.  STARTTIME is the time the request was
+   started and FAILED is true if no response was received.  */
+static void
+note_host_response (const char *url, struct timespec *starttime, int failed)
+{
+  struct timespec curtime;
+  hostinfo_t hi;
+  unsigned int msec;
+  int idx;
+
+  idx = find_hostinfo_by_url (url);
+  if (idx == -1)
+    return;
+  hi = hosttable[idx];
+
+  npth_clock_gettime (&curtime);
+  msec = ((curtime.tv_sec - starttime->tv_sec) * 1000
+          + (curtime.tv_nsec - starttime->tv_nsec) / 1000000);
+  if (!msec)
+    msec = 1;
+
+  /* A failed request gives only an upper bound for the response
+     time; thus we use it only if it is larger than what we have.  */
+  if (!hi->rtt)
+    hi->rtt = msec;
+  else if (!failed || msec > hi->rtt)
+    hi->rtt = (hi->rtt * (EWMA_DIVISOR - 1) + msec) / EWMA_DIVISOR;
+  if (!hi->rtt)
+    hi->rtt = 1;
+  hi->errrate = ((hi->errrate * (EWMA_DIVISOR - 1) + (failed? 1000 : 0))
+                 / EWMA_DIVISOR);
+  hi->lastsample = gnupg_get_time ();
+
+  if (!failed)
+    {
+      for (idx=0; idx < RTT_BUCKETS - 1; idx++)
+        if (msec <= (RTT_BUCKET_BASE << idx))
+          break;
+      rtt_histogram[idx]++;
+      if (++rtt_histogram_total >= RTT_HISTOGRAM_MAX)
         {
-          hi = hosttable[idx];
-          log_info ("marking host '%s' as dead%s\n",
-                    hi->name, hi->dead? " (again)":"");
-          hi->dead = 1;
-          hi->died_at = gnupg_get_time ();
-          if (!hi->died_at)
-            hi->died_at = 1;
-          done = 1;
+          rtt_histogram_total = 0;
+          for (idx=0; idx < RTT_BUCKETS; idx++)
+            {
+              rtt_histogram[idx] /= 2;
+              rtt_histogram_total += rtt_histogram[idx];
+            }
         }
     }
 
-  http_release_parsed_uri (parsed_uri);
-  xfree (host_buffer);
-  return done;
+  if (DBG_LOOKUP)
+    log_debug ("host '%s': %ums%s (rtt=%u err=%u)\n", hi->name, msec,
+               failed? " failed":"", hi->rtt, hi->errrate);
 }
 
 
@@ -700,7 +911,8 @@ ks_hkp_print_hosttable (ctrl_t ctrl)
   char *p, *died;
   const char *diedstr;
 
-  err = ks_print_help (ctrl, "hosttable (idx, ipv6, ipv4, dead, name, time):");
+  err = ks_print_help (ctrl, "hosttable (idx, ipv6, ipv4, dead, name, time,"
+                       " rtt, errors):");
   if (err)
     return err;
 
@@ -730,6 +942,13 @@ ks_hkp_print_hosttable (ctrl_t ctrl)
         if (err)
           return err;
 
+        if (hi->rtt)
+          err = ks_printf_help (ctrl, "  .       rtt=%ums err=%u.%u%%%s",
+                                hi->rtt, hi->errrate / 10, hi->errrate % 10,
+                                hi->probe? " (probe)":"");
+        if (err)
+          return err;
+
         if (hi->cname)
           err = ks_printf_help (ctrl, "  .       %s", hi->cname);
         if (err)
@@ -785,12 +1004,12 @@ ks_hkp_help (ctrl_t ctrl, parsed_uri_t uri)
 
 /* Build the remote part of the URL from SCHEME, HOST and an optional
    PORT.  Returns an allocated string or NULL on failure and sets
-   ERRNO.  If R_HTTPHOST is not NULL it receive a mallcoed string with
-   the poolname.  */
+   ERRNO.  FOR_REQUEST is passed to map_host.  If R_HTTPHOST is not
+   NULL it receive a mallcoed string with the poolname.  */
 static char *
 make_host_part (ctrl_t ctrl,
                 const char *scheme, const char *host, unsigned short port,
-                int force_reselect,
+                int force_reselect, int for_request,
                 unsigned int *r_httpflags, char **r_httphost)
 {
   char portstr[10];
@@ -815,7 +1034,8 @@ make_host_part (ctrl_t ctrl,
       /*fixme_do_srv_lookup ()*/
     }
 
-  hostname = map_host (ctrl, host, force_reselect, r_httpflags, r_httphost);
+  hostname = map_host (ctrl, host, force_reselect, for_request,
+                       r_httpflags, r_httphost);
   if (!hostname)
     return NULL;
 
@@ -834,7 +1054,7 @@ ks_hkp_resolve (ctrl_t ctrl, parsed_uri_t uri)
   gpg_error_t err;
   char *hostport = NULL;
 
-  hostport = make_host_part (ctrl, uri->scheme, uri->host, uri->port, 1,
+  hostport = make_host_part (ctrl, uri->scheme, uri->host, uri->port, 1, 0,
                              NULL, NULL);
   if (!hostport)
     {
@@ -854,12 +1074,15 @@ ks_hkp_resolve (ctrl_t ctrl, parsed_uri_t uri)
 
 /* Housekeeping function called from the housekeeping thread.  It is
    used to mark dead hosts alive so that they may be tried again after
-   some time.  */
+   some time.  Slow hosts are marked for a probe so that map_host
+   routes the next request to them and their response time is
+   measured again.  */
 void
 ks_hkp_housekeeping (time_t curtime)
 {
-  int idx;
-  hostinfo_t hi;
+  int idx, idx2, n;
+  hostinfo_t hi, hi2;
+  unsigned int best;
 
   for (idx=0; idx < hosttable_size; idx++)
     {
@@ -877,6 +1100,26 @@ ks_hkp_housekeeping (time_t curtime)
           log_info ("resurrected host '%s'", hi->name);
         }
     }
+
+  for (idx=0; idx < hosttable_size; idx++)
+    {
+      hi = hosttable[idx];
+      if (!hi || !hi->pool)
+        continue;
+      best = best_score (hi->pool);
+      for (idx2=0; (n = hi->pool[idx2]) != -1; idx2++)
+        {
+          hi2 = hosttable[n];
+          if (!hi2 || hi2->dead || hi2->probe || !host_slow_p (hi2, best))
+            continue;
+          if (hi2->lastsample + PROBE_INTERVAL <= curtime
+              || hi2->lastsample > curtime)
+            {
+              hi2->probe = 1;
+              log_info ("probing slow host '%s' again\n", hi2->name);
+            }
+        }
+    }
 }
 
 
@@ -897,6 +1140,7 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
   int redirects_left = MAX_REDIRECTS;
   estream_t fp = NULL;
   char *request_buffer = NULL;
+  struct timespec starttime;
 
   *r_fp = NULL;
 
@@ -906,6 +1150,7 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
   http_session_set_log_cb (session, cert_log_cb);
 
  once_more:
+  npth_clock_gettime (&starttime);
   err = http_open (&http,
                    post_cb? HTTP_REQ_POST : HTTP_REQ_GET,
                    request,
@@ -938,18 +1183,24 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
       /* Fixme: After a redirection we show the old host name.  */
       log_error (_("error connecting to '%s': %s\n"),
                  hostportstr, gpg_strerror (err));
+      note_host_response (request, &starttime, 1);
+      stats_add_http (STATS_HKP, http, 1);
       goto leave;
     }
 
   /* Wait for the response.  */
   dirmngr_tick (ctrl);
   err = http_wait_response (http);
+  stats_add_http (STATS_HKP, http,
+                  err || http_get_status_code (http) >= 400);
   if (err)
     {
       log_error (_("error reading HTTP response for '%s': %s\n"),
                  hostportstr, gpg_strerror (err));
+      note_host_response (request, &starttime, 1);
       goto leave;
     }
+  note_host_response (request, &starttime, 0);
 
   if (http_get_tls_info (http, NULL))
     {
@@ -1058,6 +1309,293 @@ handle_send_request_error (gpg_error_t err, const char *request,
   return retry;
 }
 
+/* Return the delay in milliseconds after which a hedged request is
+   sent.  This is the 95th percentile of the recent response times.  */
+static unsigned int
+hedge_delay (void)
+{
+  unsigned int limit, sum;
+  int idx;
+
+  if (rtt_histogram_total < 20)
+    return HEDGE_DEFAULT_DELAY;
+
+  limit = (rtt_histogram_total * 95 + 99) / 100;
+  for (idx=0, sum=0; idx < RTT_BUCKETS - 1; idx++)
+    if ((sum += rtt_histogram[idx]) >= limit)
+      break;
+  if ((RTT_BUCKET_BASE << idx) < HEDGE_MIN_DELAY)
+    return HEDGE_MIN_DELAY;
+  return RTT_BUCKET_BASE << idx;
+}
+
+
+/* One of the requests of a hedged request.  */
+struct hedge_part_s
+{
+  struct hedge_s *hedge; /* The shared state.  */
+  char *request;
+  char *hostport;
+  char *httphost;
+  unsigned int httpflags;
+  int done;              /* The request has been finished.  */
+  gpg_error_t err;       /* Its result.  */
+  estream_t fp;          /* The response or NULL.  */
+};
+
+/* The state of a hedged request.  It is shared between the caller
+   and the threads running the requests and released by the last
+   one.  */
+struct hedge_s
+{
+  npth_mutex_t lock;
+  npth_cond_t cond;
+  int refcount;
+  struct hedge_part_s part[2];
+};
+
+
+/* Drop a reference to HEDGE and release it if this was the last
+   one.  */
+static void
+release_hedge (struct hedge_s *hedge)
+{
+  int last, i;
+
+  npth_mutex_lock (&hedge->lock);
+  last = !--hedge->refcount;
+  npth_mutex_unlock (&hedge->lock);
+  if (!last)
+    return;
+
+  for (i=0; i < DIM (hedge->part); i++)
+    {
+      es_fclose (hedge->part[i].fp);
+      xfree (hedge->part[i].request);
+      xfree (hedge->part[i].hostport);
+      xfree (hedge->part[i].httphost);
+    }
+  npth_cond_destroy (&hedge->cond);
+  npth_mutex_destroy (&hedge->lock);
+  xfree (hedge);
+}
+
+
+/* Thread to run one request of a hedged request.  The thread does not
+   use the CTRL object because the caller may already be gone when
+   the request finishes.  */
+static void *
+hedge_thread (void *arg)
+{
+  struct hedge_part_s *part = arg;
+  struct hedge_s *hedge = part->hedge;
+  gpg_error_t err;
+  estream_t fp;
+
+  err = send_request (NULL, part->request, part->hostport, part->httphost,
+                      part->httpflags, NULL, NULL, &fp);
+
+  npth_mutex_lock (&hedge->lock);
+  part->err = err;
+  part->fp = err? NULL : fp;
+  part->done = 1;
+  npth_cond_broadcast (&hedge->cond);
+  npth_mutex_unlock (&hedge->lock);
+
+  release_hedge (hedge);
+  return NULL;
+}
+
+
+/* Start a thread to send the request of PART.  */
+static gpg_error_t
+start_hedge_thread (struct hedge_part_s *part)
+{
+  npth_attr_t tattr;
+  npth_t thread;
+  int rc;
+
+  npth_attr_init (&tattr);
+  npth_attr_setdetachstate (&tattr, NPTH_CREATE_DETACHED);
+  npth_mutex_lock (&part->hedge->lock);
+  part->hedge->refcount++;
+  npth_mutex_unlock (&part->hedge->lock);
+  rc = npth_create (&thread, &tattr, hedge_thread, part);
+  npth_attr_destroy (&tattr);
+  if (rc)
+    {
+      log_error ("error spawning hedge thread: %s\n", strerror (rc));
+      npth_mutex_lock (&part->hedge->lock);
+      part->hedge->refcount--;
+      npth_mutex_unlock (&part->hedge->lock);
+      return gpg_error_from_errno (rc);
+    }
+  return 0;
+}
+
+
+/* Prepare the second request of HEDGE, which is the request of the
+   first one sent to another host of the pool given by URI.  Returns
+   true on success.  */
+static int
+prepare_hedge (ctrl_t ctrl, parsed_uri_t uri, struct hedge_s *hedge)
+{
+  struct hedge_part_s *first = hedge->part;
+  struct hedge_part_s *part = hedge->part + 1;
+  const char *path;
+
+  path = first->request + strlen (first->hostport);
+  part->hostport = make_host_part (ctrl, uri->scheme, uri->host, uri->port,
+                                   2, 1, &part->httpflags, &part->httphost);
+  if (!part->hostport)
+    return 0;
+  part->request = strconcat (part->hostport, path, NULL);
+  if (!part->request)
+    return 0;
+  return 1;
+}
+
+
+/* Send the HTTP GET request REQUEST for a host of the pool URI like
+   send_request.  If hedging is enabled and the host HOSTPORT does not
+   answer in time, the request is also sent to another host of the
+   pool and the first response is used.  In this case the HOSTPORT of
+   the host which answered is stored at HOSTPORT.  */
+static gpg_error_t
+send_hedged_request (ctrl_t ctrl, parsed_uri_t uri, const char *request,
+                     char **hostport, const char *httphost,
+                     unsigned int httpflags, estream_t *r_fp)
+{
+  gpg_error_t err;
+  struct hedge_s *hedge;
+  struct hedge_part_s *part;
+  struct timespec curtime, deadline, abstime;
+  unsigned int delay;
+  int nparts, winner, i;
+  int hedging = 1;
+
+  *r_fp = NULL;
+
+  if (!opt.hedge_hkp_requests)
+    return send_request (ctrl, request, *hostport, httphost, httpflags,
+                         NULL, NULL, r_fp);
+
+  hedge = xtrycalloc (1, sizeof *hedge);
+  if (!hedge)
+    return gpg_error_from_syserror ();
+  npth_mutex_init (&hedge->lock, NULL);
+  npth_cond_init (&hedge->cond, NULL);
+  hedge->refcount = 1;
+  for (i=0; i < DIM (hedge->part); i++)
+    hedge->part[i].hedge = hedge;
+
+  part = hedge->part;
+  part->request = xtrystrdup (request);
+  part->hostport = xtrystrdup (*hostport);
+  part->httphost = httphost? xtrystrdup (httphost) : NULL;
+  part->httpflags = httpflags;
+  if (!part->request || !part->hostport || (httphost && !part->httphost))
+    {
+      err = gpg_error_from_syserror ();
+      release_hedge (hedge);
+      return err;
+    }
+  if (start_hedge_thread (part))
+    {
+      release_hedge (hedge);
+      return send_request (ctrl, request, *hostport, httphost, httpflags,
+                           NULL, NULL, r_fp);
+    }
+  nparts = 1;
+
+  delay = hedge_delay ();
+  npth_clock_gettime (&deadline);
+  deadline.tv_sec += delay / 1000;
+  deadline.tv_nsec += (delay % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+  err = 0;
+  winner = -1;
+  npth_mutex_lock (&hedge->lock);
+  for (;;)
+    {
+      /* The first successful response wins.  If all requests failed
+         we return the result of the first one.  */
+      for (i=0; i < nparts; i++)
+        if (hedge->part[i].done && !hedge->part[i].err)
+          break;
+      if (i < nparts)
+        {
+          winner = i;
+          break;
+        }
+      for (i=0; i < nparts; i++)
+        if (!hedge->part[i].done)
+          break;
+      if (i == nparts)
+        {
+          winner = 0;
+          break;
+        }
+
+      npth_clock_gettime (&curtime);
+      if (nparts == 1 && hedging
+          && !(npth_timercmp (&curtime, &deadline, <)))
+        {
+          npth_mutex_unlock (&hedge->lock);
+          if (prepare_hedge (ctrl, uri, hedge)
+              && !start_hedge_thread (hedge->part + 1))
+            {
+              log_info ("no response from '%s' after %ums"
+                        " - also asking '%s'\n",
+                        *hostport, delay, hedge->part[1].hostport);
+              nparts = 2;
+            }
+          else
+            hedging = 0;  /* No other host available; simply wait.  */
+          npth_mutex_lock (&hedge->lock);
+          continue;
+        }
+
+      /* Wake up at least once a second for dirmngr_tick.  */
+      abstime = curtime;
+      abstime.tv_sec++;
+      if (nparts == 1 && hedging && npth_timercmp (&deadline, &abstime, <))
+        abstime = deadline;
+      npth_cond_timedwait (&hedge->cond, &hedge->lock, &abstime);
+
+      npth_mutex_unlock (&hedge->lock);
+      err = dirmngr_tick (ctrl);
+      npth_mutex_lock (&hedge->lock);
+      if (err)
+        break;
+    }
+
+  if (winner != -1)
+    {
+      part = hedge->part + winner;
+      err = part->err;
+      *r_fp = part->fp;
+      part->fp = NULL;
+      if (winner && !err)
+        {
+          log_info ("response from '%s' arrived first\n", part->hostport);
+          xfree (*hostport);
+          *hostport = part->hostport;
+          part->hostport = NULL;
+        }
+    }
+  npth_mutex_unlock (&hedge->lock);
+
+  release_hedge (hedge);
+  return err;
+}
+
+
 static gpg_error_t
 armor_data (char **r_string, const void *data, size_t datalen)
 {
@@ -1182,7 +1720,7 @@ ks_hkp_search (ctrl_t ctrl, parsed_uri_t uri, const char *pattern,
     xfree (hostport);
     xfree (httphost); httphost = NULL;
     hostport = make_host_part (ctrl, uri->scheme, uri->host, uri->port,
-                               reselect, &httpflags, &httphost);
+                               reselect, 1, &httpflags, &httphost);
     if (!hostport)
       {
         err = gpg_error_from_syserror ();
@@ -1210,8 +1748,8 @@ ks_hkp_search (ctrl_t ctrl, parsed_uri_t uri, const char *pattern,
   }
 
   /* Send the request.  */
-  err = send_request (ctrl, request, hostport, httphost, httpflags,
-                      NULL, NULL, &fp);
+  err = send_hedged_request (ctrl, uri, request, &hostport, httphost,
+                             httpflags, &fp);
   if (handle_send_request_error (err, request, &tries))
     {
       reselect = 1;
@@ -1325,7 +1863,7 @@ ks_hkp_get (ctrl_t ctrl, parsed_uri_t uri, const char *keyspec, estream_t *r_fp)
   xfree (hostport);
   xfree (httphost); httphost = NULL;
   hostport = make_host_part (ctrl, uri->scheme, uri->host, uri->port,
-                             reselect, &httpflags, &httphost);
+                             reselect, 1, &httpflags, &httphost);
   if (!hostport)
     {
       err = gpg_error_from_syserror ();
@@ -1345,8 +1883,8 @@ ks_hkp_get (ctrl_t ctrl, parsed_uri_t uri, const char *keyspec, estream_t *r_fp)
     }
 
   /* Send the request.  */
-  err = send_request (ctrl, request, hostport, httphost, httpflags,
-                      NULL, NULL, &fp);
+  err = send_hedged_request (ctrl, uri, request, &hostport, httphost,
+                             httpflags, &fp);
   if (handle_send_request_error (err, request, &tries))
     {
       reselect = 1;
@@ -1440,7 +1978,7 @@ ks_hkp_put (ctrl_t ctrl, parsed_uri_t uri, const void *data, size_t datalen)
   xfree (hostport);
   xfree (httphost); httphost = NULL;
   hostport = make_host_part (ctrl, uri->scheme, uri->host, uri->port,
-                             reselect, &httpflags, &httphost);
+                             reselect, 1, &httpflags, &httphost);
   if (!hostport)
     {
       err = gpg_error_from_syserror ();
@@ -37,7 +37,12 @@
       cancellation of a query at any point of time.
 
    4. Given that we are going out to the network and usually get back
-      a long response, the fork/exec overhead is acceptable.
+      a long response, the fork/exec overhead is acceptable.  To
+      avoid it anyway for frequent queries, the wrapper processes are
+      kept running after a query: They read further queries from
+      stdin and keep their bound connections open (see the server
+      mode of dirmngr_ldap.c).  Each response is sent in frames so
+      that we can tell where it ends.
 
    Note that under WindowsCE the number of processes is strongly
    limited (32 processes including the kernel processes) and thus we
@@ -61,11 +66,10 @@
 #include "exechelp.h"
 #include "misc.h"
 #include "ldap-wrapper.h"
+#include "stats.h"
 
 
-#ifdef HAVE_W32_SYSTEM
-#define setenv(a,b,c) SetEnvironmentVariable ((a),(b))
-#else
+#ifndef HAVE_W32_SYSTEM
 #define pth_close(fd) close(fd)
 #endif
 
@@ -84,6 +88,16 @@
 
 #define TIMERTICK_INTERVAL 2
 
+/* The number of idle wrapper processes we keep for further queries
+   and the time after which an idle process is terminated.  */
+#define MAX_IDLE_WRAPPERS 4
+#define IDLE_TIMEOUT (60*5)  /* seconds */
+
+/* The maximum number of bytes the reaper thread skips to get to the
+   end of a response which has not been read completely.  If there is
+   more data, the process is killed instead.  */
+#define MAX_DRAIN_BYTES (64*1024)
+
 /* To keep track of the LDAP wrapper state we use this structure.  */
 struct wrapper_context_s
 {
@@ -92,6 +106,7 @@ struct wrapper_context_s
   pid_t pid;    /* The pid of the wrapper process. */
   int printable_pid; /* Helper to print diagnostics after the process has
                         been cleaned up. */
+  int in_fd;    /* Connected with stdin of the ldap wrapper.  */
   int fd;       /* Connected with stdout of the ldap wrapper.  */
   gpg_error_t fd_error; /* Set to the gpg_error of the last read error
                            if any.  */
@@ -103,6 +118,18 @@ struct wrapper_context_s
   size_t linesize;/* Allocated size of LINE.  */
   size_t linelen; /* Use size of LINE.  */
   time_t stamp;   /* The last time we noticed ativity.  */
+  int busy;       /* A query is being processed.  */
+  char *server;   /* The server of the last query (malloced).  */
+  time_t idle_since; /* The time the last query was finished.  */
+  unsigned char frame[5]; /* The header of the current frame.  */
+  size_t framepos;  /* Number of bytes of FRAME already read.  */
+  size_t frameleft; /* Bytes left in the current data frame.  */
+  int eor;        /* The end of the response has been seen.  */
+  int draining;   /* The reader has been released and the reaper
+                     thread skips the rest of the response.  */
+  size_t drained; /* Number of bytes skipped so far.  */
+  unsigned long readtime; /* Milliseconds spent waiting for the
+                             response after its first byte.  */
 };
 
 
@@ -120,6 +147,9 @@ static int shutting_down;
   do { int _fd = fd; if (_fd != -1) { close (_fd); fd = -1;} } while (0)
 
 
+static void drain_response (struct wrapper_context_s *ctx);
+
+
 
 
 /* Read a fixed amount of data from READER into BUFFER.  */
@@ -151,8 +181,10 @@ destroy_wrapper (struct wrapper_context_s *ctx)
       gnupg_release_process (ctx->pid);
     }
   ksba_reader_release (ctx->reader);
+  SAFE_CLOSE (ctx->in_fd);
   SAFE_CLOSE (ctx->fd);
   SAFE_CLOSE (ctx->log_fd);
+  xfree (ctx->server);
   xfree (ctx->line);
   xfree (ctx);
 }
@@ -262,23 +294,10 @@ ldap_wrapper_thread (void *dummy)
   int saved_errno;
   fd_set fdset, read_fdset;
   int ret;
-  time_t exptime;
+  time_t exptime, idletime;
 
   (void)dummy;
 
-  FD_ZERO (&fdset);
-  nfds = -1;
-  for (ctx = wrapper_list; ctx; ctx = ctx->next)
-    {
-      if (ctx->log_fd != -1)
-	{
-	  FD_SET (ctx->log_fd, &fdset);
-	  if (ctx->log_fd > nfds)
-	    nfds = ctx->log_fd;
-	}
-    }
-  nfds++;
-
   npth_clock_gettime (&abstime);
   abstime.tv_sec += TIMERTICK_INTERVAL;
 
@@ -286,6 +305,27 @@ ldap_wrapper_thread (void *dummy)
     {
       int any_action = 0;
 
+      /* The list of wrappers changes all the time, thus we need to
+         build the set of log fds for each round.  */
+      FD_ZERO (&fdset);
+      nfds = -1;
+      for (ctx = wrapper_list; ctx; ctx = ctx->next)
+        {
+          if (ctx->log_fd != -1)
+            {
+              FD_SET (ctx->log_fd, &fdset);
+              if (ctx->log_fd > nfds)
+                nfds = ctx->log_fd;
+            }
+          if (ctx->draining && ctx->fd != -1)
+            {
+              FD_SET (ctx->fd, &fdset);
+              if (ctx->fd > nfds)
+                nfds = ctx->fd;
+            }
+        }
+      nfds++;
+
       /* POSIX says that fd_set should be implemented as a structure,
          thus a simple assignment is fine to copy the entire set.  */
       read_fdset = fdset;
@@ -302,7 +342,7 @@ ldap_wrapper_thread (void *dummy)
 
       /* FIXME: For Windows, we have to use a reader thread on the
 	 pipe that signals an event (and a npth_select_ev variant).  */
-      ret = npth_pselect (nfds + 1, &read_fdset, NULL, NULL, &timeout, NULL);
+      ret = npth_pselect (nfds, &read_fdset, NULL, NULL, &timeout, NULL);
       saved_errno = errno;
 
       if (ret == -1 && saved_errno != EINTR)
@@ -314,14 +354,19 @@ ldap_wrapper_thread (void *dummy)
 	}
 
       if (ret <= 0)
-	/* Interrupt or timeout.  Will be handled when calculating the
-	   next timeout.  */
-	continue;
+        {
+          /* Interrupt or timeout.  The next timeout is computed
+             above; we only need to check the processes.  */
+          FD_ZERO (&read_fdset);
+        }
 
       /* All timestamps before exptime should be considered expired.  */
       exptime = time (NULL);
+      idletime = exptime;
       if (exptime > INACTIVITY_TIMEOUT)
         exptime -= INACTIVITY_TIMEOUT;
+      if (idletime > IDLE_TIMEOUT)
+        idletime -= IDLE_TIMEOUT;
 
       /* Note that there is no need to lock the list because we always
          add entries at the head (with a pending event status) and
@@ -337,6 +382,15 @@ ldap_wrapper_thread (void *dummy)
                 any_action = 1;
             }
 
+          /* Skip the rest of a response nobody is interested in.  */
+          if (nfds && ctx->draining && ctx->fd != -1
+              && FD_ISSET (ctx->fd, &read_fdset))
+            {
+              drain_response (ctx);
+              if (!ctx->draining)
+                any_action = 1;
+            }
+
           /* Check whether the process is still running.  */
           if (ctx->pid != (pid_t)(-1))
             {
@@ -375,7 +429,7 @@ ldap_wrapper_thread (void *dummy)
             }
 
           /* Check whether we should terminate the process. */
-          if (ctx->pid != (pid_t)(-1)
+          if (ctx->pid != (pid_t)(-1) && ctx->busy
               && ctx->stamp != (time_t)(-1) && ctx->stamp < exptime)
             {
               gnupg_kill_process (ctx->pid);
@@ -387,6 +441,22 @@ ldap_wrapper_thread (void *dummy)
               SAFE_CLOSE (ctx->log_fd);
               any_action = 1;
             }
+
+          /* Let an idle process terminate if it has not been used for
+             some time or we are shutting down.  Closing its stdin
+             tells it to exit.  A process whose response is being
+             skipped exits after that response.  */
+          if (ctx->pid != (pid_t)(-1) && ctx->in_fd != -1
+              && ((!ctx->busy
+                   && (shutting_down || ctx->idle_since < idletime))
+                  || (ctx->draining && shutting_down)))
+            {
+              if (DBG_LOOKUP)
+                log_info ("ldap wrapper %d idle - terminating\n",
+                          (int)ctx->pid);
+              SAFE_CLOSE (ctx->in_fd);
+              any_action = 1;
+            }
         }
 
       /* If something has been printed to the log file or we got an
@@ -396,12 +466,13 @@ ldap_wrapper_thread (void *dummy)
         {
           log_info ("ldap worker stati:\n");
           for (ctx = wrapper_list; ctx; ctx = ctx->next)
-            log_info ("  c=%p pid=%d/%d rdr=%p ctrl=%p/%d la=%lu rdy=%d\n",
+            log_info ("  c=%p pid=%d/%d rdr=%p ctrl=%p/%d la=%lu rdy=%d"
+                      " busy=%d\n",
                       ctx,
                       (int)ctx->pid, (int)ctx->printable_pid,
                       ctx->reader,
                       ctx->ctrl, ctx->ctrl? ctx->ctrl->refcount:0,
-                      (unsigned long)ctx->stamp, ctx->ready);
+                      (unsigned long)ctx->stamp, ctx->ready, ctx->busy);
         }
 
 
@@ -472,12 +543,275 @@ ldap_wrapper_wait_connections ()
 }
 
 
+
+
+/* Read up to COUNT bytes from the stdout of the wrapper into BUFFER
+   and store the number of bytes read at NREAD.  While waiting for
+   data the dirmngr_tick function is called.  Returns 0 on success, 1
+   on EOF, and -1 on error with the error code stored in the
+   context.  */
+static int
+read_wrapper_output (struct wrapper_context_s *ctx,
+                     void *buffer, size_t count, size_t *nread)
+{
+  int nfds;
+  struct timespec abstime;
+  struct timespec curtime;
+  struct timespec timeout;
+  int saved_errno;
+  fd_set fdset, read_fdset;
+  int ret;
+  int n;
+  gpg_error_t err;
+  unsigned long starttime;
+
+  FD_ZERO (&fdset);
+  FD_SET (ctx->fd, &fdset);
+  nfds = ctx->fd + 1;
+
+  starttime = stats_get_msec ();
+
+  npth_clock_gettime (&abstime);
+  abstime.tv_sec += TIMERTICK_INTERVAL;
+
+  for (;;)
+    {
+      npth_clock_gettime (&curtime);
+      if (!(npth_timercmp (&curtime, &abstime, <)))
+	{
+	  err = dirmngr_tick (ctx->ctrl);
+          if (err)
+            {
+              ctx->fd_error = err;
+              SAFE_CLOSE (ctx->fd);
+              return -1;
+            }
+	  npth_clock_gettime (&abstime);
+	  abstime.tv_sec += TIMERTICK_INTERVAL;
+	}
+      npth_timersub (&abstime, &curtime, &timeout);
+
+      read_fdset = fdset;
+      ret = npth_pselect (nfds, &read_fdset, NULL, NULL, &timeout, NULL);
+      saved_errno = errno;
+
+      if (ret == -1 && saved_errno != EINTR)
+	{
+          ctx->fd_error = gpg_error_from_errno (saved_errno);
+          SAFE_CLOSE (ctx->fd);
+          return -1;
+        }
+      if (ret > 0)
+        break;
+      /* Timeout.  Will be handled when calculating the next timeout.  */
+    }
+  ctx->readtime += stats_get_msec () - starttime;
+
+  /* This should not block now that select returned with a file
+     descriptor.  So it shouldn't be necessary to use npth_read (and
+     it is slightly dangerous in the sense that a concurrent thread
+     might (accidentially?) change the status of ctx->fd before we
+     read.  FIXME: Set ctx->fd to nonblocking?  */
+  n = read (ctx->fd, buffer, count);
+  if (n < 0)
+    {
+      ctx->fd_error = gpg_error_from_errno (errno);
+      SAFE_CLOSE (ctx->fd);
+      return -1;
+    }
+  if (!n)
+    return 1; /* EOF.  */
+
+  if (ctx->stamp != (time_t)(-1))
+    ctx->stamp = time (NULL);
+  *nread = n;
+  return 0;
+}
+
+
+/* Note the end of the current response of CTX.  STATUS is the exit
+   status of the query as sent by the wrapper.  */
+static void
+query_finished (struct wrapper_context_s *ctx, int status)
+{
+  ctx->eor = 1;
+  if (status)
+    log_info (_("ldap wrapper %d: query failed: exitcode=%d\n"),
+              ctx->printable_pid, status);
+  else if (DBG_LOOKUP)
+    log_info ("ldap wrapper %d: query finished\n", ctx->printable_pid);
+}
+
+
+/* This is the callback used by the ldap wrapper to feed the ksba
+   reader with the wrappers stdout.  See the description of
+   ksba_reader_set_cb for details.  The response is sent by the
+   wrapper in 'D' frames with the data and an 'S' frame with the
+   status at the end; we only pass on the data.  */
+static int
+reader_callback (void *cb_value, char *buffer, size_t count,  size_t *nread)
+{
+  struct wrapper_context_s *ctx = cb_value;
+  size_t nleft = count;
+  size_t n;
+  int rc;
+
+  /* FIXME: We might want to add some internal buffering because the
+     ksba code does not do any buffering for itself (because a ksba
+     reader may be detached from another stream to read other data and
+     the it would be cumbersome to get back already buffered
+     stuff).  */
+
+  if (!buffer && !count && !nread)
+    return -1; /* Rewind is not supported. */
+
+  /* If we ever encountered a read error don't allow to continue and
+     possible overwrite the last error cause.  Bail out also if the
+     file descriptor has been closed. */
+  if (ctx->fd_error || ctx->fd == -1)
+    {
+      *nread = 0;
+      return -1;
+    }
+
+  while (nleft > 0 && !ctx->eor)
+    {
+      if (!ctx->frameleft)
+        {
+          /* Read the next frame header.  */
+          rc = read_wrapper_output (ctx, ctx->frame + ctx->framepos,
+                                    sizeof ctx->frame - ctx->framepos, &n);
+          if (rc < 0)
+            return -1;
+          if (rc)
+            break;  /* EOF.  */
+          ctx->framepos += n;
+          if (ctx->framepos < sizeof ctx->frame)
+            continue;
+          ctx->framepos = 0;
+          n = (((size_t)ctx->frame[1] << 24) | (ctx->frame[2] << 16)
+               | (ctx->frame[3] << 8) | ctx->frame[4]);
+          if (ctx->frame[0] == 'D')
+            ctx->frameleft = n;
+          else if (ctx->frame[0] == 'S')
+            query_finished (ctx, (int)n);
+          else
+            {
+              ctx->fd_error = gpg_error (GPG_ERR_INV_RESPONSE);
+              SAFE_CLOSE (ctx->fd);
+              return -1;
+            }
+          continue;
+        }
+
+      rc = read_wrapper_output (ctx, buffer,
+                                nleft < ctx->frameleft? nleft : ctx->frameleft,
+                                &n);
+      if (rc < 0)
+        return -1;
+      if (rc)
+        break;  /* EOF.  */
+      ctx->frameleft -= n;
+      nleft -= n;
+      buffer += n;
+    }
+  if (nleft == count)
+    return -1; /* EOF. */
+  *nread = count - nleft;
+
+  return 0;
+}
+
+
+/* Skip the LENGTH bytes of the response in BUFFER, which have been
+   read after the reader was released.  Returns true if the response
+   is malformed.  */
+static int
+skip_response_data (struct wrapper_context_s *ctx,
+                    const unsigned char *buffer, size_t length)
+{
+  size_t n;
+
+  while (length)
+    {
+      if (ctx->eor)
+        return 1;  /* Garbage after the end of the response.  */
+      if (ctx->frameleft)
+        {
+          n = length < ctx->frameleft? length : ctx->frameleft;
+          ctx->frameleft -= n;
+          buffer += n;
+          length -= n;
+          continue;
+        }
+      ctx->frame[ctx->framepos++] = *buffer++;
+      length--;
+      if (ctx->framepos < sizeof ctx->frame)
+        continue;
+      ctx->framepos = 0;
+      n = (((size_t)ctx->frame[1] << 24) | (ctx->frame[2] << 16)
+           | (ctx->frame[3] << 8) | ctx->frame[4]);
+      if (ctx->frame[0] == 'D')
+        ctx->frameleft = n;
+      else if (ctx->frame[0] == 'S')
+        query_finished (ctx, (int)n);
+      else
+        return 1;
+    }
+  return 0;
+}
+
+
+/* Read the rest of the response for the released reader of CTX.
+   This is called by the reaper thread if data is available.  Once
+   the end of the response has been seen, the process may be used for
+   the next query.  If the response is too long or can't be read, the
+   process is killed.  */
+static void
+drain_response (struct wrapper_context_s *ctx)
+{
+  unsigned char buffer[4096];
+  int n;
+
+  do
+    n = read (ctx->fd, buffer, sizeof buffer);
+  while (n < 0 && errno == EINTR);
+
+  if (n > 0)
+    {
+      ctx->stamp = time (NULL);
+      ctx->drained += n;
+    }
+  if (n <= 0 || ctx->drained > MAX_DRAIN_BYTES
+      || skip_response_data (ctx, buffer, n))
+    {
+      if (DBG_LOOKUP)
+        log_info ("ldap wrapper %d: can't skip the response - killing\n",
+                  ctx->printable_pid);
+      if (ctx->pid != (pid_t)(-1))
+        gnupg_kill_process (ctx->pid);
+      SAFE_CLOSE (ctx->in_fd);
+      SAFE_CLOSE (ctx->fd);
+      ctx->draining = 0;
+      ctx->busy = 0;
+    }
+  else if (ctx->eor)
+    {
+      ctx->draining = 0;
+      ctx->busy = 0;
+      ctx->eor = 0;
+      ctx->idle_since = time (NULL);
+    }
+}
+
+
 /* This function is to be used to release a context associated with the
    given reader object. */
 void
 ldap_wrapper_release_context (ksba_reader_t reader)
 {
   struct wrapper_context_s *ctx;
+  int nidle;
 
   if (!reader )
     return;
@@ -492,8 +826,37 @@ ldap_wrapper_release_context (ksba_reader_t reader)
                     ctx->reader,
                     ctx->ctrl, ctx->ctrl? ctx->ctrl->refcount:0);
 
+        if (!ctx->fd_error)
+          stats_add (STATS_LDAP, STATS_BODY, ctx->readtime);
+        stats_count_request (STATS_LDAP, !!ctx->fd_error);
+
         ctx->reader = NULL;
-        SAFE_CLOSE (ctx->fd);
+        if (ctx->in_fd != -1 && ctx->eor)
+          {
+            /* The process may be used for the next query.  */
+            ctx->busy = 0;
+            ctx->eor = 0;
+            ctx->idle_since = time (NULL);
+          }
+        else if (ctx->in_fd != -1 && ctx->fd != -1 && !ctx->fd_error)
+          {
+            /* The response has not been read completely.  We don't
+               want to block the caller until the rest has arrived;
+               thus the reaper thread skips it and the process stays
+               busy until then.  */
+            ctx->draining = 1;
+            ctx->drained = 0;
+            ctx->stamp = time (NULL);
+          }
+        else
+          {
+            /* We can't use this process anymore.  */
+            if (ctx->pid != (pid_t)(-1))
+              gnupg_kill_process (ctx->pid);
+            SAFE_CLOSE (ctx->in_fd);
+            SAFE_CLOSE (ctx->fd);
+            ctx->busy = 0;
+          }
         if (ctx->ctrl)
           {
             ctx->ctrl->refcount--;
@@ -504,6 +867,15 @@ ldap_wrapper_release_context (ksba_reader_t reader)
                     ctx->printable_pid, gpg_strerror (ctx->fd_error));
         break;
       }
+
+  /* Do not keep more idle processes than needed.  */
+  if (ctx && ctx->in_fd != -1)
+    {
+      nidle = 0;
+      for (ctx=wrapper_list; ctx; ctx=ctx->next)
+        if (ctx->in_fd != -1 && !ctx->busy && ++nidle > MAX_IDLE_WRAPPERS)
+          SAFE_CLOSE (ctx->in_fd);
+    }
 }
 
 /* Cleanup all resources held by the connection associated with
@@ -520,6 +892,7 @@ ldap_wrapper_connection_cleanup (ctrl_t ctrl)
         ctx->ctrl = NULL;
         if (ctx->pid != (pid_t)(-1))
           gnupg_kill_process (ctx->pid);
+        SAFE_CLOSE (ctx->in_fd);
         if (ctx->fd_error)
           log_info (_("reading from ldap wrapper %d failed: %s\n"),
                     ctx->printable_pid, gpg_strerror (ctx->fd_error));
@@ -527,133 +900,124 @@ ldap_wrapper_connection_cleanup (ctrl_t ctrl)
 }
 
 
-/* This is the callback used by the ldap wrapper to feed the ksba
-   reader with the wrappers stdout.  See the description of
-   ksba_reader_set_cb for details.  */
-static int
-reader_callback (void *cb_value, char *buffer, size_t count,  size_t *nread)
+/* Return a malloced string describing the server used by the query
+   given by ARGV.  This is used to run a query by a process which has
+   already a connection to that server.  Returns NULL on error.  */
+static char *
+query_server (const char *argv[])
 {
-  struct wrapper_context_s *ctx = cb_value;
-  size_t nleft = count;
-  int nfds;
-  struct timespec abstime;
-  struct timespec curtime;
-  struct timespec timeout;
-  int saved_errno;
-  fd_set fdset, read_fdset;
-  int ret;
-
-  /* FIXME: We might want to add some internal buffering because the
-     ksba code does not do any buffering for itself (because a ksba
-     reader may be detached from another stream to read other data and
-     the it would be cumbersome to get back already buffered
-     stuff).  */
-
-  if (!buffer && !count && !nread)
-    return -1; /* Rewind is not supported. */
+  membuf_t mb;
+  const char *s;
+  int i;
 
-  /* If we ever encountered a read error don't allow to continue and
-     possible overwrite the last error cause.  Bail out also if the
-     file descriptor has been closed. */
-  if (ctx->fd_error || ctx->fd == -1)
+  init_membuf (&mb, 100);
+  for (i = 0; argv[i]; i++)
     {
-      *nread = 0;
-      return -1;
+      if (!argv[i+1])
+        {
+          /* The URL: Take the scheme and the host part.  */
+          s = strstr (argv[i], "://");
+          if (s)
+            {
+              s += 3;
+              s += strcspn (s, "/?");
+              put_membuf (&mb, argv[i], s - argv[i]);
+            }
+        }
+      else if (!strcmp (argv[i], "--proxy") || !strcmp (argv[i], "--host")
+               || !strcmp (argv[i], "--port") || !strcmp (argv[i], "--user"))
+        {
+          put_membuf_str (&mb, argv[i]);
+          put_membuf (&mb, " ", 1);
+          put_membuf_str (&mb, argv[++i]);
+          put_membuf (&mb, " ", 1);
+        }
+      else if (!strcmp (argv[i], "--pass"))
+        i++;
     }
+  put_membuf (&mb, "", 1);
+  return get_membuf (&mb, NULL);
+}
 
-  FD_ZERO (&fdset);
-  FD_SET (ctx->fd, &fdset);
-  nfds = ctx->fd + 1;
 
-  npth_clock_gettime (&abstime);
-  abstime.tv_sec += TIMERTICK_INTERVAL;
+/* Build the query for the arguments ARGV as sent to the wrapper
+   process: One argument per line with '%' and line feeds percent
+   escaped and an empty line at the end.  Returns a malloced buffer
+   and its length at R_LEN or NULL on error.  */
+static char *
+build_query (const char *argv[], size_t *r_len)
+{
+  membuf_t mb;
+  const char *s;
+  int i;
 
-  while (nleft > 0)
+  init_membuf (&mb, 256);
+  for (i = 0; argv[i]; i++)
     {
-      int n;
-      gpg_error_t err;
+      for (s = argv[i]; *s; s++)
+        if (*s == '%' || *s == '\n' || *s == '\r')
+          put_membuf_printf (&mb, "%%%02X", *(const unsigned char *)s);
+        else
+          put_membuf (&mb, s, 1);
+      put_membuf (&mb, "\n", 1);
+    }
+  put_membuf (&mb, "\n", 1);
+  return get_membuf (&mb, r_len);
+}
 
-      npth_clock_gettime (&curtime);
-      if (!(npth_timercmp (&curtime, &abstime, <)))
-	{
-	  err = dirmngr_tick (ctx->ctrl);
-          if (err)
-            {
-              ctx->fd_error = err;
-              SAFE_CLOSE (ctx->fd);
-              return -1;
-            }
-	  npth_clock_gettime (&abstime);
-	  abstime.tv_sec += TIMERTICK_INTERVAL;
-	}
-      npth_timersub (&abstime, &curtime, &timeout);
 
-      read_fdset = fdset;
-      ret = npth_pselect (nfds, &read_fdset, NULL, NULL, &timeout, NULL);
-      saved_errno = errno;
+/* Write the query BUFFER of LENGTH to the wrapper process of CTX.  */
+static gpg_error_t
+write_query (struct wrapper_context_s *ctx, const char *buffer, size_t length)
+{
+  int n;
 
-      if (ret == -1 && saved_errno != EINTR)
-	{
-          ctx->fd_error = gpg_error_from_errno (errno);
-          SAFE_CLOSE (ctx->fd);
-          return -1;
-        }
-      if (ret <= 0)
-	/* Timeout.  Will be handled when calculating the next timeout.  */
-	continue;
-
-      /* This should not block now that select returned with a file
-	 descriptor.  So it shouldn't be necessary to use npth_read
-	 (and it is slightly dangerous in the sense that a concurrent
-	 thread might (accidentially?) change the status of ctx->fd
-	 before we read.  FIXME: Set ctx->fd to nonblocking?  */
-      n = read (ctx->fd, buffer, nleft);
+  while (length)
+    {
+      n = npth_write (ctx->in_fd, buffer, length);
+      if (n < 0 && errno == EINTR)
+        continue;
       if (n < 0)
-        {
-          ctx->fd_error = gpg_error_from_errno (errno);
-          SAFE_CLOSE (ctx->fd);
-          return -1;
-        }
-      else if (!n)
-        {
-          if (nleft == count)
-	    return -1; /* EOF. */
-          break;
-        }
-      nleft -= n;
+        return gpg_error_from_syserror ();
       buffer += n;
-      if (n > 0 && ctx->stamp != (time_t)(-1))
-        ctx->stamp = time (NULL);
+      length -= n;
     }
-  *nread = count - nleft;
-
   return 0;
 }
 
-/* Fork and exec the LDAP wrapper and returns a new libksba reader
-   object at READER.  ARGV is a NULL terminated list of arguments for
-   the wrapper.  The function returns 0 on success or an error code.
-
-   Special hack to avoid passing a password through the command line
-   which is globally visible: If the first element of ARGV is "--pass"
-   it will be removed and instead the environment variable
-   DIRMNGR_LDAP_PASS will be set to the next value of ARGV.  On modern
-   OSes the environment is not visible to other users.  For those old
-   systems where it can't be avoided, we don't want to go into the
-   hassle of passing the password via stdin; it's just too complicated
-   and an LDAP password used for public directory lookups should not
-   be that confidential.  */
-gpg_error_t
-ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
+
+/* Return an idle wrapper process, preferable one whose last query
+   was for SERVER, or NULL if there is none.  */
+static struct wrapper_context_s *
+find_idle_wrapper (const char *server)
+{
+  struct wrapper_context_s *ctx;
+  struct wrapper_context_s *any = NULL;
+
+  for (ctx = wrapper_list; ctx; ctx = ctx->next)
+    if (!ctx->busy && !ctx->ready && ctx->pid != (pid_t)(-1)
+        && ctx->in_fd != -1 && ctx->fd != -1 && !ctx->fd_error)
+      {
+        if (server && ctx->server && !strcmp (ctx->server, server))
+          return ctx;
+        if (!any)
+          any = ctx;
+      }
+  return any;
+}
+
+
+/* Fork and exec a new LDAP wrapper process and put it into our list.
+   On success the new context is stored at R_CTX.  */
+static gpg_error_t
+spawn_wrapper (struct wrapper_context_s **r_ctx)
 {
   gpg_error_t err;
   pid_t pid;
   struct wrapper_context_s *ctx;
-  int i;
-  int j;
-  const char **arg_list;
   const char *pgmname;
-  int outpipe[2], errpipe[2];
+  const char *arg_list[2];
+  int inpipe[2], outpipe[2], errpipe[2];
 
   /* It would be too simple to connect stderr just to our logging
      stream.  The problem is that if we are running multi-threaded
@@ -664,50 +1028,41 @@ ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
      need a way to rip the child process and this is best done using a
      general ripping thread, that thread can do the logging too. */
 
-  *reader = NULL;
+  *r_ctx = NULL;
 
-  /* Files: We need to prepare stdin and stdout.  We get stderr from
-     the function.  */
   if (!opt.ldap_wrapper_program || !*opt.ldap_wrapper_program)
     pgmname = gnupg_module_name (GNUPG_MODULE_NAME_DIRMNGR_LDAP);
   else
     pgmname = opt.ldap_wrapper_program;
 
-  /* Create command line argument array.  */
-  for (i = 0; argv[i]; i++)
-    ;
-  arg_list = xtrycalloc (i + 2, sizeof *arg_list);
-  if (!arg_list)
-    {
-      err = gpg_error_from_syserror ();
-      log_error (_("error allocating memory: %s\n"), strerror (errno));
-      return err;
-    }
-  for (i = j = 0; argv[i]; i++, j++)
-    if (!i && argv[i + 1] && !strcmp (*argv, "--pass"))
-      {
-	arg_list[j] = "--env-pass";
-	setenv ("DIRMNGR_LDAP_PASS", argv[1], 1);
-	i++;
-      }
-    else
-      arg_list[j] = (char*) argv[i];
+  arg_list[0] = "--server";
+  arg_list[1] = NULL;
 
   ctx = xtrycalloc (1, sizeof *ctx);
   if (!ctx)
     {
       err = gpg_error_from_syserror ();
       log_error (_("error allocating memory: %s\n"), strerror (errno));
-      xfree (arg_list);
       return err;
     }
 
-  err = gnupg_create_inbound_pipe (outpipe);
+  err = gnupg_create_outbound_pipe (inpipe);
+  if (!err)
+    {
+      err = gnupg_create_inbound_pipe (outpipe);
+      if (err)
+        {
+          close (inpipe[0]);
+          close (inpipe[1]);
+        }
+    }
   if (!err)
     {
       err = gnupg_create_inbound_pipe (errpipe);
       if (err)
         {
+          close (inpipe[0]);
+          close (inpipe[1]);
           close (outpipe[0]);
           close (outpipe[1]);
         }
@@ -715,18 +1070,18 @@ ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
   if (err)
     {
       log_error (_("error creating a pipe: %s\n"), gpg_strerror (err));
-      xfree (arg_list);
       xfree (ctx);
       return err;
     }
 
   err = gnupg_spawn_process_fd (pgmname, arg_list,
-                                -1, outpipe[1], errpipe[1], &pid);
-  xfree (arg_list);
+                                inpipe[0], outpipe[1], errpipe[1], &pid);
+  close (inpipe[0]);
   close (outpipe[1]);
   close (errpipe[1]);
   if (err)
     {
+      close (inpipe[1]);
       close (outpipe[0]);
       close (errpipe[0]);
       xfree (ctx);
@@ -735,11 +1090,110 @@ ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
 
   ctx->pid = pid;
   ctx->printable_pid = (int) pid;
+  ctx->in_fd = inpipe[1];
   ctx->fd = outpipe[0];
   ctx->log_fd = errpipe[0];
+  ctx->stamp = time (NULL);
+
+  /* Hook the context into our list of running wrappers.  */
+  ctx->next = wrapper_list;
+  wrapper_list = ctx;
+  if (opt.verbose)
+    log_info ("ldap wrapper %d started\n", (int)ctx->pid);
+
+  *r_ctx = ctx;
+  return 0;
+}
+
+
+/* Run the LDAP query given by ARGV using a wrapper process and return
+   a new libksba reader object at READER.  ARGV is a NULL terminated
+   list of arguments for the wrapper.  An idle wrapper process is used
+   if available, preferable one which has already been connected to
+   the same server; otherwise a new process is started.  The function
+   returns 0 on success or an error code.
+
+   The query is written to stdin of the wrapper process, thus a
+   password given with "--pass" is not visible to other users.  */
+gpg_error_t
+ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
+{
+  gpg_error_t err;
+  struct wrapper_context_s *ctx;
+  char *server;
+  char *query;
+  size_t querylen;
+  int reused;
+  int tries = 0;
+  unsigned long starttime;
+
+  *reader = NULL;
+
+  query = build_query (argv, &querylen);
+  if (!query)
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error allocating memory: %s\n"), strerror (errno));
+      return err;
+    }
+  server = query_server (argv);
+  starttime = stats_get_msec ();
+
+ again:
+  ctx = find_idle_wrapper (server);
+  reused = !!ctx;
+  if (reused)
+    {
+      if (opt.verbose)
+        log_info ("ldap wrapper %d reused\n", (int)ctx->pid);
+    }
+  else
+    {
+      err = spawn_wrapper (&ctx);
+      if (err)
+        {
+          stats_count_request (STATS_LDAP, 1);
+          xfree (server);
+          xfree (query);
+          return err;
+        }
+    }
+
+  /* Mark the process as busy before we write because writing might
+     run other threads.  */
+  ctx->busy = 1;
+  ctx->eor = 0;
+  ctx->framepos = 0;
+  ctx->frameleft = 0;
+  ctx->readtime = 0;
+  ctx->stamp = time (NULL);
+  xfree (ctx->server);
+  ctx->server = server? xtrystrdup (server) : NULL;
+
+  err = write_query (ctx, query, querylen);
+  if (err)
+    {
+      /* The process might have terminated while it was idle; a new
+         process is started for the next try.  */
+      log_info ("error writing to ldap wrapper %d: %s\n",
+                ctx->printable_pid, gpg_strerror (err));
+      if (ctx->pid != (pid_t)(-1))
+        gnupg_kill_process (ctx->pid);
+      SAFE_CLOSE (ctx->in_fd);
+      SAFE_CLOSE (ctx->fd);
+      ctx->busy = 0;
+      if (reused && !tries++)
+        goto again;
+      stats_count_request (STATS_LDAP, 1);
+      xfree (server);
+      xfree (query);
+      return err;
+    }
+  xfree (server);
+  xfree (query);
+
   ctx->ctrl = ctrl;
   ctrl->refcount++;
-  ctx->stamp = time (NULL);
 
   err = ksba_reader_new (reader);
   if (!err)
@@ -748,18 +1202,21 @@ ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
     {
       log_error (_("error initializing reader object: %s\n"),
                  gpg_strerror (err));
-      destroy_wrapper (ctx);
+      stats_count_request (STATS_LDAP, 1);
       ksba_reader_release (*reader);
       *reader = NULL;
+      ctx->ctrl->refcount--;
+      ctx->ctrl = NULL;
+      if (ctx->pid != (pid_t)(-1))
+        gnupg_kill_process (ctx->pid);
+      SAFE_CLOSE (ctx->in_fd);
+      SAFE_CLOSE (ctx->fd);
+      ctx->busy = 0;
       return err;
     }
-
-  /* Hook the context into our list of running wrappers.  */
   ctx->reader = *reader;
-  ctx->next = wrapper_list;
-  wrapper_list = ctx;
   if (opt.verbose)
-    log_info ("ldap wrapper %d started (reader %p)\n",
+    log_info ("ldap wrapper %d running query (reader %p)\n",
               (int)ctx->pid, ctx->reader);
 
   /* Need to wait for the first byte so we are able to detect an empty
@@ -782,6 +1239,10 @@ ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
           return err;
       }
     ksba_reader_unread (*reader, &c, 1);
+    /* The worker does the name lookup, connect and bind; we can only
+       measure them together with the server's response time.  */
+    stats_add (STATS_LDAP, STATS_FIRSTBYTE, stats_get_msec () - starttime);
+    ctx->readtime = 0;
   }
 
   return 0;
@@ -30,6 +30,7 @@
 #include "validate.h"
 #include "certcache.h"
 #include "ocsp.h"
+#include "stats.h"
 
 /* The maximum size we allow as a response from an OCSP reponder. */
 #define MAX_RESPONSE_SIZE 65536
@@ -129,6 +130,7 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp, gcry_md_hd_t md,
   const char *t;
   int redirects_left = 2;
   char *free_this = NULL;
+  unsigned long starttime;
 
   (void)ctrl;
 
@@ -170,6 +172,7 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp, gcry_md_hd_t md,
   if (err)
     {
       log_error (_("error connecting to '%s': %s\n"), url, gpg_strerror (err));
+      stats_add_http (STATS_OCSP, NULL, 1);
       xfree (free_this);
       return err;
     }
@@ -183,6 +186,7 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp, gcry_md_hd_t md,
     {
       err = gpg_error_from_errno (errno);
       log_error ("error sending request to '%s': %s\n", url, strerror (errno));
+      stats_add_http (STATS_OCSP, http, 1);
       http_close (http, 0);
       xfree (request);
       xfree (free_this);
@@ -192,6 +196,8 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp, gcry_md_hd_t md,
   request = NULL;
 
   err = http_wait_response (http);
+  stats_add_http (STATS_OCSP, http,
+                  err || http_get_status_code (http) >= 400);
   if (err || http_get_status_code (http) != 200)
     {
       if (err)
@@ -239,7 +245,9 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp, gcry_md_hd_t md,
       return err;
     }
 
+  starttime = stats_get_msec ();
   err = read_response (http_get_read_ptr (http), &response, &responselen);
+  stats_add (STATS_OCSP, STATS_BODY, stats_get_msec () - starttime);
   http_close (http, 0);
   if (err)
     {
@@ -536,6 +544,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
   char *oid;
   ksba_name_t name;
   fingerprint_list_t default_signer = NULL;
+  unsigned long starttime;
 
   /* Get the certificate.  */
   if (cert)
@@ -647,6 +656,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
     goto leave;
 
   /* We got a useful answer, check that the answer has a valid signature. */
+  starttime = stats_get_msec ();
   sigval = ksba_ocsp_get_sig_val (ocsp, produced_at);
   if (!sigval || !*produced_at)
     {
@@ -658,6 +668,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
   xfree (sigval);
   sigval = NULL;
   err = check_signature (ctrl, ocsp, s_sig, md, default_signer);
+  stats_add (STATS_OCSP, STATS_PROCESS, stats_get_msec () - starttime);
   if (err)
     goto leave;
 
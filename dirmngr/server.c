@@ -48,6 +48,11 @@
 #endif
 #include "ks-action.h"
 #include "ks-engine.h"  /* (ks_hkp_print_hosttable) */
+#include "../common/dns-cache.h"
+#include "../common/dns-cert.h"
+#include "../common/pka.h"
+#include "stats.h"
+#include "akl.h"
 
 /* To avoid DoS attacks we limit the size of a certificate to
    something reasonable. */
@@ -1765,6 +1770,244 @@ cmd_ks_put (assuan_context_t ctx, char *line)
 
 
 
+
+/* Send the key data read from KEY as data lines.  */
+static gpg_error_t
+send_key_data (assuan_context_t ctx, estream_t key)
+{
+  gpg_error_t err = 0;
+  char buffer[1024];
+  size_t nread;
+
+  es_rewind (key);
+  while (!err)
+    {
+      if (es_read (key, buffer, sizeof buffer, &nread))
+        err = gpg_error_from_syserror ();
+      else if (!nread)
+        break;
+      else
+        err = assuan_send_data (ctx, buffer, nread);
+    }
+  if (!err)
+    err = assuan_send_data (ctx, NULL, 0);
+  return err;
+}
+
+
+/* Emit the status lines "FPR" and "URL" for the fingerprint FPR of
+   length FPRLEN and the URL.  Both are optional.  The URL is percent
+   escaped because it has been taken verbatim from a DNS record.  */
+static gpg_error_t
+send_fpr_url_status (ctrl_t ctrl, const unsigned char *fpr, size_t fprlen,
+                     const char *url)
+{
+  gpg_error_t err = 0;
+  char *buf;
+
+  if (fpr && fprlen)
+    {
+      buf = bin2hex (fpr, fprlen, NULL);
+      if (!buf)
+        return gpg_error_from_syserror ();
+      err = dirmngr_status (ctrl, "FPR", buf, NULL);
+      xfree (buf);
+    }
+  if (!err && url && *url)
+    {
+      buf = percent_plus_escape (url);
+      if (!buf)
+        return gpg_error_from_syserror ();
+      err = dirmngr_status (ctrl, "URL", buf, NULL);
+      xfree (buf);
+    }
+  return err;
+}
+
+
+static const char hlp_dns_cert[] =
+  "DNS_CERT [--pka] [--] <name>\n"
+  "\n"
+  "Look up the CERT record of NAME.  A key stored in the record is\n"
+  "returned as data lines.  A fingerprint and an URL are returned\n"
+  "with the status lines\n"
+  "\n"
+  "  FPR <hexfingerprint>\n"
+  "  URL <percent-plus-escaped-url>\n"
+  "\n"
+  "With option --pka the PKA record of the mailbox NAME is looked up\n"
+  "instead and its fingerprint and URL are returned the same way.\n"
+  "Unlike lookups done by the client these lookups use the DNS\n"
+  "cache of the dirmngr.";
+static gpg_error_t
+cmd_dns_cert (assuan_context_t ctx, char *line)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  int pka_flag;
+  estream_t key = NULL;
+  unsigned char *fpr = NULL;
+  size_t fprlen = 0;
+  char *url = NULL;
+  char *p;
+
+  pka_flag = has_option (line, "--pka");
+  line = skip_options (line);
+  for (p=line; *p && *p != ' '; p++)
+    ;
+  *p = 0;
+  if (!*line)
+    {
+      err = PARM_ERROR ("name missing");
+      goto leave;
+    }
+
+  if (pka_flag)
+    {
+      fpr = xtrymalloc (20);
+      if (!fpr)
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+      fprlen = 20;
+      url = get_pka_info (line, fpr);
+      if (!url)
+        {
+          err = gpg_error (GPG_ERR_NOT_FOUND);
+          goto leave;
+        }
+    }
+  else
+    {
+      err = get_dns_cert (line, &key, &fpr, &fprlen, &url);
+      if (err)
+        goto leave;
+    }
+
+  if (key)
+    err = send_key_data (ctx, key);
+  else
+    err = send_fpr_url_status (ctrl, fpr, fprlen, url);
+
+ leave:
+  es_fclose (key);
+  xfree (fpr);
+  xfree (url);
+  return leave_cmd (ctx, err);
+}
+
+
+/* The names of the mechanisms used by AKL_LOOKUP.  */
+static const char *akl_mech_names[AKL_MECH_N] = { "cert", "pka", "keyserver" };
+
+
+/* The result callback for cmd_akl_lookup.  */
+static gpg_error_t
+akl_result_cb (void *opaque, akl_mech_t mech, gpg_error_t err,
+               estream_t key, const unsigned char *fpr, size_t fprlen,
+               const char *url)
+{
+  assuan_context_t ctx = opaque;
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t rc = 0;
+  char numbuf[35];
+
+  if (!err)
+    {
+      if (key)
+        rc = send_key_data (ctx, key);
+      else
+        rc = send_fpr_url_status (ctrl, fpr, fprlen, url);
+    }
+  if (!rc)
+    {
+      snprintf (numbuf, sizeof numbuf, "%u", err);
+      rc = dirmngr_status (ctrl, "AKL_RESULT", akl_mech_names[mech],
+                           numbuf, NULL);
+    }
+  return rc;
+}
+
+
+static const char hlp_akl_lookup[] =
+  "AKL_LOOKUP <mechanisms> <name>\n"
+  "\n"
+  "Look up the key for the mailbox NAME using the comma separated\n"
+  "auto-key-locate MECHANISMS \"cert\", \"pka\" and \"keyserver\".\n"
+  "The lookups are run concurrently but their results are returned in\n"
+  "the given order up to the first successful one; each one with the\n"
+  "status line\n"
+  "\n"
+  "  AKL_RESULT <mechanism> <errorcode>\n"
+  "\n"
+  "A successful lookup returns its data before that status line: the\n"
+  "key as data lines or the fingerprint and URL as with DNS_CERT.\n"
+  "Lookups still running when the command returns are completed in\n"
+  "the background and their results are discarded.";
+static gpg_error_t
+cmd_akl_lookup (assuan_context_t ctx, char *line)
+{
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err = 0;
+  akl_mech_t mechs[AKL_MECH_N];
+  int nmechs = 0;
+  char *p, *next, *name;
+  unsigned int seen = 0;
+  int i;
+
+  line = skip_options (line);
+  name = strchr (line, ' ');
+  if (!name)
+    {
+      err = PARM_ERROR ("name missing");
+      goto leave;
+    }
+  *name++ = 0;
+  while (*name == ' ')
+    name++;
+  for (p=name; *p && *p != ' '; p++)
+    ;
+  *p = 0;
+  if (!*name)
+    {
+      err = PARM_ERROR ("name missing");
+      goto leave;
+    }
+
+  for (p=line; p; p = next)
+    {
+      next = strchr (p, ',');
+      if (next)
+        *next++ = 0;
+      for (i=0; i < AKL_MECH_N && strcmp (p, akl_mech_names[i]); i++)
+        ;
+      if (i == AKL_MECH_N)
+        {
+          err = set_error (GPG_ERR_ASS_PARAMETER, "unknown mechanism");
+          goto leave;
+        }
+      if ((seen & (1 << i)))
+        {
+          err = set_error (GPG_ERR_ASS_PARAMETER, "duplicate mechanism");
+          goto leave;
+        }
+      seen |= (1 << i);
+      mechs[nmechs++] = i;
+    }
+  if (!nmechs)
+    {
+      err = PARM_ERROR ("no mechanism given");
+      goto leave;
+    }
+
+  err = akl_lookup (ctrl, mechs, nmechs, name, akl_result_cb, ctx);
+
+ leave:
+  return leave_cmd (ctx, err);
+}
+
+
 
 static const char hlp_getinfo[] =
   "GETINFO <what>\n"
@@ -1775,7 +2018,10 @@ static const char hlp_getinfo[] =
   "version     - Return the version of the program.\n"
   "pid         - Return the process id of the server.\n"
   "\n"
-  "socket_name - Return the name of the socket.\n";
+  "socket_name - Return the name of the socket.\n"
+  "dnscache    - Return statistics of the DNS answer cache.\n"
+  "stats       - Return request timings and cache hit rates; one\n"
+  "              line per item, durations as count/avg/max in ms.\n";
 static gpg_error_t
 cmd_getinfo (assuan_context_t ctx, char *line)
 {
@@ -1805,6 +2051,32 @@ cmd_getinfo (assuan_context_t ctx, char *line)
       else
         err = gpg_error (GPG_ERR_NO_DATA);
     }
+  else if (!strcmp (line, "dnscache"))
+    {
+      struct dns_cache_stats_s stats;
+      char numbuf[200];
+
+      dns_cache_get_stats (&stats);
+      snprintf (numbuf, sizeof numbuf,
+                "size=%u entries=%u hits=%lu neghits=%lu misses=%lu"
+                " expired=%lu",
+                stats.size, stats.entries, stats.hits, stats.neghits,
+                stats.misses, stats.expired);
+      err = assuan_send_data (ctx, numbuf, strlen (numbuf));
+    }
+  else if (!strcmp (line, "stats"))
+    {
+      char buffer[400];
+      int idx;
+
+      err = 0;
+      for (idx=0; !err && stats_format_line (idx, buffer, sizeof buffer - 1);
+           idx++)
+        {
+          strcat (buffer, "\n");
+          err = assuan_send_data (ctx, buffer, strlen (buffer));
+        }
+    }
   else
     err = set_error (GPG_ERR_ASS_PARAMETER, "unknown value for WHAT");
 
@@ -1904,6 +2176,8 @@ register_commands (assuan_context_t ctx)
     { "KS_GET",     cmd_ks_get,     hlp_ks_get },
     { "KS_FETCH",   cmd_ks_fetch,   hlp_ks_fetch },
     { "KS_PUT",     cmd_ks_put,     hlp_ks_put },
+    { "DNS_CERT",   cmd_dns_cert,   hlp_dns_cert },
+    { "AKL_LOOKUP", cmd_akl_lookup, hlp_akl_lookup },
     { "GETINFO",    cmd_getinfo,    hlp_getinfo },
     { "KILLDIRMNGR",cmd_killdirmngr,hlp_killdirmngr },
     { "RELOADDIRMNGR",cmd_reloaddirmngr,hlp_reloaddirmngr },
@@ -2152,7 +2426,9 @@ dirmngr_status_help (ctrl_t ctrl, const char *text)
 }
 
 /* Send a tick progress indicator back.  Fixme: This is only done for
-   the currently active channel.  */
+   the currently active channel.  Calls without CTRL, for example from
+   the threads of a hedged request, are ignored so that they don't use
+   up the ticks of the sessions.  */
 gpg_error_t
 dirmngr_tick (ctrl_t ctrl)
 {
@@ -2160,22 +2436,22 @@ dirmngr_tick (ctrl_t ctrl)
   gpg_error_t err = 0;
   time_t now = time (NULL);
 
+  if (!ctrl)
+    return 0;
+
   if (!next_tick)
     {
       next_tick = now + 1;
     }
   else if ( now > next_tick )
     {
-      if (ctrl)
+      err = dirmngr_status (ctrl, "PROGRESS", "tick", "? 0 0", NULL);
+      if (err)
         {
-          err = dirmngr_status (ctrl, "PROGRESS", "tick", "? 0 0", NULL);
-          if (err)
-            {
-              /* Take this as in indication for a cancel request.  */
-              err = gpg_error (GPG_ERR_CANCELED);
-            }
-          now = time (NULL);
+          /* Take this as in indication for a cancel request.  */
+          err = gpg_error (GPG_ERR_CANCELED);
         }
+      now = time (NULL);
 
       next_tick = now + 1;
     }
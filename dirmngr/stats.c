@@ -0,0 +1,210 @@
+/* stats.c - Request and cache statistics
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This module collects the time spent in the phases of the network
+   requests done by the dirmngr and the hit rates of the certificate
+   and CRL caches.  The counters are only updated and read while
+   holding the nPth big lock, thus no extra locking is required.  The
+   values are available with "GETINFO stats" and are written to the
+   log on SIGUSR1 and, with --log-stats, at each housekeeping run.  */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <npth.h>
+
+#include "dirmngr.h"
+#include "stats.h"
+
+
+/* The accumulated durations of one phase.  */
+struct phase_stats_s
+{
+  unsigned long count;   /* Number of samples.  */
+  unsigned long total;   /* Sum of the samples in milliseconds.  */
+  unsigned long max;     /* Largest sample in milliseconds.  */
+};
+
+/* The statistics for one kind of request.  */
+struct kind_stats_s
+{
+  unsigned long requests;
+  unsigned long failed;
+  struct phase_stats_s phase[STATS_N_PHASES];
+};
+
+/* The hit counters of a cache.  */
+struct cache_stats_s
+{
+  unsigned long hits;
+  unsigned long misses;
+};
+
+static struct kind_stats_s kind_stats[STATS_N_KINDS];
+static struct cache_stats_s cache_stats[STATS_N_CACHES];
+
+/* The names used in the output.  They are indexed by the enums.  */
+static const char *kind_names[STATS_N_KINDS] =
+  { "hkp", "crl", "ocsp", "ldap" };
+static const char *phase_names[STATS_N_PHASES] =
+  { "dns", "connect", "tls", "firstbyte", "body", "process" };
+static const char *cache_names[STATS_N_CACHES] =
+  { "certcache", "crlcache" };
+
+
+
+/* Return a time stamp in milliseconds to be used for the durations
+   passed to stats_add.  */
+unsigned long
+stats_get_msec (void)
+{
+  struct timespec curtime;
+
+  npth_clock_gettime (&curtime);
+  return (unsigned long)curtime.tv_sec * 1000 + curtime.tv_nsec / 1000000;
+}
+
+
+/* Add a sample of MSEC milliseconds for PHASE of a request of
+   KIND.  */
+void
+stats_add (stats_kind_t kind, stats_phase_t phase, unsigned long msec)
+{
+  struct phase_stats_s *ps;
+
+  if ((unsigned int)kind >= STATS_N_KINDS
+      || (unsigned int)phase >= STATS_N_PHASES)
+    return;
+
+  ps = &kind_stats[kind].phase[phase];
+  ps->count++;
+  ps->total += msec;
+  if (msec > ps->max)
+    ps->max = msec;
+}
+
+
+/* Count a request of KIND; FAILED is true if it did not succeed.  */
+void
+stats_count_request (stats_kind_t kind, int failed)
+{
+  if ((unsigned int)kind >= STATS_N_KINDS)
+    return;
+
+  kind_stats[kind].requests++;
+  if (failed)
+    kind_stats[kind].failed++;
+}
+
+
+/* Count a request of KIND done with the HTTP handle HTTP and add the
+   durations of its connection phases.  HTTP may be NULL if the
+   request failed before a handle was available.  */
+void
+stats_add_http (stats_kind_t kind, http_t http, int failed)
+{
+  struct http_timing_s timing;
+
+  stats_count_request (kind, failed);
+  if (!http)
+    return;
+
+  http_get_timing (http, &timing);
+  stats_add (kind, STATS_DNS, timing.dns);
+  stats_add (kind, STATS_CONNECT, timing.connect);
+  if (http_get_tls_info (http, NULL))
+    stats_add (kind, STATS_TLS, timing.tls);
+  stats_add (kind, STATS_FIRSTBYTE, timing.firstbyte);
+}
+
+
+/* Count a lookup in CACHE; HIT is true if the cache had a usable
+   answer.  */
+void
+stats_count_cache (stats_cache_t cache, int hit)
+{
+  if ((unsigned int)cache >= STATS_N_CACHES)
+    return;
+
+  if (hit)
+    cache_stats[cache].hits++;
+  else
+    cache_stats[cache].misses++;
+}
+
+
+/* Format line IDX of the statistics into BUFFER of size BUFSIZE.
+   Returns false if there is no such line.  The first lines describe
+   the request kinds, the durations are given as "count/avg/max" in
+   milliseconds; the remaining lines describe the caches.  */
+int
+stats_format_line (int idx, char *buffer, size_t bufsize)
+{
+  size_t n;
+  int i;
+
+  if (idx < 0)
+    return 0;
+
+  if (idx < STATS_N_KINDS)
+    {
+      struct kind_stats_s *ks = &kind_stats[idx];
+
+      snprintf (buffer, bufsize, "%s requests=%lu failed=%lu",
+                kind_names[idx], ks->requests, ks->failed);
+      for (i=0; i < STATS_N_PHASES; i++)
+        {
+          struct phase_stats_s *ps = &ks->phase[i];
+
+          n = strlen (buffer);
+          snprintf (buffer + n, bufsize - n, " %s=%lu/%lu/%lu",
+                    phase_names[i], ps->count,
+                    ps->count? ps->total / ps->count : 0, ps->max);
+        }
+      return 1;
+    }
+
+  idx -= STATS_N_KINDS;
+  if (idx < STATS_N_CACHES)
+    {
+      struct cache_stats_s *cs = &cache_stats[idx];
+      unsigned long lookups = cs->hits + cs->misses;
+
+      snprintf (buffer, bufsize, "%s hits=%lu misses=%lu ratio=%lu%%",
+                cache_names[idx], cs->hits, cs->misses,
+                lookups? cs->hits * 100 / lookups : 0);
+      return 1;
+    }
+
+  return 0;
+}
+
+
+/* Write the statistics to the log.  */
+void
+stats_log (void)
+{
+  char line[400];
+  int idx;
+
+  for (idx=0; stats_format_line (idx, line, sizeof line); idx++)
+    log_info ("stats: %s\n", line);
+}
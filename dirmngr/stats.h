@@ -0,0 +1,67 @@
+/* stats.h - Request and cache statistics
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIRMNGR_STATS_H
+#define DIRMNGR_STATS_H 1
+
+#include "http.h"
+
+/* The kinds of requests we keep statistics for.  */
+typedef enum
+  {
+    STATS_HKP = 0,     /* Keyserver requests.  */
+    STATS_CRL,         /* CRLs fetched via HTTP.  */
+    STATS_OCSP,        /* OCSP requests.  */
+    STATS_LDAP,        /* Queries run by the LDAP wrapper.  */
+    STATS_N_KINDS
+  }
+stats_kind_t;
+
+/* The phases of a request.  */
+typedef enum
+  {
+    STATS_DNS = 0,     /* Resolving the server name.  */
+    STATS_CONNECT,     /* Connecting to the server.  */
+    STATS_TLS,         /* TLS handshake and server verification.  */
+    STATS_FIRSTBYTE,   /* Waiting for the start of the response.  */
+    STATS_BODY,        /* Reading the response.  */
+    STATS_PROCESS,     /* Parsing and checking the response.  */
+    STATS_N_PHASES
+  }
+stats_phase_t;
+
+/* The caches we count hits and misses for.  */
+typedef enum
+  {
+    STATS_CACHE_CERT = 0,
+    STATS_CACHE_CRL,
+    STATS_N_CACHES
+  }
+stats_cache_t;
+
+unsigned long stats_get_msec (void);
+void stats_add (stats_kind_t kind, stats_phase_t phase, unsigned long msec);
+void stats_count_request (stats_kind_t kind, int failed);
+void stats_add_http (stats_kind_t kind, http_t http, int failed);
+void stats_count_cache (stats_cache_t cache, int hit);
+int  stats_format_line (int idx, char *buffer, size_t bufsize);
+void stats_log (void);
+
+
+#endif /*DIRMNGR_STATS_H*/
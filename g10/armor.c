@@ -40,12 +40,6 @@
 #define MAX_LINELEN 20000
 
 #define CRCINIT 0xB704CE
-#define CRCPOLY 0X864CFB
-#define CRCUPDATE(a,c) do {						    \
-			a = ((a) << 8) ^ crc_table[((a)&0xff >> 16) ^ (c)]; \
-			a &= 0x00ffffff;				    \
-		    } while(0)
-static u32 crc_table[256];
 static byte bintoasc[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 			 "abcdefghijklmnopqrstuvwxyz"
 			 "0123456789+/";
@@ -163,25 +157,9 @@ push_armor_filter (armor_filter_context_t *afx, iobuf_t iobuf)
 static void
 initialize(void)
 {
-    int i, j;
-    u32 t;
+    int i;
     byte *s;
 
-    /* init the crc lookup table */
-    crc_table[0] = 0;
-    for(i=j=0; j < 128; j++ ) {
-	t = crc_table[j];
-	if( t & 0x00800000 ) {
-	    t <<= 1;
-	    crc_table[i++] = t ^ CRCPOLY;
-	    crc_table[i++] = t;
-	}
-	else {
-	    t <<= 1;
-	    crc_table[i++] = t;
-	    crc_table[i++] = t ^ CRCPOLY;
-	}
-    }
     /* build the helptable for radix64 to bin conversion */
     for(i=0; i < 256; i++ )
 	asctobin[i] = 255; /* used to detect invalid characters */
@@ -751,7 +729,7 @@ radix64_read( armor_filter_context_t *afx, IOBUF a, size_t *retn,
     int checkcrc=0;
     int rc = 0;
     size_t n = 0;
-    int  idx, i, onlypad=0;
+    int  idx, onlypad=0;
     u32 crc;
 
     crc = afx->crc;
@@ -759,6 +737,21 @@ radix64_read( armor_filter_context_t *afx, IOBUF a, size_t *retn,
     val = afx->radbuf[0];
     for( n=0; n < size; ) {
 
+	if( !idx && afx->buffer_pos < afx->buffer_len && size - n > 2 ) {
+	    /* Decode a run of complete groups directly into BUF.  */
+	    size_t len, used;
+
+	    len = afx->buffer_len - afx->buffer_pos;
+	    if( len > (size - n) / 3 * 4 )
+		len = (size - n) / 3 * 4;
+	    n += b64_decode_groups( buf + n,
+				    (char*)afx->buffer + afx->buffer_pos,
+				    len, &used );
+	    afx->buffer_pos += used;
+	    if( used )
+		continue;
+	}
+
 	if( afx->buffer_pos < afx->buffer_len )
 	    c = afx->buffer[afx->buffer_pos++];
 	else { /* read the next line */
@@ -817,9 +810,7 @@ radix64_read( armor_filter_context_t *afx, IOBUF a, size_t *retn,
 	idx = (idx+1) % 4;
     }
 
-    for(i=0; i < n; i++ )
-	crc = (crc << 8) ^ crc_table[((crc >> 16)&0xff) ^ buf[i]];
-    crc &= 0x00ffffff;
+    crc = crc24_update( crc, buf, n );
     afx->crc = crc;
     afx->idx = idx;
     afx->radbuf[0] = val;
@@ -1130,13 +1121,28 @@ armor_filter( void *opaque, int control,
 	for(i=0; i < idx; i++ )
 	    radbuf[i] = afx->radbuf[i];
 
-	for(i=0; i < size; i++ )
-	    crc = (crc << 8) ^ crc_table[((crc >> 16)&0xff) ^ buf[i]];
-	crc &= 0x00ffffff;
-
-	for( ; size; buf++, size-- ) {
-	    radbuf[idx++] = *buf;
-	    if( idx > 2 ) {
+	crc = crc24_update( crc, buf, size );
+
+	while( size ) {
+	    if( !idx && size > 2 ) {
+		/* Encode as many complete groups as fit into the
+		   current line in one go.  */
+		char line[64];
+		size_t k = (64/4) - idx2;
+
+		if( k > size / 3 )
+		    k = size / 3;
+		b64_encode_groups( line, buf, k );
+		iobuf_write( a, line, 4 * k );
+		buf += 3 * k;
+		size -= 3 * k;
+		idx2 += k;
+	    }
+	    else {
+		radbuf[idx++] = *buf++;
+		size--;
+		if( idx < 3 )
+		    continue;
 		idx = 0;
 		c = bintoasc[(*radbuf >> 2) & 077];
 		iobuf_put(a, c);
@@ -1146,12 +1152,13 @@ armor_filter( void *opaque, int control,
 		iobuf_put(a, c);
 		c = bintoasc[radbuf[2]&077];
 		iobuf_put(a, c);
-		if( ++idx2 >= (64/4) )
-		  { /* pgp doesn't like 72 here */
-		    iobuf_writestr(a,afx->eol);
-		    idx2=0;
-		  }
+		idx2++;
 	    }
+	    if( idx2 >= (64/4) )
+	      { /* pgp doesn't like 72 here */
+		iobuf_writestr(a,afx->eol);
+		idx2=0;
+	      }
 	}
 	for(i=0; i < idx; i++ )
 	    afx->radbuf[i] = radbuf[i];
@@ -1494,8 +1501,9 @@ unarmor_pump (UnarmorPump x, int c)
     }
 
     if ( !(rval & ~255) ) { /* compute the CRC */
-        x->crc = (x->crc << 8) ^ crc_table[((x->crc >> 16)&0xff) ^ rval];
-        x->crc &= 0x00ffffff;
+        byte b = rval;
+
+        x->crc = crc24_update (x->crc, &b, 1);
     }
 
     return rval;
@@ -657,6 +657,8 @@ delete_sig_subpkt (subpktarea_t *area, sigsubpkttype_t reqtype )
         log_error ("delete_subpkt: buffer shorter than subpacket\n");
     assert (unused <= area->len);
     area->len -= unused;
+    if (unused)
+        index_sig_subpkts (area);
     return !!unused;
 }
 
@@ -796,6 +798,7 @@ build_sig_subpkt (PKT_signature *sig, sigsubpkttype_t type,
     else {
         newarea = xmalloc (sizeof (*newarea) + n - 1);
         newarea->size = n;
+        newarea->index = NULL;
         /*log_debug ("allocating area for type %d\n", type );*/
     }
     newarea->len = n;
@@ -821,6 +824,7 @@ build_sig_subpkt (PKT_signature *sig, sigsubpkttype_t type,
 	*p++ = type;
 	memcpy (p, buffer, buflen);
     }
+    index_sig_subpkts (newarea);
 
     if (hashed)
 	sig->hashed = newarea;
@@ -1133,11 +1137,19 @@ do_signature( IOBUF out, int ctb, PKT_signature *sig )
     }
   iobuf_put(a, sig->digest_start[0] );
   iobuf_put(a, sig->digest_start[1] );
-  n = pubkey_get_nsig( sig->pubkey_algo );
-  if ( !n )
-    write_fake_data( a, sig->data[0] );
-  for (i=0; i < n && !rc ; i++ )
-    rc = gpg_mpi_write (a, sig->data[i] );
+  if (sig->lazy_data)
+    {
+      /* The MPIs have not been parsed; write them as read.  */
+      rc = iobuf_write (a, sig->lazy_data, sig->lazy_datalen);
+    }
+  else
+    {
+      n = pubkey_get_nsig( sig->pubkey_algo );
+      if ( !n )
+        write_fake_data( a, sig->data[0] );
+      for (i=0; i < n && !rc ; i++ )
+        rc = gpg_mpi_write (a, sig->data[i] );
+    }
 
   if (!rc)
     {
@@ -53,6 +53,29 @@
 static assuan_context_t agent_ctx = NULL;
 static int did_early_card_test;
 
+/* The maximum number of keygrips we cache in SECRET_GRIPS.  */
+#define MAX_SECRET_GRIPS 100000
+
+/* The number of seconds SECRET_GRIPS is used without asking the
+   agent whether its set of keys changed.  */
+#define SECRET_GRIPS_TTL 1
+
+/* The keygrips of all secret keys of the agent as returned by
+   "HAVEKEY --list".  This is used by the probe functions instead of
+   asking the agent for each key.  Because other processes may add or
+   remove keys while we are running (e.g. in server mode), the list is
+   revalidated using the agent's key event counter once it is older
+   than SECRET_GRIPS_TTL.  */
+static struct
+{
+  int state;             /* 0 = not loaded, 1 = loaded, -1 = not
+                            supported by the agent.  */
+  unsigned int keycounter; /* The agent's key event counter at load time.  */
+  time_t checked;        /* The time the list was last validated.  */
+  unsigned char *grips;  /* Sorted array of 20 byte keygrips.  */
+  size_t ngrips;
+} secret_grips;
+
 struct default_inq_parm_s
 {
   ctrl_t ctrl;
@@ -151,6 +174,21 @@ membuf_data_cb (void *opaque, const void *buffer, size_t length)
 }
 
 
+/* Forget the cached keygrips of the secret keys.  This needs to be
+   called before all requests which may create or delete a key.  */
+static void
+forget_secret_grips (void)
+{
+  if (secret_grips.state > 0)
+    {
+      xfree (secret_grips.grips);
+      secret_grips.grips = NULL;
+      secret_grips.ngrips = 0;
+      secret_grips.state = 0;
+    }
+}
+
+
 
 /* This is the default inquiry callback.  It mainly handles the
    Pinentry notifications.  */
@@ -666,6 +704,7 @@ agent_scd_learn (struct agent_card_info_s *info)
 
   parm.ctx = agent_ctx;
   memset (info, 0, sizeof *info);
+  forget_secret_grips ();
   rc = assuan_transact (agent_ctx, "SCD LEARN --force",
                         dummy_data_cb, NULL, default_inq_cb, &parm,
                         learn_status_cb, info);
@@ -692,6 +731,7 @@ agent_learn (void)
     return err;
 
   parm.ctx = agent_ctx;
+  forget_secret_grips ();
   err = assuan_transact (agent_ctx, "LEARN",
                          dummy_data_cb, NULL, default_inq_cb, &parm,
                          NULL, NULL);
@@ -719,6 +759,7 @@ agent_keytocard (const char *hexgrip, int keyno, int force,
   if (rc)
     return rc;
 
+  forget_secret_grips ();
   rc = assuan_transact (agent_ctx, line, NULL, NULL, default_inq_cb, &parm,
                         NULL, NULL);
   if (rc)
@@ -915,6 +956,7 @@ agent_scd_writekey (int keyno, const char *serialno,
   parms.keydata = keydata;
   parms.keydatalen = keydatalen;
 
+  forget_secret_grips ();
   rc = assuan_transact (agent_ctx, line, NULL, NULL,
                         inq_writekey_parms, &parms, NULL, NULL);
 
@@ -1062,6 +1104,7 @@ agent_scd_genkey (struct agent_card_genkey_s *info, int keyno, int force,
 
   dfltparm.ctx = agent_ctx;
   memset (info, 0, sizeof *info);
+  forget_secret_grips ();
   rc = assuan_transact (agent_ctx, line,
                         NULL, NULL, default_inq_cb, &dfltparm,
                         scd_genkey_cb, &parms);
@@ -1474,6 +1517,139 @@ agent_get_s2k_count (unsigned long *r_count)
 
 
 
+/* qsort and bsearch helper for the keygrips in SECRET_GRIPS.  */
+static int
+compare_grips (const void *a, const void *b)
+{
+  return memcmp (a, b, 20);
+}
+
+
+/* Parameter for eventcounter_status_cb.  */
+struct eventcounter_parm_s
+{
+  int valid;                /* Set if the status line was seen.  */
+  unsigned int keycounter;
+};
+
+
+/* Status callback for get_key_eventcounter.  */
+static gpg_error_t
+eventcounter_status_cb (void *opaque, const char *line)
+{
+  struct eventcounter_parm_s *parm = opaque;
+  const char *s;
+  unsigned int any, key, card;
+
+  if ((s = has_leading_keyword (line, "EVENTCOUNTER"))
+      && sscanf (s, "%u %u %u", &any, &key, &card) == 3)
+    {
+      parm->keycounter = key;
+      parm->valid = 1;
+    }
+  return 0;
+}
+
+
+/* Store the agent's key event counter at R_KEYCOUNTER.  */
+static gpg_error_t
+get_key_eventcounter (unsigned int *r_keycounter)
+{
+  gpg_error_t err;
+  struct eventcounter_parm_s parm;
+
+  memset (&parm, 0, sizeof parm);
+  err = assuan_transact (agent_ctx, "GETEVENTCOUNTER",
+                         NULL, NULL, NULL, NULL,
+                         eventcounter_status_cb, &parm);
+  if (!err && !parm.valid)
+    err = gpg_error (GPG_ERR_INV_RESPONSE);
+  if (!err)
+    *r_keycounter = parm.keycounter;
+  return err;
+}
+
+
+/* Make sure that SECRET_GRIPS is loaded and up to date.  Returns true
+   if it can be used.  Agents not supporting "HAVEKEY --list" or with
+   too many keys are asked for each key.  */
+static int
+load_secret_grips (void)
+{
+  gpg_error_t err;
+  char line[ASSUAN_LINELENGTH];
+  membuf_t data;
+  unsigned char *buf;
+  size_t len;
+  unsigned int keycounter;
+  time_t now;
+
+  if (secret_grips.state < 0)
+    return 0;
+
+  now = time (NULL);
+  if (secret_grips.state > 0)
+    {
+      if (now >= secret_grips.checked
+          && now - secret_grips.checked < SECRET_GRIPS_TTL)
+        return 1;
+      if (!get_key_eventcounter (&keycounter)
+          && keycounter == secret_grips.keycounter)
+        {
+          secret_grips.checked = now;
+          return 1;
+        }
+      if (DBG_ASSUAN)
+        log_debug ("secret keys changed - reloading the keygrips\n");
+      forget_secret_grips ();
+    }
+
+  /* Get the counter first so that a change done while we read the
+     list is detected by the next check.  */
+  err = get_key_eventcounter (&keycounter);
+  if (err)
+    {
+      if (DBG_ASSUAN)
+        log_debug ("not caching the secret keygrips: %s\n",
+                   gpg_strerror (err));
+      secret_grips.state = -1;
+      return 0;
+    }
+
+  init_membuf (&data, 1024);
+  snprintf (line, sizeof line, "HAVEKEY --list=%d", MAX_SECRET_GRIPS);
+  err = assuan_transact (agent_ctx, line, membuf_data_cb, &data,
+                         NULL, NULL, NULL, NULL);
+  buf = get_membuf (&data, &len);
+  if (err || !buf || (len % 20))
+    {
+      if (DBG_ASSUAN)
+        log_debug ("not caching the secret keygrips: %s\n",
+                   err? gpg_strerror (err) : "bad length");
+      xfree (buf);
+      secret_grips.state = -1;
+      return 0;
+    }
+
+  qsort (buf, len / 20, 20, compare_grips);
+  secret_grips.grips = buf;
+  secret_grips.ngrips = len / 20;
+  secret_grips.keycounter = keycounter;
+  secret_grips.checked = now;
+  secret_grips.state = 1;
+  return 1;
+}
+
+
+/* Return true if the keygrip GRIP is in SECRET_GRIPS.  */
+static int
+have_secret_grip (const unsigned char *grip)
+{
+  return !!bsearch (grip, secret_grips.grips, secret_grips.ngrips, 20,
+                    compare_grips);
+}
+
+
 /* Ask the agent whether a secret key for the given public key is
    available.  Returns 0 if available.  */
 gpg_error_t
@@ -1487,6 +1663,16 @@ agent_probe_secret_key (ctrl_t ctrl, PKT_public_key *pk)
   if (err)
     return err;
 
+  if (load_secret_grips ())
+    {
+      unsigned char grip[20];
+
+      err = keygrip_from_pk (pk, grip);
+      if (err)
+        return err;
+      return have_secret_grip (grip)? 0 : gpg_error (GPG_ERR_NO_SECKEY);
+    }
+
   err = hexkeygrip_from_pk (pk, &hexgrip);
   if (err)
     return err;
@@ -1514,6 +1700,23 @@ agent_probe_any_secret_key (ctrl_t ctrl, kbnode_t keyblock)
   if (err)
     return err;
 
+  if (load_secret_grips ())
+    {
+      for (kbctx=NULL; (node = walk_kbnode (keyblock, &kbctx, 0)); )
+        if (node->pkt->pkttype == PKT_PUBLIC_KEY
+            || node->pkt->pkttype == PKT_PUBLIC_SUBKEY
+            || node->pkt->pkttype == PKT_SECRET_KEY
+            || node->pkt->pkttype == PKT_SECRET_SUBKEY)
+          {
+            err = keygrip_from_pk (node->pkt->pkt.public_key, grip);
+            if (err)
+              return err;
+            if (have_secret_grip (grip))
+              return 0;
+          }
+      return gpg_error (GPG_ERR_NO_SECKEY);
+    }
+
   err = gpg_error (GPG_ERR_NO_SECKEY); /* Just in case no key was
                                           found in KEYBLOCK.  */
   p = stpcpy (line, "HAVEKEY");
@@ -1713,6 +1916,7 @@ agent_genkey (ctrl_t ctrl, char **cache_nonce_addr,
             cache_nonce_addr && *cache_nonce_addr? *cache_nonce_addr:"");
   cn_parm.cache_nonce_addr = cache_nonce_addr;
   cn_parm.passwd_nonce_addr = NULL;
+  forget_secret_grips ();
   err = assuan_transact (agent_ctx, line,
                          membuf_data_cb, &data,
                          inq_genkey_parms, &gk_parm,
@@ -2141,6 +2345,7 @@ agent_import_key (ctrl_t ctrl, const char *desc, char **cache_nonce_addr,
             cache_nonce_addr && *cache_nonce_addr? *cache_nonce_addr:"");
   cn_parm.cache_nonce_addr = cache_nonce_addr;
   cn_parm.passwd_nonce_addr = NULL;
+  forget_secret_grips ();
   err = assuan_transact (agent_ctx, line,
                          NULL, NULL,
                          inq_import_key_parms, &parm,
@@ -2245,6 +2450,7 @@ agent_delete_key (ctrl_t ctrl, const char *hexkeygrip, const char *desc)
     }
 
   snprintf (line, DIM(line)-1, "DELETE_KEY %s", hexkeygrip);
+  forget_secret_grips ();
   err = assuan_transact (agent_ctx, line, NULL, NULL,
                          default_inq_cb, &dfltparm,
                          NULL, NULL);
@@ -735,3 +735,326 @@ gpg_dirmngr_ks_put (ctrl_t ctrl, void *data, size_t datalen, kbnode_t keyblock)
   close_context (ctrl, ctx);
   return err;
 }
+
+
+
+/* Parameter structure used with the DNS_CERT command.  */
+struct dns_cert_parm_s
+{
+  estream_t memfp;
+  unsigned char *fpr;
+  size_t fprlen;
+  char *url;
+};
+
+
+/* Data callback for the DNS_CERT command. */
+static gpg_error_t
+dns_cert_data_cb (void *opaque, const void *data, size_t datalen)
+{
+  struct dns_cert_parm_s *parm = opaque;
+  gpg_error_t err = 0;
+  size_t nwritten;
+
+  if (!data)
+    return 0;  /* Ignore END commands.  */
+  if (!parm->memfp)
+    return 0;  /* Data is not requested.  */
+
+  if (es_write (parm->memfp, data, datalen, &nwritten))
+    err = gpg_error_from_syserror ();
+
+  return err;
+}
+
+
+/* Status callback for the DNS_CERT command.  */
+static gpg_error_t
+dns_cert_status_cb (void *opaque, const char *line)
+{
+  struct dns_cert_parm_s *parm = opaque;
+  gpg_error_t err = 0;
+  const char *s;
+  size_t nbytes;
+
+  if ((s = has_leading_keyword (line, "FPR")))
+    {
+      nbytes = strlen (s) / 2;
+      if (parm->fpr)
+        err = gpg_error (GPG_ERR_DUP_KEY);
+      else if (!nbytes)
+        err = gpg_error (GPG_ERR_TOO_SHORT);
+      else if (!(parm->fpr = xtrymalloc (nbytes)))
+        err = gpg_error_from_syserror ();
+      else if (hex2bin (s, parm->fpr, nbytes) < 0)
+        {
+          xfree (parm->fpr);
+          parm->fpr = NULL;
+          err = gpg_error (GPG_ERR_INV_DATA);
+        }
+      else
+        parm->fprlen = nbytes;
+    }
+  else if ((s = has_leading_keyword (line, "URL")) && *s)
+    {
+      if (parm->url)
+        err = gpg_error (GPG_ERR_DUP_KEY);
+      else if (!(parm->url = percent_plus_unescape (s, 0xff)))
+        err = gpg_error_from_syserror ();
+    }
+
+  return err;
+}
+
+
+/* Ask the dirmngr for the DNS CERT record of NAME.  If the record
+   holds a key, a stream to read it is stored at R_KEY and the other
+   return values are set to NULL/0.  If it holds a fingerprint, the
+   fingerprint is stored as a malloced block at (R_FPR,R_FPRLEN) and
+   the URL, if any, as a malloced string at R_URL; NULL is stored at
+   R_KEY then.  */
+gpg_error_t
+gpg_dirmngr_dns_cert (ctrl_t ctrl, const char *name, estream_t *r_key,
+                      unsigned char **r_fpr, size_t *r_fprlen, char **r_url)
+{
+  gpg_error_t err;
+  assuan_context_t ctx;
+  struct dns_cert_parm_s parm;
+  char *line = NULL;
+
+  memset (&parm, 0, sizeof parm);
+  *r_key = NULL;
+  *r_fpr = NULL;
+  *r_fprlen = 0;
+  *r_url = NULL;
+
+  err = open_context (ctrl, &ctx);
+  if (err)
+    return err;
+
+  line = es_bsprintf ("DNS_CERT -- %s", name);
+  if (!line)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  if (strlen (line) + 2 >= ASSUAN_LINELENGTH)
+    {
+      err = gpg_error (GPG_ERR_TOO_LARGE);
+      goto leave;
+    }
+
+  parm.memfp = es_fopenmem (0, "rwb");
+  if (!parm.memfp)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  err = assuan_transact (ctx, line, dns_cert_data_cb, &parm,
+                         NULL, NULL, dns_cert_status_cb, &parm);
+  if (err)
+    goto leave;
+
+  if (es_ftell (parm.memfp) > 0)
+    {
+      es_rewind (parm.memfp);
+      *r_key = parm.memfp;
+      parm.memfp = NULL;
+    }
+  else if (parm.fpr)
+    {
+      *r_fpr = parm.fpr;
+      parm.fpr = NULL;
+      *r_fprlen = parm.fprlen;
+      *r_url = parm.url;
+      parm.url = NULL;
+    }
+  else
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+
+ leave:
+  xfree (parm.fpr);
+  xfree (parm.url);
+  es_fclose (parm.memfp);
+  es_free (line);
+  close_context (ctrl, ctx);
+  return err;
+}
+
+
+/* Ask the dirmngr for the PKA record of the mailbox USERID.  On
+   success the 20 byte fingerprint is stored as a malloced block at
+   R_FPR and the URL, if the record has one, as a malloced string at
+   R_URL; NULL is stored at R_URL if there is no URL.  */
+gpg_error_t
+gpg_dirmngr_get_pka (ctrl_t ctrl, const char *userid,
+                     unsigned char **r_fpr, char **r_url)
+{
+  gpg_error_t err;
+  assuan_context_t ctx;
+  struct dns_cert_parm_s parm;
+  char *line = NULL;
+
+  memset (&parm, 0, sizeof parm);
+  *r_fpr = NULL;
+  *r_url = NULL;
+
+  err = open_context (ctrl, &ctx);
+  if (err)
+    return err;
+
+  line = es_bsprintf ("DNS_CERT --pka -- %s", userid);
+  if (!line)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  if (strlen (line) + 2 >= ASSUAN_LINELENGTH)
+    {
+      err = gpg_error (GPG_ERR_TOO_LARGE);
+      goto leave;
+    }
+
+  err = assuan_transact (ctx, line, dns_cert_data_cb, &parm,
+                         NULL, NULL, dns_cert_status_cb, &parm);
+  if (err)
+    goto leave;
+
+  if (!parm.fpr || parm.fprlen != 20)
+    {
+      err = gpg_error (GPG_ERR_INV_DATA);
+      goto leave;
+    }
+  *r_fpr = parm.fpr;
+  parm.fpr = NULL;
+  *r_url = parm.url;
+  parm.url = NULL;
+
+ leave:
+  xfree (parm.fpr);
+  xfree (parm.url);
+  es_free (line);
+  close_context (ctrl, ctx);
+  return err;
+}
+
+
+
+/* Parameter structure used with the AKL_LOOKUP command.  */
+struct akl_lookup_parm_s
+{
+  struct dns_cert_parm_s dcparm;  /* The data of the current result.  */
+  gpg_error_t (*cb)(void *, const char *, gpg_error_t,
+                    estream_t, unsigned char *, size_t, char *);
+  void *cb_value;
+};
+
+
+/* Data callback for the AKL_LOOKUP command. */
+static gpg_error_t
+akl_lookup_data_cb (void *opaque, const void *data, size_t datalen)
+{
+  struct akl_lookup_parm_s *parm = opaque;
+
+  if (!data)
+    return 0;  /* Ignore END commands.  */
+
+  if (!parm->dcparm.memfp)
+    {
+      parm->dcparm.memfp = es_fopenmem (0, "rwb");
+      if (!parm->dcparm.memfp)
+        return gpg_error_from_syserror ();
+    }
+  return dns_cert_data_cb (&parm->dcparm, data, datalen);
+}
+
+
+/* Status callback for the AKL_LOOKUP command.  */
+static gpg_error_t
+akl_lookup_status_cb (void *opaque, const char *line)
+{
+  struct akl_lookup_parm_s *parm = opaque;
+  gpg_error_t err;
+  const char *s;
+  char *mech, *p;
+  estream_t key;
+
+  if (!(s = has_leading_keyword (line, "AKL_RESULT")))
+    return dns_cert_status_cb (&parm->dcparm, line);
+
+  mech = xtrystrdup (s);
+  if (!mech)
+    return gpg_error_from_syserror ();
+  p = strchr (mech, ' ');
+  if (!p)
+    {
+      xfree (mech);
+      return gpg_error (GPG_ERR_INV_RESPONSE);
+    }
+  *p++ = 0;
+  err = strtoul (p, NULL, 10);
+
+  key = parm->dcparm.memfp;
+  parm->dcparm.memfp = NULL;
+  if (key)
+    es_rewind (key);
+  err = parm->cb (parm->cb_value, mech, err, key,
+                  parm->dcparm.fpr, parm->dcparm.fprlen, parm->dcparm.url);
+  parm->dcparm.fpr = NULL;
+  parm->dcparm.fprlen = 0;
+  parm->dcparm.url = NULL;
+  xfree (mech);
+  return err;
+}
+
+
+/* Ask the dirmngr to run the lookups of the comma separated
+   auto-key-locate mechanisms MECHS for the mailbox NAME concurrently.
+   CB is called for each mechanism tried with the name of the
+   mechanism, its error code, and the key data, the fingerprint and
+   the URL found.  The results are reported in the order of MECHS up
+   to the first successful one; CB takes ownership of the key stream,
+   the fingerprint and the URL, each of which may be NULL.  */
+gpg_error_t
+gpg_dirmngr_akl_lookup (ctrl_t ctrl, const char *mechs, const char *name,
+                        gpg_error_t (*cb)(void *, const char *, gpg_error_t,
+                                          estream_t, unsigned char *, size_t,
+                                          char *),
+                        void *cb_value)
+{
+  gpg_error_t err;
+  assuan_context_t ctx;
+  struct akl_lookup_parm_s parm;
+  char *line = NULL;
+
+  memset (&parm, 0, sizeof parm);
+  parm.cb = cb;
+  parm.cb_value = cb_value;
+
+  err = open_context (ctrl, &ctx);
+  if (err)
+    return err;
+
+  line = es_bsprintf ("AKL_LOOKUP %s %s", mechs, name);
+  if (!line)
+    {
+      err = gpg_error_from_syserror ();
+      goto leave;
+    }
+  if (strlen (line) + 2 >= ASSUAN_LINELENGTH)
+    {
+      err = gpg_error (GPG_ERR_TOO_LARGE);
+      goto leave;
+    }
+
+  err = assuan_transact (ctx, line, akl_lookup_data_cb, &parm,
+                         NULL, NULL, akl_lookup_status_cb, &parm);
+
+ leave:
+  es_fclose (parm.dcparm.memfp);
+  xfree (parm.dcparm.fpr);
+  xfree (parm.dcparm.url);
+  es_free (line);
+  close_context (ctrl, ctx);
+  return err;
+}
@@ -28,6 +28,7 @@
 #include "filter.h"
 #include "main.h"
 #include "options.h"
+#include "../common/parallel.h"
 
 /* Note that the code in compress.c is nearly identical to the code
    here, so if you fix a bug here, look there to see if a matching bug
@@ -35,21 +36,24 @@
    do ZIP, ZLIB, and BZIP2, but it became dangerously unreadable with
    #ifdefs and if(algo) -dshaw */
 
+/* Return the bzip2 block size (1 to 9) to use.  */
+static int
+get_compress_level (void)
+{
+  if (opt.bz2_compress_level >= 1 && opt.bz2_compress_level <= 9)
+    return opt.bz2_compress_level;
+  else if (opt.bz2_compress_level != -1)
+    log_error ("invalid compression level; using default level\n");
+  return 6; /* no particular reason, but it seems reasonable */
+}
+
 static void
 init_compress( compress_filter_context_t *zfx, bz_stream *bzs )
 {
   int rc;
   int level;
 
-  if( opt.bz2_compress_level >= 1 && opt.bz2_compress_level <= 9 )
-    level = opt.bz2_compress_level;
-  else if( opt.bz2_compress_level == -1 )
-    level = 6; /* no particular reason, but it seems reasonable */
-  else
-    {
-      log_error("invalid compression level; using default level\n");
-      level = 6;
-    }
+  level = get_compress_level ();
 
   if((rc=BZ2_bzCompressInit(bzs,level,0,0))!=BZ_OK)
     log_fatal("bz2lib problem: %d\n",rc);
@@ -176,6 +180,743 @@ do_uncompress( compress_filter_context_t *zfx, bz_stream *bzs,
   return rc;
 }
 
+/* The parallel bzip2 code.  A bzip2 stream consists of a header,
+   independently compressed blocks and a trailer.  The blocks and the
+   trailer start with a 48 bit magic value and are not byte aligned;
+   the trailer carries a CRC combined from the CRCs of all blocks.
+   For compression the input is split into chunks which are small
+   enough to yield exactly one block; the chunks are compressed as
+   separate streams and the blocks are then stitched together.  For
+   decompression the blocks are located by scanning for the magic
+   values and each block is decompressed as a separate stream.  The
+   block magic may also appear by chance inside a block; we detect
+   this because the decompression of the truncated block fails and
+   then merge it with the next block.  */
+
+/* The size of the buffer used to read the compressed data.  */
+#define PBZ2_READSIZE (64*1024)
+/* The maximum number of false block magics we accept in one block
+   before we declare the data as corrupt.  */
+#define PBZ2_MAX_MERGES 8
+/* An upper bound for the compressed size of a block at LEVEL.  The
+   library guarantees that the output does not exceed the input by
+   more than 1% plus 600 bytes; we add some more slack.  */
+#define PBZ2_MAX_BLOCK(level) ((level) * 102000 + 1024)
+
+/* The block magic and the end of stream magic (pi and sqrt(pi)).  */
+static const byte block_magic[6] = { 0x31, 0x41, 0x59, 0x26, 0x53, 0x59 };
+static const byte eos_magic[6]   = { 0x17, 0x72, 0x45, 0x38, 0x50, 0x90 };
+
+
+/* A buffer to write a stream of bits.  */
+struct bitbuf_s
+{
+  byte *buf;      /* The output buffer; the caller needs to make sure
+                     that it is large enough.  */
+  size_t len;     /* The number of complete bytes in BUF.  */
+  unsigned int acc;  /* The pending bits.  */
+  int nacc;          /* The number of pending bits.  */
+};
+
+
+/* Append the NBITS (1 to 8) low bits of VALUE to BB.  */
+static void
+bitbuf_put_value (struct bitbuf_s *bb, unsigned int value, int nbits)
+{
+  bb->acc = (bb->acc << nbits) | value;
+  bb->nacc += nbits;
+  if (bb->nacc >= 8)
+    {
+      bb->nacc -= 8;
+      bb->buf[bb->len++] = bb->acc >> bb->nacc;
+      bb->acc &= (1 << bb->nacc) - 1;
+    }
+}
+
+
+/* Append NBITS bits taken from SRC starting at bit offset OFF to BB.  */
+static void
+bitbuf_put (struct bitbuf_s *bb, const byte *src, size_t off, size_t nbits)
+{
+  unsigned int shift = off % 8;
+  unsigned int value;
+
+  src += off / 8;
+  if (!shift && !bb->nacc)
+    {
+      memcpy (bb->buf + bb->len, src, nbits / 8);
+      bb->len += nbits / 8;
+      src += nbits / 8;
+      nbits %= 8;
+    }
+  for (; nbits >= 8; nbits -= 8, src++)
+    {
+      if (shift)
+        value = ((src[0] << shift) | (src[1] >> (8 - shift))) & 0xff;
+      else
+        value = src[0];
+      bitbuf_put_value (bb, value, 8);
+    }
+  if (nbits)
+    {
+      value = (src[0] << shift) & 0xff;
+      if (shift + nbits > 8)
+        value |= src[1] >> (8 - shift);
+      bitbuf_put_value (bb, value >> (8 - nbits), nbits);
+    }
+}
+
+
+/* Append the 32 bit VALUE to BB.  */
+static void
+bitbuf_put_u32 (struct bitbuf_s *bb, u32 value)
+{
+  bitbuf_put_value (bb, (value >> 24) & 0xff, 8);
+  bitbuf_put_value (bb, (value >> 16) & 0xff, 8);
+  bitbuf_put_value (bb, (value >>  8) & 0xff, 8);
+  bitbuf_put_value (bb, value & 0xff, 8);
+}
+
+
+/* Pad BB with zero bits to a byte boundary.  */
+static void
+bitbuf_flush (struct bitbuf_s *bb)
+{
+  if (bb->nacc)
+    {
+      bb->buf[bb->len++] = bb->acc << (8 - bb->nacc);
+      bb->acc = 0;
+      bb->nacc = 0;
+    }
+}
+
+
+/* Return the 32 bit value stored at bit offset OFF of BUF.  */
+static u32
+get_bits32 (const byte *buf, size_t off)
+{
+  unsigned int shift = off % 8;
+  u32 value;
+
+  buf += off / 8;
+  value = ((u32)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+  if (shift)
+    value = (value << shift) | (buf[4] >> (8 - shift));
+  return value;
+}
+
+
+/* Return true if the 48 bit MAGIC is stored at bit offset OFF of BUF.  */
+static int
+has_magic (const byte *buf, size_t off, const byte *magic)
+{
+  return (get_bits32 (buf, off) == get_bits32 (magic, 0)
+          && ((get_bits32 (buf, off + 16) ^ get_bits32 (magic, 16)) & 0xffff) == 0);
+}
+
+
+/* Object describing the processing of one block.  */
+struct pbz2_job_s
+{
+  const byte *in;   /* The input for the compressor.  */
+  size_t inlen;
+  size_t bitstart;  /* The bit range of the block in the compressed */
+  size_t bitend;    /* data; i.e. from the block magic up to the next */
+                    /* magic.  */
+  byte *out;        /* Malloced buffer with the output.  */
+  size_t outlen;
+  u32 crc;          /* The CRC of the block.  */
+  int zrc;          /* The bzlib error code.  */
+};
+
+/* Object describing a block or end of stream magic found in the
+   compressed data.  */
+struct pbz2_mark_s
+{
+  size_t pos;       /* The bit offset of the magic in the buffer.  */
+  int eos;          /* This is the end of stream magic.  */
+};
+
+/* The context of the parallel compressor and decompressor.  */
+struct pbz2_context_s
+{
+  int level;
+  int nthreads;
+  size_t chunksize; /* Compression: The size of an input chunk.  */
+  int header_done;  /* Compression: The header has been written.  */
+  struct bitbuf_s bb;  /* Compression: The output bit buffer.  */
+  u32 combined_crc; /* The CRC over all blocks.  */
+
+  byte *buffer;     /* The input data.  */
+  size_t bufsize;
+  size_t buflen;
+  size_t maxbufsize; /* Decompression: The limit for BUFSIZE.  */
+
+  int eof;          /* Decompression: EOF seen on the input.  */
+  int stream_end;   /* Decompression: The end of stream was reached.  */
+  size_t scanlen;   /* Decompression: Number of bytes in BUFFER which */
+                    /*   have been scanned for magics.  */
+  byte shifts[256]; /* Decompression: For each byte value the bit mask */
+                    /*   of magic offsets it may be part of.  */
+  struct pbz2_mark_s *marks;  /* Decompression: The found magics.  */
+  unsigned int nmarks;
+  unsigned int marksize;
+  int merges;       /* Decompression: Number of merges of the first */
+                    /*   block.  */
+
+  struct pbz2_job_s *jobs;
+  unsigned int njobs;   /* Decompression: Number of finished jobs, */
+  unsigned int outjob;  /* the job with pending output, */
+  size_t outpos;        /* and the offset into its output.  */
+};
+typedef struct pbz2_context_s *pbz2_context_t;
+
+
+static pbz2_context_t
+pbz2_new (int compress)
+{
+  pbz2_context_t pz;
+  int shift;
+
+  pz = xmalloc_clear (sizeof *pz);
+  pz->nthreads = gnupg_parallel_threads (opt.worker_threads);
+  pz->jobs = xcalloc (pz->nthreads, sizeof *pz->jobs);
+  if (compress)
+    {
+      pz->level = get_compress_level ();
+      /* The run length encoding done before the block sorting may
+         expand the input by 5/4; a chunk of this size will thus
+         always be compressed into exactly one block.  */
+      pz->chunksize = (pz->level * 100000 - 19) / 5 * 4 - 64;
+      pz->bufsize = pz->nthreads * pz->chunksize;
+    }
+  else
+    {
+      /* The second byte of a magic starting at bit SHIFT of a byte
+         is always fully part of the magic.  Record these values so
+         that we can scan the data bytewise.  */
+      for (shift = 0; shift < 8; shift++)
+        {
+          pz->shifts[get_bits32 (block_magic, 8 - shift) >> 24] |= 1 << shift;
+          pz->shifts[get_bits32 (eos_magic, 8 - shift) >> 24] |= 1 << shift;
+        }
+      pz->scanlen = 1;
+      pz->bufsize = 2 * PBZ2_READSIZE;
+      pz->maxbufsize = pz->bufsize; /* Raised by pbz2_start.  */
+    }
+  pz->buffer = xmalloc (pz->bufsize);
+  return pz;
+}
+
+
+static void
+pbz2_release (pbz2_context_t pz)
+{
+  unsigned int idx;
+
+  if (!pz)
+    return;
+  for (idx = 0; idx < pz->nthreads; idx++)
+    xfree (pz->jobs[idx].out);
+  xfree (pz->jobs);
+  xfree (pz->marks);
+  xfree (pz->bb.buf);
+  xfree (pz->buffer);
+  xfree (pz);
+}
+
+
+/* Worker function to compress chunk IDX of the context OPAQUE.  */
+static void
+pbz2_compress_job (void *opaque, unsigned int idx)
+{
+  pbz2_context_t pz = opaque;
+  struct pbz2_job_s *job = pz->jobs + idx;
+  unsigned int outlen;
+  int pad;
+
+  job->outlen = job->inlen + job->inlen / 100 + 600;
+  job->out = xtrymalloc (job->outlen);
+  if (!job->out)
+    {
+      job->zrc = BZ_MEM_ERROR;
+      return;
+    }
+  outlen = job->outlen;
+  job->zrc = BZ2_bzBuffToBuffCompress ((char*)job->out, &outlen,
+                                       (char*)job->in, job->inlen,
+                                       pz->level, 0, 0);
+  if (job->zrc != BZ_OK)
+    return;
+  job->outlen = outlen;
+
+  /* The stream has only one block, thus the stream CRC at the end is
+     identical to the block CRC.  We use this to locate the end of
+     stream magic which is followed by up to 7 padding bits.  */
+  job->crc = get_bits32 (job->out, 80);
+  job->bitstart = 32;
+  for (pad = 0; pad < 8; pad++)
+    {
+      job->bitend = job->outlen * 8 - 80 - pad;
+      if (has_magic (job->out, job->bitend, eos_magic)
+          && get_bits32 (job->out, job->bitend + 48) == job->crc)
+        return;
+    }
+  job->zrc = BZ_DATA_ERROR_MAGIC;
+}
+
+
+/* Compress the buffered input of PZ and write it to A.  If FINAL is
+   not set only complete chunks are compressed and the remaining
+   input is kept; if FINAL is set all input is processed and the
+   stream is terminated.  */
+static int
+pbz2_flush (pbz2_context_t pz, int final, IOBUF a)
+{
+  unsigned int njobs, idx;
+  struct pbz2_job_s *job;
+  size_t consumed, outsize;
+  int rc = 0;
+
+  if (final)
+    njobs = (pz->buflen + pz->chunksize - 1) / pz->chunksize;
+  else
+    njobs = pz->buflen / pz->chunksize;
+  if (!njobs && !final)
+    return 0;
+
+  for (idx = 0, consumed = 0; idx < njobs; idx++)
+    {
+      job = pz->jobs + idx;
+      job->in = pz->buffer + consumed;
+      job->inlen = pz->buflen - consumed;
+      if (job->inlen > pz->chunksize)
+        job->inlen = pz->chunksize;
+      consumed += job->inlen;
+    }
+
+  gnupg_parallel_run (pz->nthreads, njobs, pbz2_compress_job, pz);
+
+  outsize = 4 + 10 + 1;
+  for (idx = 0; idx < njobs; idx++)
+    {
+      job = pz->jobs + idx;
+      if (job->zrc != BZ_OK)
+        log_fatal ("bz2lib deflate problem: rc=%d\n", job->zrc);
+      outsize += job->outlen;
+    }
+  xfree (pz->bb.buf);
+  pz->bb.buf = xmalloc (outsize);
+  pz->bb.len = 0;
+
+  if (!pz->header_done)
+    {
+      bitbuf_put (&pz->bb, "BZh", 0, 24);
+      bitbuf_put_value (&pz->bb, '0' + pz->level, 8);
+      pz->header_done = 1;
+    }
+  for (idx = 0; idx < njobs; idx++)
+    {
+      job = pz->jobs + idx;
+      if (DBG_FILTER)
+        log_debug ("parallel bzCompress: block %u: in=%u, out=%u\n", idx,
+                   (unsigned int)job->inlen, (unsigned int)job->outlen);
+      bitbuf_put (&pz->bb, job->out, job->bitstart,
+                  job->bitend - job->bitstart);
+      pz->combined_crc = ((pz->combined_crc << 1)
+                          | (pz->combined_crc >> 31)) ^ job->crc;
+      xfree (job->out);
+      job->out = NULL;
+    }
+  if (final)
+    {
+      bitbuf_put (&pz->bb, eos_magic, 0, 48);
+      bitbuf_put_u32 (&pz->bb, pz->combined_crc);
+      bitbuf_flush (&pz->bb);
+    }
+
+  /* Pending bits are kept in the bit buffer for the next round.  */
+  if ((rc = iobuf_write (a, pz->bb.buf, pz->bb.len)))
+    {
+      log_debug ("bzCompress: iobuf_write failed\n");
+      return rc;
+    }
+  pz->bb.len = 0;
+
+  pz->buflen -= consumed;
+  memmove (pz->buffer, pz->buffer + consumed, pz->buflen);
+  return 0;
+}
+
+
+/* Feed SIZE bytes from BUF into the parallel compressor PZ.  */
+static int
+pbz2_write (pbz2_context_t pz, const byte *buf, size_t size, IOBUF a)
+{
+  size_t n;
+  int rc;
+
+  while (size)
+    {
+      n = pz->bufsize - pz->buflen;
+      if (n > size)
+        n = size;
+      memcpy (pz->buffer + pz->buflen, buf, n);
+      pz->buflen += n;
+      buf += n;
+      size -= n;
+      if (pz->buflen == pz->bufsize && (rc = pbz2_flush (pz, 0, a)))
+        return rc;
+    }
+  return 0;
+}
+
+
+/* Read more compressed data from A into the buffer of PZ and record
+   the positions of all magics found in the new data.  Returns
+   GPG_ERR_TOO_LARGE if the buffer has reached its limit.  */
+static int
+pbz2_fill (pbz2_context_t pz, IOBUF a)
+{
+  int nread;
+  unsigned int mask;
+  int shift, eos;
+  size_t pos, n;
+  void *p;
+
+  if (pz->bufsize - pz->buflen < PBZ2_READSIZE
+      && pz->bufsize < pz->maxbufsize)
+    {
+      n = 2 * pz->bufsize + PBZ2_READSIZE;
+      if (n > pz->maxbufsize)
+        n = pz->maxbufsize;
+      p = xtryrealloc (pz->buffer, n);
+      if (!p)
+        return gpg_err_code_from_syserror ();
+      pz->buffer = p;
+      pz->bufsize = n;
+    }
+  n = pz->bufsize - pz->buflen;
+  if (!n)
+    return GPG_ERR_TOO_LARGE;
+  nread = iobuf_read (a, pz->buffer + pz->buflen,
+                      n < PBZ2_READSIZE? n : PBZ2_READSIZE);
+  if (nread == -1)
+    {
+      pz->eof = 1;
+      return 0;
+    }
+  pz->buflen += nread;
+
+  /* A magic starting in the byte before SCANLEN extends up to 5
+     bytes after it.  */
+  for (; pz->scanlen + 5 < pz->buflen; pz->scanlen++)
+    {
+      mask = pz->shifts[pz->buffer[pz->scanlen]];
+      for (shift = 0; mask; shift++, mask >>= 1)
+        {
+          if (!(mask & 1))
+            continue;
+          pos = (pz->scanlen - 1) * 8 + shift;
+          if (has_magic (pz->buffer, pos, block_magic))
+            eos = 0;
+          else if (has_magic (pz->buffer, pos, eos_magic))
+            eos = 1;
+          else
+            continue;
+          if (pz->nmarks == pz->marksize)
+            {
+              p = xtryrealloc (pz->marks,
+                               (pz->marksize + 64) * sizeof *pz->marks);
+              if (!p)
+                return gpg_err_code_from_syserror ();
+              pz->marks = p;
+              pz->marksize += 64;
+            }
+          pz->marks[pz->nmarks].pos = pos;
+          pz->marks[pz->nmarks].eos = eos;
+          pz->nmarks++;
+        }
+    }
+  return 0;
+}
+
+
+/* Worker function to decompress block IDX of the context OPAQUE.  */
+static void
+pbz2_decompress_job (void *opaque, unsigned int idx)
+{
+  pbz2_context_t pz = opaque;
+  struct pbz2_job_s *job = pz->jobs + idx;
+  size_t nbits = job->bitend - job->bitstart;
+  struct bitbuf_s bb;
+  bz_stream bzs;
+  size_t outsize, used;
+  byte *p;
+  int zrc;
+
+  job->out = NULL;
+  job->outlen = 0;
+  if (nbits < 80)
+    {
+      job->zrc = BZ_DATA_ERROR;
+      return;
+    }
+  job->crc = get_bits32 (pz->buffer, job->bitstart + 48);
+
+  /* Build a stream consisting of just this block.  */
+  memset (&bb, 0, sizeof bb);
+  bb.buf = xtrymalloc (nbits / 8 + 16);
+  if (!bb.buf)
+    {
+      job->zrc = BZ_MEM_ERROR;
+      return;
+    }
+  bitbuf_put (&bb, "BZh", 0, 24);
+  bitbuf_put_value (&bb, '0' + pz->level, 8);
+  bitbuf_put (&bb, pz->buffer, job->bitstart, nbits);
+  bitbuf_put (&bb, eos_magic, 0, 48);
+  bitbuf_put_u32 (&bb, job->crc);
+  bitbuf_flush (&bb);
+
+  memset (&bzs, 0, sizeof bzs);
+  zrc = BZ2_bzDecompressInit (&bzs, 0, opt.bz2_decompress_lowmem);
+  if (zrc != BZ_OK)
+    {
+      xfree (bb.buf);
+      job->zrc = zrc;
+      return;
+    }
+  outsize = pz->level * 100000;
+  job->out = xtrymalloc (outsize);
+  if (!job->out)
+    zrc = BZ_MEM_ERROR;
+  bzs.next_in = (char*)bb.buf;
+  bzs.avail_in = bb.len;
+  bzs.next_out = (char*)job->out;
+  bzs.avail_out = outsize;
+  while (zrc == BZ_OK)
+    {
+      zrc = BZ2_bzDecompress (&bzs);
+      if (zrc == BZ_STREAM_END)
+        {
+          /* A false block magic in the next block would leave
+             trailing data.  */
+          zrc = bzs.avail_in? BZ_DATA_ERROR : BZ_OK;
+          break;
+        }
+      if (zrc != BZ_OK)
+        break;
+      if (bzs.avail_out)
+        {
+          if (!bzs.avail_in)
+            zrc = BZ_UNEXPECTED_EOF;
+          continue;
+        }
+      /* Not enough space for the output.  */
+      used = outsize - bzs.avail_out;
+      p = xtryrealloc (job->out, 2 * outsize);
+      if (!p)
+        {
+          zrc = BZ_MEM_ERROR;
+          break;
+        }
+      job->out = p;
+      outsize *= 2;
+      bzs.next_out = (char*)job->out + used;
+      bzs.avail_out = outsize - used;
+    }
+  job->zrc = zrc;
+  job->outlen = outsize - bzs.avail_out;
+  BZ2_bzDecompressEnd (&bzs);
+  xfree (bb.buf);
+}
+
+
+/* Start the parallel decompression by reading the header and the
+   first block magic from A.  Returns false if the data does not look
+   like a proper bzip2 stream and the standard decompressor shall be
+   used instead.  The first magic directly follows the 4 byte header;
+   thus we never need to read more than the initial buffer.  */
+static int
+pbz2_start (pbz2_context_t pz, IOBUF a)
+{
+  while (!pz->eof && !pz->nmarks && pz->buflen < 16)
+    if (pbz2_fill (pz, a))
+      return 0;
+
+  if (pz->buflen < 4 || memcmp (pz->buffer, "BZh", 3)
+      || pz->buffer[3] < '1' || pz->buffer[3] > '9'
+      || !pz->nmarks || pz->marks[0].pos != 32)
+    return 0;
+  pz->level = pz->buffer[3] - '0';
+  /* Each job needs at most one block, and a block must end within
+     one maximum block size; that is room for all jobs plus the start
+     of the next set.  */
+  pz->maxbufsize = ((pz->nthreads + 1) * PBZ2_MAX_BLOCK (pz->level)
+                    + 2 * PBZ2_READSIZE);
+  return 1;
+}
+
+
+/* Decompress the next set of blocks from A.  */
+static int
+pbz2_decompress_blocks (pbz2_context_t pz, IOBUF a)
+{
+  unsigned int njobs, idx;
+  struct pbz2_job_s *job;
+  size_t n;
+  int rc;
+
+  while (!pz->eof && pz->nmarks <= pz->nthreads)
+    {
+      rc = pbz2_fill (pz, a);
+      if (rc == GPG_ERR_TOO_LARGE && pz->nmarks > 1)
+        break;  /* Process the complete blocks we have.  */
+      if (rc == GPG_ERR_TOO_LARGE)
+        {
+          /* The buffer starts at a block; a proper block ends well
+             before the limit.  */
+          log_error ("bz2lib: block too large\n");
+          return GPG_ERR_BAD_DATA;
+        }
+      if (rc)
+        {
+          log_error ("bz2lib: error reading input: %s\n",
+                     gpg_strerror (rc));
+          return rc;
+        }
+    }
+
+  /* The first mark is always the end of a properly decompressed
+     block and thus no false positive.  */
+  if (!pz->nmarks)
+    {
+      log_error ("unexpected EOF in bz2lib\n");
+      return GPG_ERR_BAD_DATA;
+    }
+  if (pz->marks[0].eos)
+    {
+      if (pz->marks[0].pos + 80 > pz->buflen * 8
+          || get_bits32 (pz->buffer, pz->marks[0].pos + 48)
+             != pz->combined_crc)
+        {
+          log_error ("bz2lib: stream CRC mismatch\n");
+          return GPG_ERR_BAD_DATA;
+        }
+      pz->stream_end = 1;
+      return 0;
+    }
+
+  for (njobs = 0; (njobs < pz->nthreads && njobs + 1 < pz->nmarks
+                   && !pz->marks[njobs].eos); njobs++)
+    {
+      job = pz->jobs + njobs;
+      job->bitstart = pz->marks[njobs].pos;
+      job->bitend = pz->marks[njobs + 1].pos;
+    }
+  if (!njobs)
+    {
+      log_error ("unexpected EOF in bz2lib\n");
+      return GPG_ERR_BAD_DATA;
+    }
+
+  gnupg_parallel_run (pz->nthreads, njobs, pbz2_decompress_job, pz);
+
+  for (idx = 0; idx < njobs; idx++)
+    {
+      job = pz->jobs + idx;
+      if (job->zrc == BZ_OK)
+        {
+          if (DBG_FILTER)
+            log_debug ("parallel bzDecompress: block %u: in=%u, out=%u\n",
+                       idx, (unsigned int)(job->bitend - job->bitstart) / 8,
+                       (unsigned int)job->outlen);
+          pz->combined_crc = ((pz->combined_crc << 1)
+                              | (pz->combined_crc >> 31)) ^ job->crc;
+          pz->merges = 0;
+          continue;
+        }
+
+      /* The magic at the end of this block may have been a false
+         positive: Discard it along with the results of the following
+         jobs and try again.  */
+      if (++pz->merges > PBZ2_MAX_MERGES
+          || (idx + 2 >= pz->nmarks && pz->eof))
+        {
+          log_error ("bz2lib inflate problem: rc=%d\n", job->zrc);
+          return GPG_ERR_BAD_DATA;
+        }
+      for (n = idx; n < njobs; n++)
+        {
+          xfree (pz->jobs[n].out);
+          pz->jobs[n].out = NULL;
+        }
+      pz->nmarks--;
+      memmove (pz->marks + idx + 1, pz->marks + idx + 2,
+               (pz->nmarks - idx - 1) * sizeof *pz->marks);
+      njobs = idx;
+      break;
+    }
+  pz->njobs = njobs;
+  pz->outjob = 0;
+  pz->outpos = 0;
+
+  /* Remove the processed data.  */
+  pz->nmarks -= njobs;
+  memmove (pz->marks, pz->marks + njobs, pz->nmarks * sizeof *pz->marks);
+  n = pz->marks[0].pos / 8;
+  pz->buflen -= n;
+  pz->scanlen -= n;
+  memmove (pz->buffer, pz->buffer + n, pz->buflen);
+  for (idx = 0; idx < pz->nmarks; idx++)
+    pz->marks[idx].pos -= n * 8;
+  return 0;
+}
+
+
+/* Return up to SIZE bytes of decompressed data from A in BUF.  */
+static int
+pbz2_read (pbz2_context_t pz, IOBUF a, byte *buf, size_t size,
+           size_t *ret_len)
+{
+  struct pbz2_job_s *job;
+  size_t n, len = 0;
+  int rc = 0;
+
+  while (len < size)
+    {
+      if (pz->outjob < pz->njobs)
+        {
+          job = pz->jobs + pz->outjob;
+          n = job->outlen - pz->outpos;
+          if (n > size - len)
+            n = size - len;
+          memcpy (buf + len, job->out + pz->outpos, n);
+          len += n;
+          pz->outpos += n;
+          if (pz->outpos == job->outlen)
+            {
+              xfree (job->out);
+              job->out = NULL;
+              pz->outjob++;
+              pz->outpos = 0;
+            }
+        }
+      else if (pz->stream_end)
+        {
+          rc = -1; /* eof */
+          break;
+        }
+      else if ((rc = pbz2_decompress_blocks (pz, a)))
+        break;
+    }
+
+  *ret_len = len;
+  return rc;
+}
+
+
 int
 compress_filter_bz2( void *opaque, int control,
 		     IOBUF a, byte *buf, size_t *ret_len)
@@ -187,17 +928,50 @@ compress_filter_bz2( void *opaque, int control,
 
   if( control == IOBUFCTRL_UNDERFLOW )
     {
-      if( !zfx->status )
+      if( !zfx->status && gnupg_parallel_threads (opt.worker_threads) > 1 )
+	{
+	  pbz2_context_t pz = pbz2_new (0);
+
+	  if (pbz2_start (pz, a))
+	    {
+	      zfx->opaque = pz;
+	      zfx->status = 4;
+	    }
+	  else
+	    {
+	      /* Hand the data already read over to the standard
+	         decompressor.  */
+	      bzs = zfx->opaque = xmalloc_clear( sizeof *bzs );
+	      init_uncompress( zfx, bzs );
+	      if (pz->buflen > zfx->inbufsize)
+		{
+		  xfree (zfx->inbuf);
+		  zfx->inbufsize = pz->buflen;
+		  zfx->inbuf = xmalloc (zfx->inbufsize);
+		}
+	      memcpy (zfx->inbuf, pz->buffer, pz->buflen);
+	      bzs->next_in = zfx->inbuf;
+	      bzs->avail_in = pz->buflen;
+	      pbz2_release (pz);
+	      zfx->status = 1;
+	    }
+	}
+      else if( !zfx->status )
 	{
 	  bzs = zfx->opaque = xmalloc_clear( sizeof *bzs );
 	  init_uncompress( zfx, bzs );
 	  zfx->status = 1;
 	}
 
-      bzs->next_out = buf;
-      bzs->avail_out = size;
-      zfx->outbufsize = size; /* needed only for calculation */
-      rc = do_uncompress( zfx, bzs, a, ret_len );
+      if( zfx->status == 4 )
+	rc = pbz2_read (zfx->opaque, a, buf, size, ret_len);
+      else
+	{
+	  bzs->next_out = buf;
+	  bzs->avail_out = size;
+	  zfx->outbufsize = size; /* needed only for calculation */
+	  rc = do_uncompress( zfx, bzs, a, ret_len );
+	}
     }
   else if( control == IOBUFCTRL_FLUSH )
     {
@@ -216,14 +990,27 @@ compress_filter_bz2( void *opaque, int control,
 	  pkt.pkt.compressed = &cd;
 	  if( build_packet( a, &pkt ))
 	    log_bug("build_packet(PKT_COMPRESSED) failed\n");
-	  bzs = zfx->opaque = xmalloc_clear( sizeof *bzs );
-	  init_compress( zfx, bzs );
-	  zfx->status = 2;
+	  if (gnupg_parallel_threads (opt.worker_threads) > 1)
+	    {
+	      zfx->opaque = pbz2_new (1);
+	      zfx->status = 3;
+	    }
+	  else
+	    {
+	      bzs = zfx->opaque = xmalloc_clear( sizeof *bzs );
+	      init_compress( zfx, bzs );
+	      zfx->status = 2;
+	    }
 	}
 
-      bzs->next_in = buf;
-      bzs->avail_in = size;
-      rc = do_compress( zfx, bzs, BZ_RUN, a );
+      if( zfx->status == 3 )
+	rc = pbz2_write (zfx->opaque, buf, size, a);
+      else
+	{
+	  bzs->next_in = buf;
+	  bzs->avail_in = size;
+	  rc = do_compress( zfx, bzs, BZ_RUN, a );
+	}
     }
   else if( control == IOBUFCTRL_FREE )
     {
@@ -244,6 +1031,17 @@ compress_filter_bz2( void *opaque, int control,
 	  zfx->opaque = NULL;
 	  xfree(zfx->outbuf); zfx->outbuf = NULL;
 	}
+      else if( zfx->status == 3 )
+	{
+	  rc = pbz2_flush (zfx->opaque, 1, a);
+	  pbz2_release (zfx->opaque);
+	  zfx->opaque = NULL;
+	}
+      else if( zfx->status == 4 )
+	{
+	  pbz2_release (zfx->opaque);
+	  zfx->opaque = NULL;
+	}
       if (zfx->release)
 	zfx->release (zfx);
     }
@@ -44,6 +44,7 @@
 #include "filter.h"
 #include "main.h"
 #include "options.h"
+#include "../common/parallel.h"
 
 
 #ifdef __riscos__
@@ -58,6 +59,17 @@ int compress_filter_bz2( void *opaque, int control,
 			 IOBUF a, byte *buf, size_t *ret_len);
 
 #ifdef HAVE_ZIP
+/* Return the zlib compression level to use.  */
+static int
+get_compress_level (void)
+{
+  if (opt.compress_level >= 1 && opt.compress_level <= 9)
+    return opt.compress_level;
+  else if (opt.compress_level != -1)
+    log_error ("invalid compression level; using default level\n");
+  return Z_DEFAULT_COMPRESSION;
+}
+
 static void
 init_compress( compress_filter_context_t *zfx, z_stream *zs )
 {
@@ -71,14 +83,7 @@ init_compress( compress_filter_context_t *zfx, z_stream *zs )
         zlib_initialized = riscos_load_module("ZLib", zlib_path, 1);
 #endif
 
-    if( opt.compress_level >= 1 && opt.compress_level <= 9 )
-	level = opt.compress_level;
-    else if( opt.compress_level == -1 )
-	level = Z_DEFAULT_COMPRESSION;
-    else {
-	log_error("invalid compression level; using default level\n");
-	level = Z_DEFAULT_COMPRESSION;
-    }
+    level = get_compress_level ();
 
     if( (rc = zfx->algo == 1? deflateInit2( zs, level, Z_DEFLATED,
 					    -13, 8, Z_DEFAULT_STRATEGY)
@@ -131,6 +136,284 @@ do_compress( compress_filter_context_t *zfx, z_stream *zs, int flush, IOBUF a )
     return 0;
 }
 
+/* The parallel compressor.  To make use of several CPUs the input is
+   split into blocks which are deflated independently, as done by
+   pigz.  Each block is primed with the tail of the preceding input
+   and terminated with a sync flush so that the concatenation of the
+   compressed blocks is one regular deflate stream.  The last block
+   is terminated with Z_FINISH.  For ZLIB we write the header and the
+   Adler-32 trailer ourselves.  */
+
+/* The size of the independently compressed blocks.  */
+#define PZIP_BLOCKSIZE (128*1024)
+/* The size of the deflate window.  */
+#define PZIP_DICTSIZE  32768
+
+/* Object describing the compression of one block.  */
+struct pzip_job_s
+{
+  const byte *in;   /* The input data of the block.  */
+  size_t inlen;
+  const byte *dict; /* The input data preceding IN.  */
+  size_t dictlen;
+  int flush;        /* Z_SYNC_FLUSH or Z_FINISH.  */
+  byte *out;        /* Malloced buffer with the compressed block.  */
+  size_t outlen;
+  uLong adler;      /* The Adler-32 checksum of the input.  */
+  int zrc;          /* The zlib error code.  */
+};
+
+/* The context of the parallel compressor.  */
+struct pzip_context_s
+{
+  int algo;
+  int level;
+  int nthreads;
+  int header_done;  /* The ZLIB header has been written.  */
+  byte *buffer;     /* Input buffer for NTHREADS blocks.  */
+  size_t buflen;
+  byte dict[PZIP_DICTSIZE]; /* The tail of the processed input.  */
+  size_t dictlen;
+  uLong adler;      /* The Adler-32 checksum of all input.  */
+  struct pzip_job_s *jobs;
+};
+typedef struct pzip_context_s *pzip_context_t;
+
+
+static pzip_context_t
+pzip_new (int algo)
+{
+  pzip_context_t pz;
+
+  pz = xmalloc_clear (sizeof *pz);
+  pz->algo = algo;
+  pz->level = get_compress_level ();
+  pz->nthreads = gnupg_parallel_threads (opt.worker_threads);
+  pz->buffer = xmalloc (pz->nthreads * PZIP_BLOCKSIZE);
+  pz->jobs = xcalloc (pz->nthreads, sizeof *pz->jobs);
+  pz->adler = adler32 (0, NULL, 0);
+  return pz;
+}
+
+
+static void
+pzip_release (pzip_context_t pz)
+{
+  if (!pz)
+    return;
+  xfree (pz->buffer);
+  xfree (pz->jobs);
+  xfree (pz);
+}
+
+
+/* Worker function to compress block IDX of the parallel compressor
+   context OPAQUE.  */
+static void
+pzip_job (void *opaque, unsigned int idx)
+{
+  pzip_context_t pz = opaque;
+  struct pzip_job_s *job = pz->jobs + idx;
+  z_stream zs;
+  size_t outsize, used;
+  byte *p;
+  int zrc;
+
+  memset (&zs, 0, sizeof zs);
+  job->out = NULL;
+  job->outlen = 0;
+  zrc = deflateInit2 (&zs, pz->level, Z_DEFLATED,
+                      pz->algo == COMPRESS_ALGO_ZIP? -13 : -15,
+                      8, Z_DEFAULT_STRATEGY);
+  if (zrc != Z_OK)
+    {
+      job->zrc = zrc;
+      return;
+    }
+  if (job->dictlen)
+    zrc = deflateSetDictionary (&zs, BYTEF_CAST (job->dict), job->dictlen);
+
+  /* Allow for the empty stored block emitted by the sync flush.  */
+  outsize = deflateBound (&zs, job->inlen) + 16;
+  job->out = xtrymalloc (outsize);
+  if (!job->out)
+    zrc = Z_MEM_ERROR;
+
+  zs.next_in = BYTEF_CAST ((byte*)job->in);
+  zs.avail_in = job->inlen;
+  zs.next_out = BYTEF_CAST (job->out);
+  zs.avail_out = outsize;
+  while (zrc == Z_OK)
+    {
+      zrc = deflate (&zs, job->flush);
+      if (zrc == Z_STREAM_END
+          || (zrc == Z_OK && job->flush != Z_FINISH && zs.avail_out))
+        {
+          zrc = Z_STREAM_END;
+          break;
+        }
+      if ((zrc != Z_OK && zrc != Z_BUF_ERROR) || zs.avail_out)
+        break;
+      /* Not enough space for the output.  */
+      used = outsize - zs.avail_out;
+      p = xtryrealloc (job->out, 2 * outsize);
+      if (!p)
+        {
+          zrc = Z_MEM_ERROR;
+          break;
+        }
+      job->out = p;
+      outsize *= 2;
+      zs.next_out = BYTEF_CAST (job->out + used);
+      zs.avail_out = outsize - used;
+      zrc = Z_OK;
+    }
+  job->zrc = zrc == Z_STREAM_END? Z_OK : zrc;
+  job->outlen = outsize - zs.avail_out;
+  deflateEnd (&zs);
+
+  if (pz->algo == COMPRESS_ALGO_ZLIB)
+    job->adler = adler32 (adler32 (0, NULL, 0),
+                          BYTEF_CAST ((byte*)job->in), job->inlen);
+}
+
+
+/* Compress the buffered input of PZ and write it to A.  If FINAL is
+   not set only complete blocks are compressed and the remaining
+   input is kept; if FINAL is set all input is processed and the
+   stream is terminated.  */
+static int
+pzip_flush (pzip_context_t pz, int final, IOBUF a)
+{
+  unsigned int njobs, idx;
+  struct pzip_job_s *job;
+  size_t consumed;
+  byte tmp[4];
+  int rc = 0;
+
+  if (final)
+    njobs = (pz->buflen + PZIP_BLOCKSIZE - 1) / PZIP_BLOCKSIZE;
+  else
+    njobs = pz->buflen / PZIP_BLOCKSIZE;
+  if (!njobs && !final)
+    return 0;
+  if (!njobs)
+    njobs = 1;  /* We need one block to terminate the stream.  */
+
+  for (idx = 0, consumed = 0; idx < njobs; idx++)
+    {
+      job = pz->jobs + idx;
+      job->in = pz->buffer + consumed;
+      job->inlen = pz->buflen - consumed;
+      if (job->inlen > PZIP_BLOCKSIZE)
+        job->inlen = PZIP_BLOCKSIZE;
+      if (!idx)
+        {
+          job->dict = pz->dict;
+          job->dictlen = pz->dictlen;
+        }
+      else
+        {
+          job->dict = job->in - PZIP_DICTSIZE;
+          job->dictlen = PZIP_DICTSIZE;
+        }
+      job->flush = (final && idx + 1 == njobs)? Z_FINISH : Z_SYNC_FLUSH;
+      consumed += job->inlen;
+    }
+
+  gnupg_parallel_run (pz->nthreads, njobs, pzip_job, pz);
+
+  if (pz->algo == COMPRESS_ALGO_ZLIB && !pz->header_done)
+    {
+      /* Write a standard zlib header for a 32k window.  */
+      int flevel;
+
+      if (pz->level == 1)
+        flevel = 0;
+      else if (pz->level >= 2 && pz->level <= 5)
+        flevel = 1;
+      else if (pz->level >= 7)
+        flevel = 3;
+      else
+        flevel = 2;
+      tmp[0] = 0x78;
+      tmp[1] = flevel << 6;
+      tmp[1] += 31 - ((tmp[0] << 8) + tmp[1]) % 31;
+      rc = iobuf_write (a, tmp, 2);
+      pz->header_done = 1;
+    }
+
+  for (idx = 0; idx < njobs; idx++)
+    {
+      job = pz->jobs + idx;
+      if (job->zrc != Z_OK)
+        log_fatal ("zlib deflate problem: rc=%d\n", job->zrc);
+      if (DBG_FILTER)
+        log_debug ("parallel deflate: block %u: in=%u, out=%u\n", idx,
+                   (unsigned int)job->inlen, (unsigned int)job->outlen);
+      if (!rc)
+        rc = iobuf_write (a, job->out, job->outlen);
+      if (pz->algo == COMPRESS_ALGO_ZLIB)
+        pz->adler = adler32_combine (pz->adler, job->adler, job->inlen);
+      xfree (job->out);
+      job->out = NULL;
+    }
+  if (rc)
+    {
+      log_debug ("deflate: iobuf_write failed\n");
+      return rc;
+    }
+
+  if (final)
+    {
+      if (pz->algo == COMPRESS_ALGO_ZLIB)
+        {
+          tmp[0] = pz->adler >> 24;
+          tmp[1] = pz->adler >> 16;
+          tmp[2] = pz->adler >> 8;
+          tmp[3] = pz->adler;
+          rc = iobuf_write (a, tmp, 4);
+        }
+      pz->buflen = 0;
+    }
+  else
+    {
+      /* Non-final flushes process at least one full block which is
+         larger than the dictionary.  */
+      memcpy (pz->dict, pz->buffer + consumed - PZIP_DICTSIZE,
+              PZIP_DICTSIZE);
+      pz->dictlen = PZIP_DICTSIZE;
+      pz->buflen -= consumed;
+      memmove (pz->buffer, pz->buffer + consumed, pz->buflen);
+    }
+  return rc;
+}
+
+
+/* Feed SIZE bytes from BUF into the parallel compressor PZ.  */
+static int
+pzip_write (pzip_context_t pz, const byte *buf, size_t size, IOBUF a)
+{
+  size_t bufsize = pz->nthreads * PZIP_BLOCKSIZE;
+  size_t n;
+  int rc;
+
+  while (size)
+    {
+      n = bufsize - pz->buflen;
+      if (n > size)
+        n = size;
+      memcpy (pz->buffer + pz->buflen, buf, n);
+      pz->buflen += n;
+      buf += n;
+      size -= n;
+      if (pz->buflen == bufsize && (rc = pzip_flush (pz, 0, a)))
+        return rc;
+    }
+  return 0;
+}
+
+
 static void
 init_uncompress( compress_filter_context_t *zfx, z_stream *zs )
 {
@@ -259,14 +542,24 @@ compress_filter( void *opaque, int control,
 	    pkt.pkt.compressed = &cd;
 	    if( build_packet( a, &pkt ))
 		log_bug("build_packet(PKT_COMPRESSED) failed\n");
-	    zs = zfx->opaque = xmalloc_clear( sizeof *zs );
-	    init_compress( zfx, zs );
-	    zfx->status = 2;
+	    if (gnupg_parallel_threads (opt.worker_threads) > 1) {
+		zfx->opaque = pzip_new (zfx->algo);
+		zfx->status = 3;
+	    }
+	    else {
+		zs = zfx->opaque = xmalloc_clear( sizeof *zs );
+		init_compress( zfx, zs );
+		zfx->status = 2;
+	    }
 	}
 
-	zs->next_in = BYTEF_CAST (buf);
-	zs->avail_in = size;
-	rc = do_compress( zfx, zs, Z_NO_FLUSH, a );
+	if( zfx->status == 3 )
+	    rc = pzip_write (zfx->opaque, buf, size, a);
+	else {
+	    zs->next_in = BYTEF_CAST (buf);
+	    zs->avail_in = size;
+	    rc = do_compress( zfx, zs, Z_NO_FLUSH, a );
+	}
     }
     else if( control == IOBUFCTRL_FREE ) {
 	if( zfx->status == 1 ) {
@@ -284,6 +577,11 @@ compress_filter( void *opaque, int control,
 	    zfx->opaque = NULL;
 	    xfree(zfx->outbuf); zfx->outbuf = NULL;
 	}
+	else if( zfx->status == 3 ) {
+	    rc = pzip_flush (zfx->opaque, 1, a);
+	    pzip_release (zfx->opaque);
+	    zfx->opaque = NULL;
+	}
         if (zfx->release)
           zfx->release (zfx);
     }
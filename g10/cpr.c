@@ -43,6 +43,11 @@
    this is NULL.  */
 static estream_t statusfp;
 
+/* Status lines may also be written by the worker threads of the pipe
+   filters (e.g. by the progress filter); this lock keeps the lines
+   from being interleaved.  */
+GPGRT_LOCK_DEFINE (status_lock);
+
 
 static void
 progress_cb (void *ctx, const char *what, int printchar,
@@ -124,6 +129,19 @@ set_status_fd (int fd)
 }
 
 
+/* Use the stream FP for the status output.  This is used by the
+   server mode to send the status lines to the client.  The stream is
+   not closed by this module; passing NULL disables the status output
+   again.  */
+void
+set_status_stream (estream_t fp)
+{
+  statusfp = fp;
+  if (fp)
+    gcry_set_progress_handler (progress_cb, NULL);
+}
+
+
 int
 is_status_enabled ()
 {
@@ -145,10 +163,12 @@ write_status_strings (int no, const char *text, ...)
 {
   va_list arg_ptr;
   const char *s;
+  int err;
 
   if (!statusfp || !status_currently_allowed (no) )
     return;  /* Not enabled or allowed. */
 
+  gpgrt_lock_lock (&status_lock);
   es_fputs ("[GNUPG:] ", statusfp);
   es_fputs (get_status_string (no), statusfp);
   if ( text )
@@ -172,7 +192,9 @@ write_status_strings (int no, const char *text, ...)
       va_end (arg_ptr);
     }
   es_putc ('\n', statusfp);
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
+  err = es_fflush (statusfp);
+  gpgrt_lock_unlock (&status_lock);
+  if (err && opt.exit_on_status_write_error)
     g10_exit (0);
 }
 
@@ -187,12 +209,17 @@ write_status_text (int no, const char *text)
 void
 write_status_error (const char *where, gpg_error_t err)
 {
+  int rc;
+
   if (!statusfp || !status_currently_allowed (STATUS_ERROR))
     return;  /* Not enabled or allowed. */
 
+  gpgrt_lock_lock (&status_lock);
   es_fprintf (statusfp, "[GNUPG:] %s %s %u\n",
               get_status_string (STATUS_ERROR), where, err);
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
+  rc = es_fflush (statusfp);
+  gpgrt_lock_unlock (&status_lock);
+  if (rc && opt.exit_on_status_write_error)
     g10_exit (0);
 }
 
@@ -201,12 +228,17 @@ write_status_error (const char *where, gpg_error_t err)
 void
 write_status_errcode (const char *where, int errcode)
 {
+  int rc;
+
   if (!statusfp || !status_currently_allowed (STATUS_ERROR))
     return;  /* Not enabled or allowed. */
 
+  gpgrt_lock_lock (&status_lock);
   es_fprintf (statusfp, "[GNUPG:] %s %s %u\n",
               get_status_string (STATUS_ERROR), where, gpg_err_code (errcode));
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
+  rc = es_fflush (statusfp);
+  gpgrt_lock_unlock (&status_lock);
+  if (rc && opt.exit_on_status_write_error)
     g10_exit (0);
 }
 
@@ -225,6 +257,7 @@ write_status_text_and_buffer (int no, const char *string,
   int esc, first;
   int lower_limit = ' ';
   size_t n, count, dowrap;
+  int rc;
 
   if (!statusfp || !status_currently_allowed (no))
     return;  /* Not enabled or allowed. */
@@ -237,6 +270,7 @@ write_status_text_and_buffer (int no, const char *string,
 
   text = get_status_string (no);
   count = dowrap = first = 1;
+  gpgrt_lock_lock (&status_lock);
   do
     {
       if (dowrap)
@@ -286,7 +320,9 @@ write_status_text_and_buffer (int no, const char *string,
   while (len);
 
   es_putc ('\n',statusfp);
-  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
+  rc = es_fflush (statusfp);
+  gpgrt_lock_unlock (&status_lock);
+  if (rc && opt.exit_on_status_write_error)
     g10_exit (0);
 }
 
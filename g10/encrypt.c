@@ -38,6 +38,7 @@
 #include "i18n.h"
 #include "status.h"
 #include "pkglue.h"
+#include "../common/parallel.h"
 
 
 static int encrypt_simple( const char *filename, int mode, int use_seskey );
@@ -557,6 +558,8 @@ encrypt_crypt (ctrl_t ctrl, int filefd, const char *filename,
       afx = new_armor_context ();
       push_armor_filter (afx, out);
     }
+  if (opt.pipeline)
+    gnupg_parallel_push_pipe (out);
 
   /* Create a session key. */
   cfx.dek = xmalloc_secure_clear (sizeof *cfx.dek);
@@ -672,6 +675,8 @@ encrypt_crypt (ctrl_t ctrl, int filefd, const char *filename,
 
   /* Register the cipher filter. */
   iobuf_push_filter (out, cipher_filter, &cfx);
+  if (opt.pipeline)
+    gnupg_parallel_push_pipe (out);
 
   /* Register the compress filter. */
   if (do_compress)
@@ -704,6 +709,11 @@ encrypt_crypt (ctrl_t ctrl, int filefd, const char *filename,
         }
     }
 
+  /* Read the input in a separate thread.  This needs to be done
+     after we are finished with the file length.  */
+  if (opt.pipeline)
+    gnupg_parallel_push_pipe (inp);
+
   /* Do the work. */
   if (!opt.no_literal)
     {
@@ -846,8 +856,38 @@ encrypt_filter (void *opaque, int control,
 }
 
 
+/* Object used to pass the per recipient data to the worker threads
+   of write_pubkey_enc_from_list.  */
+struct pubkey_enc_job_s
+{
+  PKT_public_key *pk;    /* The public key of the recipient.  */
+  PKT_pubkey_enc *enc;   /* The packet to be filled in.  */
+  gcry_mpi_t frame;      /* The encoded session key.  */
+  gcry_sexp_t s_pkey;    /* The public key as S-expression.  */
+  gcry_sexp_t s_data;    /* The data to encrypt.  */
+  gcry_sexp_t s_ciph;    /* Receives the result of the encryption.  */
+  int rc;                /* The result of the encryption.  */
+};
+
+
+/* Encrypt the session key for the recipient with index IDX of the
+   job array OPAQUE.  This function may run in a separate thread and
+   thus it only calls Libgcrypt; the job objects are prepared and
+   evaluated by the caller.  */
+static void
+pubkey_enc_job (void *opaque, unsigned int idx)
+{
+  struct pubkey_enc_job_s *job = (struct pubkey_enc_job_s *)opaque + idx;
+
+  job->rc = gcry_pk_encrypt (&job->s_ciph, job->s_data, job->s_pkey);
+}
+
+
 /*
- * Write pubkey-enc packets from the list of PKs to OUT.
+ * Write pubkey-enc packets from the list of PKs to OUT.  The public
+ * key operations are independent of each other and thus run on up
+ * to opt.worker_threads threads; the packets are written in the
+ * order of the list.
  */
 static int
 write_pubkey_enc_from_list (PK_LIST pk_list, DEK *dek, iobuf_t out)
@@ -855,19 +895,28 @@ write_pubkey_enc_from_list (PK_LIST pk_list, DEK *dek, iobuf_t out)
   PACKET pkt;
   PKT_public_key *pk;
   PKT_pubkey_enc  *enc;
-  int rc;
+  PK_LIST pkr;
+  struct pubkey_enc_job_s *jobs;
+  unsigned int njobs, idx;
+  int rc = 0;
 
-  for ( ; pk_list; pk_list = pk_list->next )
-    {
-      gcry_mpi_t frame;
+  for (njobs = 0, pkr = pk_list; pkr; pkr = pkr->next)
+    njobs++;
+  if (!njobs)
+    return 0;
+  jobs = xtrycalloc (njobs, sizeof *jobs);
+  if (!jobs)
+    return gpg_error_from_syserror ();
 
-      pk = pk_list->pk;
+  for (idx = 0, pkr = pk_list; pkr && !rc; idx++, pkr = pkr->next)
+    {
+      pk = pkr->pk;
 
       print_pubkey_algo_note ( pk->pubkey_algo );
       enc = xmalloc_clear ( sizeof *enc );
       enc->pubkey_algo = pk->pubkey_algo;
       keyid_from_pk( pk, enc->keyid );
-      enc->throw_keyid = (opt.throw_keyid || (pk_list->flags&1));
+      enc->throw_keyid = (opt.throw_keyid || (pkr->flags&1));
 
       if (opt.throw_keyid && (PGP6 || PGP7 || PGP8))
         {
@@ -876,22 +925,40 @@ write_pubkey_enc_from_list (PK_LIST pk_list, DEK *dek, iobuf_t out)
           compliance_failure();
         }
 
+      jobs[idx].pk = pk;
+      jobs[idx].enc = enc;
+
       /* Okay, what's going on: We have the session key somewhere in
        * the structure DEK and want to encode this session key in an
        * integer value of n bits. pubkey_nbits gives us the number of
        * bits we have to use.  We then encode the session key in some
        * way and we get it back in the big intger value FRAME.  Then
        * we use FRAME, the public key PK->PKEY and the algorithm
-       * number PK->PUBKEY_ALGO and pass it to pubkey_encrypt which
-       * returns the encrypted value in the array ENC->DATA.  This
-       * array has a size which depends on the used algorithm (e.g. 2
-       * for Elgamal).  We don't need frame anymore because we have
-       * everything now in enc->data which is the passed to
-       * build_packet().  */
-      frame = encode_session_key (pk->pubkey_algo, dek,
-                                  pubkey_nbits (pk->pubkey_algo, pk->pkey));
-      rc = pk_encrypt (pk->pubkey_algo, enc->data, frame, pk, pk->pkey);
-      gcry_mpi_release (frame);
+       * number PK->PUBKEY_ALGO to build the S-expressions for
+       * gcry_pk_encrypt.  Only that public key operation is run by
+       * the worker threads; its result is then stored in the array
+       * ENC->DATA.  This array has a size which depends on the used
+       * algorithm (e.g. 2 for Elgamal).  */
+      jobs[idx].frame = encode_session_key (pk->pubkey_algo, dek,
+                                            pubkey_nbits (pk->pubkey_algo,
+                                                          pk->pkey));
+      rc = pk_encrypt_prepare (pk->pubkey_algo, jobs[idx].frame, pk->pkey,
+                               &jobs[idx].s_pkey, &jobs[idx].s_data);
+      if (rc)
+        log_error ("pubkey_encrypt failed: %s\n", gpg_strerror (rc) );
+    }
+
+  if (!rc)
+    gnupg_parallel_run (opt.worker_threads, njobs, pubkey_enc_job, jobs);
+
+  for (idx = 0; idx < njobs && !rc; idx++)
+    {
+      pk = jobs[idx].pk;
+      enc = jobs[idx].enc;
+      rc = jobs[idx].rc;
+      if (!rc)
+        rc = pk_encrypt_finish (pk->pubkey_algo, enc->data, jobs[idx].frame,
+                                pk, pk->pkey, jobs[idx].s_ciph);
       if (rc)
         log_error ("pubkey_encrypt failed: %s\n", gpg_strerror (rc) );
       else
@@ -914,11 +981,19 @@ write_pubkey_enc_from_list (PK_LIST pk_list, DEK *dek, iobuf_t out)
             log_error ("build_packet(pubkey_enc) failed: %s\n",
                        g10_errstr (rc));
 	}
-      free_pubkey_enc(enc);
-      if (rc)
-        return rc;
     }
-  return 0;
+
+  for (idx = 0; idx < njobs; idx++)
+    {
+      if (jobs[idx].enc)
+        free_pubkey_enc (jobs[idx].enc);
+      gcry_mpi_release (jobs[idx].frame);
+      gcry_sexp_release (jobs[idx].s_pkey);
+      gcry_sexp_release (jobs[idx].s_data);
+      gcry_sexp_release (jobs[idx].s_ciph);
+    }
+  xfree (jobs);
+  return rc;
 }
 
 
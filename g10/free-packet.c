@@ -26,10 +26,111 @@
 
 #include "gpg.h"
 #include "util.h"
+#include "../common/init.h"
 #include "packet.h"
 #include "../common/iobuf.h"
 #include "options.h"
 
+/* The maximum number of structures kept on each of the free lists.  */
+#define MAX_UNUSED_OBJECTS 4096
+
+/* Reading a keyblock allocates a signature or public key structure
+   for most of its packets and releasing the keyblock frees them
+   again.  Like the nodes in kbnode.c these structures are thus kept
+   on free lists for reuse.  The lists are chained through the first
+   bytes of the released structures.  */
+struct unused_object_s
+{
+  struct unused_object_s *next;
+};
+
+struct unused_list_s
+{
+  struct unused_object_s *head;
+  unsigned int count;
+};
+
+static int cleanup_registered;
+static struct unused_list_s unused_sigs;
+static struct unused_list_s unused_pks;
+
+
+static void
+release_unused_list (struct unused_list_s *list)
+{
+  struct unused_object_s *next;
+
+  while (list->head)
+    {
+      next = list->head->next;
+      xfree (list->head);
+      list->head = next;
+    }
+  list->count = 0;
+}
+
+
+static void
+release_unused_objects (void)
+{
+  release_unused_list (&unused_sigs);
+  release_unused_list (&unused_pks);
+}
+
+
+/* Return a cleared object of SIZE bytes from LIST or a new one.  */
+static void *
+alloc_object (struct unused_list_s *list, size_t size)
+{
+  struct unused_object_s *obj = list->head;
+
+  if (!obj)
+    return xmalloc_clear (size);
+  list->head = obj->next;
+  list->count--;
+  memset (obj, 0, size);
+  return obj;
+}
+
+
+/* Put the object P on LIST or release it if the list is full.
+   Objects in secure memory are always released.  */
+static void
+free_object (struct unused_list_s *list, void *p)
+{
+  struct unused_object_s *obj = p;
+
+  if (list->count >= MAX_UNUSED_OBJECTS || gcry_is_secure (p))
+    xfree (p);
+  else
+    {
+      if (!cleanup_registered)
+        {
+          cleanup_registered = 1;
+          register_mem_cleanup_func (release_unused_objects);
+        }
+      obj->next = list->head;
+      list->head = obj;
+      list->count++;
+    }
+}
+
+
+/* Return a new cleared signature structure.  */
+PKT_signature *
+alloc_signature (void)
+{
+  return alloc_object (&unused_sigs, sizeof (PKT_signature));
+}
+
+
+/* Return a new cleared public key structure.  */
+PKT_public_key *
+alloc_public_key (void)
+{
+  return alloc_object (&unused_pks, sizeof (PKT_public_key));
+}
+
 
 void
 free_symkey_enc( PKT_symkey_enc *enc )
@@ -61,7 +162,12 @@ free_seckey_enc( PKT_signature *sig )
     mpi_release( sig->data[i] );
 
   xfree(sig->revkey);
+  xfree (sig->lazy_data);
+  if (sig->hashed)
+    xfree (sig->hashed->index);
   xfree(sig->hashed);
+  if (sig->unhashed)
+    xfree (sig->unhashed->index);
   xfree(sig->unhashed);
 
   if (sig->pka_info)
@@ -70,7 +176,7 @@ free_seckey_enc( PKT_signature *sig )
       xfree (sig->pka_info);
     }
 
-  xfree(sig);
+  free_object (&unused_sigs, sig);
 }
 
 
@@ -90,6 +196,8 @@ release_public_key_parts (PKT_public_key *pk)
       mpi_release (pk->pkey[i]);
       pk->pkey[i] = NULL;
     }
+  pk->fprlen = 0;
+  pk->flags.grip_valid = 0;
   if (pk->seckey_info)
     {
       xfree (pk->seckey_info);
@@ -127,7 +235,7 @@ free_public_key (PKT_public_key *pk)
   if (pk)
     {
       release_public_key_parts (pk);
-      xfree(pk);
+      free_object (&unused_pks, pk);
     }
 }
 
@@ -142,7 +250,9 @@ cp_subpktarea (subpktarea_t *s )
     d = xmalloc (sizeof (*d) + s->size - 1 );
     d->size = s->size;
     d->len = s->len;
+    d->index = NULL;
     memcpy (d->data, s->data, s->len);
+    index_sig_subpkts (d);
     return d;
 }
 
@@ -181,7 +291,7 @@ copy_public_key (PKT_public_key *d, PKT_public_key *s)
   int n, i;
 
   if (!d)
-    d = xmalloc (sizeof *d);
+    d = alloc_public_key ();
   memcpy (d, s, sizeof *d);
   d->seckey_info = NULL;
   d->user_id = scopy_user_id (s->user_id);
@@ -233,7 +343,7 @@ copy_signature( PKT_signature *d, PKT_signature *s )
     int n, i;
 
     if( !d )
-	d = xmalloc(sizeof *d);
+	d = alloc_signature ();
     memcpy( d, s, sizeof *d );
     n = pubkey_get_nsig( s->pubkey_algo );
     if( !n )
@@ -242,6 +352,11 @@ copy_signature( PKT_signature *d, PKT_signature *s )
 	for(i=0; i < n; i++ )
 	    d->data[i] = mpi_copy( s->data[i] );
     }
+    if (s->lazy_data)
+      {
+        d->lazy_data = xmalloc (s->lazy_datalen);
+        memcpy (d->lazy_data, s->lazy_data, s->lazy_datalen);
+      }
     d->pka_info = s->pka_info? cp_pka_info (s->pka_info) : NULL;
     d->hashed = cp_subpktarea (s->hashed);
     d->unhashed = cp_subpktarea (s->unhashed);
@@ -447,6 +562,8 @@ cmp_signatures( PKT_signature *a, PKT_signature *b )
     n = pubkey_get_nsig( a->pubkey_algo );
     if( !n )
 	return -1; /* can't compare due to unknown algorithm */
+    if (parse_sig_data (a) || parse_sig_data (b))
+        return -1;
     for(i=0; i < n; i++ ) {
 	if( mpi_cmp( a->data[i] , b->data[i] ) )
 	    return -1;
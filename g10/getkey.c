@@ -707,6 +707,8 @@ get_pubkey_byname (ctrl_t ctrl, GETKEY_CTX * retctx, PKT_public_key * pk,
   int is_mbox;
   int nodefault = 0;
   int anylocalfirst = 0;
+  int parallel = 0;
+  akl_prefetch_t prefetch = NULL;
 
   if (retctx)
     *retctx = NULL;
@@ -731,12 +733,18 @@ get_pubkey_byname (ctrl_t ctrl, GETKEY_CTX * retctx, PKT_public_key * pk,
 	    break;
 	  }
       for (akl = opt.auto_key_locate; akl; akl = akl->next)
-	if (akl->type != AKL_NODEFAULT)
+	if (akl->type != AKL_NODEFAULT && akl->type != AKL_PARALLEL)
 	  {
 	    if (akl->type == AKL_LOCAL)
 	      anylocalfirst = 1;
 	    break;
 	  }
+      for (akl = opt.auto_key_locate; akl; akl = akl->next)
+	if (akl->type == AKL_PARALLEL)
+	  {
+	    parallel = 1;
+	    break;
+	  }
     }
 
   if (!nodefault)
@@ -766,9 +774,21 @@ get_pubkey_byname (ctrl_t ctrl, GETKEY_CTX * retctx, PKT_public_key * pk,
 	  int no_fingerprint = 0;
 	  const char *mechanism = "?";
 
+	  /* Run all remote lookups at once when we get to the first
+	     of them.  */
+	  if (parallel && (akl->type == AKL_CERT || akl->type == AKL_PKA
+			   || akl->type == AKL_KEYSERVER))
+	    {
+	      parallel = 0;
+	      glo_ctrl.in_auto_key_retrieve++;
+	      prefetch = keyserver_prefetch_akl (ctrl, name, akl);
+	      glo_ctrl.in_auto_key_retrieve--;
+	    }
+
 	  switch (akl->type)
 	    {
 	    case AKL_NODEFAULT:
+	    case AKL_PARALLEL:
 	      /* This is a dummy mechanism.  */
 	      mechanism = "None";
 	      rc = G10ERR_NO_PUBKEY;
@@ -791,14 +811,16 @@ get_pubkey_byname (ctrl_t ctrl, GETKEY_CTX * retctx, PKT_public_key * pk,
 	    case AKL_CERT:
 	      mechanism = "DNS CERT";
 	      glo_ctrl.in_auto_key_retrieve++;
-	      rc = keyserver_import_cert (ctrl, name, &fpr, &fpr_len);
+	      rc = keyserver_import_cert (ctrl, name, &fpr, &fpr_len,
+                                          prefetch);
 	      glo_ctrl.in_auto_key_retrieve--;
 	      break;
 
 	    case AKL_PKA:
 	      mechanism = "PKA";
 	      glo_ctrl.in_auto_key_retrieve++;
-	      rc = keyserver_import_pka (ctrl, name, &fpr, &fpr_len);
+	      rc = keyserver_import_pka (ctrl, name, &fpr, &fpr_len,
+                                         prefetch);
 	      glo_ctrl.in_auto_key_retrieve--;
 	      break;
 
@@ -819,7 +841,7 @@ get_pubkey_byname (ctrl_t ctrl, GETKEY_CTX * retctx, PKT_public_key * pk,
 		  mechanism = opt.keyserver->uri;
 		  glo_ctrl.in_auto_key_retrieve++;
 		  rc = keyserver_import_name (ctrl, name, &fpr, &fpr_len,
-                                              opt.keyserver);
+                                              opt.keyserver, prefetch);
 		  glo_ctrl.in_auto_key_retrieve--;
 		}
 	      else
@@ -837,7 +859,8 @@ get_pubkey_byname (ctrl_t ctrl, GETKEY_CTX * retctx, PKT_public_key * pk,
 		keyserver = keyserver_match (akl->spec);
 		glo_ctrl.in_auto_key_retrieve++;
 		rc = keyserver_import_name (ctrl,
-                                            name, &fpr, &fpr_len, keyserver);
+                                            name, &fpr, &fpr_len, keyserver,
+                                            NULL);
 		glo_ctrl.in_auto_key_retrieve--;
 	      }
 	      break;
@@ -898,6 +921,7 @@ get_pubkey_byname (ctrl_t ctrl, GETKEY_CTX * retctx, PKT_public_key * pk,
 		      name, mechanism,
 		      no_fingerprint ? _("No fingerprint") : g10_errstr (rc));
 	}
+      keyserver_release_prefetch (prefetch);
     }
 
 
@@ -2924,6 +2948,8 @@ parse_auto_key_locate (char *options)
         }
       else if (ascii_strcasecmp (tok, "nodefault") == 0)
 	akl->type = AKL_NODEFAULT;
+      else if (ascii_strcasecmp (tok, "parallel") == 0)
+	akl->type = AKL_PARALLEL;
       else if (ascii_strcasecmp (tok, "local") == 0)
 	akl->type = AKL_LOCAL;
       else if (ascii_strcasecmp (tok, "ldap") == 0)
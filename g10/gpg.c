@@ -193,6 +193,7 @@ enum cmd_and_opt_values
     oDebug,
     oDebugLevel,
     oDebugAll,
+    oDebugStartup,
     oDebugCCIDDriver,
     oStatusFD,
     oStatusFile,
@@ -379,6 +380,9 @@ enum cmd_and_opt_values
     oNoAllowMultipleMessages,
     oAllowWeakDigestAlgos,
     oFakedSystemTime,
+    oWorkerThreads,
+    oPipeline,
+    oNoPipeline,
 
     oNoop
   };
@@ -551,6 +555,7 @@ static ARGPARSE_OPTS opts[] = {
   ARGPARSE_p_u (oDebug, "debug", "@"),
   ARGPARSE_s_s (oDebugLevel, "debug-level", "@"),
   ARGPARSE_s_n (oDebugAll, "debug-all", "@"),
+  ARGPARSE_s_n (oDebugStartup, "debug-startup", "@"),
   ARGPARSE_s_i (oStatusFD, "status-fd", "@"),
   ARGPARSE_s_s (oStatusFile, "status-file", "@"),
   ARGPARSE_s_i (oAttributeFD, "attribute-fd", "@"),
@@ -770,6 +775,9 @@ static ARGPARSE_OPTS opts[] = {
   ARGPARSE_s_n (oAllowMultipleMessages,      "allow-multiple-messages", "@"),
   ARGPARSE_s_n (oNoAllowMultipleMessages, "no-allow-multiple-messages", "@"),
   ARGPARSE_s_n (oAllowWeakDigestAlgos, "allow-weak-digest-algos", "@"),
+  ARGPARSE_s_i (oWorkerThreads, "worker-threads", "@"),
+  ARGPARSE_s_n (oPipeline, "pipeline", "@"),
+  ARGPARSE_s_n (oNoPipeline, "no-pipeline", "@"),
 
   /* These two are aliases to help users of the PGP command line
      product use gpg with minimal pain.  Many commands are common
@@ -2020,6 +2028,7 @@ main (int argc, char **argv)
     int use_random_seed = 1;
     enum cmd_and_opt_values cmd = 0;
     const char *debug_level = NULL;
+    int debug_startup = 0;
 #ifndef NO_TRUST_MODELS
     const char *trustdb_name = NULL;
 #endif /*!NO_TRUST_MODELS*/
@@ -2049,6 +2058,7 @@ main (int argc, char **argv)
     /* Please note that we may running SUID(ROOT), so be very CAREFUL
        when adding any stuff between here and the call to
        secmem_init() somewhere after the option parsing. */
+    log_clock (NULL);  /* Set the reference time.  */
     gnupg_reopen_std (GPG_NAME);
     trap_unaligned ();
     gnupg_rl_initialize ();
@@ -2099,6 +2109,7 @@ main (int argc, char **argv)
     opt.completes_needed = 1;
     opt.marginals_needed = 3;
     opt.max_cert_depth = 5;
+    opt.worker_threads = 1; /* No extra threads unless requested.  */
     opt.escape_from = 1;
     opt.flags.require_cross_cert = 1;
     opt.import_options = 0;
@@ -2392,6 +2403,7 @@ main (int argc, char **argv)
 	  case oDebug: opt.debug |= pargs.r.ret_ulong; break;
 	  case oDebugAll: opt.debug = ~0; break;
           case oDebugLevel: debug_level = pargs.r.ret_str; break;
+          case oDebugStartup: debug_startup = 1; break;
 
 	  case oStatusFD:
             set_status_fd ( translate_sys2libc_fd_int (pargs.r.ret_int, 1) );
@@ -3131,6 +3143,10 @@ main (int argc, char **argv)
             }
             break;
 
+          case oWorkerThreads: opt.worker_threads = pargs.r.ret_int; break;
+          case oPipeline: opt.pipeline = 1; break;
+          case oNoPipeline: opt.pipeline = 0; break;
+
 	  case oNoop: break;
 
 	  default:
@@ -3260,6 +3276,8 @@ main (int argc, char **argv)
       }
 
     set_debug (debug_level);
+    if (debug_startup)
+      opt.debug |= DBG_CLOCK_VALUE;
     if (DBG_CLOCK)
       log_clock ("start");
 
@@ -3481,17 +3499,25 @@ main (int argc, char **argv)
     /* Add the keyrings, but not for some special commands.
        We always need to add the keyrings if we are running under
        SELinux, this is so that the rings are added to the list of
-       secured files. */
+       secured files.  Otherwise the keyrings are only opened when
+       the first key database handle is created; thus commands which
+       do not need a key do not need to access the keyrings.  */
     if( ALWAYS_ADD_KEYRINGS
         || (cmd != aDeArmor && cmd != aEnArmor && cmd != aGPGConfTest) )
       {
+        unsigned int defer;
+
+        defer = ALWAYS_ADD_KEYRINGS? 0 : KEYDB_RESOURCE_FLAG_DEFER;
+
 	if (!nrings || default_keyring)  /* Add default ring. */
 	    keydb_add_resource ("pubring" EXTSEP_S GPGEXT_GPG,
-                                KEYDB_RESOURCE_FLAG_DEFAULT);
+                                KEYDB_RESOURCE_FLAG_DEFAULT | defer);
 	for (sl = nrings; sl; sl = sl->next )
-          keydb_add_resource (sl->d, sl->flags);
+          keydb_add_resource (sl->d, sl->flags | defer);
       }
     FREE_STRLIST(nrings);
+    if (DBG_CLOCK)
+      log_clock ("keyrings registered");
 
     if (cmd == aGPGConfTest)
       g10_exit(0);
@@ -3588,6 +3614,9 @@ main (int argc, char **argv)
         break;
       }
 
+    if (DBG_CLOCK)
+      log_clock ("setup done");
+
     /* The command dispatcher.  */
     switch( cmd )
       {
@@ -3658,7 +3687,8 @@ main (int argc, char **argv)
 		strcpy(sl->d, fname);
 	    }
 	}
-	if( (rc = sign_file (ctrl, sl, detached_sig, locusr, 0, NULL, NULL)) )
+	if( (rc = sign_file (ctrl, -1, sl, detached_sig, locusr,
+                                 0, NULL, NULL, -1)) )
 	    log_error("signing failed: %s\n", g10_errstr(rc) );
 	free_strlist(sl);
 	break;
@@ -3672,7 +3702,8 @@ main (int argc, char **argv)
 	}
 	else
 	    sl = NULL;
-	if ((rc = sign_file (ctrl, sl, detached_sig, locusr, 1, remusr, NULL)))
+	if ((rc = sign_file (ctrl, -1, sl, detached_sig, locusr,
+                            1, remusr, NULL, -1)))
 	    log_error("%s: sign+encrypt failed: %s\n",
 		      print_fname_stdin(fname), g10_errstr(rc) );
 	free_strlist(sl);
@@ -3696,8 +3727,8 @@ main (int argc, char **argv)
 	      }
 	    else
 	      sl = NULL;
-	    if ((rc = sign_file (ctrl, sl, detached_sig, locusr,
-                                 2, remusr, NULL)))
+	    if ((rc = sign_file (ctrl, -1, sl, detached_sig, locusr,
+                                 2, remusr, NULL, -1)))
 	      log_error("%s: symmetric+sign+encrypt failed: %s\n",
 			print_fname_stdin(fname), g10_errstr(rc) );
 	    free_strlist(sl);
@@ -164,6 +164,7 @@ main( int argc, char **argv )
   opt.keyserver_options.options |= KEYSERVER_AUTO_KEY_RETRIEVE;
   opt.trust_model = TM_ALWAYS;
   opt.batch = 1;
+  opt.worker_threads = 1; /* Never use extra threads.  */
 
   opt.homedir = default_homedir ();
 
@@ -370,6 +371,21 @@ keyserver_import_ldap (const char *name)
   return -1;
 }
 
+void *
+keyserver_prefetch_akl (void *ctrl, const char *name, void *akl)
+{
+  (void)ctrl;
+  (void)name;
+  (void)akl;
+  return NULL;
+}
+
+void
+keyserver_release_prefetch (void *pf)
+{
+  (void)pf;
+}
+
 /* Stub:
  * No encryption here but mainproc links to these functions.
  */
@@ -574,3 +590,14 @@ agent_get_keyinfo (ctrl_t ctrl, const char *hexkeygrip, char **r_serialno)
   *r_serialno = NULL;
   return gpg_error (GPG_ERR_NO_SECKEY);
 }
+
+gpg_error_t
+gpg_dirmngr_get_pka (ctrl_t ctrl, const char *userid,
+                     unsigned char **r_fpr, char **r_url)
+{
+  (void)ctrl;
+  (void)userid;
+  *r_fpr = NULL;
+  *r_url = NULL;
+  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+}
@@ -63,6 +63,11 @@ static struct resource_item all_resources[MAX_KEYDB_RESOURCES];
 static int used_resources;
 static void *primary_keyring=NULL;
 
+/* Resources registered with KEYDB_RESOURCE_FLAG_DEFER which have not
+   yet been opened.  The flags of each resource are stored with the
+   item.  */
+static strlist_t deferred_resources;
+
 struct keydb_handle
 {
   int locked;
@@ -327,7 +332,10 @@ rt_from_file (const char *filename, int *r_found, int *r_openpgp)
  * Register a resource (keyring or aeybox).  The first keyring or
  * keybox which is added by this function is created if it does not
  * exist.  FLAGS are a combination of the KEYDB_RESOURCE_FLAG_
- * constants as defined in keydb.h.
+ * constants as defined in keydb.h.  With KEYDB_RESOURCE_FLAG_DEFER
+ * the resource is only remembered and actually registered when the
+ * first handle is created; this saves the file accesses for commands
+ * which do not need a key.
  */
 gpg_error_t
 keydb_add_resource (const char *url, unsigned int flags)
@@ -342,6 +350,15 @@ keydb_add_resource (const char *url, unsigned int flags)
   KeydbResourceType rt = KEYDB_RESOURCE_TYPE_NONE;
   void *token;
 
+  if ((flags & KEYDB_RESOURCE_FLAG_DEFER))
+    {
+      strlist_t sl;
+
+      sl = append_to_strlist (&deferred_resources, url);
+      sl->flags = (flags & ~KEYDB_RESOURCE_FLAG_DEFER);
+      return 0;
+    }
+
   /* Create the resource if it is the first registered one.  */
   create = (!read_only && !any_registered);
 
@@ -522,6 +539,25 @@ keydb_add_resource (const char *url, unsigned int flags)
 
 
 
+/* Register all resources added with KEYDB_RESOURCE_FLAG_DEFER.  Errors
+   are printed by keydb_add_resource.  */
+static void
+register_deferred_resources (void)
+{
+  strlist_t list, sl;
+
+  if (!deferred_resources)
+    return;
+
+  list = deferred_resources;
+  deferred_resources = NULL;
+  for (sl = list; sl; sl = sl->next)
+    keydb_add_resource (sl->d, sl->flags);
+  free_strlist (list);
+  if (DBG_CLOCK)
+    log_clock ("keydb resources registered");
+}
+
 
 KEYDB_HANDLE
 keydb_new (void)
@@ -532,6 +568,8 @@ keydb_new (void)
   if (DBG_CLOCK)
     log_clock ("keydb_new");
 
+  register_deferred_resources ();
+
   hd = xmalloc_clear (sizeof *hd);
   hd->found = -1;
 
@@ -741,7 +779,7 @@ parse_keyblock_image (iobuf_t iobuf, int pk_no, int uid_no,
   PACKET *pkt;
   kbnode_t keyblock = NULL;
   kbnode_t node, *tail;
-  int in_cert, save_mode;
+  int in_cert, save_mode, save_lazy;
   u32 n_sigs;
   int pk_count, uid_count;
 
@@ -752,6 +790,7 @@ parse_keyblock_image (iobuf_t iobuf, int pk_no, int uid_no,
     return gpg_error_from_syserror ();
   init_packet (pkt);
   save_mode = set_packet_list_mode (0);
+  save_lazy = set_packet_lazy_mode (1);
   in_cert = 0;
   n_sigs = 0;
   tail = NULL;
@@ -868,6 +907,7 @@ parse_keyblock_image (iobuf_t iobuf, int pk_no, int uid_no,
       init_packet (pkt);
     }
   set_packet_list_mode (save_mode);
+  set_packet_lazy_mode (save_lazy);
 
   if (err == -1 && keyblock)
     err = 0; /* Got the entire keyblock.  */
@@ -1280,6 +1320,7 @@ keydb_rebuild_caches (int noisy)
   int i, rc;
 
   keyblock_cache_clear ();
+  register_deferred_resources ();
 
   for (i=0; i < used_resources; i++)
     {
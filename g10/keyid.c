@@ -237,6 +237,28 @@ do_fingerprint_md( PKT_public_key *pk )
 }
 
 
+/* Compute the fingerprint of PK and store it along with the keyid in
+   PK.  The fingerprint is not computed again until the key material
+   is released by release_public_key_parts.  */
+static void
+compute_fingerprint (PKT_public_key *pk)
+{
+  const byte *dp;
+  size_t len;
+  gcry_md_hd_t md;
+
+  md = do_fingerprint_md (pk);
+  dp = gcry_md_read (md, 0);
+  len = gcry_md_get_algo_dlen (gcry_md_get_algo (md));
+  assert (len <= MAX_FINGERPRINT_LEN);
+  memcpy (pk->fpr, dp, len);
+  pk->fprlen = len;
+  pk->keyid[0] = dp[12] << 24 | dp[13] << 16 | dp[14] << 8 | dp[15] ;
+  pk->keyid[1] = dp[16] << 24 | dp[17] << 16 | dp[18] << 8 | dp[19] ;
+  gcry_md_close (md);
+}
+
+
 /* fixme: Check whether we can replace this function or if not
    describe why we need it.  */
 u32
@@ -420,22 +442,10 @@ keyid_from_pk (PKT_public_key *pk, u32 *keyid)
     }
   else
     {
-      const byte *dp;
-      gcry_md_hd_t md;
-
-      md = do_fingerprint_md(pk);
-      if(md)
-	{
-	  dp = gcry_md_read ( md, 0 );
-	  keyid[0] = dp[12] << 24 | dp[13] << 16 | dp[14] << 8 | dp[15] ;
-	  keyid[1] = dp[16] << 24 | dp[17] << 16 | dp[18] << 8 | dp[19] ;
-	  lowbits = keyid[1];
-	  gcry_md_close (md);
-	  pk->keyid[0] = keyid[0];
-	  pk->keyid[1] = keyid[1];
-	}
-      else
-	pk->keyid[0]=pk->keyid[1]=keyid[0]=keyid[1]=lowbits=0xFFFFFFFF;
+      compute_fingerprint (pk);
+      keyid[0] = pk->keyid[0];
+      keyid[1] = pk->keyid[1];
+      lowbits = keyid[1];
     }
 
   return lowbits;
@@ -676,27 +686,19 @@ colon_expirestr_from_sig (PKT_signature *sig)
  * Return a byte array with the fingerprint for the given PK/SK
  * The length of the array is returned in ret_len. Caller must free
  * the array or provide an array of length MAX_FINGERPRINT_LEN.
+ * The fingerprint is computed only once and then cached in PK.
  */
 byte *
 fingerprint_from_pk (PKT_public_key *pk, byte *array, size_t *ret_len)
 {
-  const byte *dp;
-  size_t len;
-  gcry_md_hd_t md;
-
-  md = do_fingerprint_md(pk);
-  dp = gcry_md_read( md, 0 );
-  len = gcry_md_get_algo_dlen (gcry_md_get_algo (md));
-  assert( len <= MAX_FINGERPRINT_LEN );
+  if (!pk->fprlen)
+    compute_fingerprint (pk);
   if (!array)
-    array = xmalloc ( len );
-  memcpy (array, dp, len );
-  pk->keyid[0] = dp[12] << 24 | dp[13] << 16 | dp[14] << 8 | dp[15] ;
-  pk->keyid[1] = dp[16] << 24 | dp[17] << 16 | dp[18] << 8 | dp[19] ;
-  gcry_md_close( md);
+    array = xmalloc (pk->fprlen);
+  memcpy (array, pk->fpr, pk->fprlen);
 
   if (ret_len)
-    *ret_len = len;
+    *ret_len = pk->fprlen;
   return array;
 }
 
@@ -720,13 +722,20 @@ hexfingerprint (PKT_public_key *pk)
 
 /* Return the so called KEYGRIP which is the SHA-1 hash of the public
    key parameters expressed as an canoncial encoded S-Exp.  ARRAY must
-   be 20 bytes long.  Returns 0 on sucess or an error code.  */
+   be 20 bytes long.  Returns 0 on sucess or an error code.  The
+   keygrip is cached in PK.  */
 gpg_error_t
 keygrip_from_pk (PKT_public_key *pk, unsigned char *array)
 {
   gpg_error_t err;
   gcry_sexp_t s_pkey;
 
+  if (pk->flags.grip_valid)
+    {
+      memcpy (array, pk->grip, 20);
+      return 0;
+    }
+
   if (DBG_PACKET)
     log_debug ("get_keygrip for public key\n");
 
@@ -791,7 +800,8 @@ keygrip_from_pk (PKT_public_key *pk, unsigned char *array)
     {
       if (DBG_PACKET)
         log_printhex ("keygrip=", array, 20);
-      /* FIXME: Save the keygrip in PK.  */
+      memcpy (pk->grip, array, 20);
+      pk->flags.grip_valid = 1;
     }
   gcry_sexp_release (s_pkey);
 
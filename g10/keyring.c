@@ -365,7 +365,7 @@ keyring_get_keyblock (KEYRING_HANDLE hd, KBNODE *ret_kb)
     int in_cert = 0;
     int pk_no = 0;
     int uid_no = 0;
-    int save_mode;
+    int save_mode, save_lazy;
 
     if (ret_kb)
         *ret_kb = NULL;
@@ -391,6 +391,7 @@ keyring_get_keyblock (KEYRING_HANDLE hd, KBNODE *ret_kb)
     hd->found.n_packets = 0;;
     lastnode = NULL;
     save_mode = set_packet_list_mode(0);
+    save_lazy = set_packet_lazy_mode (1);
     while ((rc=parse_packet (a, pkt)) != -1) {
         hd->found.n_packets++;
         if (rc == G10ERR_UNKNOWN_PACKET) {
@@ -469,6 +470,7 @@ keyring_get_keyblock (KEYRING_HANDLE hd, KBNODE *ret_kb)
         init_packet(pkt);
     }
     set_packet_list_mode(save_mode);
+    set_packet_lazy_mode (save_lazy);
 
     if (rc == -1 && keyblock)
 	rc = 0; /* got the entire keyblock */
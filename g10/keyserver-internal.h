@@ -42,13 +42,23 @@ int keyserver_import_keyid (ctrl_t ctrl, u32 *keyid,
 int keyserver_refresh (ctrl_t ctrl, strlist_t users);
 gpg_error_t keyserver_search (ctrl_t ctrl, strlist_t tokens);
 int keyserver_fetch (ctrl_t ctrl, strlist_t urilist);
+
+/* The results of remote key lookups run in advance.  */
+typedef struct akl_prefetch_s *akl_prefetch_t;
+
+akl_prefetch_t keyserver_prefetch_akl (ctrl_t ctrl, const char *name,
+                                       struct akl *akl);
+void keyserver_release_prefetch (akl_prefetch_t pf);
 int keyserver_import_cert (ctrl_t ctrl, const char *name,
-                           unsigned char **fpr,size_t *fpr_len);
+                           unsigned char **fpr,size_t *fpr_len,
+                           akl_prefetch_t prefetch);
 int keyserver_import_pka (ctrl_t ctrl,
-                          const char *name,unsigned char **fpr,size_t *fpr_len);
+                          const char *name,unsigned char **fpr,size_t *fpr_len,
+                          akl_prefetch_t prefetch);
 int keyserver_import_name (ctrl_t ctrl,
                            const char *name,unsigned char **fpr,size_t *fpr_len,
-                           struct keyserver_spec *keyserver);
+                           struct keyserver_spec *keyserver,
+                           akl_prefetch_t prefetch);
 int keyserver_import_ldap (ctrl_t ctrl, const char *name,
                            unsigned char **fpr,size_t *fpr_len);
 
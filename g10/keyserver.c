@@ -1050,6 +1050,42 @@ struct ks_retrieval_screener_arg_s
 };
 
 
+/* The result of one lookup run by keyserver_prefetch_akl.  */
+struct akl_lookup_s
+{
+  int type;               /* AKL_CERT, AKL_PKA or AKL_KEYSERVER.  */
+  int done;               /* The result below is valid.  */
+  gpg_error_t err;        /* The error code of the lookup.  */
+  estream_t key;          /* The key data or NULL.  */
+  unsigned char *fpr;     /* The fingerprint or NULL.  */
+  size_t fpr_len;
+  char *url;              /* The URL of the key or NULL.  */
+};
+
+/* The object returned by keyserver_prefetch_akl.  */
+struct akl_prefetch_s
+{
+  int nlookups;           /* The number of used items in LOOKUPS.  */
+  struct akl_lookup_s lookups[3];
+};
+
+
+/* Return the lookup of TYPE from PREFETCH.  Returns NULL if the
+   dirmngr did not report a result for it.  */
+static struct akl_lookup_s *
+get_prefetched (akl_prefetch_t prefetch, int type)
+{
+  int n;
+
+  if (!prefetch)
+    return NULL;
+  for (n=0; n < prefetch->nlookups; n++)
+    if (prefetch->lookups[n].type == type && prefetch->lookups[n].done)
+      return prefetch->lookups + n;
+  return NULL;
+}
+
+
 /* Check whether a key matches the search description.  The function
    returns 0 if the key shall be imported.  */
 static gpg_error_t
@@ -1161,20 +1197,41 @@ keyserver_import (ctrl_t ctrl, strlist_t users)
 }
 
 
-/* Import all keys that exactly match NAME */
+/* Import all keys that exactly match NAME.  If PREFETCH is not NULL
+   and has the result of a keyserver lookup, that result is used.  */
 int
 keyserver_import_name (ctrl_t ctrl, const char *name,
                        unsigned char **fpr, size_t *fprlen,
-                       struct keyserver_spec *keyserver)
+                       struct keyserver_spec *keyserver,
+                       akl_prefetch_t prefetch)
 {
   KEYDB_SEARCH_DESC desc;
+  struct akl_lookup_s *lookup;
+  struct ks_retrieval_screener_arg_s screenerarg;
+  void *stats_handle;
 
   memset (&desc, 0, sizeof desc);
 
   desc.mode = KEYDB_SEARCH_MODE_EXACT;
   desc.u.name = name;
 
-  return keyserver_get (ctrl, &desc, 1, keyserver, fpr, fprlen);
+  lookup = get_prefetched (prefetch, AKL_KEYSERVER);
+  if (!lookup)
+    return keyserver_get (ctrl, &desc, 1, keyserver, fpr, fprlen);
+
+  /* Import the prefetched data the same way keyserver_get does.  */
+  if (lookup->err)
+    return lookup->err;
+  stats_handle = import_new_stats_handle ();
+  screenerarg.desc = &desc;
+  screenerarg.ndesc = 1;
+  import_keys_es_stream (ctrl, lookup->key, stats_handle, fpr, fprlen,
+                         (opt.keyserver_options.import_options
+                          | IMPORT_NO_SECKEY),
+                         keyserver_retrieval_screener, &screenerarg);
+  import_print_stats (stats_handle);
+  import_release_stats_handle (stats_handle);
+  return 0;
 }
 
 
@@ -1888,14 +1945,17 @@ keyserver_fetch (ctrl_t ctrl, strlist_t urilist)
 }
 
 
-/* Import key in a CERT or pointed to by a CERT */
+/* Import key in a CERT or pointed to by a CERT.  If PREFETCH is not
+   NULL and has the result of a CERT lookup, that result is used.  */
 int
 keyserver_import_cert (ctrl_t ctrl,
-                       const char *name,unsigned char **fpr,size_t *fpr_len)
+                       const char *name,unsigned char **fpr,size_t *fpr_len,
+                       akl_prefetch_t prefetch)
 {
   gpg_error_t err;
   char *domain,*look,*url;
   estream_t key;
+  struct akl_lookup_s *lookup;
 
 
   look=xstrdup(name);
@@ -1904,7 +1964,21 @@ keyserver_import_cert (ctrl_t ctrl,
   if(domain)
     *domain='.';
 
-  err = get_dns_cert (look, &key, fpr, fpr_len, &url);
+  lookup = get_prefetched (prefetch, AKL_CERT);
+  if (lookup)
+    {
+      /* Take over the results.  */
+      err = lookup->err;
+      key = lookup->key;
+      lookup->key = NULL;
+      *fpr = lookup->fpr;
+      lookup->fpr = NULL;
+      *fpr_len = lookup->fpr_len;
+      url = lookup->url;
+      lookup->url = NULL;
+    }
+  else
+    err = gpg_dirmngr_dns_cert (ctrl, look, &key, fpr, fpr_len, &url);
   if (err)
     ;
   else if (key)
@@ -1963,18 +2037,36 @@ keyserver_import_cert (ctrl_t ctrl,
 }
 
 /* Import key pointed to by a PKA record. Return the requested
-   fingerprint in fpr. */
+   fingerprint in fpr.  If PREFETCH is not NULL and has the result of
+   a PKA lookup, that result is used.  */
 int
 keyserver_import_pka (ctrl_t ctrl,
-                      const char *name,unsigned char **fpr,size_t *fpr_len)
+                      const char *name,unsigned char **fpr,size_t *fpr_len,
+                      akl_prefetch_t prefetch)
 {
-  char *uri;
+  char *uri = NULL;
   int rc = G10ERR_NO_PUBKEY;
+  struct akl_lookup_s *lookup;
+  unsigned char *pkafpr;
 
   *fpr = xmalloc (20);
   *fpr_len = 20;
 
-  uri = get_pka_info (name, *fpr);
+  lookup = get_prefetched (prefetch, AKL_PKA);
+  if (lookup)
+    {
+      if (lookup->fpr && lookup->fpr_len == 20)
+        {
+          uri = lookup->url;
+          lookup->url = NULL;
+          memcpy (*fpr, lookup->fpr, 20);
+        }
+    }
+  else if (!gpg_dirmngr_get_pka (ctrl, name, &pkafpr, &uri))
+    {
+      memcpy (*fpr, pkafpr, 20);
+      xfree (pkafpr);
+    }
   if (uri && *uri)
     {
       /* An URI is available.  Lookup the key. */
@@ -1985,8 +2077,8 @@ keyserver_import_pka (ctrl_t ctrl,
 	  rc = keyserver_import_fprint (ctrl, *fpr, 20, spec);
 	  free_keyserver_spec (spec);
 	}
-      xfree (uri);
     }
+  xfree (uri);
 
   if (rc)
     {
@@ -2081,3 +2173,128 @@ keyserver_import_ldap (ctrl_t ctrl,
   return rc;
 #endif
 }
+
+
+
+/* The names of the mechanisms as used by the dirmngr.  */
+static const char *
+akl_mech_name (int type)
+{
+  switch (type)
+    {
+    case AKL_CERT:      return "cert";
+    case AKL_PKA:       return "pka";
+    case AKL_KEYSERVER: return "keyserver";
+    default:            return NULL;
+    }
+}
+
+
+/* The result callback for keyserver_prefetch_akl.  */
+static gpg_error_t
+prefetch_result_cb (void *opaque, const char *mech, gpg_error_t err,
+                    estream_t key, unsigned char *fpr, size_t fpr_len,
+                    char *url)
+{
+  akl_prefetch_t pf = opaque;
+  struct akl_lookup_s *lookup = NULL;
+  int n;
+
+  for (n=0; n < pf->nlookups; n++)
+    if (!strcmp (akl_mech_name (pf->lookups[n].type), mech))
+      lookup = pf->lookups + n;
+  if (!lookup || lookup->done)
+    {
+      es_fclose (key);
+      xfree (fpr);
+      xfree (url);
+      return gpg_error (GPG_ERR_INV_RESPONSE);
+    }
+
+  lookup->done = 1;
+  lookup->err = err;
+  lookup->key = key;
+  lookup->fpr = fpr;
+  lookup->fpr_len = fpr_len;
+  lookup->url = url;
+  return 0;
+}
+
+
+/* Run the remote lookups of the auto-key-locate mechanisms starting
+   at AKL concurrently for the mailbox NAME.  The lookups are run by
+   the dirmngr, which returns the results in the order of the
+   mechanisms up to the first successful one.  The object returned
+   may be passed to the import functions of the respective mechanism;
+   mechanisms without a result are then looked up as usual.  Returns
+   NULL if there is nothing to gain from running the lookups
+   concurrently or on error.  */
+akl_prefetch_t
+keyserver_prefetch_akl (ctrl_t ctrl, const char *name, struct akl *akl)
+{
+  gpg_error_t err;
+  akl_prefetch_t pf;
+  char mechs[30];
+  int n;
+
+  pf = xtrycalloc (1, sizeof *pf);
+  if (!pf)
+    return NULL;
+
+  *mechs = 0;
+  for (; akl; akl = akl->next)
+    {
+      if (akl->type != AKL_CERT && akl->type != AKL_PKA
+          && !(akl->type == AKL_KEYSERVER && opt.keyserver))
+        continue;
+      for (n=0; n < pf->nlookups; n++)
+        if (pf->lookups[n].type == akl->type)
+          break;
+      if (n == pf->nlookups && n < DIM (pf->lookups))
+        {
+          pf->lookups[pf->nlookups++].type = akl->type;
+          if (*mechs)
+            strcat (mechs, ",");
+          strcat (mechs, akl_mech_name (akl->type));
+        }
+    }
+  if (pf->nlookups < 2)
+    {
+      xfree (pf);
+      return NULL;
+    }
+
+  if (opt.verbose)
+    log_info ("running %d key lookups for '%s' concurrently\n",
+              pf->nlookups, name);
+  err = gpg_dirmngr_akl_lookup (ctrl, mechs, name, prefetch_result_cb, pf);
+  if (err)
+    {
+      if (opt.verbose)
+        log_info ("concurrent key lookup failed: %s\n", gpg_strerror (err));
+      keyserver_release_prefetch (pf);
+      return NULL;
+    }
+
+  return pf;
+}
+
+
+/* Release the object returned by keyserver_prefetch_akl.  */
+void
+keyserver_release_prefetch (akl_prefetch_t pf)
+{
+  int n;
+
+  if (!pf)
+    return;
+
+  for (n=0; n < pf->nlookups; n++)
+    {
+      es_fclose (pf->lookups[n].key);
+      xfree (pf->lookups[n].fpr);
+      xfree (pf->lookups[n].url);
+    }
+  xfree (pf);
+}
+
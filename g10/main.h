@@ -181,6 +181,7 @@ unsigned int ecdsa_qbits_from_Q (unsigned int qbits);
 
 /*-- status.c --*/
 void set_status_fd ( int fd );
+void set_status_stream (estream_t fp);
 int  is_status_enabled ( void );
 void write_status ( int no );
 void write_status_error (const char *where, gpg_error_t err);
@@ -229,8 +230,9 @@ int encrypt_filter (void *opaque, int control,
 /*-- sign.c --*/
 int complete_sig (PKT_signature *sig, PKT_public_key *pksk, gcry_md_hd_t md,
                   const char *cache_nonce);
-int sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
-	       int do_encrypt, strlist_t remusr, const char *outfile );
+int sign_file (ctrl_t ctrl, int filefd, strlist_t filenames, int detached,
+               strlist_t locusr, int do_encrypt, strlist_t remusr,
+               const char *outfile, int outputfd);
 int clearsign_file( const char *fname, strlist_t locusr, const char *outfile );
 int sign_symencrypt_file (const char *fname, strlist_t locusr);
 
@@ -235,6 +235,7 @@ struct
   {
     enum {
       AKL_NODEFAULT,
+      AKL_PARALLEL,
       AKL_LOCAL,
       AKL_CERT,
       AKL_PKA,
@@ -248,6 +249,13 @@ struct
 
   int passphrase_repeat;
   int pinentry_mode;
+
+  /* Number of threads used for CPU bound tasks; defaults to 1; 0
+     uses all CPUs.  */
+  int worker_threads;
+
+  /* Run the filter stages of encryption and signing in threads.  */
+  int pipeline;
 } opt;
 
 /* CTRL is used to keep some global variables we currently can't
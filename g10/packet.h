@@ -112,9 +112,12 @@ typedef struct {
 } PKT_onepass_sig;
 
 
+struct subpkt_index_s;
+
 typedef struct {
     size_t size;  /* allocated */
     size_t len;   /* used */
+    struct subpkt_index_s *index; /* see index_sig_subpkts */
     byte data[1];
 } subpktarea_t;
 
@@ -174,6 +177,9 @@ typedef struct
   subpktarea_t *unhashed;    /* Ditto for unhashed data. */
   byte digest_start[2];      /* First 2 bytes of the digest. */
   gcry_mpi_t  data[PUBKEY_MAX_NSIG];
+  byte *lazy_data;           /* The still unparsed DATA or NULL; see
+                                parse_sig_data.  */
+  size_t lazy_datalen;       /* Length of LAZY_DATA.  */
 } PKT_signature;
 
 #define ATTRIB_IMAGE 1
@@ -276,6 +282,9 @@ typedef struct
   u32     has_expired;    /* set to the expiration date if expired */
   u32     main_keyid[2];  /* keyid of the primary key */
   u32     keyid[2];	    /* calculated by keyid_from_pk() */
+  byte    fprlen;         /* Length of FPR or 0 if not yet computed.  */
+  byte    fpr[MAX_FINGERPRINT_LEN]; /* calculated by fingerprint_from_pk() */
+  byte    grip[20];       /* calculated by keygrip_from_pk() */
   prefitem_t *prefs;      /* list of preferences (may be NULL) */
   struct
   {
@@ -293,6 +302,7 @@ typedef struct
     unsigned int dont_cache:1;    /* Do not cache this key.  */
     unsigned int backsig:2;       /* 0=none, 1=bad, 2=good.  */
     unsigned int serialno_valid:1;/* SERIALNO below is valid.  */
+    unsigned int grip_valid:1;    /* GRIP above is valid.  */
   } flags;
   PKT_user_id *user_id;   /* If != NULL: found by that uid. */
   struct revocation_key *revkey;
@@ -418,6 +428,7 @@ int list_packets( iobuf_t a );
 
 /*-- parse-packet.c --*/
 int set_packet_list_mode( int mode );
+int set_packet_lazy_mode (int mode);
 
 #if DEBUG_PARSE_PACKET
 int dbg_search_packet( iobuf_t inp, PACKET *pkt, off_t *retpos, int with_uid,
@@ -460,6 +471,8 @@ const byte *parse_sig_subpkt2 ( PKT_signature *sig,
                                 sigsubpkttype_t reqtype,
                                 size_t *ret_n );
 int parse_one_sig_subpkt( const byte *buffer, size_t n, int type );
+void index_sig_subpkts (subpktarea_t *area);
+int parse_sig_data (PKT_signature *sig);
 void parse_revkeys(PKT_signature *sig);
 int parse_attribute_subpkts(PKT_user_id *uid);
 void make_attribute_uidname(PKT_user_id *uid, size_t max_namelen);
@@ -484,6 +497,8 @@ struct notation *sig_to_notation(PKT_signature *sig);
 void free_notation(struct notation *notation);
 
 /*-- free-packet.c --*/
+PKT_signature *alloc_signature (void);
+PKT_public_key *alloc_public_key (void);
 void free_symkey_enc( PKT_symkey_enc *enc );
 void free_pubkey_enc( PKT_pubkey_enc *enc );
 void free_seckey_enc( PKT_signature *enc );
@@ -37,6 +37,7 @@
 
 static int mpi_print_mode;
 static int list_mode;
+static int lazy_mode;
 static estream_t listfp;
 
 static int parse (IOBUF inp, PACKET * pkt, int onlykeypkts,
@@ -190,6 +191,20 @@ set_packet_list_mode (int mode)
 }
 
 
+/* Enable or disable the lazy parsing of signatures and return the
+   previous mode.  In lazy mode the MPIs of a signature are only
+   checked for a valid encoding and kept in their external form; they
+   are converted by parse_sig_data on first use.  This is used for
+   keyblocks where most signatures are never checked.  */
+int
+set_packet_lazy_mode (int mode)
+{
+  int old = lazy_mode;
+  lazy_mode = mode;
+  return old;
+}
+
+
 static void
 unknown_pubkey_warning (int algo)
 {
@@ -598,7 +613,7 @@ parse (IOBUF inp, PACKET * pkt, int onlykeypkts, off_t * retpos,
     case PKT_PUBLIC_SUBKEY:
     case PKT_SECRET_KEY:
     case PKT_SECRET_SUBKEY:
-      pkt->pkt.public_key = xmalloc_clear (sizeof *pkt->pkt.public_key);
+      pkt->pkt.public_key = alloc_public_key ();
       rc = parse_key (inp, pkttype, pktlen, hdr, hdrlen, pkt);
       break;
     case PKT_SYMKEY_ENC:
@@ -608,7 +623,7 @@ parse (IOBUF inp, PACKET * pkt, int onlykeypkts, off_t * retpos,
       rc = parse_pubkeyenc (inp, pkttype, pktlen, pkt);
       break;
     case PKT_SIGNATURE:
-      pkt->pkt.signature = xmalloc_clear (sizeof *pkt->pkt.signature);
+      pkt->pkt.signature = alloc_signature ();
       rc = parse_signature (inp, pkttype, pktlen, pkt->pkt.signature);
       break;
     case PKT_ONEPASS_SIG:
@@ -1410,31 +1425,36 @@ can_handle_critical (const byte * buffer, size_t n, int type)
 }
 
 
-const byte *
-enum_sig_subpkt (const subpktarea_t * pktbuf, sigsubpkttype_t reqtype,
-		 size_t * ret_n, int *start, int *critical)
+/* An item of the subpacket index.  */
+struct subpkt_index_item_s
 {
-  const byte *buffer;
-  int buflen;
-  int type;
-  int critical_dummy;
-  int offset;
-  size_t n;
-  int seq = 0;
-  int reqseq = start ? *start : 0;
+  size_t off;   /* Offset of the type octet in the area.  */
+  size_t len;   /* Length of the subpacket including the type octet.  */
+  byte type;    /* The type octet including the critical bit.  */
+};
+
+/* The index of a subpacket area.  It is built when the area is
+   created or changed so that lookups do not need to decode the
+   length headers of all subpackets again.  */
+struct subpkt_index_s
+{
+  u32 present[4];           /* Bit vector with the types in the area.  */
+  unsigned int truncated:1; /* The area ends in a broken subpacket.  */
+  unsigned int count;       /* Number of items.  */
+  struct subpkt_index_item_s item[1];
+};
 
-  if (!critical)
-    critical = &critical_dummy;
 
-  if (!pktbuf || reqseq == -1)
-    {
-      static char dummy[] = "x";
-      /* Return a value different from NULL to indicate that
-       * there is no critical bit we do not understand.  */
-      return reqtype ==	SIGSUBPKT_TEST_CRITICAL ? dummy : NULL;
-    }
-  buffer = pktbuf->data;
-  buflen = pktbuf->len;
+/* Walk over the subpackets of AREA and store them at INDEX if that is
+   not NULL.  Returns the number of subpackets.  */
+static unsigned int
+walk_sig_subpkts (const subpktarea_t *area, struct subpkt_index_s *index)
+{
+  const byte *buffer = area->data;
+  size_t buflen = area->len;
+  size_t n;
+  unsigned int count = 0;
+
   while (buflen)
     {
       n = *buffer++;
@@ -1458,21 +1478,89 @@ enum_sig_subpkt (const subpktarea_t * pktbuf, sigsubpkttype_t reqtype,
 	}
       if (buflen < n)
 	goto too_short;
-      type = *buffer;
-      if (type & 0x80)
+      if (!buflen) /* An empty subpacket at the end; ignore it.  */
+	break;
+      if (index)
 	{
-	  type &= 0x7f;
-	  *critical = 1;
+	  index->item[count].off = buffer - area->data;
+	  index->item[count].len = n;
+	  index->item[count].type = *buffer;
+	  index->present[(*buffer & 0x7f) / 32] |= 1u << (*buffer & 31);
 	}
-      else
-	*critical = 0;
-      if (!(++seq > reqseq))
-	;
-      else if (reqtype == SIGSUBPKT_TEST_CRITICAL)
+      count++;
+      buffer += n;
+      buflen -= n;
+    }
+  return count;
+
+ too_short:
+  if (index)
+    index->truncated = 1;
+  return count;
+}
+
+
+/* Build the index of the subpackets in AREA.  This needs to be called
+   whenever the data of AREA has been changed.  */
+void
+index_sig_subpkts (subpktarea_t *area)
+{
+  unsigned int count;
+
+  xfree (area->index);
+  count = walk_sig_subpkts (area, NULL);
+  area->index = xcalloc (1, (sizeof *area->index
+                             + (count? count - 1 : 0)
+                             * sizeof *area->index->item));
+  area->index->count = walk_sig_subpkts (area, area->index);
+}
+
+
+const byte *
+enum_sig_subpkt (const subpktarea_t * pktbuf, sigsubpkttype_t reqtype,
+		 size_t * ret_n, int *start, int *critical)
+{
+  const struct subpkt_index_s *index;
+  const struct subpkt_index_item_s *item;
+  const byte *buffer;
+  int type;
+  int critical_dummy;
+  int offset;
+  size_t n;
+  unsigned int seq;
+  int reqseq = start ? *start : 0;
+
+  if (!critical)
+    critical = &critical_dummy;
+
+  if (!pktbuf || reqseq == -1)
+    {
+      static char dummy[] = "x";
+      /* Return a value different from NULL to indicate that
+       * there is no critical bit we do not understand.  */
+      return reqtype ==	SIGSUBPKT_TEST_CRITICAL ? dummy : NULL;
+    }
+  index = pktbuf->index;
+  if (!index) /* Not read completely.  */
+    goto too_short;
+
+  /* Most lookups are for types not in the area at all.  */
+  if (reqtype >= 0 && reqtype < 128
+      && !(index->present[reqtype / 32] & (1u << (reqtype % 32))))
+    goto not_found;
+
+  for (seq = reqseq; seq < index->count; seq++)
+    {
+      item = index->item + seq;
+      buffer = pktbuf->data + item->off;
+      n = item->len;
+      type = item->type & 0x7f;
+      *critical = !!(item->type & 0x80);
+      if (reqtype == SIGSUBPKT_TEST_CRITICAL)
 	{
 	  if (*critical)
 	    {
-	      if (n - 1 > buflen + 1)
+	      if (!n)
 		goto too_short;
 	      if (!can_handle_critical (buffer + 1, n - 1, type))
 		{
@@ -1480,20 +1568,20 @@ enum_sig_subpkt (const subpktarea_t * pktbuf, sigsubpkttype_t reqtype,
 		    log_info (_("subpacket of type %d has "
 				"critical bit set\n"), type);
 		  if (start)
-		    *start = seq;
+		    *start = seq + 1;
 		  return NULL;	/* This is an error.  */
 		}
 	    }
 	}
       else if (reqtype < 0) /* List packets.  */
 	dump_sig_subpkt (reqtype == SIGSUBPKT_LIST_HASHED,
-			 type, *critical, buffer, buflen, n);
+			 type, *critical, buffer, pktbuf->len - item->off, n);
       else if (type == reqtype) /* Found.  */
 	{
+	  if (!n)
+	    goto too_short;
 	  buffer++;
 	  n--;
-	  if (n > buflen)
-	    goto too_short;
 	  if (ret_n)
 	    *ret_n = n;
 	  offset = parse_one_sig_subpkt (buffer, n, type);
@@ -1508,14 +1596,17 @@ enum_sig_subpkt (const subpktarea_t * pktbuf, sigsubpkttype_t reqtype,
 	      break;
 	    }
 	  if (start)
-	    *start = seq;
+	    *start = seq + 1;
 	  return buffer + offset;
 	}
-      buffer += n;
-      buflen -= n;
     }
+
+ not_found:
+  if (index->truncated)
+    goto too_short;
   if (reqtype == SIGSUBPKT_TEST_CRITICAL)
-    return buffer;  /* Used as True to indicate that there is no. */
+    /* Used as True to indicate that there is no. */
+    return pktbuf->data + pktbuf->len;
 
   /* Critical bit we don't understand. */
   if (start)
@@ -1651,6 +1742,7 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
 	  sig->hashed = xmalloc (sizeof (*sig->hashed) + n - 1);
 	  sig->hashed->size = n;
 	  sig->hashed->len = n;
+	  sig->hashed->index = NULL;
 	  if (iobuf_read (inp, sig->hashed->data, n) != n)
 	    {
 	      log_error ("premature eof while reading "
@@ -1660,6 +1752,7 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
 	      rc = -1;
 	      goto leave;
 	    }
+	  index_sig_subpkts (sig->hashed);
 	  pktlen -= n;
 	}
       n = read_16 (inp);
@@ -1677,6 +1770,7 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
 	  sig->unhashed = xmalloc (sizeof (*sig->unhashed) + n - 1);
 	  sig->unhashed->size = n;
 	  sig->unhashed->len = n;
+	  sig->unhashed->index = NULL;
 	  if (iobuf_read (inp, sig->unhashed->data, n) != n)
 	    {
 	      log_error ("premature eof while reading "
@@ -1686,6 +1780,7 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
 	      rc = -1;
 	      goto leave;
 	    }
+	  index_sig_subpkts (sig->unhashed);
 	  pktlen -= n;
 	}
     }
@@ -1824,6 +1919,48 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
 	  pktlen = 0;
 	}
     }
+  else if (lazy_mode && !list_mode)
+    {
+      size_t used = 0;
+      unsigned int nbits;
+
+      /* The MPIs can't be longer than this; anything after them is
+	 skipped anyway.  */
+      n = pktlen;
+      if (n > ndata * (2 + MAX_EXTERN_MPI_BITS / 8))
+	n = ndata * (2 + MAX_EXTERN_MPI_BITS / 8);
+      if (n)
+	{
+	  sig->lazy_data = xmalloc (n);
+	  if (iobuf_read (inp, sig->lazy_data, n) != n)
+	    {
+	      log_error ("premature eof while reading signature data\n");
+	      rc = -1;
+	      goto leave;
+	    }
+	  pktlen -= n;
+	}
+      for (i = 0; i < ndata; i++)
+	{
+	  if (n - used < 2)
+	    break;
+	  nbits = (sig->lazy_data[used] << 8) | sig->lazy_data[used + 1];
+	  if (nbits > MAX_EXTERN_MPI_BITS)
+	    {
+	      log_error ("mpi too large (%u bits)\n", nbits);
+	      break;
+	    }
+	  if (n - used - 2 < (nbits + 7) / 8)
+	    break;
+	  used += 2 + (nbits + 7) / 8;
+	}
+      if (i < ndata)
+	{
+	  log_error ("signature packet: invalid data\n");
+	  rc = G10ERR_INVALID_PACKET;
+	}
+      sig->lazy_datalen = used;
+    }
   else
     {
       for (i = 0; i < ndata; i++)
@@ -1848,6 +1985,49 @@ parse_signature (IOBUF inp, int pkttype, unsigned long pktlen,
 }
 
 
+/* Convert the MPIs of SIG if they have been kept in their external
+   form by the lazy mode.  This needs to be called before the DATA
+   field of a signature read from a keyblock is used.  */
+int
+parse_sig_data (PKT_signature *sig)
+{
+  const byte *p;
+  size_t n, nbytes;
+  int i, ndata;
+
+  if (!sig->lazy_data)
+    return 0;
+
+  ndata = pubkey_get_nsig (sig->pubkey_algo);
+  p = sig->lazy_data;
+  n = sig->lazy_datalen;
+  for (i = 0; i < ndata; i++)
+    {
+      if (n < 2 || n - 2 < (((p[0] << 8) | p[1]) + 7) / 8)
+	break;
+      nbytes = 2 + (((p[0] << 8) | p[1]) + 7) / 8;
+      if (gcry_mpi_scan (&sig->data[i], GCRYMPI_FMT_PGP, p, nbytes, NULL))
+	break;
+      p += nbytes;
+      n -= nbytes;
+    }
+  if (i < ndata)
+    {
+      while (i--)
+	{
+	  mpi_release (sig->data[i]);
+	  sig->data[i] = NULL;
+	}
+      return G10ERR_INVALID_PACKET;
+    }
+
+  xfree (sig->lazy_data);
+  sig->lazy_data = NULL;
+  sig->lazy_datalen = 0;
+  return 0;
+}
+
+
 static int
 parse_onepass_sig (IOBUF inp, int pkttype, unsigned long pktlen,
 		   PKT_onepass_sig * ops)
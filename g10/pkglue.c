@@ -181,20 +181,20 @@ pk_verify (pubkey_algo_t pkalgo, gcry_mpi_t hash,
 
 
 
-/****************
- * Emulate our old PK interface here - sometime in the future we might
- * change the internal design to directly fit to libgcrypt.
- * PK is only required to compute the fingerprint for ECDH.
- */
-int
-pk_encrypt (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
-            PKT_public_key *pk, gcry_mpi_t *pkey)
+/* Build the S-expressions for encrypting DATA with the public key
+   PKEY of algorithm ALGO.  On success the key is stored at R_PKEY and
+   the data at R_DATA; they are to be passed to gcry_pk_encrypt.  */
+gpg_error_t
+pk_encrypt_prepare (pubkey_algo_t algo, gcry_mpi_t data, gcry_mpi_t *pkey,
+                    gcry_sexp_t *r_pkey, gcry_sexp_t *r_data)
 {
-  gcry_sexp_t s_ciph = NULL;
   gcry_sexp_t s_data = NULL;
   gcry_sexp_t s_pkey = NULL;
   int rc;
 
+  *r_pkey = NULL;
+  *r_data = NULL;
+
   /* Make a sexp from pkey.  */
   if (algo == PUBKEY_ALGO_ELGAMAL || algo == PUBKEY_ALGO_ELGAMAL_E)
     {
@@ -243,16 +243,28 @@ pk_encrypt (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
   else
     rc = gpg_error (GPG_ERR_PUBKEY_ALGO);
 
-  /* Pass it to libgcrypt. */
-  if (!rc)
-    rc = gcry_pk_encrypt (&s_ciph, s_data, s_pkey);
+  if (rc)
+    {
+      gcry_sexp_release (s_data);
+      gcry_sexp_release (s_pkey);
+      return rc;
+    }
+  *r_pkey = s_pkey;
+  *r_data = s_data;
+  return 0;
+}
 
-  gcry_sexp_release (s_data);
-  gcry_sexp_release (s_pkey);
 
-  if (rc)
-    ;
-  else if (algo == PUBKEY_ALGO_ECDH)
+/* Store the result S_CIPH of gcry_pk_encrypt for the S-expressions
+   built by pk_encrypt_prepare in the array RESARR.  The other
+   arguments are the same as for pk_encrypt.  */
+gpg_error_t
+pk_encrypt_finish (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
+                   PKT_public_key *pk, gcry_mpi_t *pkey, gcry_sexp_t s_ciph)
+{
+  int rc = 0;
+
+  if (algo == PUBKEY_ALGO_ECDH)
     {
       gcry_mpi_t shared, public, result;
       byte fp[MAX_FINGERPRINT_LEN];
@@ -261,8 +273,6 @@ pk_encrypt (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
       /* Get the shared point and the ephemeral public key.  */
       shared = get_mpi_from_sexp (s_ciph, "s", GCRYMPI_FMT_USG);
       public = get_mpi_from_sexp (s_ciph, "e", GCRYMPI_FMT_USG);
-      gcry_sexp_release (s_ciph);
-      s_ciph = NULL;
       if (DBG_CIPHER)
         {
           log_debug ("ECDH ephemeral key:");
@@ -297,6 +307,35 @@ pk_encrypt (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
         resarr[1] = get_mpi_from_sexp (s_ciph, "b", GCRYMPI_FMT_USG);
     }
 
+  return rc;
+}
+
+
+/****************
+ * Emulate our old PK interface here - sometime in the future we might
+ * change the internal design to directly fit to libgcrypt.
+ * PK is only required to compute the fingerprint for ECDH.
+ */
+int
+pk_encrypt (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
+            PKT_public_key *pk, gcry_mpi_t *pkey)
+{
+  gcry_sexp_t s_ciph = NULL;
+  gcry_sexp_t s_data, s_pkey;
+  int rc;
+
+  rc = pk_encrypt_prepare (algo, data, pkey, &s_pkey, &s_data);
+  if (rc)
+    return rc;
+
+  /* Pass it to libgcrypt. */
+  rc = gcry_pk_encrypt (&s_ciph, s_data, s_pkey);
+  gcry_sexp_release (s_data);
+  gcry_sexp_release (s_pkey);
+
+  if (!rc)
+    rc = pk_encrypt_finish (algo, resarr, data, pk, pkey, s_ciph);
+
   gcry_sexp_release (s_ciph);
   return rc;
 }
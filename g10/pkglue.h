@@ -29,6 +29,12 @@ int pk_verify (pubkey_algo_t algo, gcry_mpi_t hash, gcry_mpi_t *data,
                gcry_mpi_t *pkey);
 int pk_encrypt (pubkey_algo_t algo, gcry_mpi_t *resarr, gcry_mpi_t data,
 		PKT_public_key *pk, gcry_mpi_t *pkey);
+gpg_error_t pk_encrypt_prepare (pubkey_algo_t algo, gcry_mpi_t data,
+                                gcry_mpi_t *pkey,
+                                gcry_sexp_t *r_pkey, gcry_sexp_t *r_data);
+gpg_error_t pk_encrypt_finish (pubkey_algo_t algo, gcry_mpi_t *resarr,
+                               gcry_mpi_t data, PKT_public_key *pk,
+                               gcry_mpi_t *pkey, gcry_sexp_t s_ciph);
 int pk_check_secret_key (pubkey_algo_t algo, gcry_mpi_t *skey);
 
 
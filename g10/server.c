@@ -34,6 +34,8 @@
 #include "options.h"
 #include "../common/sysutils.h"
 #include "status.h"
+#include "main.h"
+#include "keydb.h"
 
 
 #define set_error(e,t) assuan_set_error (ctx, gpg_error (e), (t))
@@ -50,9 +52,18 @@ struct server_local_s
   /* List of prepared recipients.  */
   pk_list_t recplist;
 
+  /* List of user IDs given with the SIGNER command.  */
+  strlist_t signers;
+
   /* Set if pinentry notifications should be passed back to the
      client. */
   int allow_pinentry_notify;
+
+  /* The stream used to send the status lines to the client and the
+     buffer to assemble a line.  */
+  estream_t status_fp;
+  char status_line[ASSUAN_LINELENGTH];
+  size_t status_len;
 };
 
 
@@ -69,6 +80,59 @@ close_message_fd (ctrl_t ctrl)
 }
 
 
+/* Send the status line in the status buffer as an Assuan status
+   line.  The keyword prefix used for the status fd is removed.  */
+static void
+flush_status_line (ctrl_t ctrl)
+{
+  struct server_local_s *sl = ctrl->server_local;
+  char *keyword, *args;
+
+  sl->status_line[sl->status_len] = 0;
+  sl->status_len = 0;
+  keyword = sl->status_line;
+  if (!strncmp (keyword, "[GNUPG:] ", 9))
+    keyword += 9;
+  args = strchr (keyword, ' ');
+  if (args)
+    *args++ = 0;
+  if (*keyword)
+    assuan_write_status (sl->assuan_ctx, keyword, args? args : "");
+}
+
+
+/* A write handler used by es_fopencookie to pass the status lines
+   written by the status module to the client.  */
+static ssize_t
+status_cookie_write (void *cookie, const void *buffer_arg, size_t size)
+{
+  ctrl_t ctrl = cookie;
+  struct server_local_s *sl = ctrl->server_local;
+  const char *buffer = buffer_arg;
+  size_t n;
+
+  if (!buffer || !size)
+    return 0; /* Flush request.  */
+
+  for (n=0; n < size; n++)
+    {
+      if (buffer[n] == '\n')
+        flush_status_line (ctrl);
+      else if (sl->status_len < sizeof sl->status_line - 1)
+        sl->status_line[sl->status_len++] = buffer[n];
+    }
+  return size;
+}
+
+static es_cookie_io_functions_t status_cookie_functions =
+  {
+    NULL,
+    status_cookie_write,
+    NULL,
+    NULL
+  };
+
+
 /* Skip over options.  Blanks after the options are also removed.  */
 static char *
 skip_options (const char *line)
@@ -159,6 +223,8 @@ reset_notify (assuan_context_t ctx, char *line)
 
   release_pk_list (ctrl->server_local->recplist);
   ctrl->server_local->recplist = NULL;
+  free_strlist (ctrl->server_local->signers);
+  ctrl->server_local->signers = NULL;
 
   close_message_fd (ctrl);
   assuan_close_input_fd (ctx);
@@ -265,9 +331,27 @@ cmd_recipient (assuan_context_t ctx, char *line)
 static gpg_error_t
 cmd_signer (assuan_context_t ctx, char *line)
 {
-  (void)ctx;
-  (void)line;
-  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  strlist_t sl = NULL;
+  SK_LIST sk_list = NULL;
+
+  line = skip_options (line);
+  if (!*line)
+    return set_error (GPG_ERR_ASS_PARAMETER, "no user ID given");
+
+  /* Check that the key is usable now so that the client learns about
+     problems before the actual signing.  */
+  add_to_strlist (&sl, line);
+  err = build_sk_list (sl, &sk_list, PUBKEY_USAGE_SIG);
+  release_sk_list (sk_list);
+  free_strlist (sl);
+  if (!err)
+    add_to_strlist (&ctrl->server_local->signers, line);
+
+  if (err)
+    log_error ("command '%s' failed: %s\n", "SIGNER", gpg_strerror (err));
+  return err;
 }
 
 
@@ -409,34 +493,26 @@ cmd_verify (assuan_context_t ctx, char *line)
   gnupg_fd_t out_fd = assuan_get_output_fd (ctx);
   estream_t out_fp = NULL;
 
-  /* FIXME: Revamp this code it is nearly to 3 years old and was only
-     intended as a quick test.  */
-
   (void)line;
 
   if (fd == GNUPG_INVALID_FD)
-    return gpg_error (GPG_ERR_ASS_NO_INPUT);
+    return set_error (GPG_ERR_ASS_NO_INPUT, NULL);
 
   if (out_fd != GNUPG_INVALID_FD)
     {
       es_syshd_t syshd;
 
-#ifdef HAVE_W32_SYSTEM
-      syshd.type = ES_SYSHD_HANDLE;
-      syshd.u.handle = out_fd;
-#else
       syshd.type = ES_SYSHD_FD;
       syshd.u.fd = out_fd;
-#endif
       out_fp = es_sysopen_nc (&syshd, "w");
       if (!out_fp)
         return set_error (gpg_err_code_from_syserror (), "fdopen() failed");
     }
 
-  log_debug ("WARNING: The server mode is WORK "
-             "IN PROGRESS and not ready for use\n");
-
+  glo_ctrl.lasterr = 0;
   rc = gpg_verify (ctrl, fd, ctrl->server_local->message_fd, out_fp);
+  if (!rc)
+    rc = glo_ctrl.lasterr;
 
   es_fclose (out_fp);
   close_message_fd (ctrl);
@@ -450,7 +526,7 @@ cmd_verify (assuan_context_t ctx, char *line)
 }
 
 
-
+
 /*  SIGN [--detached]
 
    Sign the data set with the INPUT command and write it to the sink
@@ -459,9 +535,32 @@ cmd_verify (assuan_context_t ctx, char *line)
 static gpg_error_t
 cmd_sign (assuan_context_t ctx, char *line)
 {
-  (void)ctx;
-  (void)line;
-  return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  ctrl_t ctrl = assuan_get_pointer (ctx);
+  gpg_error_t err;
+  int inp_fd, out_fd;
+  int detached;
+
+  detached = has_option (line, "--detached");
+
+  inp_fd = translate_sys2libc_fd (assuan_get_input_fd (ctx), 0);
+  if (inp_fd == -1)
+    return set_error (GPG_ERR_ASS_NO_INPUT, NULL);
+  out_fd = translate_sys2libc_fd (assuan_get_output_fd (ctx), 1);
+  if (out_fd == -1)
+    return set_error (GPG_ERR_ASS_NO_OUTPUT, NULL);
+
+  /* Without a SIGNER command the default key is used.  */
+  err = sign_file (ctrl, inp_fd, NULL, detached,
+                   ctrl->server_local->signers, 0, NULL, NULL, out_fd);
+
+  /* Close and reset the fds. */
+  close_message_fd (ctrl);
+  assuan_close_input_fd (ctx);
+  assuan_close_output_fd (ctx);
+
+  if (err)
+    log_error ("command '%s' failed: %s\n", "SIGN", gpg_strerror (err));
+  return err;
 }
 
 
@@ -757,6 +856,20 @@ gpg_server (ctrl_t ctrl)
   ctrl->server_local->assuan_ctx = ctx;
   ctrl->server_local->message_fd = GNUPG_INVALID_FD;
 
+  /* Unless a status fd has been given, the status lines are sent to
+     the client.  */
+  if (!is_status_enabled ())
+    {
+      ctrl->server_local->status_fp = es_fopencookie (ctrl, "w",
+                                                      status_cookie_functions);
+      if (!ctrl->server_local->status_fp)
+        {
+          rc = gpg_error_from_syserror ();
+          goto leave;
+        }
+      set_status_stream (ctrl->server_local->status_fp);
+    }
+
   for (;;)
     {
       rc = assuan_accept (ctx);
@@ -782,7 +895,13 @@ gpg_server (ctrl_t ctrl)
  leave:
   if (ctrl->server_local)
     {
+      if (ctrl->server_local->status_fp)
+        {
+          set_status_stream (NULL);
+          es_fclose (ctrl->server_local->status_fp);
+        }
       release_pk_list (ctrl->server_local->recplist);
+      free_strlist (ctrl->server_local->signers);
 
       xfree (ctrl->server_local);
       ctrl->server_local = NULL;
@@ -41,6 +41,7 @@
 #include "pkglue.h"
 #include "sysutils.h"
 #include "call-agent.h"
+#include "../common/parallel.h"
 
 
 #ifdef HAVE_DOSISH_SYSTEM
@@ -742,10 +743,14 @@ write_signature_packets (SK_LIST sk_list, IOBUF out, gcry_md_hd_t hash,
  * If OUTFILE is not NULL; this file is used for output and the function
  * does not ask for overwrite permission; output is then always
  * uncompressed, non-armored and in binary mode.
+ * If FILEFD is not -1 the data is read from this file descriptor
+ * instead of FILENAMES; if OUTPUTFD is not -1 and OUTFILE is NULL the
+ * output is written to that file descriptor.  Both are not closed.
  */
 int
-sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
-	   int encryptflag, strlist_t remusr, const char *outfile )
+sign_file (ctrl_t ctrl, int filefd, strlist_t filenames, int detached,
+           strlist_t locusr, int encryptflag, strlist_t remusr,
+           const char *outfile, int outputfd)
 {
     const char *fname;
     armor_filter_context_t *afx;
@@ -770,7 +775,7 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
     memset( &efx, 0, sizeof efx);
     init_packet( &pkt );
 
-    if( filenames ) {
+    if( filenames && filefd == -1 ) {
 	fname = filenames->d;
 	multifile = !!filenames->next;
     }
@@ -802,7 +807,17 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
     if( multifile )  /* have list of filenames */
 	inp = NULL; /* we do it later */
     else {
-      inp = iobuf_open(fname);
+#ifdef HAVE_W32_SYSTEM
+      if (filefd == -1)
+        inp = iobuf_open (fname);
+      else
+        {
+          inp = NULL;
+          gpg_err_set_errno (ENOSYS);
+        }
+#else
+      inp = iobuf_open_fd_or_name (filefd, fname, "rb");
+#endif
       if (inp && is_secured_file (iobuf_get_fd (inp)))
         {
           iobuf_close (inp);
@@ -811,8 +826,14 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
         }
       if( !inp )
         {
+          char xname[64];
+
           rc = gpg_error_from_syserror ();
-          log_error (_("can't open '%s': %s\n"), fname? fname: "[stdin]",
+          if (filefd != -1)
+            snprintf (xname, sizeof xname, "[fd %d]", filefd);
+          else
+            strcpy (xname, "[stdin]");
+          log_error (_("can't open '%s': %s\n"), fname? fname: xname,
                      strerror(errno) );
           goto leave;
 	}
@@ -836,7 +857,7 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
 	else if( opt.verbose )
 	    log_info(_("writing to '%s'\n"), outfile );
     }
-    else if( (rc = open_outfile (-1, fname,
+    else if( (rc = open_outfile (outputfd, fname,
                                  opt.armor? 1: detached? 2:0, 0, &out)))
 	goto leave;
 
@@ -939,18 +960,28 @@ sign_file (ctrl_t ctrl, strlist_t filenames, int detached, strlist_t locusr,
       gcry_md_enable (mfx.md, hash_for (sk_rover->pk));
 
     if( !multifile )
+      {
 	iobuf_push_filter( inp, md_filter, &mfx );
+        /* The file length is determined before anything is read and
+           thus we can already push the pipe.  */
+        if (opt.pipeline)
+          gnupg_parallel_push_pipe (inp);
+      }
 
     if( detached && !encryptflag)
 	afx->what = 2;
 
     if( opt.armor && !outfile  )
 	push_armor_filter (afx, out);
+    if (opt.pipeline)
+      gnupg_parallel_push_pipe (out);
 
     if( encryptflag ) {
 	efx.pk_list = pk_list;
 	/* fixme: set efx.cfx.datalen if known */
 	iobuf_push_filter( out, encrypt_filter, &efx );
+        if (opt.pipeline)
+          gnupg_parallel_push_pipe (out);
     }
 
     if (opt.compress_algo && !outfile && !detached)
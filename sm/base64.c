@@ -312,6 +312,21 @@ base64_reader_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
 
           while (n < count && parm->readpos < parm->linelen )
             {
+              if (!idx && count - n > 2)
+                {
+                  /* Decode a run of complete groups in one go.  */
+                  size_t len, used;
+
+                  len = parm->linelen - parm->readpos;
+                  if (len > (count - n) / 3 * 4)
+                    len = (count - n) / 3 * 4;
+                  n += b64_decode_groups (buffer + n,
+                                          (char*)parm->line + parm->readpos,
+                                          len, &used);
+                  parm->readpos += used;
+                  if (used)
+                    continue;
+                }
               c = parm->line[parm->readpos++];
               if (c == '\n' || c == ' ' || c == '\r' || c == '\t')
                 continue;
@@ -434,11 +449,30 @@ base64_writer_cb (void *cb_value, const void *buffer, size_t count)
   for (i=0; i < idx; i++)
     radbuf[i] = parm->base64.radbuf[i];
 
-  for (p=buffer; count; p++, count--)
+  p = buffer;
+  while (count)
     {
-      radbuf[idx++] = *p;
-      if (idx > 2)
+      if (!idx && count > 2)
+        {
+          /* Encode as many complete groups as fit into the current
+             line in one go.  */
+          char line[64];
+          size_t n = (64/4) - quad_count;
+
+          if (n > count / 3)
+            n = count / 3;
+          b64_encode_groups (line, p, n);
+          es_write (stream, line, 4 * n, NULL);
+          p += 3 * n;
+          count -= 3 * n;
+          quad_count += n;
+        }
+      else
         {
+          radbuf[idx++] = *p++;
+          count--;
+          if (idx < 3)
+            continue;
           idx = 0;
           c = bintoasc[(*radbuf >> 2) & 077];
           es_putc (c, stream);
@@ -448,11 +482,12 @@ base64_writer_cb (void *cb_value, const void *buffer, size_t count)
           es_putc (c, stream);
           c = bintoasc[radbuf[2]&077];
           es_putc (c, stream);
-          if (++quad_count >= (64/4))
-            {
-              es_fputs (LF, stream);
-              quad_count = 0;
-            }
+          quad_count++;
+        }
+      if (quad_count >= (64/4))
+        {
+          es_fputs (LF, stream);
+          quad_count = 0;
         }
     }
   for (i=0; i < idx; i++)
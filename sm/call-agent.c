@@ -1010,6 +1010,41 @@ gpgsm_agent_send_nop (ctrl_t ctrl)
 }
 
 
+
+static gpg_error_t
+eventcounter_status_cb (void *opaque, const char *line)
+{
+  unsigned int *r_counter = opaque;
+  const char *s;
+
+  if ((s = has_leading_keyword (line, "EVENTCOUNTER")))
+    {
+      /* The line has the counters ANY, KEY and CARD.  */
+      if (sscanf (s, "%*u %u", r_counter) != 1)
+        *r_counter = 0;
+    }
+  return 0;
+}
+
+/* Store the key event counter of the agent at R_COUNTER.  This
+   counter is incremented by the agent for added or removed private
+   keys and for changes of the trustlist.  */
+gpg_error_t
+gpgsm_agent_get_key_eventcounter (ctrl_t ctrl, unsigned int *r_counter)
+{
+  gpg_error_t err;
+
+  *r_counter = 0;
+
+  err = start_agent (ctrl);
+  if (err)
+    return err;
+
+  return assuan_transact (agent_ctx, "GETEVENTCOUNTER", NULL, NULL, NULL, NULL,
+                          eventcounter_status_cb, r_counter);
+}
+
+
 
 static gpg_error_t
 keyinfo_status_cb (void *opaque, const char *line)
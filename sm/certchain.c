@@ -60,6 +60,36 @@ struct chain_item_s
 typedef struct chain_item_s *chain_item_t;
 
 
+/* The number of entries in the cache of validated chains.  */
+#define CHAIN_CACHE_SIZE 32
+
+/* The maximum number of seconds a cached validation result is used.
+   This also limits the time a revocation published by a CRL or via
+   OCSP goes unnoticed.  */
+#define CHAIN_CACHE_TTL 300
+
+/* An entry in the cache of successfully validated chains.  */
+struct chain_cache_s
+{
+  int used;                 /* The entry is in use.  */
+  unsigned char fpr[20];    /* The fingerprint of the target cert.  */
+  unsigned int flags;       /* The VALIDATE_FLAG_ values used.  */
+  int use_ocsp;             /* The OCSP flag of the session.  */
+  ksba_isotime_t checktime; /* The check time if the chain model has
+                               been used or the empty string.  */
+  unsigned int retflags;    /* The flags returned by the validation.  */
+  ksba_isotime_t exptime;   /* The nearest expiration time.  */
+  int is_qualified;         /* The qualified flag or -1 if not known.  */
+  time_t created;           /* The time the entry has been created.  */
+  time_t expires;           /* The time the entry expires.  */
+};
+static struct chain_cache_s chain_cache[CHAIN_CACHE_SIZE];
+
+/* The event counters used to invalidate the chain cache.  */
+static unsigned int chain_cache_agent_counter;
+static unsigned int chain_cache_keydb_counter;
+
+
 static int is_root_cert (ksba_cert_t cert,
                          const char *issuerdn, const char *subjectdn);
 static int get_regtp_ca_info (ctrl_t ctrl, ksba_cert_t cert, int *chainlen);
@@ -1856,6 +1886,108 @@ do_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime_arg,
 }
 
 
+/* Check whether the chain cache is still valid given the event
+   counter AGENT_COUNTER of the agent and flush it if not.  A change
+   of that counter indicates a change of the trustlist.  */
+static void
+check_chain_cache (unsigned int agent_counter)
+{
+  unsigned int keydb_counter = keydb_get_change_counter ();
+
+  if (agent_counter == chain_cache_agent_counter
+      && keydb_counter == chain_cache_keydb_counter)
+    return;
+
+  if (DBG_CACHE)
+    log_debug ("chain cache: flushed\n");
+  memset (chain_cache, 0, sizeof chain_cache);
+  chain_cache_agent_counter = agent_counter;
+  chain_cache_keydb_counter = keydb_counter;
+}
+
+
+/* Return the cache entry for the certificate with fingerprint FPR
+   validated with FLAGS and CHECKTIME or NULL if there is none.  */
+static struct chain_cache_s *
+find_chain_cache (ctrl_t ctrl, const unsigned char *fpr,
+                  unsigned int flags, const char *checktime)
+{
+  struct chain_cache_s *ce;
+  time_t now = gnupg_get_time ();
+  int idx;
+
+  for (idx=0; idx < CHAIN_CACHE_SIZE; idx++)
+    {
+      ce = chain_cache + idx;
+      if (!ce->used || memcmp (ce->fpr, fpr, 20)
+          || ce->flags != flags || ce->use_ocsp != ctrl->use_ocsp
+          || (*ce->checktime && strcmp (ce->checktime, checktime)))
+        continue;
+      if (now < ce->created || now >= ce->expires)
+        {
+          ce->used = 0;
+          return NULL;
+        }
+      return ce;
+    }
+  return NULL;
+}
+
+
+/* Store the result of a successful validation in the chain cache.
+   The arguments are those of gpgsm_validate_chain.  */
+static void
+put_chain_cache (ctrl_t ctrl, ksba_cert_t cert, const unsigned char *fpr,
+                 unsigned int flags, const char *checktime,
+                 unsigned int retflags, const ksba_isotime_t exptime)
+{
+  struct chain_cache_s *ce = NULL;
+  time_t now = gnupg_get_time ();
+  time_t t;
+  size_t buflen;
+  char buf[1];
+  int idx;
+
+  /* Take an unused or expired entry or the oldest one.  */
+  for (idx=0; idx < CHAIN_CACHE_SIZE; idx++)
+    {
+      if (!chain_cache[idx].used || chain_cache[idx].expires <= now)
+        {
+          ce = chain_cache + idx;
+          break;
+        }
+      if (!ce || chain_cache[idx].created < ce->created)
+        ce = chain_cache + idx;
+    }
+
+  memset (ce, 0, sizeof *ce);
+  memcpy (ce->fpr, fpr, 20);
+  ce->flags = flags;
+  ce->use_ocsp = ctrl->use_ocsp;
+  /* Under the shell model the time of the check does not matter.  */
+  if ((retflags & VALIDATE_FLAG_CHAIN_MODEL))
+    gnupg_copy_time (ce->checktime, checktime);
+  ce->retflags = retflags;
+  gnupg_copy_time (ce->exptime, exptime);
+  if (!ksba_cert_get_user_data (cert, "is_qualified",
+                                &buf, sizeof (buf), &buflen) && buflen)
+    ce->is_qualified = !!*buf;
+  else
+    ce->is_qualified = -1;
+  ce->created = now;
+  ce->expires = now + CHAIN_CACHE_TTL;
+  /* Don't use the result past the expiration of any cert in the
+     chain.  */
+  if (*exptime)
+    {
+      t = isotime2epoch (exptime);
+      if (t != (time_t)(-1) && t < ce->expires)
+        ce->expires = t;
+    }
+  ce->used = 1;
+}
+
+
 /* Validate a certificate chain.  For a description see
    do_validate_chain.  This function is a wrapper to handle a root
    certificate with the chain_model flag set.  If RETFLAGS is not
@@ -1867,7 +1999,11 @@ do_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime_arg,
    creation time of the signature.  If your are verifying a
    certificate, set it nil (i.e. the empty string).  If the creation
    date of the signature is not known use the special date
-   "19700101T000000" which is treated in a special way here. */
+   "19700101T000000" which is treated in a special way here.
+
+   Successful validations are cached for a short time.  The cache is
+   not used in listmode and if an audit log is requested because
+   those need the details of the validation.  */
 int
 gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime,
                       ksba_isotime_t r_exptime,
@@ -1877,6 +2013,11 @@ gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime,
   int rc;
   struct rootca_flags_s rootca_flags;
   unsigned int dummy_retflags;
+  int use_cache;
+  unsigned char fpr[20];
+  unsigned int agent_counter;
+  struct chain_cache_s *ce = NULL;
+  ksba_isotime_t exptime;
 
   if (!retflags)
     retflags = &dummy_retflags;
@@ -1892,10 +2033,51 @@ gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime,
      RETFLAGS.  */
   *retflags = (flags & VALIDATE_FLAG_CHAIN_MODEL);
 
+  if (!checktime)
+    checktime = "";
+
+  use_cache = (!listmode && !ctrl->audit && !opt.no_chain_validation
+               && !gpgsm_agent_get_key_eventcounter (ctrl, &agent_counter));
+  if (use_cache)
+    {
+      check_chain_cache (agent_counter);
+      gpgsm_get_fingerprint (cert, GCRY_MD_SHA1, fpr, NULL);
+      ce = find_chain_cache (ctrl, fpr, flags, checktime);
+    }
+  if (ce)
+    {
+      gpg_error_t err;
+      char buf[1];
+
+      if (DBG_CACHE)
+        log_debug ("chain cache: using cached result\n");
+      *retflags = ce->retflags;
+      if (r_exptime)
+        gnupg_copy_time (r_exptime, ce->exptime);
+      if (ce->is_qualified != -1)
+        {
+          buf[0] = ce->is_qualified;
+          err = ksba_cert_set_user_data (cert, "is_qualified", buf, 1);
+          if (err)
+            log_error ("set_user_data(is_qualified) failed: %s\n",
+                       gpg_strerror (err));
+        }
+      /* The certificate may have been stored as ephemeral since it
+         has been validated; clear that flag as the validation
+         would do.  */
+      err = keydb_set_cert_flags (cert, 1, KEYBOX_FLAG_BLOB, 0,
+                                  KEYBOX_FLAG_BLOB_EPHEMERAL, 0);
+      if (err && gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+        log_error ("clearing ephemeral flag failed: %s\n",
+                   gpg_strerror (err));
+      rc = 0;
+      goto leave;
+    }
+
   memset (&rootca_flags, 0, sizeof rootca_flags);
 
   rc = do_validate_chain (ctrl, cert, checktime,
-                          r_exptime, listmode, listfp, flags,
+                          exptime, listmode, listfp, flags,
                           &rootca_flags);
   if (!rc && (flags & VALIDATE_FLAG_STEED))
     {
@@ -1907,12 +2089,18 @@ gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime,
     {
       do_list (0, listmode, listfp, _("switching to chain model"));
       rc = do_validate_chain (ctrl, cert, checktime,
-                              r_exptime, listmode, listfp,
-                              (flags |= VALIDATE_FLAG_CHAIN_MODEL),
+                              exptime, listmode, listfp,
+                              (flags | VALIDATE_FLAG_CHAIN_MODEL),
                               &rootca_flags);
       *retflags |= VALIDATE_FLAG_CHAIN_MODEL;
     }
 
+  if (r_exptime)
+    gnupg_copy_time (r_exptime, exptime);
+  if (use_cache && !rc)
+    put_chain_cache (ctrl, cert, fpr, flags, checktime, *retflags, exptime);
+
+ leave:
   if (opt.verbose)
     do_list (0, listmode, listfp, _("validation model used: %s"),
              (*retflags & VALIDATE_FLAG_STEED)?
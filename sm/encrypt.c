@@ -33,6 +33,7 @@
 
 #include "keydb.h"
 #include "i18n.h"
+#include "../common/parallel.h"
 
 
 struct dek_s {
@@ -47,6 +48,9 @@ struct dek_s {
 typedef struct dek_s *DEK;
 
 
+/* The size of the buffer used to read the plaintext.  */
+#define ENCRYPT_BUFSIZE 65536
+
 /* Callback parameters for the encryption.  */
 struct encrypt_cb_parm_s
 {
@@ -55,9 +59,10 @@ struct encrypt_cb_parm_s
   int eof_seen;
   int ready;
   int readerror;
-  int bufsize;
+  size_t bufsize;
   unsigned char *buffer;
-  int buflen;
+  size_t buflen;   /* The number of bytes in BUFFER.  */
+  size_t bufoff;   /* The offset of the not yet encrypted bytes.  */
 };
 
 
@@ -164,17 +169,20 @@ encode_session_key (DEK dek, gcry_sexp_t * r_data)
 }
 
 
-/* Encrypt the DEK under the key contained in CERT and return it as a
-   canonical S-Exp in encval. */
-static int
-encrypt_dek (const DEK dek, ksba_cert_t cert, unsigned char **encval)
+/* Prepare the encryption of the DEK under the key contained in CERT.
+   On success the public key is stored at R_PKEY and the encoded
+   session key at R_DATA.  */
+static gpg_error_t
+prepare_encrypt_dek (const DEK dek, ksba_cert_t cert,
+                     gcry_sexp_t *r_pkey, gcry_sexp_t *r_data)
 {
-  gcry_sexp_t s_ciph, s_data, s_pkey;
+  gcry_sexp_t s_data, s_pkey;
   int rc;
   ksba_sexp_t buf;
   size_t len;
 
-  *encval = NULL;
+  *r_pkey = NULL;
+  *r_data = NULL;
 
   /* get the key from the cert */
   buf = ksba_cert_get_public_key (cert);
@@ -203,18 +211,13 @@ encrypt_dek (const DEK dek, ksba_cert_t cert, unsigned char **encval)
   if (rc)
     {
       log_error ("encode_session_key failed: %s\n", gpg_strerror (rc));
+      gcry_sexp_release (s_pkey);
       return rc;
     }
 
-  /* pass it to libgcrypt */
-  rc = gcry_pk_encrypt (&s_ciph, s_data, s_pkey);
-  gcry_sexp_release (s_data);
-  gcry_sexp_release (s_pkey);
-
-  /* Reformat it. */
-  rc = make_canon_sexp (s_ciph, encval, NULL);
-  gcry_sexp_release (s_ciph);
-  return rc;
+  *r_pkey = s_pkey;
+  *r_data = s_data;
+  return 0;
 }
 
 
@@ -224,9 +227,8 @@ static int
 encrypt_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
 {
   struct encrypt_cb_parm_s *parm = cb_value;
-  int blklen = parm->dek->ivlen;
-  unsigned char *p;
-  size_t n;
+  size_t blklen = parm->dek->ivlen;
+  size_t n, avail;
 
   *nread = 0;
   if (!buffer)
@@ -238,44 +240,51 @@ encrypt_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
   if (count < blklen)
     BUG ();
 
-  if (!parm->eof_seen)
-    { /* fillup the buffer */
-      p = parm->buffer;
-      for (n=parm->buflen; n < parm->bufsize; n++)
+  avail = parm->buflen - parm->bufoff;
+  if (avail < count || avail < blklen)
+    {
+      /* Move the remaining bytes to the front; there are only a few
+         of them unless the caller asks for large amounts.  */
+      if (parm->bufoff)
         {
-          int c = es_getc (parm->fp);
-          if (c == EOF)
+          memmove (parm->buffer, parm->buffer + parm->bufoff, avail);
+          parm->buflen = avail;
+          parm->bufoff = 0;
+        }
+
+      /* Fill up the buffer using large reads.  */
+      while (!parm->eof_seen && parm->buflen < parm->bufsize)
+        {
+          if (es_read (parm->fp, parm->buffer + parm->buflen,
+                       parm->bufsize - parm->buflen, &n))
             {
-              if (es_ferror (parm->fp))
-                {
-                  parm->readerror = errno;
-                  return -1;
-                }
-              parm->eof_seen = 1;
-              break;
+              parm->readerror = errno;
+              return -1;
             }
-          p[n] = c;
+          if (!n)
+            parm->eof_seen = 1;
+          parm->buflen += n;
         }
-      parm->buflen = n;
+      avail = parm->buflen;
     }
 
-  n = parm->buflen < count? parm->buflen : count;
+  n = avail < count? avail : count;
   n = n/blklen * blklen;
   if (n)
     { /* encrypt the stuff */
-      gcry_cipher_encrypt (parm->dek->chd, buffer, n, parm->buffer, n);
+      gcry_cipher_encrypt (parm->dek->chd, buffer, n,
+                           parm->buffer + parm->bufoff, n);
       *nread = n;
-      /* Who cares about cycles, take the easy way and shift the buffer */
-      parm->buflen -= n;
-      memmove (parm->buffer, parm->buffer+n, parm->buflen);
+      parm->bufoff += n;
     }
   else if (parm->eof_seen)
     { /* no complete block but eof: add padding */
       /* fixme: we should try to do this also in the above code path */
-      int i, npad = blklen - (parm->buflen % blklen);
-      p = parm->buffer;
-      for (n=parm->buflen, i=0; n < parm->bufsize && i < npad; n++, i++)
-        p[n] = npad;
+      int npad = blklen - (avail % blklen);
+
+      /* The above refill moved the remaining bytes to the front.  */
+      memset (parm->buffer + avail, npad, npad);
+      n = avail + npad;
       gcry_cipher_encrypt (parm->dek->chd, buffer, n, parm->buffer, n);
       *nread = n;
       parm->ready = 1;
@@ -287,6 +296,30 @@ encrypt_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
 
 
 
+/* Object used to pass the per recipient data to the worker threads
+   running encrypt_dek_job.  */
+struct encrypt_dek_job_s
+{
+  gcry_sexp_t s_pkey;     /* The public key of the recipient.  */
+  gcry_sexp_t s_data;     /* The encoded session key.  */
+  gcry_sexp_t s_ciph;     /* Receives the encrypted session key.  */
+  gpg_error_t err;        /* Receives the error code.  */
+};
+
+
+/* Encrypt the session key for the recipient with index IDX of the
+   job array OPAQUE.  This function may run in a separate thread and
+   thus it only calls Libgcrypt; the job objects are prepared and
+   evaluated by the caller.  */
+static void
+encrypt_dek_job (void *opaque, unsigned int idx)
+{
+  struct encrypt_dek_job_s *job = (struct encrypt_dek_job_s *)opaque + idx;
+
+  job->err = gcry_pk_encrypt (&job->s_ciph, job->s_data, job->s_pkey);
+}
+
+
 /* Perform an encrypt operation.
 
    Encrypt the data received on DATA-FD and write it to OUT_FP.  The
@@ -309,6 +342,7 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
   estream_t data_fp = NULL;
   certlist_t cl;
   int count;
+  struct encrypt_dek_job_s *jobs = NULL;
 
   memset (&encparm, 0, sizeof encparm);
 
@@ -349,6 +383,9 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
       log_error ("fdopen() failed: %s\n", strerror (errno));
       goto leave;
     }
+  /* We read in large blocks; thus an additional buffer would only
+     add a copy of the data.  */
+  es_setvbuf (data_fp, NULL, _IONBF, 0);
 
   err = ksba_reader_new (&reader);
   if (err)
@@ -425,8 +462,7 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
     }
 
   encparm.dek = dek;
-  /* Use a ~8k (AES) or ~4k (3DES) buffer */
-  encparm.bufsize = 500 * dek->ivlen;
+  encparm.bufsize = ENCRYPT_BUFSIZE;
   encparm.buffer = xtrymalloc (encparm.bufsize);
   if (!encparm.buffer)
     {
@@ -436,13 +472,37 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
 
   audit_log_s (ctrl->audit, AUDIT_SESSION_KEY, dek->algoid);
 
-  /* Gather certificates of recipients, encrypt the session key for
-     each and store them in the CMS object */
+  /* Encrypt the session key for each recipient.  The public key
+     operations are independent and thus we run them in parallel.  */
+  jobs = xtrycalloc (count, sizeof *jobs);
+  if (!jobs)
+    {
+      rc = out_of_core ();
+      goto leave;
+    }
   for (recpno = 0, cl = recplist; cl; recpno++, cl = cl->next)
     {
-      unsigned char *encval;
+      rc = prepare_encrypt_dek (dek, cl->cert,
+                                &jobs[recpno].s_pkey, &jobs[recpno].s_data);
+      if (rc)
+        {
+          audit_log_cert (ctrl->audit, AUDIT_ENCRYPTED_TO, cl->cert, rc);
+          log_error ("encryption failed for recipient no. %d: %s\n",
+                     recpno, gpg_strerror (rc));
+          goto leave;
+        }
+    }
+  gnupg_parallel_run (opt.worker_threads, count, encrypt_dek_job, jobs);
+
+  /* Gather certificates of recipients and store them along with the
+     encrypted session keys in the CMS object.  */
+  for (recpno = 0, cl = recplist; cl; recpno++, cl = cl->next)
+    {
+      unsigned char *encval = NULL;
 
-      rc = encrypt_dek (dek, cl->cert, &encval);
+      rc = jobs[recpno].err;
+      if (!rc)
+        rc = make_canon_sexp (jobs[recpno].s_ciph, &encval, NULL);
       if (rc)
         {
           audit_log_cert (ctrl->audit, AUDIT_ENCRYPTED_TO, cl->cert, rc);
@@ -510,6 +570,16 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
   gpgsm_destroy_writer (b64writer);
   ksba_reader_release (reader);
   keydb_release (kh);
+  if (jobs)
+    {
+      for (recpno = 0; recpno < count; recpno++)
+        {
+          gcry_sexp_release (jobs[recpno].s_pkey);
+          gcry_sexp_release (jobs[recpno].s_data);
+          gcry_sexp_release (jobs[recpno].s_ciph);
+        }
+      xfree (jobs);
+    }
   xfree (dek);
   es_fclose (data_fp);
   xfree (encparm.buffer);
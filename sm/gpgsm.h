@@ -142,6 +142,8 @@ struct
      OID per string.  */
   strlist_t ignored_cert_extensions;
 
+  int worker_threads;       /* Number of threads for CPU bound tasks;
+                               defaults to 1; 0 uses all CPUs.  */
 } opt;
 
 /* Debug values and macros.  */
@@ -410,6 +412,8 @@ int gpgsm_agent_learn (ctrl_t ctrl);
 int gpgsm_agent_passwd (ctrl_t ctrl, const char *hexkeygrip, const char *desc);
 gpg_error_t gpgsm_agent_get_confirmation (ctrl_t ctrl, const char *desc);
 gpg_error_t gpgsm_agent_send_nop (ctrl_t ctrl);
+gpg_error_t gpgsm_agent_get_key_eventcounter (ctrl_t ctrl,
+                                              unsigned int *r_counter);
 gpg_error_t gpgsm_agent_keyinfo (ctrl_t ctrl, const char *hexkeygrip,
                                  char **r_serialno);
 gpg_error_t gpgsm_agent_ask_passphrase (ctrl_t ctrl, const char *desc_msg,
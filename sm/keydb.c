@@ -35,6 +35,10 @@
 
 static int active_handles;
 
+/* Incremented with each change of a certificate or its validity
+   flags.  */
+static unsigned int change_counter;
+
 typedef enum {
     KEYDB_RESOURCE_TYPE_NONE = 0,
     KEYDB_RESOURCE_TYPE_KEYBOX
@@ -736,6 +740,10 @@ keydb_set_flags (KEYDB_HANDLE hd, int which, int idx, unsigned int value)
       break;
     }
 
+  /* The blob flags merely track whether a certificate is ephemeral,
+     changes of them don't affect the validity.  */
+  if (!err && which != KEYBOX_FLAG_BLOB)
+    change_counter++;
   return err;
 }
 
@@ -776,6 +784,8 @@ keydb_insert_cert (KEYDB_HANDLE hd, ksba_cert_t cert)
       rc = keybox_insert_cert (hd->active[idx].u.kr, cert, digest);
       break;
     }
+  if (!rc)
+    change_counter++;
 
   unlock_all (hd);
   return rc;
@@ -814,6 +824,8 @@ keydb_update_cert (KEYDB_HANDLE hd, ksba_cert_t cert)
       rc = keybox_update_cert (hd->active[hd->found].u.kr, cert, digest);
       break;
     }
+  if (!rc)
+    change_counter++;
 
   unlock_all (hd);
   return rc;
@@ -849,6 +861,8 @@ keydb_delete (KEYDB_HANDLE hd, int unlock)
       rc = keybox_delete (hd->active[hd->found].u.kr);
       break;
     }
+  if (!rc)
+    change_counter++;
 
   if (unlock)
     unlock_all (hd);
@@ -857,6 +871,16 @@ keydb_delete (KEYDB_HANDLE hd, int unlock)
 
 
 
+/* Return a counter which is incremented with each change to the
+   certificates done by this process.  This may be used to invalidate
+   cached information.  */
+unsigned int
+keydb_get_change_counter (void)
+{
+  return change_counter;
+}
+
+
 /*
  * Locate the default writable key resource, so that the next
  * operation (which is only relevant for inserts) will be done on this
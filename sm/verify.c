@@ -48,26 +48,37 @@ strtimestamp_r (ksba_isotime_t atime)
 
 
 
+/* The size of the buffer used to hash the data of a detached
+   signature.  */
+#define HASH_DATA_BUFSIZE 65536
+
 /* Hash the data for a detached signature.  Returns 0 on success.  */
 static gpg_error_t
 hash_data (int fd, gcry_md_hd_t md)
 {
   gpg_error_t err = 0;
   estream_t fp;
-  char buffer[4096];
-  int nread;
+  char *buffer;
+  size_t nread;
+
+  buffer = xtrymalloc (HASH_DATA_BUFSIZE);
+  if (!buffer)
+    return gpg_error_from_syserror ();
 
   fp = es_fdopen_nc (fd, "rb");
   if (!fp)
     {
       err = gpg_error_from_syserror ();
       log_error ("fdopen(%d) failed: %s\n", fd, gpg_strerror (err));
+      xfree (buffer);
       return err;
     }
+  /* Read directly into our large buffer.  */
+  es_setvbuf (fp, NULL, _IONBF, 0);
 
   do
     {
-      nread = es_fread (buffer, 1, DIM(buffer), fp);
+      nread = es_fread (buffer, 1, HASH_DATA_BUFSIZE, fp);
       gcry_md_write (md, buffer, nread);
     }
   while (nread);
@@ -77,6 +88,7 @@ hash_data (int fd, gcry_md_hd_t md)
       log_error ("read error on fd %d: %s\n", fd, gpg_strerror (err));
     }
   es_fclose (fp);
+  xfree (buffer);
   return err;
 }
 
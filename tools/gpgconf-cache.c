@@ -0,0 +1,498 @@
+/* gpgconf-cache.c - Cache for the output of the components
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* To avoid running all components each time gpgconf is asked to
+   list options or to check the programs, the output of the programs
+   may be kept in a cache file.  An entry is valid as long as the
+   program binary and the files its output depends on (the
+   configuration file) have not been changed.  The file is line
+   based:
+
+     V:<version>
+     P:<kind>:<exitcode>:<mtime>:<size>:<program>
+     F:<mtime>:<size>:<filename>
+     D:<output line>
+
+   The P line starts a new entry for the program and is followed by
+   the F lines for the files it depends on and the D lines with the
+   output.  An unterminated last output line uses "d:" instead.  The
+   cache is only an optimization; thus all errors are silently
+   ignored and yield a cache miss.  */
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <time.h>
+
+#include "util.h"
+#include "membuf.h"
+#include "gpgconf-cache.h"
+
+#define GC_CACHE_VERSION "1"
+
+/* A file a cache entry depends on.  */
+struct gc_cache_dep_s;
+typedef struct gc_cache_dep_s *gc_cache_dep_t;
+struct gc_cache_dep_s
+{
+  gc_cache_dep_t next;
+  unsigned long long mtime;
+  unsigned long long size;
+  char name[1];
+};
+
+/* An entry of the cache.  */
+struct gc_cache_entry_s;
+typedef struct gc_cache_entry_s *gc_cache_entry_t;
+struct gc_cache_entry_s
+{
+  gc_cache_entry_t next;
+  int kind;                  /* GC_RUN_LIST or GC_RUN_TEST.  */
+  int valid;                 /* 0 = not yet checked, 1 = valid, -1 = stale.  */
+  int exitcode;
+  unsigned long long mtime;  /* Of the program.  */
+  unsigned long long size;   /* Of the program.  */
+  gc_cache_dep_t deps;
+  char *output;              /* The output of the program.  */
+  size_t outputlen;
+  char pgmname[1];
+};
+
+/* The name of the cache file or NULL if the cache is not used.  */
+static char *gc_cache_fname;
+
+/* The cache as read from the file and flags telling whether we
+   already read it and whether it needs to be written back.  */
+static gc_cache_entry_t gc_cache;
+static int gc_cache_loaded;
+static int gc_cache_dirty;
+
+
+/* Store the modification time and the size of FNAME at R_MTIME and
+   R_SIZE.  A non-existing file yields 0 for both.  Returns an error
+   only if the file exists but can't be stat-ed.  */
+static gpg_error_t
+get_file_stamp (const char *fname,
+                unsigned long long *r_mtime, unsigned long long *r_size)
+{
+  struct stat st;
+
+  *r_mtime = *r_size = 0;
+  if (stat (fname, &st))
+    {
+      if (errno == ENOENT)
+        return 0;
+      return gpg_error_from_syserror ();
+    }
+  *r_mtime = st.st_mtime;
+  *r_size = st.st_size;
+  return 0;
+}
+
+
+/* Release the cache entry ENTRY.  */
+static void
+release_cache_entry (gc_cache_entry_t entry)
+{
+  gc_cache_dep_t dep;
+
+  if (!entry)
+    return;
+  while ((dep = entry->deps))
+    {
+      entry->deps = dep->next;
+      xfree (dep);
+    }
+  xfree (entry->output);
+  xfree (entry);
+}
+
+
+/* Read the cache file.  A cache file which can't be parsed is
+   ignored.  */
+static void
+load_cache (void)
+{
+  estream_t fp;
+  char *line = NULL;
+  size_t line_len = 0;
+  ssize_t length;
+  gc_cache_entry_t entry = NULL;
+  gc_cache_entry_t *tail = &gc_cache;
+  membuf_t mb;
+  int version_seen = 0;
+  int bad = 0;
+  char *p;
+
+  if (gc_cache_loaded)
+    return;
+  gc_cache_loaded = 1;
+
+  fp = es_fopen (gc_cache_fname, "r");
+  if (!fp)
+    return;
+
+  init_membuf (&mb, 1024);
+  while (!bad && (length = es_read_line (fp, &line, &line_len, NULL)) > 0)
+    {
+      if (line[length-1] != '\n')
+        {
+          bad = 1;
+          break;
+        }
+      line[--length] = 0;
+
+      if (line[0] && line[1] == ':')
+        p = line + 2;
+      else
+        p = NULL;
+
+      if (!version_seen)
+        {
+          if (!p || *line != 'V' || strcmp (p, GC_CACHE_VERSION))
+            bad = 1;
+          version_seen = 1;
+        }
+      else if (p && *line == 'P')
+        {
+          char kind;
+          int exitcode;
+          unsigned long long mtime, size;
+          int n = -1;
+
+          if (entry)
+            {
+              entry->output = get_membuf (&mb, &entry->outputlen);
+              *tail = entry;
+              tail = &entry->next;
+              init_membuf (&mb, 1024);
+            }
+          if (sscanf (p, "%c:%d:%llu:%llu:%n",
+                      &kind, &exitcode, &mtime, &size, &n) < 4 || n < 0)
+            {
+              entry = NULL;
+              bad = 1;
+              break;
+            }
+          entry = xcalloc (1, sizeof *entry + strlen (p + n));
+          entry->kind = (unsigned char)kind;
+          entry->exitcode = exitcode;
+          entry->mtime = mtime;
+          entry->size = size;
+          strcpy (entry->pgmname, p + n);
+        }
+      else if (p && *line == 'F' && entry)
+        {
+          gc_cache_dep_t dep;
+          unsigned long long mtime, size;
+          int n = -1;
+
+          if (sscanf (p, "%llu:%llu:%n", &mtime, &size, &n) < 2 || n < 0)
+            {
+              bad = 1;
+              break;
+            }
+          dep = xcalloc (1, sizeof *dep + strlen (p + n));
+          dep->mtime = mtime;
+          dep->size = size;
+          strcpy (dep->name, p + n);
+          dep->next = entry->deps;
+          entry->deps = dep;
+        }
+      else if (p && (*line == 'D' || *line == 'd') && entry)
+        {
+          put_membuf (&mb, p, length - 2);
+          if (*line == 'D')
+            put_membuf (&mb, "\n", 1);
+        }
+      else
+        bad = 1;
+    }
+  if (es_ferror (fp))
+    bad = 1;
+  es_fclose (fp);
+  xfree (line);
+
+  if (entry)
+    {
+      entry->output = get_membuf (&mb, &entry->outputlen);
+      if (!entry->output)
+        bad = 1;
+      *tail = entry;
+    }
+  else
+    xfree (get_membuf (&mb, NULL));
+
+  if (bad)
+    {
+      gc_cache_release ();
+      gc_cache_loaded = 1;
+    }
+}
+
+
+/* Return true if the stamps of the program and of all dependencies
+   of ENTRY are unchanged.  */
+static int
+cache_entry_valid_p (gc_cache_entry_t entry)
+{
+  gc_cache_dep_t dep;
+  unsigned long long mtime, size;
+
+  if (!entry->valid)
+    {
+      entry->valid = -1;
+      if (get_file_stamp (entry->pgmname, &mtime, &size)
+          || !mtime || mtime != entry->mtime || size != entry->size)
+        return 0;
+      for (dep = entry->deps; dep; dep = dep->next)
+        if (get_file_stamp (dep->name, &mtime, &size)
+            || mtime != dep->mtime || size != dep->size)
+          return 0;
+      entry->valid = 1;
+    }
+  return entry->valid > 0;
+}
+
+
+/* Return the valid cache entry of KIND for PGMNAME or NULL.  */
+static gc_cache_entry_t
+find_cache_entry (int kind, const char *pgmname)
+{
+  gc_cache_entry_t entry;
+
+  if (!gc_cache_fname)
+    return NULL;
+
+  load_cache ();
+  for (entry = gc_cache; entry; entry = entry->next)
+    if (entry->kind == kind && !strcmp (entry->pgmname, pgmname)
+        && entry->valid >= 0)
+      return cache_entry_valid_p (entry)? entry : NULL;
+  return NULL;
+}
+
+
+/* Use the cache file FNAME.  NULL disables the cache, which is the
+   default.  */
+void
+gc_cache_set_file (const char *fname)
+{
+  gc_cache_release ();
+  xfree (gc_cache_fname);
+  gc_cache_fname = fname? xstrdup (fname) : NULL;
+}
+
+
+/* Return the cached output of the run of KIND for PGMNAME or NULL if
+   there is no valid entry.  On success the exit code of the run is
+   stored at R_EXITCODE and the length of the output at R_OUTPUTLEN.
+   The output is valid until the entry is replaced by gc_cache_put or
+   the cache is released.  */
+const char *
+gc_cache_get (int kind, const char *pgmname,
+              int *r_exitcode, size_t *r_outputlen)
+{
+  gc_cache_entry_t entry;
+
+  entry = find_cache_entry (kind, pgmname);
+  if (!entry)
+    return NULL;
+  *r_exitcode = entry->exitcode;
+  *r_outputlen = entry->outputlen;
+  return entry->output;
+}
+
+
+/* Add the OUTPUT of length OUTPUTLEN and the EXITCODE of a completed
+   run of KIND for PGMNAME to the cache.  The output depends on the
+   files in the NULL terminated array DEPFILES and, if DEPKIND is not
+   0, on the same files as the valid entry of that kind for PGMNAME;
+   nothing is cached if there is no such entry.  Nothing is cached
+   either if any of these files has been modified so recently that a
+   change in the same second would go unnoticed.  */
+void
+gc_cache_put (int kind, const char *pgmname, int exitcode,
+              const char *output, size_t outputlen,
+              const char **depfiles, int depkind)
+{
+  gc_cache_entry_t entry, depentry = NULL;
+  gc_cache_dep_t dep, deps;
+  unsigned long long mtime, size;
+  unsigned long long limit = (unsigned long long)time (NULL) - 1;
+  int i;
+
+  if (!gc_cache_fname)
+    return;
+  load_cache ();  /* Keep the entries of the other programs.  */
+  if (depkind && !(depentry = find_cache_entry (depkind, pgmname)))
+    return;
+  if (get_file_stamp (pgmname, &mtime, &size) || !mtime)
+    return;
+  if (mtime >= limit || strchr (pgmname, '\n'))
+    return;
+
+  entry = xcalloc (1, sizeof *entry + strlen (pgmname));
+  entry->kind = kind;
+  entry->valid = 1;
+  entry->exitcode = exitcode;
+  entry->mtime = mtime;
+  entry->size = size;
+  strcpy (entry->pgmname, pgmname);
+
+  for (i=0; depfiles && depfiles[i]; i++)
+    {
+      if (get_file_stamp (depfiles[i], &mtime, &size)
+          || mtime >= limit || strchr (depfiles[i], '\n'))
+        goto fail;
+      dep = xcalloc (1, sizeof *dep + strlen (depfiles[i]));
+      dep->mtime = mtime;
+      dep->size = size;
+      strcpy (dep->name, depfiles[i]);
+      dep->next = entry->deps;
+      entry->deps = dep;
+    }
+  for (deps = depentry? depentry->deps : NULL; deps; deps = deps->next)
+    {
+      dep = xcalloc (1, sizeof *dep + strlen (deps->name));
+      dep->mtime = deps->mtime;
+      dep->size = deps->size;
+      strcpy (dep->name, deps->name);
+      dep->next = entry->deps;
+      entry->deps = dep;
+    }
+
+  entry->output = xmalloc (outputlen + 1);
+  memcpy (entry->output, output, outputlen);
+  entry->outputlen = outputlen;
+
+  /* Replace an old entry for the same program.  */
+  {
+    gc_cache_entry_t *prev, e;
+
+    for (prev = &gc_cache; (e = *prev); prev = &e->next)
+      if (e->kind == entry->kind && !strcmp (e->pgmname, entry->pgmname))
+        {
+          *prev = e->next;
+          release_cache_entry (e);
+          break;
+        }
+  }
+  entry->next = gc_cache;
+  gc_cache = entry;
+  gc_cache_dirty = 1;
+  return;
+
+ fail:
+  release_cache_entry (entry);
+}
+
+
+/* Write the cache back to its file if it has been changed.  The file
+   is replaced atomically so that concurrent readers see either the
+   old or the new version.  */
+gpg_error_t
+gc_cache_save (void)
+{
+  gpg_error_t err = 0;
+  char *tmpname;
+  estream_t fp;
+  gc_cache_entry_t entry;
+  gc_cache_dep_t dep;
+  const char *s, *end, *eol;
+
+  if (!gc_cache_fname || !gc_cache_dirty)
+    return 0;
+  gc_cache_dirty = 0;
+
+  tmpname = xasprintf ("%s.%u.tmp", gc_cache_fname, (unsigned int)getpid ());
+  fp = es_fopen (tmpname, "w");
+  if (!fp)
+    {
+      err = gpg_error_from_syserror ();
+      xfree (tmpname);
+      return err;
+    }
+
+  es_fputs ("V:" GC_CACHE_VERSION "\n", fp);
+  for (entry = gc_cache; entry; entry = entry->next)
+    {
+      if (!cache_entry_valid_p (entry))
+        continue;
+      es_fprintf (fp, "P:%c:%d:%llu:%llu:%s\n", entry->kind,
+                  entry->exitcode, entry->mtime, entry->size,
+                  entry->pgmname);
+      for (dep = entry->deps; dep; dep = dep->next)
+        es_fprintf (fp, "F:%llu:%llu:%s\n", dep->mtime, dep->size, dep->name);
+      s = entry->output;
+      end = s + entry->outputlen;
+      for (; s < end; s = eol + 1)
+        {
+          eol = memchr (s, '\n', end - s);
+          if (!eol)
+            {
+              es_fputs ("d:", fp);
+              es_fwrite (s, end - s, 1, fp);
+              es_putc ('\n', fp);
+              break;
+            }
+          es_fputs ("D:", fp);
+          es_fwrite (s, eol - s + 1, 1, fp);
+        }
+    }
+
+  if (es_ferror (fp))
+    err = gpg_error_from_syserror ();
+  if (es_fclose (fp) && !err)
+    err = gpg_error_from_syserror ();
+  if (!err)
+    {
+#ifdef HAVE_W32_SYSTEM
+      unlink (gc_cache_fname);
+#endif
+      if (rename (tmpname, gc_cache_fname))
+        err = gpg_error_from_syserror ();
+    }
+  if (err)
+    unlink (tmpname);
+  xfree (tmpname);
+  return err;
+}
+
+
+/* Release the cache read from the file.  The next lookup reads the
+   file again.  */
+void
+gc_cache_release (void)
+{
+  gc_cache_entry_t entry;
+
+  while ((entry = gc_cache))
+    {
+      gc_cache = entry->next;
+      release_cache_entry (entry);
+    }
+  gc_cache_loaded = 0;
+  gc_cache_dirty = 0;
+}
@@ -0,0 +1,50 @@
+/* gpgconf-cache.h - Cache for the output of the components
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GPGCONF_CACHE_H
+#define GPGCONF_CACHE_H
+
+/* The default name of the cache file in the home directory.  */
+#define GC_CACHE_NAME "gpgconf.cache"
+
+/* The kinds of program runs.  */
+#define GC_RUN_LIST 'L'   /* Run with --gpgconf-list.  */
+#define GC_RUN_TEST 'T'   /* Run with --gpgconf-test.  */
+
+/* Use the cache file FNAME.  NULL disables the cache, which is the
+   default.  */
+void gc_cache_set_file (const char *fname);
+
+/* Return the cached output of the run of KIND for PGMNAME or NULL.
+   The output is valid until the entry is replaced.  */
+const char *gc_cache_get (int kind, const char *pgmname,
+                          int *r_exitcode, size_t *r_outputlen);
+
+/* Add the output of a run of KIND for PGMNAME to the cache.  */
+void gc_cache_put (int kind, const char *pgmname, int exitcode,
+                   const char *output, size_t outputlen,
+                   const char **depfiles, int depkind);
+
+/* Write the cache back to its file if it has been changed.  */
+gpg_error_t gc_cache_save (void);
+
+/* Release the cache read from the file.  */
+void gc_cache_release (void);
+
+#endif /*GPGCONF_CACHE_H*/
@@ -48,9 +48,11 @@
 #include "util.h"
 #include "i18n.h"
 #include "exechelp.h"
+#include "membuf.h"
 
 #include "gc-opt-flags.h"
 #include "gpgconf.h"
+#include "gpgconf-cache.h"
 
 /* There is a problem with gpg 1.4 under Windows: --gpgconf-list
    returns a plain filename without escaping.  As long as we have not
@@ -1517,23 +1519,182 @@ collect_error_output (estream_t fp, const char *tag)
 }
 
 
-/* Check the options of a single component.  Returns 0 if everything
-   is OK.  */
-int
-gc_component_check_options (int component, estream_t out, const char *conf_file)
+/* Description of a program run to gather the options or to check the
+   configuration.  Runs are either answered from the cache or by
+   spawning the program; see run_programs.  */
+struct gc_run_s
+{
+  int kind;               /* GC_RUN_LIST or GC_RUN_TEST.  */
+  const char *pgmname;
+  const char *conf_file;  /* If not NULL use this config file.  */
+  int version_only;       /* Run with --version instead of --gpgconf-test.  */
+  gpg_error_t err;        /* Error from running the program.  */
+  int exitcode;
+  char *output;           /* The collected stdout (LIST) or stderr (TEST).  */
+  size_t outputlen;
+  int cached;             /* OUTPUT is owned by the cache.  */
+  pid_t pid;
+  estream_t fp;
+};
+typedef struct gc_run_s *gc_run_t;
+
+
+/* Add the output of the completed RUN to the cache.  See gc_cache_put
+   for DEPFILES and DEPKIND.  */
+static void
+cache_run (gc_run_t run, const char **depfiles, int depkind)
+{
+  if (run->cached || run->err || run->exitcode == -1
+      || (run->kind == GC_RUN_LIST && run->exitcode)
+      || run->conf_file || run->version_only)
+    return;
+  gc_cache_put (run->kind, run->pgmname, run->exitcode,
+                run->output, run->outputlen, depfiles, depkind);
+}
+
+
+/* Write the cache back to its file.  Errors are only reported in
+   verbose mode because the cache is only an optimization.  */
+static void
+save_cache (void)
 {
   gpg_error_t err;
-  unsigned int result;
+
+  if (opt.dry_run)
+    return;
+  err = gc_cache_save ();
+  if (err && opt.verbose)
+    gc_error (0, 0, "warning: can not write cache file: %s",
+              gpg_strerror (err));
+}
+
+
+/* Complete the NRUNS runs in RUNS.  Runs for which a valid cache
+   entry exists take their output from the cache; all other programs
+   are started at once so that they run in parallel and their output
+   is then collected one after the other.  Each program writes only
+   to the one pipe we read from and thus this can't deadlock.  Runs
+   without a program name are skipped.  */
+static void
+run_programs (gc_run_t runs, int nruns)
+{
+  const char *output;
+  gc_run_t run;
+  const char *argv[4];
+  membuf_t mb;
+  char buffer[512];
+  size_t nread;
+  gpg_error_t err;
+  int i, n;
+
+  for (i=0; i < nruns; i++)
+    {
+      run = runs + i;
+      run->pid = (pid_t)(-1);
+      run->fp = NULL;
+      if (!run->pgmname)
+        continue;
+      if (run->conf_file || run->version_only)
+        output = NULL;
+      else
+        output = gc_cache_get (run->kind, run->pgmname,
+                               &run->exitcode, &run->outputlen);
+      if (output)
+        {
+          run->cached = 1;
+          run->output = (char*)output;
+          continue;
+        }
+
+      n = 0;
+      if (run->kind == GC_RUN_LIST)
+        argv[n++] = "--gpgconf-list";
+      else
+        {
+          if (run->conf_file)
+            {
+              argv[n++] = "--options";
+              argv[n++] = run->conf_file;
+            }
+          argv[n++] = run->version_only? "--version" : "--gpgconf-test";
+        }
+      argv[n] = NULL;
+
+      run->err = gnupg_spawn_process (run->pgmname, argv,
+                                      GPG_ERR_SOURCE_DEFAULT, NULL, 0, NULL,
+                                      run->kind == GC_RUN_LIST? &run->fp:NULL,
+                                      run->kind == GC_RUN_LIST? NULL:&run->fp,
+                                      &run->pid);
+      if (run->err)
+        run->exitcode = -1;
+    }
+
+  for (i=0; i < nruns; i++)
+    {
+      run = runs + i;
+      if (!run->pgmname || run->cached || run->err)
+        continue;
+
+      init_membuf (&mb, 1024);
+      while (!es_read (run->fp, buffer, sizeof buffer, &nread) && nread)
+        put_membuf (&mb, buffer, nread);
+      if (es_ferror (run->fp))
+        run->err = gpg_error_from_syserror ();
+      es_fclose (run->fp);
+      run->fp = NULL;
+      put_membuf (&mb, "", 1);
+      run->output = get_membuf (&mb, &run->outputlen);
+      if (!run->output)
+        gc_error (1, errno, "error reading from %s", run->pgmname);
+      run->outputlen--;
+
+      err = gnupg_wait_process (run->pgmname, run->pid, 1, &run->exitcode);
+      if (err && !run->err)
+        run->err = err;
+      gnupg_release_process (run->pid);
+      run->pid = (pid_t)(-1);
+    }
+}
+
+
+/* Release the resources of the NRUNS runs in RUNS.  */
+static void
+release_runs (gc_run_t runs, int nruns)
+{
+  int i;
+
+  for (i=0; i < nruns; i++)
+    {
+      if (!runs[i].cached)
+        xfree (runs[i].output);
+      runs[i].output = NULL;
+    }
+}
+
+
+/* Return a memory stream with the output of RUN.  */
+static estream_t
+run_output_stream (gc_run_t run)
+{
+  estream_t fp;
+
+  fp = es_fopenmem (0, "w+b");
+  if (!fp
+      || (run->outputlen && es_fwrite (run->output, run->outputlen, 1, fp) != 1)
+      || es_fseek (fp, 0, SEEK_SET))
+    gc_error (1, errno, "error buffering the output of %s", run->pgmname);
+  return fp;
+}
+
+
+/* Return the name of the program to run for checking the options of
+   COMPONENT or NULL if there is none.  */
+static const char *
+check_options_program (int component)
+{
   int backend_seen[GC_BACKEND_NR];
   gc_backend_t backend;
   gc_option_t *option;
-  const char *pgmname;
-  const char *argv[4];
-  int i;
-  pid_t pid;
-  int exitcode;
-  estream_t errfp;
-  error_line_t errlines;
 
   for (backend = 0; backend < GC_BACKEND_NR; backend++)
     backend_seen[backend] = 0;
@@ -1556,42 +1717,41 @@ gc_component_check_options (int component, estream_t out, const char *conf_file)
       break;
     }
   if (! option || ! option->name)
-    return 0;
+    return NULL;
 
-  pgmname = gnupg_module_name (gc_backend[backend].module_name);
-  i = 0;
-  if (conf_file)
-    {
-      argv[i++] = "--options";
-      argv[i++] = conf_file;
-    }
-  if (component == GC_COMPONENT_PINENTRY)
-    argv[i++] = "--version";
-  else
-    argv[i++] = "--gpgconf-test";
-  argv[i++] = NULL;
+  return gnupg_module_name (gc_backend[backend].module_name);
+}
+
+
+/* Evaluate the completed check RUN of COMPONENT and print the result
+   to OUT.  Returns 0 if everything is OK.  */
+static int
+check_options_result (int component, gc_run_t run, estream_t out)
+{
+  unsigned int result;
+  estream_t errfp;
+  error_line_t errlines;
 
   result = 0;
   errlines = NULL;
-  err = gnupg_spawn_process (pgmname, argv, GPG_ERR_SOURCE_DEFAULT, NULL, 0,
-                             NULL, NULL, &errfp, &pid);
-  if (err)
-    result |= 1; /* Program could not be run.  */
-  else
+  if (run->err || run->exitcode)
     {
-      errlines = collect_error_output (errfp,
-				       gc_component[component].name);
-      if (gnupg_wait_process (pgmname, pid, 1, &exitcode))
-	{
-	  if (exitcode == -1)
-	    result |= 1; /* Program could not be run or it
-			    terminated abnormally.  */
-	  result |= 2; /* Program returned an error.  */
-	}
-      gnupg_release_process (pid);
+      if (run->exitcode == -1)
+        result |= 1; /* Program could not be run or it
+                        terminated abnormally.  */
+      result |= 2; /* Program returned an error.  */
+    }
+  if (run->output)
+    {
+      errfp = run_output_stream (run);
+      errlines = collect_error_output (errfp, gc_component[component].name);
       es_fclose (errfp);
     }
 
+  /* The result depends on the same files as the option listing of
+     the program; thus we can only cache it if we know them.  */
+  cache_run (run, NULL, GC_RUN_LIST);
+
   /* If the program could not be run, we can't tell whether
      the config file is good.  */
   if (result & 1)
@@ -1606,7 +1766,7 @@ gc_component_check_options (int component, estream_t out, const char *conf_file)
       desc = my_dgettext (gc_component[component].desc_domain, desc);
       es_fprintf (out, "%s:%s:",
                   gc_component[component].name, gc_percent_escape (desc));
-      es_fputs (gc_percent_escape (pgmname), out);
+      es_fputs (gc_percent_escape (run->pgmname), out);
       es_fprintf (out, ":%d:%d:", !(result & 1), !(result & 2));
       for (errptr = errlines; errptr; errptr = errptr->next)
 	{
@@ -1635,15 +1795,58 @@ gc_component_check_options (int component, estream_t out, const char *conf_file)
 }
 
 
+/* Check the options of a single component.  Returns 0 if everything
+   is OK.  */
+int
+gc_component_check_options (int component, estream_t out, const char *conf_file)
+{
+  struct gc_run_s run;
+  int result;
+
+  memset (&run, 0, sizeof run);
+  run.kind = GC_RUN_TEST;
+  run.pgmname = check_options_program (component);
+  if (!run.pgmname)
+    return 0;
+  run.conf_file = conf_file;
+  run.version_only = (component == GC_COMPONENT_PINENTRY);
+
+  run_programs (&run, 1);
+  result = check_options_result (component, &run, out);
+  release_runs (&run, 1);
+  save_cache ();
+  return result;
+}
+
+
 
-/* Check all components that are available.  */
+/* Check all components that are available.  The programs are run in
+   parallel.  */
 void
 gc_check_programs (estream_t out)
 {
+  struct gc_run_s runs[GC_COMPONENT_NR];
+  int components[GC_COMPONENT_NR];
   gc_component_t component;
+  int i, nruns;
 
+  memset (runs, 0, sizeof runs);
+  nruns = 0;
   for (component = 0; component < GC_COMPONENT_NR; component++)
-    gc_component_check_options (component, out, NULL);
+    {
+      runs[nruns].kind = GC_RUN_TEST;
+      runs[nruns].pgmname = check_options_program (component);
+      if (!runs[nruns].pgmname)
+        continue;
+      runs[nruns].version_only = (component == GC_COMPONENT_PINENTRY);
+      components[nruns++] = component;
+    }
+
+  run_programs (runs, nruns);
+  for (i=0; i < nruns; i++)
+    check_options_result (components[i], runs + i, out);
+  release_runs (runs, nruns);
+  save_cache ();
 }
 
 
@@ -1889,36 +2092,44 @@ get_config_filename (gc_component_t component, gc_backend_t backend)
 }
 
 
+/* Return the name of the program for the program-type backend
+   BACKEND.  */
+static const char *
+backend_program (gc_backend_t backend)
+{
+  return (gc_backend[backend].module_name
+          ? gnupg_module_name (gc_backend[backend].module_name)
+          : gc_backend[backend].program );
+}
+
+
 /* Retrieve the options for the component COMPONENT from backend
-   BACKEND, which we already know is a program-type backend.  */
+   BACKEND, which we already know is a program-type backend.  RUN is
+   the completed run of the program with --gpgconf-list.  */
 static void
-retrieve_options_from_program (gc_component_t component, gc_backend_t backend)
+retrieve_options_from_program (gc_component_t component, gc_backend_t backend,
+                               gc_run_t run)
 {
-  gpg_error_t err;
-  const char *pgmname;
-  const char *argv[2];
+  const char *pgmname = run->pgmname;
   estream_t outfp;
-  int exitcode;
-  pid_t pid;
   char *line = NULL;
   size_t line_len = 0;
   ssize_t length;
   estream_t config;
   char *config_filename;
+  const char *depfiles[2];
 
-  pgmname = (gc_backend[backend].module_name
-             ? gnupg_module_name (gc_backend[backend].module_name)
-             : gc_backend[backend].program );
-  argv[0] = "--gpgconf-list";
-  argv[1] = NULL;
-
-  err = gnupg_spawn_process (pgmname, argv, GPG_ERR_SOURCE_DEFAULT, NULL, 0,
-                             NULL, &outfp, NULL, &pid);
-  if (err)
+  if (run->err && run->exitcode == -1 && !run->output)
     {
       gc_error (1, 0, "could not gather active options from '%s': %s",
-                pgmname, gpg_strerror (err));
+                pgmname, gpg_strerror (run->err));
     }
+  if (run->err || run->exitcode)
+    gc_error (1, 0, "running %s failed (exitcode=%d): %s",
+              pgmname, run->exitcode,
+              gpg_strerror (run->err? run->err : gpg_error (GPG_ERR_GENERAL)));
+
+  outfp = run_output_stream (run);
 
   while ((length = es_read_line (outfp, &line, &line_len, NULL)) > 0)
     {
@@ -1994,16 +2205,15 @@ retrieve_options_from_program (gc_component_t component, gc_backend_t backend)
   if (es_fclose (outfp))
     gc_error (1, errno, "error closing %s", pgmname);
 
-  err = gnupg_wait_process (pgmname, pid, 1, &exitcode);
-  if (err)
-    gc_error (1, 0, "running %s failed (exitcode=%d): %s",
-              pgmname, exitcode, gpg_strerror (err));
-  gnupg_release_process (pid);
-
 
   /* At this point, we can parse the configuration file.  */
   config_filename = get_config_filename (component, backend);
 
+  /* The listing depends on the configuration file.  */
+  depfiles[0] = config_filename;
+  depfiles[1] = NULL;
+  cache_run (run, depfiles, 0);
+
   config = es_fopen (config_filename, "r");
   if (!config)
     gc_error (0, errno, "warning: can not open config file %s",
@@ -2181,7 +2391,8 @@ retrieve_options_from_file (gc_component_t component, gc_backend_t backend)
 
 /* Retrieve the currently active options and their defaults from all
    involved backends for this component.  Using -1 for component will
-   retrieve all options from all components. */
+   retrieve all options from all components.  The programs of all
+   involved program-type backends are run in parallel.  */
 void
 gc_component_retrieve_options (int component)
 {
@@ -2189,6 +2400,10 @@ gc_component_retrieve_options (int component)
   int backend_seen[GC_BACKEND_NR];
   gc_backend_t backend;
   gc_option_t *option;
+  struct gc_run_s runs[GC_COMPONENT_NR * GC_BACKEND_NR];
+  gc_component_t run_component[DIM (runs)];
+  gc_backend_t run_backend[DIM (runs)];
+  int i, nruns;
 
   if (component == GC_COMPONENT_PINENTRY)
     return; /* Dummy module for now.  */
@@ -2203,6 +2418,8 @@ gc_component_retrieve_options (int component)
       assert (component < GC_COMPONENT_NR);
     }
 
+  memset (runs, 0, sizeof runs);
+  nruns = 0;
   do
     {
       option = gc_component[component].options;
@@ -2222,16 +2439,33 @@ gc_component_retrieve_options (int component)
 
               assert (backend != GC_BACKEND_ANY);
 
+              assert (nruns < DIM (runs));
+              run_component[nruns] = component;
+              run_backend[nruns] = backend;
               if (gc_backend[backend].program)
-                retrieve_options_from_program (component, backend);
-              else
-                retrieve_options_from_file (component, backend);
+                {
+                  runs[nruns].kind = GC_RUN_LIST;
+                  runs[nruns].pgmname = backend_program (backend);
+                }
+              nruns++;
             }
           option++;
         }
     }
   while (process_all && ++component < GC_COMPONENT_NR);
 
+  run_programs (runs, nruns);
+
+  for (i=0; i < nruns; i++)
+    {
+      if (gc_backend[run_backend[i]].program)
+        retrieve_options_from_program (run_component[i], run_backend[i],
+                                       runs + i);
+      else
+        retrieve_options_from_file (run_component[i], run_backend[i]);
+    }
+  release_runs (runs, nruns);
+  save_cache ();
 }
 
 
@@ -24,6 +24,7 @@
 #include <string.h>
 
 #include "gpgconf.h"
+#include "gpgconf-cache.h"
 #include "i18n.h"
 #include "sysutils.h"
 #include "../common/init.h"
@@ -41,6 +42,7 @@ enum cmd_and_opt_values
     oComponent  = 'c',
     oNoVerbose	= 500,
     oHomedir,
+    oUseCache,
 
     aListComponents,
     aCheckPrograms,
@@ -86,6 +88,7 @@ static ARGPARSE_OPTS opts[] =
     { oQuiet, "quiet",      0, N_("quiet") },
     { oDryRun, "dry-run",   0, N_("do not make any changes") },
     { oRuntime, "runtime",  0, N_("activate changes at runtime, if possible") },
+    { oUseCache, "use-cache", 0, N_("cache the output of the components") },
     /* hidden options */
     { oNoVerbose, "no-verbose",  0, "@"},
     {0}
@@ -175,6 +178,7 @@ main (int argc, char **argv)
 	  break;
         case oVerbose:   opt.verbose++; break;
         case oNoVerbose: opt.verbose = 0; break;
+        case oUseCache:  opt.use_cache = 1; break;
 
 	case aListDirs:
         case aListComponents:
@@ -198,6 +202,13 @@ main (int argc, char **argv)
   if (log_get_errorcount (0))
     exit (2);
 
+  if (opt.use_cache)
+    {
+      char *tmp = make_filename (default_homedir (), GC_CACHE_NAME, NULL);
+      gc_cache_set_file (tmp);
+      xfree (tmp);
+    }
+
   /* Print a warning if an argument looks like an option.  */
   if (!opt.quiet && !(pargs.flags & ARGPARSE_FLAG_STOP_SEEN))
     {
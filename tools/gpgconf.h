@@ -29,6 +29,7 @@ struct
   int quiet;		/* Be extra quiet.  */
   int dry_run;		/* Don't change any persistent data.  */
   int runtime;		/* Make changes active at runtime.  */
+  int use_cache;	/* Cache the output of the components.  */
   char *outfile;	/* Name of output file.  */
 
   int component;	/* The active component.  */
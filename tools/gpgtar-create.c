@@ -24,6 +24,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <dirent.h>
 #ifdef HAVE_W32_SYSTEM
 # define WIN32_LEAN_AND_MEAN
@@ -38,11 +39,16 @@
 #include "i18n.h"
 #include "../common/sysutils.h"
 #include "gpgtar.h"
+#include "../common/parallel.h"
 
 #ifndef HAVE_LSTAT
 #define lstat(a,b) stat ((a), (b))
 #endif
 
+/* The number of bytes of the following files we ask the kernel to
+   read ahead while writing a file.  */
+#define READAHEAD_SIZE (8*1024*1024)
+
 
 /* Object to control the file scanning.  */
 struct scanctrl_s;
@@ -131,7 +137,8 @@ fillup_entry_w32 (tar_header_t hdr)
 
 
 /* Given a fresh header object HDR with only the name field set, try
-   to gather all available info.  This is the POSIX version.  */
+   to gather all available info.  This is the POSIX version.  It does
+   not log anything and may thus be run by a worker thread.  */
 #ifndef HAVE_W32_SYSTEM
 static gpg_error_t
 fillup_entry_posix (tar_header_t hdr)
@@ -140,11 +147,7 @@ fillup_entry_posix (tar_header_t hdr)
   struct stat sbuf;
 
   if (lstat (hdr->name, &sbuf))
-    {
-      err = gpg_error_from_syserror ();
-      log_error ("error stat-ing '%s': %s\n", hdr->name, gpg_strerror (err));
-      return err;
-    }
+    return gpg_error_from_syserror ();
 
   if (S_ISREG (sbuf.st_mode))
     hdr->typeflag = TF_REGULAR;
@@ -211,14 +214,14 @@ fillup_entry_posix (tar_header_t hdr)
 #endif /*!HAVE_W32_SYSTEM*/
 
 
-/* Add a new entry.  The name of a director entry is ENTRYNAME; if
-   that is NULL, DNAME is the name of the directory itself.  Under
-   Windows ENTRYNAME shall have backslashes replaced by standard
-   slashes.  */
-static gpg_error_t
-add_entry (const char *dname, const char *entryname, scanctrl_t scanctrl)
+/* Allocate a new header object for a directory entry.  The name of
+   a directory entry is ENTRYNAME; if that is NULL, DNAME is the name
+   of the directory itself.  Under Windows ENTRYNAME shall have
+   backslashes replaced by standard slashes.  Returns NULL on
+   error.  */
+static tar_header_t
+new_entry (const char *dname, const char *entryname)
 {
-  gpg_error_t err;
   tar_header_t hdr;
   char *p;
   size_t dnamelen = strlen (dname);
@@ -228,7 +231,7 @@ add_entry (const char *dname, const char *entryname, scanctrl_t scanctrl)
   hdr = xtrycalloc (1, sizeof *hdr + dnamelen + 1
                     + (entryname? strlen (entryname) : 0) + 1);
   if (!hdr)
-    return gpg_error_from_syserror ();
+    return NULL;
 
   p = stpcpy (hdr->name, dname);
   if (entryname)
@@ -242,25 +245,79 @@ add_entry (const char *dname, const char *entryname, scanctrl_t scanctrl)
       if (hdr->name[dnamelen-1] == '/')
         hdr->name[dnamelen-1] = 0;
     }
+  return hdr;
+}
+
+
+/* Gather all available info for the fresh header object HDR.  */
+static gpg_error_t
+fillup_entry (tar_header_t hdr)
+{
 #ifdef HAVE_DOSISH_SYSTEM
-  err = fillup_entry_w32 (hdr);
+  return fillup_entry_w32 (hdr);
 #else
+  gpg_error_t err;
+
   err = fillup_entry_posix (hdr);
-#endif
   if (err)
+    log_error ("error stat-ing '%s': %s\n", hdr->name, gpg_strerror (err));
+  return err;
+#endif
+}
+
+
+/* Append the filled up header object HDR to the list of files.  */
+static void
+append_entry (tar_header_t hdr, scanctrl_t scanctrl)
+{
+  if (opt.verbose)
+    gpgtar_print_header (hdr, log_get_stream ());
+  *scanctrl->flist_tail = hdr;
+  scanctrl->flist_tail = &hdr->next;
+}
+
+
+/* Add a new entry.  See new_entry for the meaning of DNAME and
+   ENTRYNAME.  */
+static gpg_error_t
+add_entry (const char *dname, const char *entryname, scanctrl_t scanctrl)
+{
+  tar_header_t hdr;
+
+  hdr = new_entry (dname, entryname);
+  if (!hdr)
+    return gpg_error_from_syserror ();
+
+  if (fillup_entry (hdr))
     xfree (hdr);
   else
-    {
-      if (opt.verbose)
-        gpgtar_print_header (hdr, log_get_stream ());
-      *scanctrl->flist_tail = hdr;
-      scanctrl->flist_tail = &hdr->next;
-    }
+    append_entry (hdr, scanctrl);
 
   return 0;
 }
 
 
+#ifndef HAVE_W32_SYSTEM
+/* The job data used to stat the entries of a directory in parallel.  */
+struct fillup_job_s
+{
+  tar_header_t hdr;
+  gpg_error_t err;
+};
+
+
+/* The job function for gnupg_parallel_run.  Errors are only
+   recorded and logged by the caller after all jobs are done.  */
+static void
+fillup_job (void *opaque, unsigned int idx)
+{
+  struct fillup_job_s *jobs = opaque;
+
+  jobs[idx].err = fillup_entry_posix (jobs[idx].hdr);
+}
+#endif /*!HAVE_W32_SYSTEM*/
+
+
 static gpg_error_t
 scan_directory (const char *dname, scanctrl_t scanctrl)
 {
@@ -358,6 +415,10 @@ scan_directory (const char *dname, scanctrl_t scanctrl)
 #else /*!HAVE_W32_SYSTEM*/
   DIR *dir;
   struct dirent *de;
+  struct fillup_job_s *jobs = NULL;
+  size_t njobs = 0;
+  size_t jobssize = 0;
+  size_t idx;
 
   if (!*dname)
     return 0;  /* An empty directory name has no entries.  */
@@ -371,17 +432,56 @@ scan_directory (const char *dname, scanctrl_t scanctrl)
       return err;
     }
 
+  /* First collect the names and then stat them in parallel; on a
+     cold cache or a network filesystem the latency of the stat calls
+     determines the scanning time.  The entries are appended in the
+     order returned by readdir.  */
   while ((de = readdir (dir)))
     {
       if (!strcmp (de->d_name, "." ) || !strcmp (de->d_name, ".."))
         continue; /* Skip self and parent dir entry.  */
 
-      err = add_entry (dname, de->d_name, scanctrl);
-      if (err)
-        goto leave;
+      if (njobs == jobssize)
+        {
+          struct fillup_job_s *tmp;
+
+          jobssize += 256;
+          tmp = xtryrealloc (jobs, jobssize * sizeof *jobs);
+          if (!tmp)
+            {
+              err = gpg_error_from_syserror ();
+              goto leave;
+            }
+          jobs = tmp;
+        }
+      jobs[njobs].hdr = new_entry (dname, de->d_name);
+      if (!jobs[njobs].hdr)
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+      njobs++;
      }
 
+  gnupg_parallel_run (opt.worker_threads, njobs, fillup_job, jobs);
+
+  for (idx=0; idx < njobs; idx++)
+    {
+      if (jobs[idx].err)
+        {
+          log_error ("error stat-ing '%s': %s\n",
+                     jobs[idx].hdr->name, gpg_strerror (jobs[idx].err));
+          xfree (jobs[idx].hdr);
+        }
+      else
+        append_entry (jobs[idx].hdr, scanctrl);
+      jobs[idx].hdr = NULL;
+    }
+
  leave:
+  for (idx=0; idx < njobs; idx++)
+    xfree (jobs[idx].hdr);
+  xfree (jobs);
   closedir (dir);
 #endif /*!HAVE_W32_SYSTEM*/
   return err;
@@ -645,13 +745,17 @@ build_header (void *record, tar_header_t hdr)
 }
 
 
+/* Write the header and the data of the file described by HDR to
+   STREAM.  BUFFER is a caller provided buffer of size COPYBUFSIZE
+   used to copy the data in large chunks.  */
 static gpg_error_t
-write_file (estream_t stream, tar_header_t hdr)
+write_file (estream_t stream, tar_header_t hdr, char *buffer)
 {
   gpg_error_t err;
   char record[RECORDSIZE];
   estream_t infp;
-  size_t nread, nbytes;
+  unsigned long long left;
+  size_t nread, nbytes, padding;
   int any;
 
   err = build_header (record, hdr);
@@ -675,6 +779,9 @@ write_file (estream_t stream, tar_header_t hdr)
                      hdr->name, gpg_strerror (err));
           return err;
         }
+      /* We read in large chunks anyway; thus the stream's own buffer
+         would only add a copy.  */
+      es_setvbuf (infp, NULL, _IONBF, 0);
     }
   else
     infp = NULL;
@@ -687,12 +794,10 @@ write_file (estream_t stream, tar_header_t hdr)
     {
       hdr->nrecords = (hdr->size + RECORDSIZE-1)/RECORDSIZE;
       any = 0;
-      while (hdr->nrecords--)
+      for (left = hdr->size; left; left -= nbytes)
         {
-          nbytes = hdr->nrecords? RECORDSIZE : (hdr->size % RECORDSIZE);
-          if (!nbytes)
-            nbytes = RECORDSIZE;
-          nread = es_fread (record, 1, nbytes, infp);
+          nbytes = left < COPYBUFSIZE? (size_t)left : COPYBUFSIZE;
+          nread = es_fread (buffer, 1, nbytes, infp);
           if (nread != nbytes)
             {
               err = gpg_error_from_syserror ();
@@ -702,9 +807,17 @@ write_file (estream_t stream, tar_header_t hdr)
               goto leave;
             }
           any = 1;
-          err = write_record (stream, record);
-          if (err)
-            goto leave;
+          /* Pad the last record with zeroes.  */
+          padding = (RECORDSIZE - (nbytes % RECORDSIZE)) % RECORDSIZE;
+          memset (buffer + nbytes, 0, padding);
+          if (es_fwrite (buffer, 1, nbytes + padding, stream)
+              != nbytes + padding)
+            {
+              err = gpg_error_from_syserror ();
+              log_error ("error writing '%s': %s\n",
+                         es_fname_get (stream), gpg_strerror (err));
+              goto leave;
+            }
         }
       nread = es_fread (record, 1, 1, infp);
       if (nread)
@@ -721,6 +834,39 @@ write_file (estream_t stream, tar_header_t hdr)
 }
 
 
+/* Return the number of bytes of the file HDR to read ahead.  */
+static size_t
+readahead_length (tar_header_t hdr)
+{
+  if (hdr->typeflag != TF_REGULAR)
+    return 0;
+  return hdr->size < READAHEAD_SIZE? (size_t)hdr->size : READAHEAD_SIZE;
+}
+
+
+/* Ask the kernel to start reading the first bytes of the file HDR
+   into the cache so that they are available when we come to that
+   file.  */
+static void
+readahead_file (tar_header_t hdr)
+{
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+  size_t len = readahead_length (hdr);
+  int fd;
+
+  if (!len)
+    return;
+  fd = open (hdr->name, O_RDONLY);
+  if (fd == -1)
+    return;  /* We will see the error when writing the file.  */
+  posix_fadvise (fd, 0, len, POSIX_FADV_WILLNEED);
+  close (fd);
+#else
+  (void)hdr;
+#endif
+}
+
+
 static gpg_error_t
 write_eof_mark (estream_t stream)
 {
@@ -738,15 +884,20 @@ write_eof_mark (estream_t stream)
 
 /* Create a new tarball using the names in the array INPATTERN.  If
    INPATTERN is NULL take the pattern as null terminated strings from
-   stdin.  */
-void
-gpgtar_create (char **inpattern)
+   stdin.  If OUTSTREAM is not NULL the tarball is written to that
+   stream, which is not closed; otherwise it is written to the file
+   given by --output or to stdout.  */
+gpg_error_t
+gpgtar_create (char **inpattern, estream_t outstream)
 {
   gpg_error_t err = 0;
   struct scanctrl_s scanctrl_buffer;
   scanctrl_t scanctrl = &scanctrl_buffer;
   tar_header_t hdr, *start_tail;
-  estream_t outstream = NULL;
+  tar_header_t ahead;
+  size_t ahead_len;
+  char *buffer = NULL;
+  int own_outstream = !outstream;
   int eof_seen = 0;
 
   if (!inpattern)
@@ -841,7 +992,17 @@ gpgtar_create (char **inpattern)
       xfree (pat);
     }
 
-  if (opt.outfile)
+  buffer = xtrymalloc (COPYBUFSIZE);
+  if (!buffer)
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("memory allocation problem: %s\n", gpg_strerror (err));
+      goto leave;
+    }
+
+  if (!own_outstream)
+    ;
+  else if (opt.outfile)
     {
       if (!strcmp (opt.outfile, "-"))
         outstream = es_stdout;
@@ -863,36 +1024,61 @@ gpgtar_create (char **inpattern)
   if (outstream == es_stdout)
     es_set_binary (es_stdout);
 
+  /* While writing a file we keep the kernel reading ahead the next
+     files up to a total of READAHEAD_SIZE bytes.  AHEAD is the next
+     file to read ahead and AHEAD_LEN the number of bytes requested
+     for the files not yet written.  */
+  ahead = scanctrl->flist;
+  ahead_len = 0;
   for (hdr = scanctrl->flist; hdr; hdr = hdr->next)
     {
-      err = write_file (outstream, hdr);
+      for (; ahead && ahead_len < READAHEAD_SIZE; ahead = ahead->next)
+        {
+          readahead_file (ahead);
+          ahead_len += readahead_length (ahead);
+        }
+      err = write_file (outstream, hdr, buffer);
       if (err)
         goto leave;
+      ahead_len -= readahead_length (hdr);
     }
   err = write_eof_mark (outstream);
 
  leave:
-  if (!err)
+  if (!own_outstream)
     {
-      if (outstream != es_stdout)
-        err = es_fclose (outstream);
-      else
+      if (!err)
         err = es_fflush (outstream);
-      outstream = NULL;
+      if (err)
+        log_error ("creating tarball '%s' failed: %s\n",
+                   es_fname_get (outstream), gpg_strerror (err));
     }
-  if (err)
+  else
     {
-      log_error ("creating tarball '%s' failed: %s\n",
-                 es_fname_get (outstream), gpg_strerror (err));
-      if (outstream && outstream != es_stdout)
-        es_fclose (outstream);
-      if (opt.outfile)
-        gnupg_remove (opt.outfile);
+      if (!err)
+        {
+          if (outstream != es_stdout)
+            err = es_fclose (outstream);
+          else
+            err = es_fflush (outstream);
+          outstream = NULL;
+        }
+      if (err)
+        {
+          log_error ("creating tarball '%s' failed: %s\n",
+                     es_fname_get (outstream), gpg_strerror (err));
+          if (outstream && outstream != es_stdout)
+            es_fclose (outstream);
+          if (opt.outfile)
+            gnupg_remove (opt.outfile);
+        }
     }
+  xfree (buffer);
   scanctrl->flist_tail = NULL;
   while ( (hdr = scanctrl->flist) )
     {
       scanctrl->flist = hdr->next;
       xfree (hdr);
     }
+  return err;
 }
@@ -260,16 +260,27 @@ create_directory (const char *dirprefix)
 
 
 
-void
-gpgtar_extract (const char *filename)
+/* Extract the tarball FILENAME or, if FILENAME is NULL, the tarball
+   read from stdin.  If STREAM is not NULL the tarball is read from
+   that stream, which is not closed, and FILENAME is only used to
+   derive the name of the extract directory.  If R_DIRNAME is not
+   NULL the name of the extract directory is stored there; the caller
+   must free it.  */
+gpg_error_t
+gpgtar_extract (const char *filename, estream_t stream, char **r_dirname)
 {
-  gpg_error_t err;
-  estream_t stream;
+  gpg_error_t err = 0;
   tar_header_t header = NULL;
   const char *dirprefix = NULL;
   char *dirname = NULL;
+  int own_stream = !stream;
 
-  if (filename)
+  if (r_dirname)
+    *r_dirname = NULL;
+
+  if (!own_stream)
+    ;
+  else if (filename)
     {
       if (!strcmp (filename, "-"))
         stream = es_stdout;
@@ -279,7 +290,7 @@ gpgtar_extract (const char *filename)
         {
           err = gpg_error_from_syserror ();
           log_error ("error opening '%s': %s\n", filename, gpg_strerror (err));
-          return;
+          return err;
         }
     }
   else
@@ -324,7 +335,8 @@ gpgtar_extract (const char *filename)
       if (!header)
         goto leave;
 
-      if (extract (stream, dirname, header))
+      err = extract (stream, dirname, header);
+      if (err)
         goto leave;
       xfree (header);
       header = NULL;
@@ -333,8 +345,11 @@ gpgtar_extract (const char *filename)
 
  leave:
   xfree (header);
-  xfree (dirname);
-  if (stream != es_stdin)
+  if (r_dirname)
+    *r_dirname = dirname;
+  else
+    xfree (dirname);
+  if (own_stream && stream != es_stdin)
     es_fclose (stream);
-  return;
+  return err;
 }
@@ -265,15 +265,18 @@ print_header (tar_header_t header, estream_t out)
 
 
 /* List the tarball FILENAME or, if FILENAME is NULL, the tarball read
-   from stdin.  */
-void
-gpgtar_list (const char *filename)
+   from stdin.  If STREAM is not NULL the tarball is read from that
+   stream, which is not closed.  */
+gpg_error_t
+gpgtar_list (const char *filename, estream_t stream)
 {
-  gpg_error_t err;
-  estream_t stream;
+  gpg_error_t err = 0;
   tar_header_t header;
+  int own_stream = !stream;
 
-  if (filename)
+  if (!own_stream)
+    ;
+  else if (filename)
     {
       if (!strcmp (filename, "-"))
         stream = es_stdout;
@@ -283,7 +286,7 @@ gpgtar_list (const char *filename)
         {
           err = gpg_error_from_syserror ();
           log_error ("error opening '%s': %s\n", filename, gpg_strerror (err));
-          return;
+          return err;
         }
     }
   else
@@ -301,7 +304,10 @@ gpgtar_list (const char *filename)
       print_header (header, es_stdout);
       
       if (skip_data (stream, header))
-        goto leave;
+        {
+          err = gpg_error (GPG_ERR_GENERAL);
+          goto leave;
+        }
       xfree (header);
       header = NULL;
     }
@@ -309,9 +315,9 @@ gpgtar_list (const char *filename)
 
  leave:
   xfree (header);
-  if (stream != es_stdin)
+  if (own_stream && stream != es_stdin)
     es_fclose (stream);
-  return;
+  return err;
 }
 
 tar_header_t
@@ -32,10 +32,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <signal.h>
+#ifndef HAVE_W32_SYSTEM
+# include <unistd.h>
+#endif
 
 #include "util.h"
 #include "i18n.h"
 #include "sysutils.h"
+#include "exechelp.h"
 #include "../common/openpgpdefs.h"
 #include "../common/init.h"
 
@@ -65,7 +70,9 @@ enum cmd_and_opt_values
     oOpenPGP,
     oCMS,
     oSetFilename,
-    oNull
+    oNull,
+    oWorkerThreads,
+    oGpgProgram
   };
 
 
@@ -92,15 +99,18 @@ static ARGPARSE_OPTS opts[] = {
   ARGPARSE_s_s (oFilesFrom, "files-from",
                 N_("|FILE|get names to create from FILE")),
   ARGPARSE_s_n (oNull, "null", N_("-T reads null-terminated names")),
+  ARGPARSE_s_i (oWorkerThreads, "worker-threads",
+                N_("|N|use N threads to scan directories")),
   ARGPARSE_s_n (oOpenPGP, "openpgp", "@"),
   ARGPARSE_s_n (oCMS, "cms", "@"),
+  ARGPARSE_s_s (oGpgProgram, "gpg", "@"),
 
   ARGPARSE_end ()
 };
 
 
 
-static void tar_and_encrypt (char **inpattern);
+static void tar_and_encrypt (char **inpattern, enum cmd_and_opt_values cmd);
 static void decrypt_and_untar (const char *fname);
 static void decrypt_and_list (const char *fname);
 
@@ -180,6 +190,10 @@ main (int argc, char **argv)
   i18n_init();
   init_common_subsystems (&argc, &argv);
 
+  /* Scanning a directory is bound by the latency of the stat calls
+     and not by the CPU; a few threads are sufficient.  */
+  opt.worker_threads = 4;
+
   /* Parse the command line. */
   pargs.argc  = &argc;
   pargs.argv  = &argv;
@@ -193,8 +207,12 @@ main (int argc, char **argv)
 	case oQuiet:     opt.quiet = 1; break;
         case oVerbose:   opt.verbose++; break;
         case oNoVerbose: opt.verbose = 0; break;
+        case oRecipient: add_to_strlist (&opt.recipients, pargs.r.ret_str); break;
+        case oUser:      opt.user = pargs.r.ret_str; break;
         case oFilesFrom: files_from = pargs.r.ret_str; break;
         case oNull: null_names = 1; break;
+        case oWorkerThreads: opt.worker_threads = pargs.r.ret_int; break;
+        case oGpgProgram: opt.gpg_program = pargs.r.ret_str; break;
 
 	case aList:
         case aDecrypt:
@@ -227,6 +245,12 @@ main (int argc, char **argv)
   if (log_get_errorcount (0))
     exit (2);
 
+#ifndef HAVE_W32_SYSTEM
+  /* We write to and read from pipes connected to gpg; a failing gpg
+   shall not terminate us silently.  */
+  signal (SIGPIPE, SIG_IGN);
+#endif
+
   /* Print a warning if an argument looks like an option.  */
   if (!opt.quiet && !(pargs.flags & ARGPARSE_FLAG_STOP_SEEN))
     {
@@ -248,21 +272,23 @@ main (int argc, char **argv)
       if (files_from)
         log_info ("note: ignoring option --files-from\n");
       if (skip_crypto)
-        gpgtar_list (fname);
+        gpgtar_list (fname, NULL);
       else
         decrypt_and_list (fname);
       break;
 
     case aEncrypt:
+    case aSign:
+    case aSignEncrypt:
       if ((!argc && !null_names)
           || (argc && null_names))
         usage (1);
       if (opt.filename)
         log_info ("note: ignoring option --set-filename\n");
       if (skip_crypto)
-        gpgtar_create (null_names? NULL :argv);
+        gpgtar_create (null_names? NULL :argv, NULL);
       else
-        tar_and_encrypt (null_names? NULL : argv);
+        tar_and_encrypt (null_names? NULL : argv, cmd);
       break;
 
     case aDecrypt:
@@ -274,7 +300,7 @@ main (int argc, char **argv)
         log_info ("note: ignoring option --files-from\n");
       fname = argc ? *argv : NULL;
       if (skip_crypto)
-        gpgtar_extract (fname);
+        gpgtar_extract (fname, NULL, NULL);
       else
         decrypt_and_untar (fname);
       break;
@@ -382,27 +408,252 @@ openpgp_message_p (estream_t fp)
 
 
 
+/* Start gpg to process the data for CMD.  INFD is connected to the
+   stdin and OUTFD to the stdout of gpg; FNAME, if not NULL, is the
+   name of the input file given to gpg.  On success the process id of
+   gpg is stored at R_PID.  */
+static gpg_error_t
+start_gpg (enum cmd_and_opt_values cmd, const char *fname,
+           int infd, int outfd, pid_t *r_pid)
+{
+  gpg_error_t err;
+  const char *pgmname;
+  const char **argv;
+  strlist_t sl;
+  int i;
+
+  if (opt.gpg_program && *opt.gpg_program)
+    pgmname = opt.gpg_program;
+  else
+    pgmname = gnupg_module_name (GNUPG_MODULE_NAME_GPG);
+
+  i = 13;
+  for (sl = opt.recipients; sl; sl = sl->next)
+    i += 2;
+  argv = xtrycalloc (i, sizeof *argv);
+  if (!argv)
+    return gpg_error_from_syserror ();
+
+  i = 0;
+  argv[i++] = "--batch";
+  if (opt.verbose)
+    argv[i++] = "--verbose";
+  else if (opt.quiet)
+    argv[i++] = "--quiet";
+  if (cmd == aDecrypt || cmd == aList)
+    argv[i++] = "--decrypt";
+  else
+    {
+      if (cmd == aEncrypt || cmd == aSignEncrypt)
+        {
+          if (opt.recipients || !opt.symmetric)
+            argv[i++] = "--encrypt";
+          if (opt.symmetric)
+            argv[i++] = "--symmetric";
+        }
+      if (cmd == aSign || cmd == aSignEncrypt)
+        argv[i++] = "--sign";
+      if (opt.outfile && strcmp (opt.outfile, "-"))
+        {
+          argv[i++] = "--yes";
+          argv[i++] = "--output";
+          argv[i++] = opt.outfile;
+        }
+    }
+  if (opt.user)
+    {
+      argv[i++] = "--local-user";
+      argv[i++] = opt.user;
+    }
+  for (sl = opt.recipients; sl; sl = sl->next)
+    {
+      argv[i++] = "--recipient";
+      argv[i++] = sl->d;
+    }
+  argv[i++] = "--";
+  if (fname)
+    argv[i++] = fname;
+  argv[i] = NULL;
+
+  err = gnupg_spawn_process_fd (pgmname, argv, infd, outfd,
+                                es_fileno (es_stderr), r_pid);
+  if (err)
+    log_error ("error spawning '%s': %s\n", pgmname, gpg_strerror (err));
+  xfree (argv);
+  return err;
+}
+
+
+/* Wait for gpg started by start_gpg to terminate.  If DO_KILL is set
+   gpg is terminated first.  A diagnostic is printed on error.  */
+static gpg_error_t
+wait_gpg (pid_t pid, int do_kill)
+{
+  gpg_error_t err;
+
+  if (do_kill)
+    gnupg_kill_process (pid);
+  err = gnupg_wait_process (gnupg_module_name (GNUPG_MODULE_NAME_GPG),
+                            pid, 1, NULL);
+  gnupg_release_process (pid);
+  return err;
+}
+
+
+/* Create a tarball from INPATTERN and pipe it through gpg for CMD.
+   The tarball is never written to a file but streamed in chunks of
+   COPYBUFSIZE to gpg which writes the result to --output or to
+   stdout.  */
 static void
-tar_and_encrypt (char **inpattern)
+tar_and_encrypt (char **inpattern, enum cmd_and_opt_values cmd)
 {
-  (void)inpattern;
-  log_error ("tar_and_encrypt has not yet been implemented\n");
+  gpg_error_t err;
+  int fds[2];
+  int outfd;
+  pid_t pid;
+  estream_t outstream;
+
+  err = gnupg_create_outbound_pipe (fds);
+  if (err)
+    {
+      log_error (_("error creating a pipe: %s\n"), gpg_strerror (err));
+      return;
+    }
+
+  if (opt.outfile && strcmp (opt.outfile, "-"))
+    outfd = -1;
+  else
+    {
+      es_fflush (es_stdout);
+      outfd = es_fileno (es_stdout);
+    }
+
+  err = start_gpg (cmd, NULL, fds[0], outfd, &pid);
+  close (fds[0]);
+  if (err)
+    {
+      close (fds[1]);
+      return;
+    }
+
+  outstream = es_fdopen (fds[1], "wb");
+  if (!outstream)
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error opening pipe to gpg: %s\n", gpg_strerror (err));
+      close (fds[1]);
+    }
+  else
+    {
+      es_setvbuf (outstream, NULL, _IOFBF, COPYBUFSIZE);
+      err = gpgtar_create (inpattern, outstream);
+      /* Kill gpg before it sees the EOF so that a failed tarball is
+         not turned into a valid looking archive.  */
+      if (err)
+        gnupg_kill_process (pid);
+      if (es_fclose (outstream) && !err)
+        {
+          err = gpg_error_from_syserror ();
+          log_error ("error writing to gpg: %s\n", gpg_strerror (err));
+        }
+    }
+
+  if (wait_gpg (pid, !!err) && !err)
+    err = gpg_error (GPG_ERR_GENERAL);
+  if (err && opt.outfile && strcmp (opt.outfile, "-"))
+    gnupg_remove (opt.outfile);
+}
+
+
+
+/* Run gpg to decrypt FNAME or stdin and read the tarball directly
+   from its output.  If LIST_ONLY is set the content is listed,
+   otherwise it is extracted.  */
+static void
+decrypt_and_process (const char *fname, int list_only)
+{
+  gpg_error_t err;
+  int fds[2];
+  int infd;
+  pid_t pid;
+  estream_t stream;
+  char *buffer;
+  char *dirname = NULL;
+
+  err = gnupg_create_inbound_pipe (fds);
+  if (err)
+    {
+      log_error (_("error creating a pipe: %s\n"), gpg_strerror (err));
+      return;
+    }
+
+  if (fname && !strcmp (fname, "-"))
+    fname = NULL;
+  infd = fname? -1 : es_fileno (es_stdin);
+
+  err = start_gpg (list_only? aList : aDecrypt, fname, infd, fds[1], &pid);
+  close (fds[1]);
+  if (err)
+    {
+      close (fds[0]);
+      return;
+    }
+
+  stream = es_fdopen (fds[0], "rb");
+  if (!stream)
+    {
+      err = gpg_error_from_syserror ();
+      log_error ("error opening pipe from gpg: %s\n", gpg_strerror (err));
+      close (fds[0]);
+    }
+  else
+    {
+      es_setvbuf (stream, NULL, _IOFBF, COPYBUFSIZE);
+      if (list_only)
+        err = gpgtar_list (fname, stream);
+      else
+        err = gpgtar_extract (fname, stream, &dirname);
+
+      /* Consume the rest of the output so that gpg is able to finish
+         its integrity checks.  */
+      if (!err && (buffer = xtrymalloc (COPYBUFSIZE)))
+        {
+          while (es_fread (buffer, 1, COPYBUFSIZE, stream))
+            ;
+          xfree (buffer);
+        }
+      es_fclose (stream);
+    }
+
+  /* The tarball has been processed while gpg was still decrypting
+     it; only now we know whether it passed the integrity check.  A
+     failure is logged by wait_gpg and thus yields an error exit
+     status.  */
+  if (wait_gpg (pid, !!err) && !err)
+    {
+      if (dirname)
+        log_error (_("WARNING: the archive failed the integrity check;"
+                     " the files extracted to '%s/' must not be trusted\n"),
+                   dirname);
+      else if (list_only)
+        log_error (_("WARNING: the archive failed the integrity check;"
+                     " the listing must not be trusted\n"));
+      else
+        log_error ("decrypting the archive failed\n");
+    }
+  xfree (dirname);
 }
 
 
-
 static void
 decrypt_and_untar (const char *fname)
 {
-  (void)fname;
-  log_error ("decrypt_and_untar has not yet been implemented\n");
+  decrypt_and_process (fname, 0);
 }
 
 
-
 static void
 decrypt_and_list (const char *fname)
 {
-  (void)fname;
-  log_error ("decrypt_and_list has not yet been implemented\n");
+  decrypt_and_process (fname, 1);
 }
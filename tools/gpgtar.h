@@ -29,17 +29,26 @@ struct
   int quiet;
   const char *outfile;
   int symmetric;
+  strlist_t recipients;
+  const char *user;
   const char *filename;
+  int worker_threads;
+  const char *gpg_program;
 } opt;
 
 
-/* The size of a tar record.  All IO is done in chunks of this size.
+/* The size of a tar record.  All IO is done in multiples of this size.
    Note that we don't care about blocking because this version of tar
    is not expected to be used directly on a tape drive in fact it is
    used in a pipeline with GPG and thus any blocking would be
    useless.  */
 #define RECORDSIZE 512 
 
+/* The size of the buffer used to copy file data and of the stream
+   buffers for the pipes to and from gpg.  Must be a multiple of
+   RECORDSIZE.  */
+#define COPYBUFSIZE (128 * RECORDSIZE)
+
 
 /* Description of the USTAR header format.  */
 struct ustar_raw_header
@@ -111,13 +120,14 @@ gpg_error_t read_record (estream_t stream, void *record);
 gpg_error_t write_record (estream_t stream, const void *record);
 
 /*-- gpgtar-create.c --*/
-void gpgtar_create (char **inpattern);
+gpg_error_t gpgtar_create (char **inpattern, estream_t outstream);
 
 /*-- gpgtar-extract.c --*/
-void gpgtar_extract (const char *filename);
+gpg_error_t gpgtar_extract (const char *filename, estream_t stream,
+                            char **r_dirname);
 
 /*-- gpgtar-list.c --*/
-void gpgtar_list (const char *filename);
+gpg_error_t gpgtar_list (const char *filename, estream_t stream);
 tar_header_t gpgtar_read_header (estream_t stream);
 void gpgtar_print_header (tar_header_t header, estream_t out);
 
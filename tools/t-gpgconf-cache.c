@@ -0,0 +1,235 @@
+/* t-gpgconf-cache.c - Module test for gpgconf-cache.c
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "util.h"
+#include "gpgconf-cache.h"
+
+#define pass()  do { ; } while(0)
+#define fail(a)  do { fprintf (stderr, "%s:%d: test %d failed\n",\
+                               __FILE__,__LINE__, (a));          \
+                     errcount++;                                 \
+                   } while(0)
+
+#define PGMNAME   "t-gpgconf-cache.pgm"
+#define PGM2NAME  "t-gpgconf-cache.pg2"
+#define CONFNAME  "t-gpgconf-cache.conf"
+#define CACHENAME "t-gpgconf-cache.tmp"
+
+static int errcount;
+
+
+/* Write STRING to the file FNAME and set its modification time to
+   AGE seconds in the past.  */
+static void
+make_file (const char *fname, const char *string, int age)
+{
+  FILE *fp;
+  struct utimbuf ut;
+
+  fp = fopen (fname, "w");
+  if (!fp || fputs (string, fp) == EOF || fclose (fp))
+    {
+      fprintf (stderr, "error writing '%s'\n", fname);
+      exit (1);
+    }
+  ut.actime = ut.modtime = time (NULL) - age;
+  if (utime (fname, &ut))
+    {
+      fprintf (stderr, "error setting the time of '%s'\n", fname);
+      exit (1);
+    }
+}
+
+
+/* Return true if the file FNAME contains STRING.  */
+static int
+file_contains (const char *fname, const char *string)
+{
+  FILE *fp;
+  char buffer[1024];
+  size_t n;
+
+  fp = fopen (fname, "r");
+  if (!fp)
+    return 0;
+  n = fread (buffer, 1, sizeof buffer - 1, fp);
+  fclose (fp);
+  buffer[n] = 0;
+  return !!strstr (buffer, string);
+}
+
+
+/* Check that the cache has an entry of KIND with OUTPUT and
+   EXITCODE; an OUTPUT of NULL checks that there is no entry.  The
+   cache is first read again from the file.  */
+static void
+check_entry (int testno, int kind, const char *output, int exitcode)
+{
+  const char *s;
+  size_t len;
+  int rc;
+
+  gc_cache_release ();
+  s = gc_cache_get (kind, PGMNAME, &rc, &len);
+  if (!output)
+    {
+      if (s)
+        fail (testno);
+    }
+  else if (!s || len != strlen (output) || memcmp (s, output, len)
+           || rc != exitcode)
+    fail (testno);
+  else
+    pass ();
+}
+
+
+/* Fill the cache with a listing depending on the config file and a
+   test result depending on the same files.  */
+static void
+fill_cache (int testno)
+{
+  const char *depfiles[2] = { CONFNAME, NULL };
+
+  gc_cache_release ();
+  gc_cache_put (GC_RUN_LIST, PGMNAME, 0, "a:1\nb:2\n", 8, depfiles, 0);
+  gc_cache_put (GC_RUN_TEST, PGMNAME, 1, "bad\nline", 8, NULL, GC_RUN_LIST);
+  if (gc_cache_save ())
+    fail (testno);
+}
+
+
+static void
+test_cache (void)
+{
+  const char *depfiles[2] = { CONFNAME, NULL };
+  const char *s;
+  size_t len;
+  int rc;
+
+  remove (CACHENAME);
+  make_file (PGMNAME, "program", 100);
+  make_file (CONFNAME, "option", 100);
+
+  /* Without a file the cache is disabled.  */
+  gc_cache_set_file (NULL);
+  gc_cache_put (GC_RUN_LIST, PGMNAME, 0, "x", 1, depfiles, 0);
+  if (gc_cache_get (GC_RUN_LIST, PGMNAME, &rc, &len))
+    fail (1);
+  if (gc_cache_save ())
+    fail (1);
+
+  gc_cache_set_file (CACHENAME);
+
+  /* A lookup alone must not create the file.  */
+  if (gc_cache_get (GC_RUN_LIST, PGMNAME, &rc, &len))
+    fail (2);
+  if (gc_cache_save () || !access (CACHENAME, F_OK))
+    fail (2);
+
+  /* The test result can't be cached without a listing.  */
+  gc_cache_put (GC_RUN_TEST, PGMNAME, 0, "x", 1, NULL, GC_RUN_LIST);
+  s = gc_cache_get (GC_RUN_TEST, PGMNAME, &rc, &len);
+  if (s)
+    fail (3);
+
+  /* Entries survive a round trip through the file; this includes an
+     unterminated last line.  */
+  fill_cache (4);
+  check_entry (4, GC_RUN_LIST, "a:1\nb:2\n", 0);
+  check_entry (4, GC_RUN_TEST, "bad\nline", 1);
+
+  /* A changed config file invalidates both entries.  */
+  make_file (CONFNAME, "option2", 100);
+  check_entry (5, GC_RUN_LIST, NULL, 0);
+  check_entry (5, GC_RUN_TEST, NULL, 0);
+
+  /* Even if only the modification time changed.  */
+  fill_cache (6);
+  check_entry (6, GC_RUN_LIST, "a:1\nb:2\n", 0);
+  make_file (CONFNAME, "option2", 50);
+  check_entry (6, GC_RUN_LIST, NULL, 0);
+  check_entry (6, GC_RUN_TEST, NULL, 0);
+
+  /* A removed config file invalidates the entries too.  */
+  fill_cache (7);
+  remove (CONFNAME);
+  check_entry (7, GC_RUN_LIST, NULL, 0);
+  make_file (CONFNAME, "option", 100);
+
+  /* A changed program invalidates the entries.  */
+  fill_cache (8);
+  check_entry (8, GC_RUN_LIST, "a:1\nb:2\n", 0);
+  make_file (PGMNAME, "program2", 100);
+  check_entry (8, GC_RUN_LIST, NULL, 0);
+  check_entry (8, GC_RUN_TEST, NULL, 0);
+
+  /* Stale entries are not written back.  */
+  fill_cache (9);
+  make_file (PGMNAME, "program33", 100);
+  make_file (PGM2NAME, "program", 100);
+  check_entry (9, GC_RUN_LIST, NULL, 0);
+  gc_cache_put (GC_RUN_LIST, PGM2NAME, 0, "x", 1, NULL, 0);
+  if (gc_cache_save ())
+    fail (9);
+  if (!file_contains (CACHENAME, ":" PGM2NAME "\n")
+      || file_contains (CACHENAME, ":" PGMNAME "\n"))
+    fail (9);
+  make_file (PGMNAME, "program", 100);
+
+  /* A recently modified file is not cached because a change in the
+     same second would go unnoticed.  */
+  make_file (CONFNAME, "option", 0);
+  fill_cache (10);
+  check_entry (10, GC_RUN_LIST, NULL, 0);
+  make_file (CONFNAME, "option", 100);
+
+  /* A corrupt cache file is ignored.  */
+  fill_cache (11);
+  make_file (CACHENAME, "V:1\nX:foo\n", 100);
+  check_entry (11, GC_RUN_LIST, NULL, 0);
+  make_file (CACHENAME, "V:0\n", 100);
+  check_entry (11, GC_RUN_LIST, NULL, 0);
+
+  gc_cache_set_file (NULL);
+  remove (CACHENAME);
+  remove (PGMNAME);
+  remove (PGM2NAME);
+  remove (CONFNAME);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  test_cache ();
+
+  return !!errcount;
+}